@@ -0,0 +1,920 @@
+/* Author: Ted Cooper
+ * Last revised: 7-2-2009
+ * FRACTAL FLAME RENDERER
+ * See top of engine.c for program description.
+ *
+ * animate.c: renders all the frames of an animation as a stream on a
+ * work-stealing thread pool (pool.c).  every frame goes render -> tone map ->
+ * emit to a frame_sink, and then its histogram is recycled for a later frame,
+ * so memory is bounded by the number of frames in flight instead of the
+ * length of the animation.
+ *
+ * each frame only depends on its own parameters, so it's cut into chunks of
+ * iterations that any worker can run.  at most maxframes frames are in flight
+ * at a time; when one has been emitted, the worker that emitted it starts the
+ * next.  other workers keep rendering later frames while a finished one is
+ * tone mapped and emitted, and once there are fewer frames left than workers,
+ * idle workers steal the remaining chunks of the frames still running.
+ *
+ * a finished frame is tone mapped a band of rows at a time by pool tasks
+ * too, so one frame's tone mapping is spread over every idle worker, and the
+ * last band to finish emits the frame.  with supersampling or density
+ * estimation on (see filter.c), the histogram is filtered in bands first.
+ *
+ * frames can also get an adaptive number of iterations (render_params 
+ * tolerance and deadline).  then a frame's chunks are queued a batch at a 
+ * time instead of all at once; the last chunk of a batch tone maps the 
+ * histogram so far and compares it with the image after the batch before,
+ * and the frame is finished early once a batch hardly changes it.  chunks of
+ * a frame that's out of time are skipped, and no more batches are queued.
+ * the same images can go to a progress sink as they're made, so a viewer can
+ * show frames being refined instead of waiting for them.
+ *
+ * with a checkpoint prefix, each frame's histogram is saved (checkpoint.c)
+ * every so often while it renders, and once more when its iterations are
+ * done, along with which of its chunks it holds.  saving copies the
+ * histogram to a spare one under the frame's lock, which takes a few
+ * milliseconds, and writes the copy out while the frame's chunks carry on.
+ * only one checkpoint is written at a time; a frame that comes due while
+ * another's is being written waits for its next chunk.  frames started with
+ * resume on load their checkpoints first, and skip the chunks they hold.
+ *
+ * nothing in here is global, so several animations (of different flames, or
+ * the same one) can be rendered at once by separate calls to render_frames()
+ * on one shared pool.
+ */
+
+//INCLUDES
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <limits.h>
+#include <pthread.h>
+#include "global.h"
+#include "counters.h"
+#include "histogram.h"
+#include "render.h"
+#include "batch.h"
+#include "rng.h"
+#include "tonemap.h"
+#include "filter.h"
+#include "pool.h"
+#include "output.h"
+#include "checkpoint.h"
+#include "animate.h"
+
+//TYPES
+
+struct animation;
+
+//one frame's progress
+typedef struct {
+  int t;
+  int nchunks;
+  int next_chunk;        //chunks queued so far
+  int chunks_left;       //of the batch in flight.  protected by lock
+  int bands_left;        //of the stage it's in.  protected by lock
+  pthread_mutex_t lock;  //also serializes merges into h
+  histogram * h;         //a slot, from the time the frame starts until it's
+                         //been emitted
+  de_pixel * px;         //and its filtered pixels, if it's filtered
+  color_t * rgb;         //and its image
+  plotcount_t max;       //largest count in h so far.  protected by lock
+  float pxmax;           //largest count in px so far.  protected by lock
+  long long niterations; //walked so far.  protected by lock
+  double start;          //when the frame started, see now_seconds()
+  color_t * check[2];    //if adaptive, the frame's image as of the last
+                         //two batches, newest first
+  int nchecks;           //batches it's been checked after
+  float residual;        //see frame_stats
+  unsigned char * done;  //nchunks flags: chunk i is in h, if checkpointing.
+                         //protected by lock
+  double last_checkpoint; //see now_seconds().  protected by lock
+  struct animation * anim;
+} frame_job;
+
+//a task: some of one frame's iterations
+typedef struct {
+  frame_job * job;
+  int chunk;
+  int niterations;
+} chunk_task;
+
+//a task: filtering or tone mapping output rows [y0,y1) of one frame
+typedef struct {
+  frame_job * job;
+  int y0, y1;
+} band_task;
+
+typedef struct animation {
+  render_params * rp;
+  walk_fn walk;
+  thread_pool * pool;
+  frame_job * jobs;
+  chunk_task ** chunks;  //chunks[t] are frame t's tasks
+  histogram ** scratch;  //one private histogram per worker
+  tone_map * tm;
+  de_filter * filter;    //NULL if histograms are tone mapped as they are
+  band_task ** bands;    //bands[t] are frame t's filtering and tone mapping
+                         //tasks
+  int nbands;
+  de_scratch ** de_scratch; //one per worker, if filtering
+  frame_counters * counters; //one per worker, if frames are counted.  a
+                             //chunk's are added to its frame's in 
+                             //rp->counters under the frame's lock.
+
+  pthread_mutex_t lock;  //protects next_frame, the free slots and
+                         //frames_left
+  pthread_cond_t finished; //signaled when frames_left gets to 0
+  int next_frame;
+  int frames_left;       //frames not emitted yet
+  histogram ** slots;    //frame histograms not in use by a frame in flight
+  de_pixel ** pxslots;   //and their filtered pixels, if filtering
+  color_t ** rgbslots;   //and their images
+  color_t ** checkslots; //and two convergence check images each, if
+                         //adaptive
+  int nslots;
+  int batch;             //chunks queued at a time, 0 for all of them
+  int failed;
+
+  pthread_mutex_t emit_lock; //keeps the sink from being called concurrently
+
+  pthread_mutex_t checkpoint_lock; //one checkpoint is read or written at a
+                                   //time.  protects the rest of these.
+  histogram * snapshot;  //a frame's h as it's being written, if frames are
+                         //checkpointed while they render
+  unsigned char * snapdone; //and its chunk flags
+  double * params;       //CHECKPOINT_MAX_PARAMS, see flame_params()
+} animation;
+
+//FUNCTIONS
+
+//private
+
+static void run_chunk(void * arg, int worker);
+static void run_filter_band(void * arg, int worker);
+static void run_tone_band(void * arg, int worker);
+
+//function: now_seconds
+//purpose: a clock for deadlines, in seconds from some fixed point
+static double now_seconds(){
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec/1e9;
+}
+
+//function: count_seconds
+//purpose: add the time since start to one of a frame's stages, if frames
+//         are counted.  callers hold the frame's lock if anything else could
+//         be counting into the frame.
+static void count_seconds(frame_job * job, int stage, double start){
+  render_params * rp = job->anim->rp;
+
+  if(rp->counters != NULL)
+    rp->counters[job->t].seconds[stage] += now_seconds() - start;
+}
+
+//function: queue_batch
+//purpose: queue a frame's next batch of chunks on the pool.  callers make
+//         sure there is one.
+static void queue_batch(frame_job * job, int worker){
+  animation * anim = job->anim;
+  int i, first, n;
+
+  first = job->next_chunk;
+  n = job->nchunks - first;
+  if(anim->batch > 0 && n > anim->batch)
+    n = anim->batch;
+  //nothing else touches the frame until its chunks are queued
+  job->next_chunk += n;
+  job->chunks_left = n;
+  //backwards, so a worker popping its own deque does them in order
+  for(i=first+n-1; i>=first; i--){
+    pool_submit(anim->pool, worker, run_chunk, &anim->chunks[job->t][i]);
+  }
+}
+
+//function: describe_frame
+//purpose: fill in what a checkpoint of a frame says about it, and its path.
+//         callers hold the checkpoint lock.
+//params: done - the chunk flags to go with it
+//        path - MAXPATH long
+//returns TRUE on success, FALSE if the frame can't be checkpointed
+static int describe_frame(frame_job * job, unsigned char * done,
+                          long long niterations, checkpoint_info * info,
+                          char * path){
+  animation * anim = job->anim;
+  render_params * rp = anim->rp;
+
+  info->frame = job->t;
+  info->seed = rp->seed;
+  info->niterations = niterations;
+  info->chunk_iterations = anim->chunks[job->t][0].niterations;
+  info->nchunks = job->nchunks;
+  info->done = done;
+  info->params = anim->params;
+  info->nparams = flame_params(rp->fl, job->t, rp->cv, anim->params,
+                               CHECKPOINT_MAX_PARAMS);
+  if(info->nparams < 0){
+    fprintf(stderr,"describe_frame: too many flame parameters to "
+            "checkpoint. returning...\n");
+    return 0;
+  }
+  if(snprintf(path, MAXPATH, "%s%05d.hist", rp->checkpoint_prefix,
+              job->t) >= MAXPATH){
+    fprintf(stderr,"describe_frame: checkpoint path too long. "
+            "returning...\n");
+    return 0;
+  }
+  return 1;
+}
+
+//function: resume_frame
+//purpose: load a frame's checkpoint into its histogram, if it has one that
+//         matches.  the frame's chunks haven't been queued yet.
+static void resume_frame(frame_job * job){
+  animation * anim = job->anim;
+  checkpoint_info info;
+  checkpoint * c;
+  char path[MAXPATH];
+  double start = now_seconds();
+
+  pthread_mutex_lock(&anim->checkpoint_lock);
+  if(describe_frame(job, job->done, 0, &info, path) &&
+     (c = open_checkpoint(path)) != NULL){
+    if(checkpoint_matches(c, job->h, &info)){
+      load_checkpoint(c, job->h, &info, &job->max);
+      job->niterations = info.niterations;
+    }
+    close_checkpoint(c);
+  }
+  pthread_mutex_unlock(&anim->checkpoint_lock);
+  //the frame's chunks aren't queued yet, so this has it to itself
+  count_seconds(job, STAGE_CHECKPOINT, start);
+}
+
+//function: save_frame
+//purpose: write a frame's checkpoint, from h, which is the frame's or a
+//         copy of it.  callers hold the checkpoint lock, and nothing's
+//         merged into h until this returns.
+static void save_frame(frame_job * job, histogram * h, unsigned char * done,
+                       long long niterations){
+  checkpoint_info info;
+  char path[MAXPATH];
+
+  //a frame that can't be saved still renders
+  if(describe_frame(job, done, niterations, &info, path) &&
+     !write_checkpoint(path, h, &info))
+    fprintf(stderr,"render_frames: couldn't checkpoint frame %d\n", job->t);
+}
+
+//function: checkpoint_frame
+//purpose: save a frame that's still rendering: copy its histogram under its
+//         lock and write the copy out while its chunks carry on.  does
+//         nothing if another checkpoint is being written.
+static void checkpoint_frame(frame_job * job){
+  animation * anim = job->anim;
+  long long niterations;
+  double start = now_seconds();
+
+  if(pthread_mutex_trylock(&anim->checkpoint_lock) != 0)
+    return;
+  pthread_mutex_lock(&job->lock);
+  copy_histogram(anim->snapshot, job->h);
+  memcpy(anim->snapdone, job->done, job->nchunks);
+  niterations = job->niterations;
+  job->last_checkpoint = now_seconds();
+  pthread_mutex_unlock(&job->lock);
+
+  save_frame(job, anim->snapshot, anim->snapdone, niterations);
+  pthread_mutex_unlock(&anim->checkpoint_lock);
+
+  pthread_mutex_lock(&job->lock);
+  count_seconds(job, STAGE_CHECKPOINT, start);
+  pthread_mutex_unlock(&job->lock);
+}
+
+//function: start_next_frame
+//purpose: give the next frame that hasn't been started a slot and queue all of
+//         its chunks, if there is such a frame.  callers make sure a slot is
+//         free first.
+//params: worker - pool thread to queue the chunks on, or -1 from outside.
+//returns TRUE if a frame was started, FALSE if they've all been started
+static int start_next_frame(animation * anim, int worker){
+  int t;
+
+  pthread_mutex_lock(&anim->lock);
+  t = anim->next_frame;
+  if(t < anim->rp->nframes){
+    anim->next_frame++;
+    anim->nslots--;
+    anim->jobs[t].h = anim->slots[anim->nslots];
+    anim->jobs[t].px = anim->pxslots[anim->nslots];
+    anim->jobs[t].rgb = anim->rgbslots[anim->nslots];
+    anim->jobs[t].check[0] = anim->checkslots[2*anim->nslots];
+    anim->jobs[t].check[1] = anim->checkslots[2*anim->nslots+1];
+    anim->jobs[t].max = 0;
+    anim->jobs[t].pxmax = 0.0;
+    anim->jobs[t].next_chunk = 0;
+    anim->jobs[t].niterations = 0;
+    anim->jobs[t].nchecks = 0;
+    anim->jobs[t].residual = -1.0;
+    anim->jobs[t].start = now_seconds();
+    anim->jobs[t].last_checkpoint = anim->jobs[t].start;
+  }
+  pthread_mutex_unlock(&anim->lock);
+
+  if(t >= anim->rp->nframes)
+    return 0;
+
+  if(anim->jobs[t].done != NULL){
+    memset(anim->jobs[t].done, 0, anim->jobs[t].nchunks);
+    if(anim->rp->resume)
+      resume_frame(&anim->jobs[t]);
+  }
+  queue_batch(&anim->jobs[t], worker);
+  return 1;
+}
+
+//function: emit_frame
+//purpose: hand a tone mapped frame to the sink, and recycle its slot for the
+//         next frame.
+static void emit_frame(frame_job * job, int worker){
+  animation * anim = job->anim;
+  render_params * rp = anim->rp;
+  double start;
+
+  pthread_mutex_lock(&anim->emit_lock);
+  start = now_seconds();
+  if(!rp->sink(job->t, job->rgb, rp->cv->width,
+               rp->cv->height, rp->sink_arg)){
+    fprintf(stderr,"render_frames: sink failed on frame %d\n", job->t);
+    anim->failed = 1;
+  }
+  count_seconds(job, STAGE_OUTPUT, start);
+  pthread_mutex_unlock(&anim->emit_lock);
+
+  clear_histogram(job->h);
+
+  pthread_mutex_lock(&anim->lock);
+  anim->slots[anim->nslots] = job->h;
+  anim->pxslots[anim->nslots] = job->px;
+  anim->rgbslots[anim->nslots] = job->rgb;
+  anim->checkslots[2*anim->nslots] = job->check[0];
+  anim->checkslots[2*anim->nslots+1] = job->check[1];
+  anim->nslots++;
+  pthread_mutex_unlock(&anim->lock);
+  job->h = NULL;
+  job->px = NULL;
+  job->rgb = NULL;
+  job->check[0] = job->check[1] = NULL;
+
+  start_next_frame(anim, worker);
+
+  //last thing this touches: render_frames() can return as soon as it sees
+  //the count hit 0
+  pthread_mutex_lock(&anim->lock);
+  if(--anim->frames_left == 0)
+    pthread_cond_signal(&anim->finished);
+  pthread_mutex_unlock(&anim->lock);
+}
+
+//function: start_bands
+//purpose: queue one of a frame's band stages, fn, on the pool
+static void start_bands(frame_job * job, int worker, task_fn fn){
+  animation * anim = job->anim;
+  int i;
+
+  //nothing else touches the frame until its bands are queued
+  job->bands_left = anim->nbands;
+  for(i=anim->nbands-1; i>=0; i--){
+    pool_submit(anim->pool, worker, fn, &anim->bands[job->t][i]);
+  }
+}
+
+//function: finish_frame
+//purpose: a frame's iterations are all done: filter it if it's filtered,
+//         and tone map it.
+static void finish_frame(frame_job * job, int worker){
+  start_bands(job, worker, (job->anim->filter != NULL ? run_filter_band :
+                            run_tone_band));
+}
+
+//function: converged
+//purpose: tone map a frame's histogram as it is after a batch, and say 
+//         whether that's within the tolerance of how it was after the batch
+//         before.  the comparison is of the unfiltered histogram, at its
+//         own size: it's the plots that converge, not the filter.
+//returns TRUE if it has converged, FALSE if it hasn't or it's the first
+//        batch
+static int converged(frame_job * job){
+  animation * anim = job->anim;
+  color_t * c;
+  double sum = 0.0, d;
+  int i, n;
+
+  c = job->check[1];
+  job->check[1] = job->check[0];
+  job->check[0] = c;
+  //every chunk of the batch is merged, so max is final for this batch
+  tone_map_rows(anim->tm, job->h, job->max, job->check[0], 0,
+                get_height(job->h));
+  if(++job->nchecks < 2)
+    return 0;
+
+  n = 3*get_npixels(job->h);
+  for(i=0; i<n; i++){
+    d = job->check[0][i] - job->check[1][i];
+    sum += d*d;
+  }
+  job->residual = sqrt(sum/n);
+  return job->residual < anim->rp->tolerance;
+}
+
+//function: show_progress
+//purpose: hand the image converged() just made to the progress sink, at 
+//         the image's size (its ss x ss blocks of pixels averaged)
+static void show_progress(frame_job * job){
+  animation * anim = job->anim;
+  render_params * rp = anim->rp;
+  int ss = get_width(job->h) / rp->cv->width;
+  int W = get_width(job->h);
+  int x, y, i, j, c;
+  color_t * src, * dst;
+  float sum;
+
+  //the frame's own image isn't made until its last batch, so it's free to
+  //use for this until then
+  if(ss > 1){
+    for(y=0; y<rp->cv->height; y++){
+      for(x=0; x<rp->cv->width; x++){
+        dst = &job->rgb[3*(y*rp->cv->width + x)];
+        for(c=0; c<3; c++){
+          sum = 0.0;
+          for(j=0; j<ss; j++){
+            src = &job->check[0][3*((y*ss + j)*W + x*ss) + c];
+            for(i=0; i<ss; i++){
+              sum += src[3*i];
+            }
+          }
+          dst[c] = sum/(ss*ss);
+        }
+      }
+    }
+  }
+
+  pthread_mutex_lock(&anim->emit_lock);
+  rp->progress(job->t, (ss > 1 ? job->rgb : job->check[0]), rp->cv->width,
+               rp->cv->height, rp->progress_arg);
+  pthread_mutex_unlock(&anim->emit_lock);
+}
+
+//function: end_batch
+//purpose: a batch of a frame's chunks is done: queue the next one, or if
+//         the frame is done (out of chunks or time, or converged), finish it.
+static void end_batch(frame_job * job, int worker){
+  animation * anim = job->anim;
+  render_params * rp = anim->rp;
+  frame_stats * st;
+  double elapsed = now_seconds() - job->start, start;
+
+  if(job->next_chunk < job->nchunks &&
+     (rp->deadline <= 0.0 || elapsed < rp->deadline) &&
+     !(anim->batch > 0 && converged(job))){
+    //before the next batch is queued: it could finish, and make the next
+    //image, before this one has been shown
+    if(rp->progress != NULL)
+      show_progress(job);
+    queue_batch(job, worker);
+    return;
+  }
+
+  if(rp->stats != NULL){
+    st = &rp->stats[job->t];
+    st->niterations = job->niterations;
+    st->residual = job->residual;
+    st->seconds = elapsed;
+  }
+  //every chunk that ran is merged, and nothing else will be
+  if(job->done != NULL){
+    start = now_seconds();
+    pthread_mutex_lock(&anim->checkpoint_lock);
+    save_frame(job, job->h, job->done, job->niterations);
+    pthread_mutex_unlock(&anim->checkpoint_lock);
+    count_seconds(job, STAGE_CHECKPOINT, start);
+  }
+  finish_frame(job, worker);
+}
+
+//function: run_filter_band
+//purpose: pool task.  filter some of a frame's rows, and tone map the frame
+//         if this was its last band.
+static void run_filter_band(void * arg, int worker){
+  band_task * bt = (band_task *)arg;
+  frame_job * job = bt->job;
+  animation * anim = job->anim;
+  float max = 0.0;
+  int done;
+  double start = now_seconds();
+
+  filter_band(anim->filter, job->h, job->px, anim->rp->cv->width, bt->y0,
+              bt->y1, anim->de_scratch[worker], &max);
+
+  pthread_mutex_lock(&job->lock);
+  count_seconds(job, STAGE_FILTER, start);
+  if(max > job->pxmax)
+    job->pxmax = max;
+  done = (--job->bands_left == 0);
+  pthread_mutex_unlock(&job->lock);
+
+  if(done)
+    start_bands(job, worker, run_tone_band);
+}
+
+//function: run_tone_band
+//purpose: pool task.  tone map some of a frame's rows, and emit the frame if
+//         this was its last band.
+static void run_tone_band(void * arg, int worker){
+  band_task * bt = (band_task *)arg;
+  frame_job * job = bt->job;
+  animation * anim = job->anim;
+  int done;
+  double start = now_seconds();
+
+  //max and pxmax are final once a band of this stage is running
+  if(anim->filter != NULL)
+    tone_map_filtered_rows(anim->tm, job->px, anim->rp->cv->width,
+                           job->pxmax, job->rgb, bt->y0, bt->y1);
+  else
+    tone_map_rows(anim->tm, job->h, job->max, job->rgb, bt->y0, bt->y1);
+
+  pthread_mutex_lock(&job->lock);
+  count_seconds(job, STAGE_TONE_MAP, start);
+  done = (--job->bands_left == 0);
+  pthread_mutex_unlock(&job->lock);
+
+  if(done)
+    emit_frame(job, worker);
+}
+
+//function: run_chunk
+//purpose: pool task.  walk this chunk's iterations into the worker's scratch
+//         histogram and fold that into the frame, unless the frame is out of
+//         time or already has them from its checkpoint, and end the batch if
+//         this was its last chunk.
+static void run_chunk(void * arg, int worker){
+  chunk_task * ct = (chunk_task *)arg;
+  frame_job * job = ct->job;
+  animation * anim = job->anim;
+  histogram * h = anim->scratch[worker];
+  frame_counters * fc = (anim->counters != NULL ? &anim->counters[worker] :
+                         NULL);
+  rng_state rng;
+  int done, due = 0;
+  double start = 0.0, walked = 0.0;
+
+  //a stream for every chunk of every frame, or chunks would repeat each
+  //other's walks.  it depends only on which chunk this is, not on which
+  //worker happens to run it, and histogram sums don't depend on merge order,
+  //so the same seed always renders the same frames.
+  rng_seed(&rng, anim->rp->seed, ((uint64_t)job->t << 32) | ct->chunk);
+
+  //the flags of chunks that haven't run only change before they're queued
+  if((job->done == NULL || !job->done[ct->chunk]) &&
+     (anim->rp->deadline <= 0.0 ||
+      now_seconds() - job->start < anim->rp->deadline)){
+    if(fc != NULL)
+      start = now_seconds();
+    anim->walk(anim->rp->fl, job->t, ct->niterations, anim->rp->miniterations,
+               h, &rng, fc);
+    flush_histogram(h);
+    if(fc != NULL)
+      walked = now_seconds();
+
+    pthread_mutex_lock(&job->lock);
+    merge_histograms(job->h, &h, 1, 0, get_nbuckets(h), &job->max);
+    job->niterations += ct->niterations;
+    //the worker's counters only ever have this chunk in them
+    if(fc != NULL){
+      fc->seconds[STAGE_WALK] = walked - start;
+      fc->seconds[STAGE_MERGE] = now_seconds() - walked;
+      add_counters(&anim->rp->counters[job->t], fc);
+      clear_counters(fc);
+    }
+    if(job->done != NULL){
+      job->done[ct->chunk] = 1;
+      due = (anim->rp->checkpoint_interval > 0.0 &&
+             now_seconds() - job->last_checkpoint >=
+             anim->rp->checkpoint_interval);
+    }
+    pthread_mutex_unlock(&job->lock);
+
+    //before the chunk is counted: once the last one is, render_frames() may
+    //return and free the scratch histograms and the snapshot
+    clear_histogram(h);
+    if(due)
+      checkpoint_frame(job);
+  }
+
+  pthread_mutex_lock(&job->lock);
+  done = (--job->chunks_left == 0);
+  pthread_mutex_unlock(&job->lock);
+
+  if(done)
+    end_batch(job, worker);
+}
+
+//public
+
+//function: render_frames
+//purpose: render frames [0, rp->nframes) of rp->fl's animation and hand each
+//         one to rp->sink once it's tone mapped.  the flame and histograms
+//         need to be initialized first.  safe to call from several threads
+//         at once, with or without a shared pool.
+//params: rp - see render_params in animate.h.  niterations and miniterations
+//        mean the same as for render() and apply to every frame (niterations
+//        at most, with a tolerance or deadline).  smaller chunks balance
+//        better, but every chunk pays for miniterations and a merge of a full
+//        histogram.  histograms are supersample times the size of rp->cv each
+//        way.
+//returns TRUE on success, FALSE on failure
+extern int render_frames(render_params * rp){
+  int t, i, n;
+  int nthreads, maxframes, chunk_iterations, defer_points, ss, band_rows;
+  int adaptive;
+  canvas hcv;
+  animation anim;
+
+  nthreads = (rp->nthreads < 1 ? 1 : rp->nthreads);
+  maxframes = (rp->maxframes <= 0 ? nthreads : rp->maxframes);
+  if(maxframes > rp->nframes)
+    maxframes = rp->nframes;
+  chunk_iterations = rp->chunk_iterations;
+  if(chunk_iterations <= 0 || chunk_iterations > rp->niterations)
+    chunk_iterations = rp->niterations;
+  if(chunk_iterations <= rp->miniterations){
+    fprintf(stderr,"render_frames: Rendering won't work unless chunks > %d. "
+            "returning...\n", rp->miniterations);
+    return 0;
+  }
+  if(rp->pool != NULL)
+    nthreads = rp->pool->nworkers;
+  //rendered and checked a batch at a time
+  adaptive = (rp->tolerance > 0.0 || rp->deadline > 0.0 || 
+              rp->progress != NULL);
+  //frames are plotted at ss times the image's size each way, the same part
+  //of the plane
+  ss = (rp->supersample < 1 ? 1 : rp->supersample);
+  if((long long)rp->cv->width * ss > INT_MAX ||
+     (long long)rp->cv->height * ss > INT_MAX){
+    fprintf(stderr,"render_frames: supersample %d makes a %lldx%lld "
+            "histogram. returning...\n", ss, (long long)rp->cv->width * ss,
+            (long long)rp->cv->height * ss);
+    return 0;
+  }
+  if(!init_canvas(&hcv, rp->cv->width * ss, rp->cv->height * ss,
+                  rp->cv->minX, rp->cv->minY, rp->cv->rangeX, 
+                  rp->cv->rangeY)){
+    fprintf(stderr,"render_frames: bad supersample %d. returning...\n", ss);
+    return 0;
+  }
+  //binning plots only pays once the histogram is well past the size of the
+  //cache
+  defer_points = rp->defer_points;
+  if(defer_points == DEFER_AUTO)
+    defer_points = ((long long)hcv.width * hcv.height > 1920*1080 ?
+                    DEFER_POINTS : 0);
+  if(rp->sink == NULL){
+    fprintf(stderr,"render_frames: no frame sink. returning...\n");
+    return 0;
+  }
+  anim.filter = NULL;
+  if(ss > 1 || rp->estimator_radius > 0.0){
+    anim.filter = new_de_filter(rp->estimator_radius, rp->estimator_minimum,
+                                rp->estimator_curve, ss);
+    if(anim.filter == NULL){
+      fprintf(stderr,"render_frames: new_de_filter failed. returning...\n");
+      return 0;
+    }
+  }
+  anim.tm = new_tone_map(rp->gamma, rp->vibrancy);
+  if(anim.tm == NULL){
+    fprintf(stderr,"render_frames: new_tone_map failed. returning...\n");
+    free_de_filter(anim.filter);
+    return 0;
+  }
+  //a few bands per thread, in whole tiles of the filter's
+  band_rows = (rp->cv->height + 4*nthreads - 1)/(4*nthreads);
+  band_rows = (band_rows + DE_TILE_HEIGHT - 1)/DE_TILE_HEIGHT*DE_TILE_HEIGHT;
+  anim.nbands = (rp->cv->height + band_rows - 1)/band_rows;
+
+  anim.rp = rp;
+  anim.walk = (rp->walk != NULL ? rp->walk : &walk_batch);
+  anim.next_frame = 0;
+  anim.frames_left = rp->nframes;
+  anim.failed = 0;
+  pthread_mutex_init(&anim.lock, NULL);
+  pthread_cond_init(&anim.finished, NULL);
+  pthread_mutex_init(&anim.emit_lock, NULL);
+  pthread_mutex_init(&anim.checkpoint_lock, NULL);
+
+  anim.jobs = calloc(rp->nframes, sizeof(frame_job));
+  anim.chunks = calloc(rp->nframes, sizeof(chunk_task *));
+  anim.scratch = calloc(nthreads, sizeof(histogram *));
+  anim.slots = calloc(maxframes, sizeof(histogram *));
+  anim.pxslots = calloc(maxframes, sizeof(de_pixel *));
+  anim.rgbslots = calloc(maxframes, sizeof(color_t *));
+  anim.checkslots = calloc(2*maxframes, sizeof(color_t *));
+  anim.bands = calloc(rp->nframes, sizeof(band_task *));
+  anim.de_scratch = calloc(nthreads, sizeof(de_scratch *));
+  anim.snapshot = NULL;
+  anim.snapdone = NULL;
+  anim.params = NULL;
+  anim.counters = NULL;
+  if(rp->counters != NULL)
+    anim.counters = calloc(nthreads, sizeof(frame_counters));
+  if((rp->counters != NULL && anim.counters == NULL) ||
+     anim.jobs == NULL || anim.chunks == NULL || anim.scratch == NULL ||
+     anim.slots == NULL || anim.pxslots == NULL || anim.rgbslots == NULL ||
+     anim.checkslots == NULL || anim.bands == NULL || 
+     anim.de_scratch == NULL){
+    fprintf(stderr,"render_frames: out of memory. exiting...\n");
+    exit(1);
+  }
+
+  //cut every frame into chunks up front; the last one takes the remainder
+  for(t=0; t<rp->nframes; t++){
+    n = (rp->niterations + chunk_iterations - 1)/chunk_iterations;
+    //don't leave a runt chunk too short to get past miniterations
+    if(n > 1 && rp->niterations - (n-1)*chunk_iterations <= rp->miniterations)
+      n--;
+    anim.jobs[t].t = t;
+    anim.jobs[t].nchunks = n;
+    anim.jobs[t].h = NULL;
+    anim.jobs[t].px = NULL;
+    anim.jobs[t].rgb = NULL;
+    anim.jobs[t].anim = &anim;
+    pthread_mutex_init(&anim.jobs[t].lock, NULL);
+    anim.chunks[t] = calloc(n, sizeof(chunk_task));
+    anim.jobs[t].done = NULL;
+    if(rp->checkpoint_prefix != NULL)
+      anim.jobs[t].done = malloc(n);
+    if(anim.chunks[t] == NULL ||
+       (rp->checkpoint_prefix != NULL && anim.jobs[t].done == NULL)){
+      fprintf(stderr,"render_frames: out of memory. exiting...\n");
+      exit(1);
+    }
+    for(i=0; i<n; i++){
+      anim.chunks[t][i].job = &anim.jobs[t];
+      anim.chunks[t][i].chunk = i;
+      anim.chunks[t][i].niterations = (i == n-1 ?
+                                       rp->niterations - (n-1)*chunk_iterations :
+                                       chunk_iterations);
+    }
+    anim.bands[t] = calloc(anim.nbands, sizeof(band_task));
+    if(anim.bands[t] == NULL){
+      fprintf(stderr,"render_frames: out of memory. exiting...\n");
+      exit(1);
+    }
+    for(i=0; i<anim.nbands; i++){
+      anim.bands[t][i].job = &anim.jobs[t];
+      anim.bands[t][i].y0 = i*band_rows;
+      anim.bands[t][i].y1 = (i == anim.nbands-1 ? rp->cv->height :
+                             (i+1)*band_rows);
+    }
+  }
+
+  //the only histograms there will ever be: one per frame in flight and one
+  //per worker
+  for(i=0; i<nthreads; i++){
+    anim.scratch[i] = new_histogram(&hcv);
+    if(anim.scratch[i] == NULL){
+      fprintf(stderr,"render_frames: new_histogram failed. exiting...\n");
+      exit(1);
+    }
+    //plots straight into the histogram if this fails, which works too
+    defer_histogram(anim.scratch[i], defer_points);
+    if(anim.counters != NULL &&
+       !init_counters(&anim.counters[i], rp->fl->nfunctions)){
+      fprintf(stderr,"render_frames: out of memory. exiting...\n");
+      exit(1);
+    }
+    if(anim.filter != NULL &&
+       (anim.de_scratch[i] = new_de_scratch(anim.filter)) == NULL){
+      fprintf(stderr,"render_frames: new_de_scratch failed. exiting...\n");
+      exit(1);
+    }
+  }
+  for(i=0; i<maxframes; i++){
+    anim.slots[i] = new_histogram(&hcv);
+    anim.rgbslots[i] = malloc(sizeof(color_t) * 3 * rp->cv->width *
+                              rp->cv->height);
+    if(anim.slots[i] == NULL || anim.rgbslots[i] == NULL){
+      fprintf(stderr,"render_frames: new_histogram failed. exiting...\n");
+      exit(1);
+    }
+    if(anim.filter != NULL &&
+       (anim.pxslots[i] = malloc(sizeof(de_pixel) * rp->cv->width * 
+                                 rp->cv->height)) == NULL){
+      fprintf(stderr,"render_frames: out of memory. exiting...\n");
+      exit(1);
+    }
+    if(adaptive &&
+       ((anim.checkslots[2*i] = malloc(sizeof(color_t) * 3 * hcv.width *
+                                       hcv.height)) == NULL ||
+        (anim.checkslots[2*i+1] = malloc(sizeof(color_t) * 3 * hcv.width *
+                                         hcv.height)) == NULL)){
+      fprintf(stderr,"render_frames: out of memory. exiting...\n");
+      exit(1);
+    }
+  }
+  anim.nslots = maxframes;
+  if(rp->checkpoint_prefix != NULL){
+    anim.params = malloc(sizeof(double) * CHECKPOINT_MAX_PARAMS);
+    if(anim.params == NULL){
+      fprintf(stderr,"render_frames: out of memory. exiting...\n");
+      exit(1);
+    }
+  }
+  //frames written while they render are copied out of the way first
+  if(rp->checkpoint_prefix != NULL && rp->checkpoint_interval > 0.0){
+    anim.snapshot = new_histogram(&hcv);
+    //every frame has the same number of chunks
+    anim.snapdone = malloc(anim.jobs[0].nchunks);
+    if(anim.snapshot == NULL || anim.snapdone == NULL){
+      fprintf(stderr,"render_frames: new_histogram failed. exiting...\n");
+      exit(1);
+    }
+  }
+  //a batch keeps every worker busy.  checking more often than that would
+  //leave them idle while the check is done.  frames with just a deadline
+  //are checked too, so there's a residual to report.
+  anim.batch = (adaptive ? nthreads : 0);
+
+  anim.pool = (rp->pool != NULL ? rp->pool : pool_create(nthreads));
+  if(anim.pool == NULL){
+    fprintf(stderr,"render_frames: pool_create failed. exiting...\n");
+    exit(1);
+  }
+
+  //get the first maxframes frames going.  the rest are started as slots are
+  //recycled.
+  for(i=0; i<maxframes; i++){
+    start_next_frame(&anim, -1);
+  }
+
+  //the pool may be busy with other animations too, so wait for this one's
+  //frames rather than for the pool to go idle
+  pthread_mutex_lock(&anim.lock);
+  while(anim.frames_left > 0){
+    pthread_cond_wait(&anim.finished, &anim.lock);
+  }
+  pthread_mutex_unlock(&anim.lock);
+  if(rp->pool == NULL)
+    pool_destroy(anim.pool);
+
+  for(i=0; i<nthreads; i++){
+    free_histogram(anim.scratch[i]);
+    free_de_scratch(anim.de_scratch[i]);
+    if(anim.counters != NULL)
+      free_counters(&anim.counters[i]);
+  }
+  for(i=0; i<anim.nslots; i++){
+    free_histogram(anim.slots[i]);
+    free(anim.pxslots[i]);
+    free(anim.rgbslots[i]);
+    free(anim.checkslots[2*i]);
+    free(anim.checkslots[2*i+1]);
+  }
+  for(t=0; t<rp->nframes; t++){
+    pthread_mutex_destroy(&anim.jobs[t].lock);
+    free(anim.chunks[t]);
+    free(anim.bands[t]);
+    free(anim.jobs[t].done);
+  }
+  free_histogram(anim.snapshot);
+  free(anim.snapdone);
+  free(anim.params);
+  free_de_filter(anim.filter);
+  free_tone_map(anim.tm);
+  free(anim.de_scratch);
+  free(anim.counters);
+  free(anim.bands);
+  free(anim.pxslots);
+  free(anim.rgbslots);
+  free(anim.checkslots);
+  free(anim.slots);
+  free(anim.scratch);
+  free(anim.chunks);
+  free(anim.jobs);
+  pthread_mutex_destroy(&anim.emit_lock);
+  pthread_mutex_destroy(&anim.checkpoint_lock);
+  pthread_cond_destroy(&anim.finished);
+  pthread_mutex_destroy(&anim.lock);
+
+  return !anim.failed;
+}
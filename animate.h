@@ -0,0 +1,118 @@
+/* Author: Ted Cooper
+ * Last revised: 7-2-2009
+ * FRACTAL FLAME RENDERER
+ * See top of engine.c for program description.
+ *
+ * animate.h: see animate.c for description.
+ */
+
+#ifndef ANIMATE_H
+#define ANIMATE_H
+
+#include <stdint.h>
+#include "global.h"
+#include "counters.h"
+#include "functions.h"
+#include "histogram.h"
+#include "render.h"
+#include "pool.h"
+
+//render_params.defer_points: defer plots on images bigger than 1920x1080
+#define DEFER_AUTO -1
+//points deferred per worker when it's automatic
+#define DEFER_POINTS 65536
+
+//DATA TYPES
+
+//where finished frames go.  called once per frame, in whatever order frames
+//finish, never concurrently with itself.  rgb is width*height tone-mapped RGB
+//pixels and is only valid during the call.  returns TRUE on success.
+typedef int (*frame_sink)(int t, color_t * rgb, int width, int height,
+                          void * arg);
+
+//how a frame's rendering went, see render_params.stats
+typedef struct {
+  long long niterations; //iterations actually walked
+  float residual;        //RMS change per channel, [0,1], of the frame's
+                         //image over its last batch of chunks: about how
+                         //far it still is from converged.  -1 if it was 
+                         //never measured.
+  double seconds;        //from the frame starting to its last chunk
+} frame_stats;
+
+//everything render_frames() needs to know about an animation
+typedef struct {
+  //what to render
+  flame * fl;           //only read, so other animations can share it
+  canvas * cv;          //image size and the part of the plane it shows
+  int nframes;
+  int niterations;
+  int miniterations;
+  uint64_t seed;        //same seed, same frames, whatever the thread count
+
+  //filtering (see filter.c) and tone mapping
+  int supersample;         //histogram pixels per image pixel each way, so
+                           //supersample^2 are summed into one.  0 or 1
+                           //for none.
+  float estimator_radius;  //density estimation kernel radius, in image
+                           //pixels, for a pixel plotted once.  0 for no
+                           //density estimation.
+  float estimator_minimum; //smallest radius any pixel gets
+  float estimator_curve;   //how fast radii shrink as counts grow
+  float gamma;
+  float vibrancy;
+
+  //scheduling
+  int nthreads;
+  thread_pool * pool;   //pool to render on, shared with whatever else is 
+                        //using it, or NULL for one of nthreads threads just
+                        //for this call.  nthreads has to match its size.
+  int maxframes;        //frames in flight (rendering, tone mapping or being
+                        //emitted) at once.  bounds histogram memory.  0 means
+                        //one per thread.
+  int chunk_iterations; //iterations per unit of work
+  walk_fn walk;         //walk() or walk_batch().  NULL means walk_batch().
+  int defer_points;     //plots each worker buffers and bins before adding
+                        //them to its histogram (see histogram.c), 0 to add
+                        //them as they come, or DEFER_AUTO
+
+  //adaptive sample budget.  with either of these on, frames are rendered a
+  //batch of chunks (one per thread) at a time, and niterations is the most
+  //a frame gets rather than what it gets.
+  float tolerance;      //stop once a batch changes the frame's image by less
+                        //than this (RMS per channel, [0,1]).  0 to always 
+                        //finish the frame.
+  double deadline;      //seconds a frame gets from when it starts; chunks
+                        //that start after that are skipped.  0 for none.
+  frame_stats * stats;  //nframes of them to fill in, or NULL.  each frame's
+                        //is filled in before it goes to the sink.
+  frame_counters * counters; //nframes of them, init_counters()'d for fl, to
+                             //add each frame's to (see counters.c), or 
+                             //NULL.  a frame's are complete once it's been
+                             //through the sink.
+
+  //checkpoints (see checkpoint.c)
+  const char * checkpoint_prefix; //frame t's is <prefix>NNNNN.hist, or NULL
+                                  //for none
+  double checkpoint_interval; //seconds between a frame's checkpoints while
+                              //it renders, or 0.  a frame's last one is
+                              //written when its iterations are done.
+  int resume;                 //start frames from their checkpoints, where
+                              //they have ones that match
+
+  //output
+  frame_sink sink;
+  void * sink_arg;
+  frame_sink progress;  //if not NULL, gets every frame's image so far after
+                        //each of its batches of chunks but the last (so
+                        //frames are rendered in batches, as with a
+                        //tolerance).  unfiltered, and never called 
+                        //concurrently with itself or sink.
+  void * progress_arg;
+} render_params;
+
+//public
+
+extern int render_frames(render_params * rp);
+
+#endif
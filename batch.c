@@ -0,0 +1,251 @@
+/* Author: Ted Cooper
+ * Last revised: 7-2-2009
+ * FRACTAL FLAME RENDERER
+ * See top of engine.c for program description.
+ *
+ * batch.c: the random walk of render.c, NWALKERS independent walkers at a
+ * time.  walk() pushes one point through function pointers for the affine
+ * transforms and every variation; here the walkers' state is kept as
+ * separate x[], y[] and c[] arrays and every stage of an iteration is a loop
+ * over all of them, which the compiler can turn into SSE/AVX lanes (makefile
+ * SIMD=...).  per-function parameters are looked up by index into the
+ * arrays of a flame_plan (kernel.c), so the affine part is a gather and a
+ * few multiply-adds instead of a call, and each variation is one call to its
+ * batched form in variations.c for all of them.
+ *
+ * each walker follows exactly the same math as walk(), quirks included, but
+ * they draw their random numbers in a different order, so the points are a
+ * different (equally good) sample of the same attractor.  long double
+ * coordinates can't be vectorized; build with PRECISION=-DPRECISION_DOUBLE
+ * or -DPRECISION_FLOAT (and MVEC=1) to get the full benefit.
+ */
+
+//INCLUDES
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "functions.h"
+#include "variations.h"
+#include "global.h"
+#include "histogram.h"
+#include "render.h"
+#include "rng.h"
+#include "kernel.h"
+#include "batch.h"
+
+//GLOBALS
+
+//range initial points are drawn from, same as render.c
+#define MINV -1.0
+#define RANGE 2.0
+
+//TYPES
+
+//the walkers.  x and y are the walkers' positions, as in walk(); px/py are
+//where they're plotted after a final transformation.  x0/y0 and sx/sy are 
+//scratch for one iteration.
+typedef struct {
+  coord_t x[NWALKERS], y[NWALKERS];
+  coord_t px[NWALKERS], py[NWALKERS];
+  coord_t x0[NWALKERS], y0[NWALKERS];
+  coord_t sx[NWALKERS], sy[NWALKERS];
+  coord_t tx[NWALKERS], ty[NWALKERS];
+  float c[NWALKERS];  //color index
+  float cf[NWALKERS]; //color index to plot
+  float u[NWALKERS];  //selection draws
+  int fi[NWALKERS];   //selected function
+} walkers;
+
+//FUNCTIONS
+
+//private
+
+//function: advance
+//purpose: one iteration of walk()'s main loop for every walker, up to but not
+//         including the plot.  the functions picked are counted in selected
+//         unless it's NULL.
+static void advance(flame_plan * bp, walkers * w, rng_state * rng,
+                    long long * selected){
+  int i, j, k, n;
+  int * fi = w->fi;
+  float x;
+  coord_t X, wt;
+  coords p;
+  float cfinal;
+  alias_table * at = bp->selector;
+
+  //pick every walker's function, as in run_function()
+  rng_fill_uniform(rng, w->u, NWALKERS);
+  n = at->n;
+  for(k=0; k<NWALKERS; k++){
+    x = w->u[k]*n;
+    i = (int)x;
+    if(i >= n)
+      i = n - 1;
+    fi[k] = (x - i >= at->cutoff[i] ? at->alias[i] : i);
+  }
+  if(selected != NULL){
+    for(k=0; k<NWALKERS; k++){
+      selected[fi[k]]++;
+    }
+  }
+
+  //first linear transformation (see flame_plan for d and g) and the color
+  //average
+#pragma omp simd private(i, X)
+  for(k=0; k<NWALKERS; k++){
+    i = fi[k];
+    X = w->x[k]*bp->a[i] + w->y[k]*bp->b[i] + bp->c[i];
+    w->y0[k] = X*bp->d[i] + w->x[k]*bp->g[i] + w->y[k]*bp->e[i] + bp->f[i];
+    w->x0[k] = X;
+    w->c[k] = (w->c[k] + bp->color[i])/2.0f;
+    w->sx[k] = 0.0;
+    w->sy[k] = 0.0;
+  }
+
+  //weighted sum of the variations
+  for(j=0; j<bp->nactive; j++){
+    run_v_batch(&bp->v[bp->active[j]], w->x0, w->y0, w->tx, w->ty,
+                NWALKERS, bp->fp,
+                (bp->params != NULL ?
+                 &bp->params[bp->active[j]*bp->nfunctions*MAXVPARAMS] : NULL),
+                &bp->weights[bp->active[j]*bp->nfunctions], fi);
+    if(bp->uniform){
+      wt = bp->weights[bp->active[j]*bp->nfunctions];
+#pragma omp simd
+      for(k=0; k<NWALKERS; k++){
+        w->sx[k] += wt*w->tx[k];
+        w->sy[k] += wt*w->ty[k];
+      }
+    }
+    else{
+      //a walker whose function has a zero coefficient skips the variation
+      //entirely, even if it came out inf or nan
+#pragma omp simd private(wt)
+      for(k=0; k<NWALKERS; k++){
+        wt = bp->weights[bp->active[j]*bp->nfunctions + fi[k]];
+        w->sx[k] += (wt != 0.0 ? wt*w->tx[k] : 0.0);
+        w->sy[k] += (wt != 0.0 ? wt*w->ty[k] : 0.0);
+      }
+    }
+  }
+
+  //linear post transformation
+  if(bp->post){
+#pragma omp simd private(i, X)
+    for(k=0; k<NWALKERS; k++){
+      i = fi[k];
+      X = w->sx[k]*bp->pa[i] + w->sy[k]*bp->pb[i] + bp->pc[i];
+      w->y[k] = X*bp->pd[i] + w->sx[k]*bp->pg[i] + w->sy[k]*bp->pe[i] +
+                bp->pf[i];
+      w->x[k] = X;
+    }
+  }
+  else{
+#pragma omp simd
+    for(k=0; k<NWALKERS; k++){
+      w->x[k] = w->sx[k];
+      w->y[k] = w->sy[k];
+    }
+  }
+
+  //final transformation.  like walk(), only the plotted points get it.
+  if(bp->final){
+    for(k=0; k<NWALKERS; k++){
+      p.x = w->x[k];
+      p.y = w->y[k];
+      run_final(bp->fl, &p, &cfinal);
+      w->px[k] = p.x;
+      w->py[k] = p.y;
+    }
+  }
+  if(bp->cfinal < 0.0){
+#pragma omp simd
+    for(k=0; k<NWALKERS; k++){
+      w->cf[k] = w->c[k];
+    }
+  }
+  else{
+#pragma omp simd
+    for(k=0; k<NWALKERS; k++){
+      w->cf[k] = (w->c[k] + bp->cfinal)/2.0f;
+    }
+  }
+}
+
+//public
+
+//function: walk_batch
+//purpose: walk() with NWALKERS walkers.  every walker is run through
+//         miniterations iterations before anything is plotted, then they
+//         take turns plotting until niterations-miniterations points have
+//         been, the same number walk() plots.
+//params: see walk().  fc counts every walker's iterations, so a few more than
+//        walk()'s: each walker's miniterations, and the last iteration's
+//        walkers that aren't plotted.
+//returns the number of points that fell outside the plotted range
+extern int walk_batch(flame * fl, int t, int niterations, int miniterations,
+                      histogram * h, rng_state * rng, frame_counters * fc){
+  int i, k, n, m, left, outside, nonfinite;
+  long long iterations;
+  long long * selected = (fc != NULL ? fc->selected : NULL);
+  flame_plan bp;
+  walkers * w;
+  coord_t * xs, * ys;
+
+  if(!make_flame_plan(&bp, fl, t))
+    return walk(fl, t, niterations, miniterations, h, rng, fc);
+
+  //a few KB with long double coordinates; keep it off the pool's stacks
+  w = malloc(sizeof(walkers));
+  if(w == NULL){
+    fprintf(stderr,"walk_batch: out of memory. returning...\n");
+    free_flame_plan(&bp);
+    return walk(fl, t, niterations, miniterations, h, rng, fc);
+  }
+
+  //random starting points, as in walk()
+  for(k=0; k<NWALKERS; k++){
+    w->x[k] = (coord_t)(rng_uniform(rng) * RANGE + MINV);
+    w->y[k] = (coord_t)(rng_uniform(rng) * RANGE + MINV);
+    w->c[k] = (float)rng_uniform(rng);
+  }
+
+  for(i=0; i<miniterations; i++){
+    advance(&bp, w, rng, selected);
+  }
+  iterations = (long long)miniterations*NWALKERS;
+
+  //the points to plot
+  xs = (bp.final ? w->px : w->x);
+  ys = (bp.final ? w->py : w->y);
+
+  outside = 0;
+  nonfinite = 0;
+  for(left = niterations - miniterations; left > 0; left -= n){
+    advance(&bp, w, rng, selected);
+    iterations += NWALKERS;
+    //the last iteration may only need some of the walkers' points
+    n = (left < NWALKERS ? left : NWALKERS);
+    m = plot_batch(h, fl->palette, xs, ys, w->cf, n);
+    outside += m;
+    //which of the points outside weren't numbers is only worth finding out
+    //when there were some, and someone's counting
+    if(m > 0 && fc != NULL){
+      for(k=0; k<n; k++){
+        if(!isfinite(xs[k]) || !isfinite(ys[k]))
+          nonfinite++;
+      }
+    }
+  }
+
+  if(fc != NULL){
+    fc->iterations += iterations;
+    fc->outside += outside;
+    fc->nonfinite += nonfinite;
+  }
+  free(w);
+  free_flame_plan(&bp);
+  return outside;
+}
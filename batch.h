@@ -0,0 +1,26 @@
+/* Author: Ted Cooper
+ * Last revised: 7-2-2009
+ * FRACTAL FLAME RENDERER
+ * See top of engine.c for program description.
+ *
+ * batch.h: see batch.c for description.
+ */
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "global.h"
+#include "counters.h"
+#include "histogram.h"
+#include "rng.h"
+
+//walkers advanced together.  a multiple of any vector width we'd compile for.
+#define NWALKERS 64
+
+//public
+
+//drop-in replacement for walk() in render.c
+extern int walk_batch(flame * fl, int t, int niterations, int miniterations,
+                      histogram * h, rng_state * rng, frame_counters * fc);
+
+#endif
@@ -0,0 +1,1055 @@
+/* Author: Ted Cooper
+ * Last revised: 7-2-2009
+ * FRACTAL FLAME RENDERER
+ * See top of engine.c for program description.
+ *
+ * bench.c: microbenchmarks of the render's hot paths, each on its own (make
+ * bench).  every benchmark does its operation over and over for at least
+ * a minimum time, several times, and the fastest time per operation is
+ * kept, which is the steadiest number on a busy machine.  the flame is the
+ * built-in animation's frame 0 and every random number comes from a fixed
+ * seed, so runs of different builds do the same work.
+ *
+ * results are printed as JSON.  with -b baseline.json they're compared with
+ * an earlier run's, and anything more than the threshold slower is flagged,
+ * and the exit status is 1, so a build script can stop a regression in the
+ * inner loop before it's committed.
+ *
+ * -a checks every variation's batched form (run_v_batch()) against its
+ * scalar reference (run_v()) on the same points instead, and prints how far
+ * apart they came out; the exit status is 1 if any point is further than a
+ * few thousand ulps, which the compiler's vector math or fused multiply-adds
+ * shouldn't get near, if either form gives an infinity or nan, or if a
+ * variation's results don't follow the points (all the same, or the points
+ * themselves, or them with x and y swapped).  the variations get nonzero
+ * offsets and parameters away from their defaults, which some do nothing
+ * without.  it checks them with libm and with fast math (see fastmath.h),
+ * each form against the other in the same mode.  -g file
+ * does the same for the variations with parameters in a genome file's
+ * flames (params.flam3 is one), each xform's batched form reading them from
+ * the flame plan against its scalar one reading its own, and fails any xform
+ * that comes out the same as another on every point, since params.flam3's
+ * pairs of xforms differ only in their parameters.
+ *
+ * the variation and walk benchmarks run with libm whatever the build's
+ * default, and again with fast math as variation_fast/..., walk/..._fast.
+ * -d dir reports what fast math does to a picture instead: frame 0 rendered
+ * with libm and with fast math from the same seed, and with libm from
+ * another seed, which is how far apart two renders of the same flame are
+ * anyway.  it prints each pair's pixel differences next to the walks' speed
+ * as JSON, and writes the three images and the fast one's difference from
+ * the first (times BENCH_DIFF_GAIN) to dir as frame_00000.ppm to
+ * frame_00003.ppm.
+ */
+
+//INCLUDES
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include <time.h>
+#include <unistd.h>
+#include "global.h"
+#include "functions.h"
+#include "variations.h"
+#include "histogram.h"
+#include "colorpalette.h"
+#include "render.h"
+#include "kernel.h"
+#include "batch.h"
+#include "rng.h"
+#include "tonemap.h"
+#include "output.h"
+#include "engine.h"
+#include "genome.h"
+
+//GLOBALS
+
+#define BENCH_SEED 1
+#define BENCH_NFRAMES 100   //the flame's animation, as engine.c sets it up
+#define BENCH_MINV -1.0
+#define BENCH_RANGE 2.0
+#define BENCH_NPOINTS 65536 //attractor points the per-point benchmarks cycle
+                            //through.  a power of 2.
+#define BENCH_TRIALS 5
+#define BENCH_MIN_SECONDS 0.2 //per trial
+#define BENCH_THRESHOLD 10.0  //percent slower than the baseline that's a
+                              //regression
+#define BENCH_MAX 256         //benchmarks there can be
+#define BENCH_NAME 64
+#define BENCH_LABEL 32 //a variation's part of one
+#define BENCH_WALK_ITERATIONS 1000000
+#define BENCH_GAMMA 4.0
+#define BENCH_VIBRANCY 0.6
+#define BENCH_ULPS 4096.0 //furthest a batched variation's result can be from
+                          //the scalar one, in coord_t epsilons of its size
+#define BENCH_C 0.35          //-a's offsets in the linear transformation
+#define BENCH_F -0.45
+#define BENCH_PARAM_STEP 0.3  //and how far its parameters are moved from
+                              //the defaults
+#define BENCH_WEIGHT 0.7      //and its coefficient for each variation
+#define BENCH_DEGENERATE 1e-4 //relative distance within which -a takes
+                              //every result to be the point, or each other
+#define BENCH_DIFF_WIDTH 800
+#define BENCH_DIFF_HEIGHT 600
+#define BENCH_DIFF_SEED 2  //-d's second libm render
+#define BENCH_DIFF_GAIN 8.0 //how much -d's difference image is brightened
+
+//TYPES
+
+//one benchmark's result
+typedef struct {
+  char name[BENCH_NAME];
+  double ns_per_op;
+  double baseline;  //ns_per_op in the baseline, or < 0 if it wasn't there
+} bench_result;
+
+//what the benchmarks work on
+typedef struct {
+  flame * fl;
+  coords * points;   //BENCH_NPOINTS points on the attractor
+  float * colors;    //and their color indices
+  float * u;         //BENCH_NPOINTS function selectors
+  coord_t * xs, * ys; //points again, for plot_batch()
+  coord_t * tx, * ty; //run_v_batch()'s results
+  histogram * h;
+  tone_map * tm;
+  plotcount_t max;   //h's largest count
+  color_t * rgb;     //an image the size of h
+  walk_fn walk;
+  int which;         //xform or variation to run
+} bench_state;
+
+//a benchmark: do the operation some number of times
+//returns how many times
+typedef long long (*bench_fn)(bench_state * bs);
+
+static flame fl;
+static int fl_ready = 0;
+static bench_result results[BENCH_MAX];
+static int nresults = 0;
+static const char * filter = NULL;
+static double min_seconds = BENCH_MIN_SECONDS;
+static volatile coord_t sink; //keeps the compiler from dropping results
+
+//FUNCTIONS
+
+//private
+
+static double now_seconds(){
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec/1e9;
+}
+
+//function: run_bench
+//purpose: time fn, unless it's filtered out, and add it to the results
+static void run_bench(const char * name, bench_fn fn, bench_state * bs){
+  double start, elapsed, ns, best = -1.0;
+  long long ops;
+  int trial;
+
+  if(filter != NULL && strstr(name, filter) == NULL)
+    return;
+  if(nresults == BENCH_MAX){
+    fprintf(stderr,"run_bench: too many benchmarks, skipping %s\n", name);
+    return;
+  }
+
+  fn(bs); //warm up caches and branch predictors
+  for(trial=0; trial<BENCH_TRIALS; trial++){
+    ops = 0;
+    start = now_seconds();
+    do{
+      ops += fn(bs);
+      elapsed = now_seconds() - start;
+    }while(elapsed < min_seconds);
+    ns = elapsed*1e9/ops;
+    if(best < 0.0 || ns < best)
+      best = ns;
+  }
+
+  snprintf(results[nresults].name, BENCH_NAME, "%s", name);
+  results[nresults].ns_per_op = best;
+  results[nresults].baseline = -1.0;
+  nresults++;
+  fprintf(stderr,"%-36s %12.3f ns/op\n", name, best);
+}
+
+//function: bench_run_function
+//purpose: pick a function by weight and run it, per point
+static long long bench_run_function(bench_state * bs){
+  coords c;
+  float ci;
+  int i;
+
+  for(i=0; i<BENCH_NPOINTS; i++){
+    c = bs->points[i];
+    run_function(bs->fl, 0, bs->u[i], &c, &ci);
+    sink = c.x;
+  }
+  return BENCH_NPOINTS;
+}
+
+//function: bench_run_final
+//purpose: the final transformation, per point
+static long long bench_run_final(bench_state * bs){
+  coords c;
+  float cf;
+  int i;
+
+  for(i=0; i<BENCH_NPOINTS; i++){
+    c = bs->points[i];
+    run_final(bs->fl, &c, &cf);
+    sink = c.x;
+  }
+  return BENCH_NPOINTS;
+}
+
+//function: bench_run_f
+//purpose: one xform, bs->which, per point.  run_f() is private to
+//         functions.c, so this goes through run_function() with a selector
+//         that always picks that xform, which is a few instructions more.
+static long long bench_run_f(bench_state * bs){
+  flame one = *bs->fl;
+  float cutoff = 2.0; //never take the alias
+  int alias = 0;
+  coords c;
+  float ci;
+  int i;
+
+  one.functions = &bs->fl->functions[bs->which];
+  one.nfunctions = 1;
+  one.selector.cutoff = &cutoff;
+  one.selector.alias = &alias;
+  one.selector.n = 1;
+  for(i=0; i<BENCH_NPOINTS; i++){
+    c = bs->points[i];
+    run_function(&one, 0, bs->u[i], &c, &ci);
+    sink = c.x;
+  }
+  return BENCH_NPOINTS;
+}
+
+//function: bench_variation
+//purpose: one variation, bs->which of the flame's, with the first
+//         function's parameters, per point
+static long long bench_variation(bench_state * bs){
+  V_func * v = &bs->fl->vs.variations[bs->which];
+  F_params * fp = &bs->fl->functions[0].f.fp;
+  coords c;
+  int i;
+
+  for(i=0; i<BENCH_NPOINTS; i++){
+    c = bs->points[i];
+    run_v(v, &c, fp, NULL, 1.0);
+    sink = c.x;
+  }
+  return BENCH_NPOINTS;
+}
+
+//function: bench_variation_batch
+//purpose: bs->which's batched form, NWALKERS points a call like batch.c,
+//         per point
+static long long bench_variation_batch(bench_state * bs){
+  V_func * v = &bs->fl->vs.variations[bs->which];
+  F_params * fp = &bs->fl->functions[0].f.fp;
+  const coord_t w = 1.0;
+  int i;
+
+  for(i=0; i<BENCH_NPOINTS; i+=NWALKERS){
+    run_v_batch(v, &bs->xs[i], &bs->ys[i], &bs->tx[i], &bs->ty[i], NWALKERS,
+                fp, NULL, &w, NULL);
+  }
+  sink = bs->tx[0];
+  return BENCH_NPOINTS;
+}
+
+//function: bench_plot
+//purpose: plot_histogram(), per point
+static long long bench_plot(bench_state * bs){
+  int i;
+
+  for(i=0; i<BENCH_NPOINTS; i++){
+    plot_histogram(bs->h, bs->fl->palette, &bs->points[i], &bs->colors[i]);
+  }
+  return BENCH_NPOINTS;
+}
+
+//function: bench_plot_batch
+//purpose: plot_batch(), per point, RNG_BATCH at a time like batch.c
+static long long bench_plot_batch(bench_state * bs){
+  int i;
+
+  for(i=0; i<BENCH_NPOINTS; i+=RNG_BATCH){
+    plot_batch(bs->h, bs->fl->palette, &bs->xs[i], &bs->ys[i],
+               &bs->colors[i], RNG_BATCH);
+  }
+  return BENCH_NPOINTS;
+}
+
+//function: bench_tone_map
+//purpose: tone_map_rows() of a whole rendered frame, per pixel
+static long long bench_tone_map(bench_state * bs){
+  tone_map_rows(bs->tm, bs->h, bs->max, bs->rgb, 0, get_height(bs->h));
+  return get_npixels(bs->h);
+}
+
+//function: bench_walk
+//purpose: a whole walk, plots and all, per iteration
+static long long bench_walk(bench_state * bs){
+  rng_state rng;
+
+  rng_seed(&rng, BENCH_SEED, 0);
+  bs->walk(bs->fl, 0, BENCH_WALK_ITERATIONS, 20, bs->h, &rng, NULL);
+  flush_histogram(bs->h);
+  return BENCH_WALK_ITERATIONS;
+}
+
+//function: make_points
+//purpose: fill bs with points on the flame's attractor, from a fixed seed
+static void make_points(bench_state * bs){
+  rng_state rng;
+  coords p;
+  float c, ci;
+  int i;
+
+  bs->points = malloc(sizeof(coords) * BENCH_NPOINTS);
+  bs->colors = malloc(sizeof(float) * BENCH_NPOINTS);
+  bs->u = malloc(sizeof(float) * BENCH_NPOINTS);
+  bs->xs = malloc(sizeof(coord_t) * BENCH_NPOINTS);
+  bs->ys = malloc(sizeof(coord_t) * BENCH_NPOINTS);
+  bs->tx = malloc(sizeof(coord_t) * BENCH_NPOINTS);
+  bs->ty = malloc(sizeof(coord_t) * BENCH_NPOINTS);
+  if(bs->points == NULL || bs->colors == NULL || bs->u == NULL ||
+     bs->xs == NULL || bs->ys == NULL || bs->tx == NULL || bs->ty == NULL){
+    fprintf(stderr,"make_points: out of memory. exiting...\n");
+    exit(1);
+  }
+
+  rng_seed(&rng, BENCH_SEED, 0);
+  p.x = rng_uniform(&rng)*2.0 - 1.0;
+  p.y = rng_uniform(&rng)*2.0 - 1.0;
+  c = rng_uniformf(&rng);
+  //get onto the attractor first
+  for(i=0; i<20+BENCH_NPOINTS; i++){
+    run_function(bs->fl, 0, rng_uniformf(&rng), &p, &ci);
+    c = (c + ci)/2.0;
+    if(i >= 20){
+      bs->points[i-20] = p;
+      bs->xs[i-20] = p.x;
+      bs->ys[i-20] = p.y;
+      bs->colors[i-20] = c;
+    }
+  }
+  rng_fill_uniform(&rng, bs->u, BENCH_NPOINTS);
+}
+
+static void free_points(bench_state * bs){
+  free(bs->points);
+  free(bs->colors);
+  free(bs->u);
+  free(bs->xs);
+  free(bs->ys);
+  free(bs->tx);
+  free(bs->ty);
+}
+
+//function: variation_label
+//purpose: "v<V_ number>_<name>" for variation i of the flame, into label
+//         (BENCH_LABEL of it)
+static void variation_label(int i, char * label){
+  int id = fl.vs.variations[i].id;
+
+  if(variation_name(id) != NULL)
+    snprintf(label, BENCH_LABEL, "v%d_%s", id, variation_name(id));
+  else
+    snprintf(label, BENCH_LABEL, "%d", i);
+}
+
+//function: new_bench_histogram
+//purpose: a histogram of the flame's usual part of the plane at this size
+static histogram * new_bench_histogram(int width, int height){
+  canvas cv;
+  histogram * h;
+
+  if(!init_canvas(&cv, width, height, BENCH_MINV, BENCH_MINV, BENCH_RANGE,
+                  BENCH_RANGE) || (h = new_histogram(&cv)) == NULL){
+    fprintf(stderr,"new_bench_histogram: new_histogram failed. "
+            "exiting...\n");
+    exit(1);
+  }
+  return h;
+}
+
+//function: histogram_max
+//returns h's largest count
+static plotcount_t histogram_max(histogram * h){
+  plotcount_t max = 0;
+  pixel_sum p;
+  int x, y;
+
+  for(y=0; y<get_height(h); y++){
+    for(x=0; x<get_width(h); x++){
+      p = read_bucket(h, x, y);
+      if(p.count > max)
+        max = p.count;
+    }
+  }
+  return max;
+}
+
+//function: run_all
+//purpose: run every benchmark, in the order they're printed
+static void run_all(){
+  static const int sizes[][2] = {{800, 600}, {1920, 1080}, {3840, 2160}};
+  static const struct { const char * name; walk_fn walk; } walkers[] = {
+    {"generic", &walk}, {"fused", &walk_fused}, {"batch", &walk_batch}
+  };
+  bench_state bs;
+  char name[BENCH_NAME], label[BENCH_LABEL];
+  unsigned int i;
+  rng_state rng;
+
+  memset(&bs, 0, sizeof(bs));
+  bs.fl = &fl;
+  make_points(&bs);
+  set_fast_math(&fl.vs, 0);
+
+  run_bench("run_function", bench_run_function, &bs);
+  for(i=0; i<(unsigned int)fl.nfunctions; i++){
+    bs.which = i;
+    snprintf(name, BENCH_NAME, "run_f/xform%u", i);
+    run_bench(name, bench_run_f, &bs);
+  }
+  for(i=0; i<(unsigned int)fl.vs.nv; i++){
+    bs.which = i;
+    variation_label(i, label);
+    snprintf(name, BENCH_NAME, "variation/%s", label);
+    run_bench(name, bench_variation, &bs);
+    snprintf(name, BENCH_NAME, "variation_batch/%s", label);
+    run_bench(name, bench_variation_batch, &bs);
+    set_fast_math(&fl.vs, 1);
+    snprintf(name, BENCH_NAME, "variation_fast/%s", label);
+    run_bench(name, bench_variation, &bs);
+    snprintf(name, BENCH_NAME, "variation_batch_fast/%s", label);
+    run_bench(name, bench_variation_batch, &bs);
+    set_fast_math(&fl.vs, 0);
+  }
+  run_bench("run_final", bench_run_final, &bs);
+
+  for(i=0; i<sizeof(sizes)/sizeof(sizes[0]); i++){
+    bs.h = new_bench_histogram(sizes[i][0], sizes[i][1]);
+    snprintf(name, BENCH_NAME, "plot/%dx%d", sizes[i][0], sizes[i][1]);
+    run_bench(name, bench_plot, &bs);
+    snprintf(name, BENCH_NAME, "plot_batch/%dx%d", sizes[i][0],
+             sizes[i][1]);
+    run_bench(name, bench_plot_batch, &bs);
+
+    //a frame with a typical render's worth of plots
+    snprintf(name, BENCH_NAME, "tone_map/%dx%d", sizes[i][0], sizes[i][1]);
+    if(filter == NULL || strstr(name, filter) != NULL){
+      clear_histogram(bs.h);
+      rng_seed(&rng, BENCH_SEED, 1);
+      walk_batch(&fl, 0, 20*BENCH_WALK_ITERATIONS, 20, bs.h, &rng, NULL);
+      flush_histogram(bs.h);
+      bs.max = histogram_max(bs.h);
+      bs.tm = new_tone_map(BENCH_GAMMA, BENCH_VIBRANCY);
+      bs.rgb = malloc(sizeof(color_t) * 3 * get_npixels(bs.h));
+      if(bs.tm == NULL || bs.rgb == NULL){
+        fprintf(stderr,"run_all: out of memory. exiting...\n");
+        exit(1);
+      }
+      run_bench(name, bench_tone_map, &bs);
+      free_tone_map(bs.tm);
+      free(bs.rgb);
+    }
+    free_histogram(bs.h);
+  }
+
+  bs.h = new_bench_histogram(800, 600);
+  for(i=0; i<sizeof(walkers)/sizeof(walkers[0]); i++){
+    bs.walk = walkers[i].walk;
+    snprintf(name, BENCH_NAME, "walk/%s", walkers[i].name);
+    run_bench(name, bench_walk, &bs);
+  }
+  set_fast_math(&fl.vs, 1);
+  for(i=0; i<sizeof(walkers)/sizeof(walkers[0]); i++){
+    bs.walk = walkers[i].walk;
+    snprintf(name, BENCH_NAME, "walk/%s_fast", walkers[i].name);
+    run_bench(name, bench_walk, &bs);
+  }
+  set_fast_math(&fl.vs, 0);
+  free_histogram(bs.h);
+
+  free_points(&bs);
+}
+
+//function: coord_error
+//purpose: how far b is from the reference a, relative to a's size (or to 1,
+//         near 0).  infinite if either isn't a finite number.
+static double coord_error(coord_t a, coord_t b){
+  if(!isfinite(a) || !isfinite(b))
+    return INFINITY;
+  return fabs((double)(b - a))/(fabs((double)a) > 1.0 ? fabs((double)a) : 1.0);
+}
+
+//function: point_error
+//purpose: coord_error() of the further apart of b's coordinates from a's
+static double point_error(coords a, coords b){
+  double ex = coord_error(a.x, b.x), ey = coord_error(a.y, b.y);
+
+  return (ex > ey ? ex : ey);
+}
+
+//function: check_variations
+//purpose: run every variation's scalar and batched forms on the same points,
+//         with libm and then with fast math, and print, as JSON, the
+//         largest difference, how many points were further apart than
+//         BENCH_ULPS allows, how many came out infinite or nan from either
+//         form, and whether the results ignored the points: all the same,
+//         or all within BENCH_DEGENERATE of the point, or of it with x and y
+//         swapped.  the first function's linear transformation is used
+//         with BENCH_C and BENCH_F for its offsets, and parameters are
+//         BENCH_PARAM_STEP, 2 BENCH_PARAM_STEP, ... from the defaults, so
+//         variations that only do something with nonzero ones get checked,
+//         and the coefficient the ones that use it get is BENCH_WEIGHT.
+//returns how many variations had any mismatches or nonfinite results or
+//        ignored the points
+static int check_variations(){
+  bench_state bs;
+  char label[BENCH_LABEL];
+  double eps, tolerance, error, max, same, still, swapped;
+  int i, k, fast, nbad, nonfinite, nfailed = 0;
+  const char * ignored;
+  V_func * v;
+  F_params fp = fl.functions[0].f.fp;
+  coord_t p[MAXVPARAMS], w = BENCH_WEIGHT;
+  coords c, first, in, swap;
+
+  eps = (sizeof(coord_t) == sizeof(float) ? FLT_EPSILON :
+         sizeof(coord_t) == sizeof(double) ? DBL_EPSILON : LDBL_EPSILON);
+  tolerance = BENCH_ULPS*eps;
+  memset(&bs, 0, sizeof(bs));
+  bs.fl = &fl;
+  make_points(&bs);
+  fp.c = BENCH_C;
+  fp.f = BENCH_F;
+
+  printf("{\n  \"coord_bytes\": %d,\n  \"tolerance\": %g,\n"
+         "  \"variations\": [\n", (int)sizeof(coord_t), tolerance);
+  for(fast=0; fast<2; fast++){
+    set_fast_math(&fl.vs, fast);
+    for(i=0; i<fl.vs.nv; i++){
+      v = &fl.vs.variations[i];
+      for(k=0; k<MAXVPARAMS; k++)
+        p[k] = (k < v->vp.np ? v->vp.p[k] + BENCH_PARAM_STEP*(k+1) : 0.0);
+      run_v_batch(v, bs.xs, bs.ys, bs.tx, bs.ty, BENCH_NPOINTS, &fp, p, &w,
+                  NULL);
+      max = same = still = swapped = 0.0;
+      nbad = nonfinite = 0;
+      for(k=0; k<BENCH_NPOINTS; k++){
+        in = c = bs.points[k];
+        run_v(v, &c, &fp, p, w);
+        if(!isfinite(c.x) || !isfinite(c.y) ||
+           !isfinite(bs.tx[k]) || !isfinite(bs.ty[k])){
+          nonfinite++;
+          continue;
+        }
+        error = coord_error(c.x, bs.tx[k]);
+        if(coord_error(c.y, bs.ty[k]) > error)
+          error = coord_error(c.y, bs.ty[k]);
+        if(error > max)
+          max = error;
+        if(error > tolerance)
+          nbad++;
+
+        //does it do anything with the point?
+        if(nonfinite == k)
+          first = c; //the first finite result
+        swap.x = in.y;
+        swap.y = in.x;
+        if(point_error(first, c) > same)
+          same = point_error(first, c);
+        if(point_error(in, c) > still)
+          still = point_error(in, c);
+        if(point_error(swap, c) > swapped)
+          swapped = point_error(swap, c);
+      }
+      ignored = (nonfinite == BENCH_NPOINTS ? NULL :
+                 same < BENCH_DEGENERATE ? "constant" :
+                 still < BENCH_DEGENERATE && v->id != V_LINEAR ? "identity" :
+                 swapped < BENCH_DEGENERATE ? "swap" : NULL);
+      variation_label(i, label);
+      printf("    {\"name\": \"%s\", \"fast\": %s, \"max_error\": %g, "
+             "\"mismatches\": %d, \"nonfinite\": %d, \"ignores_input\": "
+             "%s%s%s}%s\n", label, fast ? "true" : "false", max, nbad,
+             nonfinite, ignored != NULL ? "\"" : "",
+             ignored != NULL ? ignored : "false", ignored != NULL ? "\"" : "",
+             fast && i == fl.vs.nv-1 ? "" : ",");
+      if(nbad > 0)
+        fprintf(stderr,"check_variations: %s%s: %d of %d points differ, by "
+                "up to %g\n", label, fast ? " (fast)" : "", nbad,
+                BENCH_NPOINTS, max);
+      if(nonfinite > 0)
+        fprintf(stderr,"check_variations: %s%s: %d of %d points aren't "
+                "finite\n", label, fast ? " (fast)" : "", nonfinite,
+                BENCH_NPOINTS);
+      if(ignored != NULL)
+        fprintf(stderr,"check_variations: %s%s: results ignore the points "
+                "(%s)\n", label, fast ? " (fast)" : "", ignored);
+      if(nbad > 0 || nonfinite > 0 || ignored != NULL)
+        nfailed++;
+    }
+  }
+  printf("  ]\n}\n");
+
+  free_points(&bs);
+  return nfailed;
+}
+
+//function: check_genome
+//purpose: check that g's xforms use their own variation parameters: every
+//         active variation's batched form, reading them from the flame plan,
+//         against its scalar one for each xform, and every xform against the
+//         others, which shouldn't come out the same on every point (the
+//         pairs in params.flam3 differ only in their parameters).  prints,
+//         as JSON, each xform's mismatches and the xform it duplicates, or
+//         -1.
+//returns how many xforms had either
+static int check_genome(genome * g){
+  bench_state bs;
+  flame_plan bp;
+  flame * gfl = &g->fl;
+  F * func;
+  coords c;
+  coord_t * p, * ox, * oy;
+  double eps, tolerance, error;
+  int * fi;
+  int i, i2, j, k, n = gfl->nfunctions, nbad, same, nfailed = 0;
+  float ci;
+
+  eps = (sizeof(coord_t) == sizeof(float) ? FLT_EPSILON :
+         sizeof(coord_t) == sizeof(double) ? DBL_EPSILON : LDBL_EPSILON);
+  tolerance = BENCH_ULPS*eps;
+  if(!make_flame_plan(&bp, gfl, 0)){
+    fprintf(stderr,"check_genome: genome %d can't be planned\n", g->index);
+    return 1;
+  }
+  memset(&bs, 0, sizeof(bs));
+  bs.fl = gfl;
+  make_points(&bs);
+  fi = malloc(sizeof(int) * BENCH_NPOINTS);
+  ox = malloc(sizeof(coord_t) * BENCH_NPOINTS * n);
+  oy = malloc(sizeof(coord_t) * BENCH_NPOINTS * n);
+  if(fi == NULL || ox == NULL || oy == NULL){
+    fprintf(stderr,"check_genome: out of memory. exiting...\n");
+    exit(1);
+  }
+
+  printf("    {\"genome\": %d, \"xforms\": [\n", g->index);
+  for(i=0; i<n; i++){
+    func = &gfl->functions[i];
+    for(k=0; k<BENCH_NPOINTS; k++)
+      fi[k] = i;
+    nbad = 0;
+    for(j=0; j<bp.nactive; j++){
+      //run_f() and walk_batch() skip ones this xform doesn't use
+      if(bp.weights[bp.active[j]*n + i] == 0.0)
+        continue;
+      p = (bp.params != NULL ?
+           &bp.params[bp.active[j]*n*MAXVPARAMS] : NULL);
+      run_v_batch(&bp.v[bp.active[j]], bs.xs, bs.ys, bs.tx, bs.ty,
+                  BENCH_NPOINTS, bp.fp, p, &bp.weights[bp.active[j]*n], fi);
+      p = (func->v_param != NULL ?
+           &func->v_param[bp.active[j]*MAXVPARAMS] : NULL);
+      for(k=0; k<BENCH_NPOINTS; k++){
+        c = bs.points[k];
+        run_v(&func->v[bp.active[j]], &c, &func->f.fp, p,
+              bp.weights[bp.active[j]*n + i]);
+        error = coord_error(c.x, bs.tx[k]);
+        if(coord_error(c.y, bs.ty[k]) > error)
+          error = coord_error(c.y, bs.ty[k]);
+        if(error > tolerance)
+          nbad++;
+      }
+    }
+    for(k=0; k<BENCH_NPOINTS; k++){
+      c = bs.points[k];
+      run_xform(gfl, 0, i, &c, &ci);
+      ox[i*BENCH_NPOINTS + k] = c.x;
+      oy[i*BENCH_NPOINTS + k] = c.y;
+    }
+    same = -1;
+    for(i2=0; i2<i && same < 0; i2++){
+      for(k=0; k<BENCH_NPOINTS; k++){
+        if(ox[i*BENCH_NPOINTS + k] != ox[i2*BENCH_NPOINTS + k] ||
+           oy[i*BENCH_NPOINTS + k] != oy[i2*BENCH_NPOINTS + k])
+          break;
+      }
+      if(k == BENCH_NPOINTS)
+        same = i2;
+    }
+    printf("      {\"xform\": %d, \"mismatches\": %d, \"same_as\": %d}%s\n",
+           i, nbad, same, i == n-1 ? "" : ",");
+    if(nbad > 0 || same >= 0){
+      fprintf(stderr,"check_genome: genome %d xform %d: %d points differ "
+              "from the scalar form, same as xform %d\n", g->index, i, nbad,
+              same);
+      nfailed++;
+    }
+  }
+  printf("    ]}");
+
+  free(fi);
+  free(ox);
+  free(oy);
+  free_points(&bs);
+  free_flame_plan(&bp);
+  return nfailed;
+}
+
+//function: check_genomes
+//purpose: check_genome() every genome in the file at path
+//returns how many xforms failed, or 1 if the file couldn't be read
+static int check_genomes(const char * path){
+  genome_file * gf;
+  genome g;
+  int r, nread = 0, nfailed = 0;
+
+  gf = open_genomes(path);
+  if(gf == NULL)
+    return 1;
+  printf("{\n  \"coord_bytes\": %d,\n  \"genomes\": [\n",
+         (int)sizeof(coord_t));
+  while((r = next_genome(gf, &g)) != 0){
+    if(r < 0){
+      nfailed++; //next_genome() said why
+      continue;
+    }
+    printf("%s", nread++ > 0 ? ",\n" : "");
+    nfailed += check_genome(&g);
+    cleanup_functions(&g.fl);
+  }
+  printf("\n  ]\n}\n");
+
+  close_genomes(gf);
+  return nfailed;
+}
+
+//function: byte_of
+//purpose: a tone-mapped channel as the 8 bits output.c writes for it
+static int byte_of(color_t v){
+  if(v > 1.0)
+    v = 1.0;
+  if(!(v > 0.0))
+    v = 0.0;
+  return (int)(v*255.0 + 0.5);
+}
+
+//function: render_frame
+//purpose: walk niterations of frame 0 from seed into h, which is cleared
+//         first, with fast math if fast is TRUE, and tone map it into rgb
+//returns the walk's nanoseconds per iteration
+static double render_frame(histogram * h, tone_map * tm, uint64_t seed,
+                           int fast, long long niterations, color_t * rgb){
+  rng_state rng;
+  double start, ns;
+
+  set_fast_math(&fl.vs, fast);
+  clear_histogram(h);
+  rng_seed(&rng, seed, 0);
+  start = now_seconds();
+  walk_batch(&fl, 0, niterations, 20, h, &rng, NULL);
+  flush_histogram(h);
+  ns = (now_seconds() - start)*1e9/niterations;
+  tone_map_rows(tm, h, histogram_max(h), rgb, 0, get_height(h));
+  return ns;
+}
+
+//function: print_difference
+//purpose: print, as a JSON object called name, how far image b is from a
+//         (n pixels) in 8-bit channel values: the mean and largest
+//         difference, the peak signal to noise ratio in dB, and the fraction
+//         of channels more than 1 apart
+static void print_difference(const char * name, color_t * a, color_t * b,
+                             int n, const char * comma){
+  double sum = 0.0, sumsq = 0.0, psnr;
+  int i, d, max = 0, over = 0;
+
+  for(i=0; i<3*n; i++){
+    d = abs(byte_of(a[i]) - byte_of(b[i]));
+    sum += d;
+    sumsq += (double)d*d;
+    if(d > max)
+      max = d;
+    if(d > 1)
+      over++;
+  }
+  psnr = (sumsq > 0.0 ? 10.0*log10(255.0*255.0/(sumsq/(3*n))) : INFINITY);
+  printf("  \"%s\": {\"mean_abs\": %.4f, \"max_abs\": %d, "
+         "\"psnr_db\": %.2f, \"over_1\": %.6f}%s\n", name, sum/(3*n), max,
+         psnr, (double)over/(3*n), comma);
+}
+
+//function: difference_report
+//purpose: -d: render frame 0 with libm and with fast math from the same
+//         seed, and with libm from another, print how far apart they came
+//         out and how fast they walked, and write them to dir
+//returns TRUE on success, FALSE if the images couldn't be written
+static int difference_report(const char * dir){
+  long long niterations = 20LL*BENCH_WALK_ITERATIONS;
+  int width = BENCH_DIFF_WIDTH, height = BENCH_DIFF_HEIGHT;
+  int i, n = width*height, ok;
+  double exact_ns, fast_ns;
+  histogram * h;
+  tone_map * tm;
+  image_writer * ow;
+  color_t * exact, * fast, * other, * diff;
+
+  h = new_bench_histogram(width, height);
+  tm = new_tone_map(BENCH_GAMMA, BENCH_VIBRANCY);
+  exact = malloc(sizeof(color_t) * 3 * n);
+  fast = malloc(sizeof(color_t) * 3 * n);
+  other = malloc(sizeof(color_t) * 3 * n);
+  diff = malloc(sizeof(color_t) * 3 * n);
+  if(tm == NULL || exact == NULL || fast == NULL || other == NULL ||
+     diff == NULL){
+    fprintf(stderr,"difference_report: out of memory. exiting...\n");
+    exit(1);
+  }
+
+  exact_ns = render_frame(h, tm, BENCH_SEED, 0, niterations, exact);
+  fast_ns = render_frame(h, tm, BENCH_SEED, 1, niterations, fast);
+  render_frame(h, tm, BENCH_DIFF_SEED, 0, niterations, other);
+  for(i=0; i<3*n; i++){
+    diff[i] = BENCH_DIFF_GAIN*fabs(fast[i] - exact[i]);
+  }
+
+  printf("{\n  \"coord_bytes\": %d,\n  \"width\": %d,\n  \"height\": %d,\n"
+         "  \"iterations\": %lld,\n", (int)sizeof(coord_t), width, height,
+         niterations);
+  printf("  \"libm_ns_per_iteration\": %.3f,\n"
+         "  \"fast_ns_per_iteration\": %.3f,\n  \"speedup\": %.3f,\n",
+         exact_ns, fast_ns, exact_ns/fast_ns);
+  print_difference("fast_vs_libm", exact, fast, n, ",");
+  print_difference("libm_vs_other_seed", exact, other, n, "");
+  printf("}\n");
+
+  ow = open_output(dir, FORMAT_PPM, width, height, 1);
+  ok = (ow != NULL);
+  if(ok){
+    ok &= write_frame(0, exact, width, height, ow);
+    ok &= write_frame(1, fast, width, height, ow);
+    ok &= write_frame(2, other, width, height, ow);
+    ok &= write_frame(3, diff, width, height, ow);
+    ok &= close_output(ow);
+  }
+
+  free(exact);
+  free(fast);
+  free(other);
+  free(diff);
+  free_tone_map(tm);
+  free_histogram(h);
+  return ok;
+}
+
+//function: load_results
+//purpose: read the results of an earlier run's JSON, as print_results()
+//         writes it, into baseline (BENCH_MAX of them)
+//returns how many there were, or -1 if the file can't be read
+static int load_results(const char * path, bench_result * baseline){
+  FILE * f = fopen(path, "r");
+  char line[512], * p;
+  int n = 0;
+
+  if(f == NULL){
+    perror(path);
+    return -1;
+  }
+  //one benchmark a line
+  while(fgets(line, sizeof(line), f) != NULL && n < BENCH_MAX){
+    p = strstr(line, "\"name\": \"");
+    if(p == NULL ||
+       sscanf(p, "\"name\": \"%63[^\"]\", \"ns_per_op\": %lf",
+              baseline[n].name, &baseline[n].ns_per_op) != 2)
+      continue;
+    n++;
+  }
+  fclose(f);
+  return n;
+}
+
+//function: compare_results
+//purpose: give every result its baseline from the nbase in baseline
+//returns how many are more than threshold percent slower than it
+static int compare_results(bench_result * baseline, int nbase,
+                           double threshold){
+  int i, j, nslower = 0;
+  double change;
+
+  for(i=0; i<nresults; i++){
+    for(j=0; j<nbase; j++){
+      if(strcmp(results[i].name, baseline[j].name) == 0)
+        break;
+    }
+    if(j == nbase)
+      continue;
+    results[i].baseline = baseline[j].ns_per_op;
+    change = 100.0*(results[i].ns_per_op/results[i].baseline - 1.0);
+    if(change > threshold){
+      fprintf(stderr,"compare_results: %s is %.1f%% slower (%.3f -> %.3f "
+              "ns/op)\n", results[i].name, change, results[i].baseline,
+              results[i].ns_per_op);
+      nslower++;
+    }
+  }
+  return nslower;
+}
+
+//function: print_results
+//purpose: write the results as JSON, one benchmark a line
+static void print_results(FILE * f, double threshold){
+  int i;
+  double change;
+
+  fprintf(f, "{\n  \"rng\": \"%s\",\n  \"coord_bytes\": %d,\n"
+          "  \"benchmarks\": [\n", rng_name(), (int)sizeof(coord_t));
+  for(i=0; i<nresults; i++){
+    fprintf(f, "    {\"name\": \"%s\", \"ns_per_op\": %.3f, "
+            "\"ops_per_second\": %.0f", results[i].name,
+            results[i].ns_per_op, 1e9/results[i].ns_per_op);
+    if(results[i].baseline > 0.0){
+      change = 100.0*(results[i].ns_per_op/results[i].baseline - 1.0);
+      fprintf(f, ", \"baseline_ns_per_op\": %.3f, \"change_percent\": %.1f, "
+              "\"regressed\": %s", results[i].baseline, change,
+              change > threshold ? "true" : "false");
+    }
+    fprintf(f, "}%s\n", i < nresults-1 ? "," : "");
+  }
+  fprintf(f, "  ]\n}\n");
+}
+
+//MAIN
+
+//function: main
+//purpose: run the benchmarks (or read them from -r) and print them, compared
+//         with -b's if it's given, or check the variations with -a, or
+//         report on fast math's images with -d.  exit status 1 if
+//         something's regressed or failed, 0 otherwise.
+int main(int argc, char ** argv){
+  const char * basepath = NULL, * readpath = NULL, * diffdir = NULL,
+    * genomepath = NULL;
+  double threshold = BENCH_THRESHOLD;
+  bench_result * baseline;
+  int opt, nbase = 0, nslower = 0, check = 0, ok;
+
+  while((opt = getopt(argc, argv, "b:r:t:f:m:ad:g:")) != -1){
+    switch(opt){
+      case 'a':
+        check = 1;
+        break;
+      case 'd':
+        diffdir = optarg;
+        break;
+      case 'g':
+        genomepath = optarg;
+        break;
+      case 'b':
+        basepath = optarg;
+        break;
+      case 'r':
+        readpath = optarg;
+        break;
+      case 't':
+        threshold = atof(optarg);
+        break;
+      case 'f':
+        filter = optarg;
+        break;
+      case 'm':
+        min_seconds = atof(optarg);
+        break;
+      default:
+        fprintf(stderr,"usage: %s [-b baseline.json] [-r results.json "
+                "instead of running] [-t regression threshold, percent] "
+                "[-f only benchmarks with this in their names] "
+                "[-m seconds per trial] [-a to check the batched "
+                "variations instead] [-g genome file whose xforms' "
+                "variation parameters to check instead] [-d directory for "
+                "fast math's image difference report instead]\n", argv[0]);
+        return 1;
+    }
+  }
+
+  if(check){
+    if(!init_functions(&fl, BENCH_NFRAMES)){
+      fprintf(stderr,"main: initialization failed.  exiting...\n");
+      return 1;
+    }
+    fl_ready = 1;
+    nslower = check_variations();
+    master_cleanup();
+    return nslower > 0 ? 1 : 0;
+  }
+  if(genomepath != NULL){
+    nslower = check_genomes(genomepath);
+    master_cleanup();
+    return nslower > 0 ? 1 : 0;
+  }
+  if(diffdir != NULL){
+    if(!init_functions(&fl, BENCH_NFRAMES) || !init_histograms()){
+      fprintf(stderr,"main: initialization failed.  exiting...\n");
+      return 1;
+    }
+    fl_ready = 1;
+    ok = difference_report(diffdir);
+    master_cleanup();
+    return ok ? 0 : 1;
+  }
+
+  baseline = malloc(sizeof(bench_result) * BENCH_MAX);
+  if(baseline == NULL){
+    fprintf(stderr,"main: out of memory.  exiting...\n");
+    return 1;
+  }
+  if(basepath != NULL && (nbase = load_results(basepath, baseline)) < 0)
+    return 1;
+
+  if(readpath != NULL){
+    //just compare two earlier runs
+    nresults = load_results(readpath, results);
+    if(nresults < 0)
+      return 1;
+  }else{
+    if(!init_functions(&fl, BENCH_NFRAMES) || !init_histograms()){
+      fprintf(stderr,"main: initialization failed.  exiting...\n");
+      return 1;
+    }
+    fl_ready = 1;
+    run_all();
+  }
+
+  if(basepath != NULL)
+    nslower = compare_results(baseline, nbase, threshold);
+  print_results(stdout, threshold);
+  free(baseline);
+  if(readpath == NULL)
+    master_cleanup(); //from global.c
+  return nslower > 0 ? 1 : 0;
+}
+
+//DESTRUCTOR
+
+//function: cleanup_engine
+//purpose: free the benchmarks' flame (master_cleanup() calls this)
+extern int cleanup_engine(){
+  if(fl_ready)
+    cleanup_functions(&fl);
+  fl_ready = 0;
+  return 1;
+}
@@ -0,0 +1,449 @@
+/* Author: Ted Cooper
+ * Last revised: 7-2-2009
+ * FRACTAL FLAME RENDERER
+ * See top of engine.c for program description.
+ *
+ * checkpoint.c: frame histograms on disk, so a long render can be killed
+ * and resumed, and more samples can be added to a frame later.  a
+ * checkpoint is a header, the flame parameters the frame was rendered with,
+ * which of the frame's chunks it holds, and every pixel's pixel_sum in row
+ * order.  the pixels start on a 64-byte boundary and are stored the way
+ * they're used, so a checkpoint can be mmap'd and read in place.
+ *
+ * chunks only ever draw from their own rng streams, which depend on nothing
+ * but the seed, the frame and the chunk (see animate.c), so the seed and the
+ * flags of the chunks that are done are the whole rng state: resuming runs
+ * the rest of the chunks and renders exactly the frame an uninterrupted
+ * render would have.
+ *
+ * sums are integers, so checkpoints of the same frame merge by adding them.
+ * ones from renders with different seeds have independent samples; ones
+ * with the same seed are only merged if they hold different chunks.
+ * checkpoints are written to a temporary file and renamed into place, so a
+ * render killed while writing one still has the one before.
+ */
+
+//INCLUDES
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "global.h"
+#include "functions.h"
+#include "histogram.h"
+#include "output.h"
+#include "checkpoint.h"
+
+//FUNCTIONS
+
+//private
+
+//function: pixels_offset
+//purpose: where a checkpoint's pixels start, after its header, nparams
+//         parameters and nchunks flags
+static uint64_t pixels_offset(int nparams, int nchunks){
+  uint64_t n = sizeof(checkpoint_header) + sizeof(double)*nparams + nchunks;
+
+  return (n + CHECKPOINT_ALIGN - 1)/CHECKPOINT_ALIGN*CHECKPOINT_ALIGN;
+}
+
+//function: begin_checkpoint
+//purpose: open a temporary file next to path and write everything up to a
+//         checkpoint's pixels into it
+//params: tmp - gets the temporary file's name, MAXPATH long
+//returns the file on success, NULL on failure
+static FILE * begin_checkpoint(const char * path, char * tmp,
+                               checkpoint_info * info, int width,
+                               int height){
+  checkpoint_header hd;
+  FILE * f;
+  uint64_t n;
+  static const char zeros[CHECKPOINT_ALIGN];
+
+  if(snprintf(tmp, MAXPATH, "%s.tmp", path) >= MAXPATH){
+    fprintf(stderr,"begin_checkpoint: path too long. returning...\n");
+    return NULL;
+  }
+  f = fopen(tmp, "wb");
+  if(f == NULL){
+    perror(tmp);
+    return NULL;
+  }
+
+  memset(&hd, 0, sizeof(hd));
+  memcpy(hd.magic, CHECKPOINT_MAGIC, sizeof(hd.magic));
+  hd.version = CHECKPOINT_VERSION;
+  hd.byte_order = CHECKPOINT_BYTE_ORDER;
+  hd.width = width;
+  hd.height = height;
+  hd.frame = info->frame;
+  hd.nparams = info->nparams;
+  hd.seed = info->seed;
+  hd.niterations = info->niterations;
+  hd.chunk_iterations = info->chunk_iterations;
+  hd.nchunks = info->nchunks;
+  hd.pixels_offset = pixels_offset(info->nparams, info->nchunks);
+
+  n = sizeof(hd) + sizeof(double)*info->nparams + info->nchunks;
+  if(fwrite(&hd, sizeof(hd), 1, f) != 1 ||
+     fwrite(info->params, sizeof(double), info->nparams, f) !=
+     (size_t)info->nparams ||
+     fwrite(info->done, 1, info->nchunks, f) != (size_t)info->nchunks ||
+     fwrite(zeros, 1, hd.pixels_offset - n, f) != hd.pixels_offset - n){
+    perror(tmp);
+    fclose(f);
+    remove(tmp);
+    return NULL;
+  }
+  return f;
+}
+
+//function: finish_checkpoint
+//purpose: close a checkpoint from begin_checkpoint() and move it to path
+//params: ok - whether writing its pixels worked
+//returns TRUE on success, FALSE on failure
+static int finish_checkpoint(FILE * f, const char * tmp, const char * path,
+                             int ok){
+  if(fclose(f) != 0)
+    ok = 0;
+  if(ok && rename(tmp, path) != 0)
+    ok = 0;
+  if(!ok){
+    perror(path);
+    remove(tmp);
+  }
+  return ok;
+}
+
+//public
+
+//function: flame_params
+//purpose: the numbers that make frame t of fl what it is, as doubles: the
+//         canvas, then every function's transformations, color, weight,
+//         variations with their coefficients and parameters, then the final
+//         transformation and whether the variations use fast math.
+//         a checkpoint only fits a render with the same ones.
+//returns how many were written into params, or -1 if there are more than
+//        max
+extern int flame_params(flame * fl, int t, canvas * cv, double * params,
+                        int max){
+  int i, j, k, n = 0;
+  F * func;
+  coord_t * coeffs;
+
+#define PARAM(v) do{ if(n >= max) return -1; params[n++] = (double)(v); } \
+                 while(0)
+  PARAM(cv->minX);
+  PARAM(cv->minY);
+  PARAM(cv->rangeX);
+  PARAM(cv->rangeY);
+  PARAM(fl->nfunctions);
+  for(i=0; i<=fl->nfunctions; i++){
+    //the final transformation's a function too, if there is one
+    func = (i < fl->nfunctions ? &fl->functions[i] : fl->finalxform);
+    if(func == NULL)
+      break;
+    PARAM(func->f.fp.a); PARAM(func->f.fp.b); PARAM(func->f.fp.c);
+    PARAM(func->f.fp.d); PARAM(func->f.fp.e); PARAM(func->f.fp.f);
+    PARAM(func->p.fp.a); PARAM(func->p.fp.b); PARAM(func->p.fp.c);
+    PARAM(func->p.fp.d); PARAM(func->p.fp.e); PARAM(func->p.fp.f);
+    PARAM(func->c);
+    PARAM(func->w);
+    PARAM(func->nv);
+    coeffs = (func->v_coeff != NULL ? func->v_coeff :
+              get_frame_coeffs(fl, t));
+    //only the variations it uses, so there's room for big genomes however
+    //many variations there are
+    for(j=0; j<func->nv; j++){
+      if(coeffs[j] == 0.0)
+        continue;
+      PARAM(func->v[j].id);
+      PARAM(coeffs[j]);
+      for(k=0; k<func->v[j].vp.np; k++){
+        PARAM(func->v_param != NULL ? func->v_param[j*MAXVPARAMS + k] :
+              func->v[j].vp.p[k]);
+      }
+    }
+  }
+  PARAM(fl->finalxform != NULL);
+  PARAM(fl->cfinal);
+  PARAM(fl->vs.fast);
+#undef PARAM
+
+  return n;
+}
+
+//function: write_checkpoint
+//purpose: save h, and what info says about it, to a checkpoint at path.
+//         h isn't changed, and has to stay put until this returns.
+//returns TRUE on success, FALSE on failure
+extern int write_checkpoint(const char * path, histogram * h,
+                            checkpoint_info * info){
+  char tmp[MAXPATH];
+  int x, y, ok = 1;
+  int width = get_width(h), height = get_height(h);
+  pixel_sum * row;
+  FILE * f;
+
+  row = malloc(sizeof(pixel_sum) * width);
+  if(row == NULL){
+    fprintf(stderr,"write_checkpoint: out of memory. returning...\n");
+    return 0;
+  }
+  f = begin_checkpoint(path, tmp, info, width, height);
+  if(f == NULL){
+    free(row);
+    return 0;
+  }
+  for(y=0; y<height && ok; y++){
+    for(x=0; x<width; x++){
+      row[x] = read_bucket(h, x, y);
+    }
+    ok = (fwrite(row, sizeof(pixel_sum), width, f) == (size_t)width);
+  }
+  free(row);
+  return finish_checkpoint(f, tmp, path, ok);
+}
+
+//function: open_checkpoint
+//purpose: map the checkpoint at path, if it is one this build can read
+//returns the checkpoint on success, NULL on failure
+extern checkpoint * open_checkpoint(const char * path){
+  struct stat st;
+  checkpoint_header * hd;
+  checkpoint * c;
+  void * map;
+  int fd;
+
+  fd = open(path, O_RDONLY);
+  if(fd < 0)
+    return NULL; //quietly: not having one is normal
+  if(fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(checkpoint_header)){
+    fprintf(stderr,"open_checkpoint: %s is too short\n", path);
+    close(fd);
+    return NULL;
+  }
+  map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd); //the mapping keeps the file
+  if(map == MAP_FAILED){
+    perror(path);
+    return NULL;
+  }
+
+  hd = (checkpoint_header *)map;
+  if(memcmp(hd->magic, CHECKPOINT_MAGIC, sizeof(hd->magic)) != 0 ||
+     hd->version != CHECKPOINT_VERSION ||
+     hd->byte_order != CHECKPOINT_BYTE_ORDER){
+    fprintf(stderr,"open_checkpoint: %s isn't a version %d checkpoint from "
+            "a machine like this one\n", path, CHECKPOINT_VERSION);
+    munmap(map, st.st_size);
+    return NULL;
+  }
+  if(hd->nparams > CHECKPOINT_MAX_PARAMS ||
+     hd->pixels_offset != pixels_offset(hd->nparams, hd->nchunks) ||
+     hd->pixels_offset + (uint64_t)hd->width*hd->height*sizeof(pixel_sum) >
+     (uint64_t)st.st_size){
+    fprintf(stderr,"open_checkpoint: %s is truncated or corrupt\n", path);
+    munmap(map, st.st_size);
+    return NULL;
+  }
+
+  c = malloc(sizeof(checkpoint));
+  if(c == NULL){
+    fprintf(stderr,"open_checkpoint: out of memory. returning...\n");
+    munmap(map, st.st_size);
+    return NULL;
+  }
+  c->map = map;
+  c->size = st.st_size;
+  c->header = hd;
+  c->params = (double *)((char *)map + sizeof(checkpoint_header));
+  c->done = (unsigned char *)(c->params + hd->nparams);
+  c->pixels = (pixel_sum *)((char *)map + hd->pixels_offset);
+  return c;
+}
+
+//function: close_checkpoint
+//purpose: unmap a checkpoint from open_checkpoint()
+//returns TRUE on success, FALSE on failure
+extern int close_checkpoint(checkpoint * c){
+  int ok;
+
+  if(c == NULL)
+    return 1;
+  ok = (munmap(c->map, c->size) == 0);
+  free(c);
+  return ok;
+}
+
+//function: checkpoint_matches
+//purpose: whether c is of the frame info describes, rendered the same way
+//         into a histogram like h, so its chunks can be carried on from.
+//         says what's different if it isn't.
+//returns TRUE if it is, FALSE if it isn't
+extern int checkpoint_matches(checkpoint * c, histogram * h,
+                              checkpoint_info * info){
+  checkpoint_header * hd = c->header;
+  const char * why = NULL;
+
+  if(hd->width != (uint32_t)get_width(h) ||
+     hd->height != (uint32_t)get_height(h))
+    why = "image size";
+  else if(hd->frame != info->frame)
+    why = "frame";
+  else if(hd->seed != info->seed)
+    why = "seed";
+  else if(hd->chunk_iterations != (uint32_t)info->chunk_iterations ||
+          hd->nchunks != (uint32_t)info->nchunks)
+    why = "iterations per chunk";
+  else if(hd->nparams != (uint32_t)info->nparams ||
+          memcmp(c->params, info->params, sizeof(double)*info->nparams) != 0)
+    why = "flame";
+  if(why != NULL){
+    fprintf(stderr,"checkpoint_matches: frame %d's checkpoint has a "
+            "different %s. starting over...\n", info->frame, why);
+    return 0;
+  }
+  return 1;
+}
+
+//function: load_checkpoint
+//purpose: add c's pixels to h, and set info's chunk flags and iterations
+//         to c's.  c has to match, see checkpoint_matches().
+//params: max - raised to the largest count in h afterwards
+//returns TRUE
+extern int load_checkpoint(checkpoint * c, histogram * h,
+                           checkpoint_info * info, plotcount_t * max){
+  int x, y, width = get_width(h), height = get_height(h);
+  pixel_sum p;
+
+  for(y=0; y<height; y++){
+    for(x=0; x<width; x++){
+      add_pixel(h, x, y, &c->pixels[y*width + x]);
+      p = read_bucket(h, x, y);
+      if(p.count > *max)
+        *max = p.count;
+    }
+  }
+  memcpy(info->done, c->done, info->nchunks);
+  info->niterations = c->header->niterations;
+  return 1;
+}
+
+//function: merge_checkpoints
+//purpose: add up nin checkpoints of the same frame of the same flame into
+//         one at out, which can be one of them.  the chunk flags and seed
+//         are the first one's, with the chunks of any others with the same
+//         seed added: a render resumed from out carries on with the first
+//         one's streams.
+//returns TRUE on success, FALSE on failure
+extern int merge_checkpoints(const char * out, const char ** in, int nin){
+  checkpoint ** c;
+  checkpoint_header * hd;
+  checkpoint_info info;
+  char tmp[MAXPATH];
+  pixel_sum * row, * p;
+  int i, j, x, y, ok = 1;
+  FILE * f;
+
+  if(nin < 1){
+    fprintf(stderr,"merge_checkpoints: nothing to merge. returning...\n");
+    return 0;
+  }
+  c = calloc(nin, sizeof(checkpoint *));
+  if(c == NULL){
+    fprintf(stderr,"merge_checkpoints: out of memory. returning...\n");
+    return 0;
+  }
+  for(i=0; i<nin && ok; i++){
+    c[i] = open_checkpoint(in[i]);
+    if(c[i] == NULL){
+      fprintf(stderr,"merge_checkpoints: can't read %s\n", in[i]);
+      ok = 0;
+    }
+  }
+  hd = (ok ? c[0]->header : NULL);
+  for(i=1; i<nin && ok; i++){
+    if(c[i]->header->width != hd->width ||
+       c[i]->header->height != hd->height ||
+       c[i]->header->frame != hd->frame ||
+       c[i]->header->nparams != hd->nparams ||
+       memcmp(c[i]->params, c[0]->params, sizeof(double)*hd->nparams) != 0){
+      fprintf(stderr,"merge_checkpoints: %s isn't the same frame as %s\n",
+              in[i], in[0]);
+      ok = 0;
+    }
+  }
+
+  info.done = NULL;
+  row = NULL;
+  if(ok){
+    info.frame = hd->frame;
+    info.seed = hd->seed;
+    info.chunk_iterations = hd->chunk_iterations;
+    info.nchunks = hd->nchunks;
+    info.params = c[0]->params;
+    info.nparams = hd->nparams;
+    info.niterations = 0;
+    info.done = calloc(hd->nchunks + 1, 1);
+    row = malloc(sizeof(pixel_sum) * hd->width);
+    if(info.done == NULL || row == NULL){
+      fprintf(stderr,"merge_checkpoints: out of memory. returning...\n");
+      ok = 0;
+    }
+  }
+  for(i=0; i<nin && ok; i++){
+    info.niterations += c[i]->header->niterations;
+    if(c[i]->header->seed != hd->seed)
+      continue;
+    if(c[i]->header->chunk_iterations != hd->chunk_iterations ||
+       c[i]->header->nchunks != hd->nchunks){
+      fprintf(stderr,"merge_checkpoints: %s and %s cut the same streams up "
+              "differently\n", in[0], in[i]);
+      ok = 0;
+      break;
+    }
+    //the same chunk twice would be the same samples twice
+    for(j=0; j<(int)hd->nchunks; j++){
+      if(info.done[j] && c[i]->done[j]){
+        fprintf(stderr,"merge_checkpoints: chunk %d of seed %llu is in "
+                "more than one of them\n", j, (unsigned long long)hd->seed);
+        ok = 0;
+        break;
+      }
+      info.done[j] |= c[i]->done[j];
+    }
+  }
+
+  if(ok){
+    f = begin_checkpoint(out, tmp, &info, hd->width, hd->height);
+    ok = (f != NULL);
+    for(y=0; y<(int)hd->height && ok; y++){
+      memcpy(row, &c[0]->pixels[y*hd->width], sizeof(pixel_sum)*hd->width);
+      for(i=1; i<nin; i++){
+        p = &c[i]->pixels[y*hd->width];
+        for(x=0; x<(int)hd->width; x++){
+          row[x].count += p[x].count;
+          row[x].r += p[x].r;
+          row[x].g += p[x].g;
+          row[x].b += p[x].b;
+        }
+      }
+      ok = (fwrite(row, sizeof(pixel_sum), hd->width, f) == hd->width);
+    }
+    if(f != NULL)
+      ok = finish_checkpoint(f, tmp, out, ok);
+  }
+
+  free(row);
+  free(info.done);
+  for(i=0; i<nin; i++){
+    close_checkpoint(c[i]);
+  }
+  free(c);
+  return ok;
+}
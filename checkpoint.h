@@ -0,0 +1,83 @@
+/* Author: Ted Cooper
+ * Last revised: 7-2-2009
+ * FRACTAL FLAME RENDERER
+ * See top of engine.c for program description.
+ *
+ * checkpoint.h: see checkpoint.c for description.
+ */
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "global.h"
+#include "functions.h"
+#include "histogram.h"
+
+#define CHECKPOINT_MAGIC "FLAMEHST"
+#define CHECKPOINT_VERSION 2 //1 had 32-bit pixel_sums
+#define CHECKPOINT_BYTE_ORDER 0x01020304 //reads back differently on a
+                                         //machine of the other endianness
+//pixels start on a multiple of this, so they can be used straight from a
+//mapping
+#define CHECKPOINT_ALIGN 64
+//flame parameters recorded, at most, see flame_params()
+#define CHECKPOINT_MAX_PARAMS 4096
+
+//DATA TYPES
+
+//the start of a checkpoint file.  after it come nparams doubles of flame
+//parameters, nchunks bytes of chunk flags, and then from pixels_offset
+//width*height pixel_sums in row order, bottom row first.  all of it in the
+//writer's byte order.
+typedef struct {
+  char magic[8];          //CHECKPOINT_MAGIC, not NUL-terminated
+  uint32_t version;       //CHECKPOINT_VERSION
+  uint32_t byte_order;    //CHECKPOINT_BYTE_ORDER
+  uint32_t width, height; //histogram pixels
+  int32_t frame;
+  uint32_t nparams;
+  uint64_t seed;          //the frame's chunks draw from streams of this
+  int64_t niterations;    //walked into the pixels, from every source
+  uint32_t chunk_iterations, nchunks; //how the frame was cut up
+  uint64_t pixels_offset;
+} checkpoint_header;
+
+//what a checkpoint says about where its pixels came from
+typedef struct {
+  int frame;
+  uint64_t seed;
+  long long niterations;
+  int chunk_iterations, nchunks;
+  unsigned char * done; //nchunks flags: chunk i of seed's streams is in the
+                        //pixels
+  double * params;      //see flame_params()
+  int nparams;
+} checkpoint_info;
+
+//a checkpoint file, mapped read-only
+typedef struct {
+  checkpoint_header * header;
+  double * params;
+  unsigned char * done;
+  pixel_sum * pixels;
+  void * map;
+  size_t size;
+} checkpoint;
+
+//public
+
+extern int flame_params(flame * fl, int t, canvas * cv, double * params,
+                        int max);
+extern int write_checkpoint(const char * path, histogram * h,
+                            checkpoint_info * info);
+extern checkpoint * open_checkpoint(const char * path);
+extern int close_checkpoint(checkpoint * c);
+extern int checkpoint_matches(checkpoint * c, histogram * h,
+                              checkpoint_info * info);
+extern int load_checkpoint(checkpoint * c, histogram * h,
+                           checkpoint_info * info, plotcount_t * max);
+extern int merge_checkpoints(const char * out, const char ** in, int nin);
+
+#endif
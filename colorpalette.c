@@ -9,26 +9,100 @@
 //a little manual intervention was involved in this process... grabbed the 
 //palette section from the genome file, read the number of colors, and deleted 
 //the last comma in the preprocessor output
-extern color somecolors[] = {
+static color somecolors[] = {
 #include "sheep_138022_color_palette_processed.inc"
                             };
 
-extern colorpalette palette = { somecolors, 256 };
+static colorpalette palette = { somecolors, NULL, 256 };
 
+//function: finish_palette
+//purpose: fill in pal's 8-bit copy once its colors are set
+//returns TRUE on success, FALSE on failure
+extern int finish_palette(colorpalette * pal){
+  int i;
+  
+  if(pal->colors8 == NULL)
+    pal->colors8 = malloc(sizeof(color8) * pal->ncolors);
+  if(pal->colors8 == NULL){
+    fprintf(stderr,"finish_palette: out of memory. returning...\n");
+    return 0;
+  }
+  //palettes come from 8-bit values, so this gets them back exactly
+  for(i=0; i<pal->ncolors; i++){
+    pal->colors8[i].r = (unsigned char)(pal->colors[i].r*255.0 + 0.5);
+    pal->colors8[i].g = (unsigned char)(pal->colors[i].g*255.0 + 0.5);
+    pal->colors8[i].b = (unsigned char)(pal->colors[i].b*255.0 + 0.5);
+  }
+  return 1;
+}
 
 extern int init_color_palette(){
-  return 1;
+  if(palette.colors8 != NULL)
+    return 1;
+  return finish_palette(&palette);
 }
+
 extern int cleanup_color_palette(){
+  free(palette.colors8);
+  palette.colors8 = NULL;
+  return 1;
+}
+
+extern colorpalette * get_default_palette(){
+  return &palette;
+}
+
+//function: new_palette
+//purpose: allocate a black palette of ncolors colors.  set the colors, then
+//         finish_palette() it.
+//returns the palette on success, NULL on failure
+extern colorpalette * new_palette(int ncolors){
+  colorpalette * pal = malloc(sizeof(colorpalette));
+  
+  if(pal == NULL)
+    return NULL;
+  pal->ncolors = ncolors;
+  pal->colors = calloc(ncolors, sizeof(color));
+  pal->colors8 = NULL;
+  if(ncolors <= 0 || pal->colors == NULL){
+    free_palette(pal);
+    return NULL;
+  }
+  return pal;
+}
+
+//function: free_palette
+//purpose: free a palette from new_palette().  the default one is left alone.
+extern int free_palette(colorpalette * pal){
+  if(pal == NULL || pal == &palette)
+    return 1;
+  free(pal->colors);
+  free(pal->colors8);
+  free(pal);
   return 1;
 }
 
 //index is a float in [0.0, 1.0]
-extern color * lookup_color(float index){
-  int i = (int)(index*palette.ncolors);
-  if(i < 0 || i >= palette.ncolors){
+extern color * lookup_color(colorpalette * pal, float index){
+  int i = (int)(index*pal->ncolors);
+  //1.0 itself is the last color
+  if(i == pal->ncolors)
+    i--;
+  if(i < 0 || i >= pal->ncolors){
     printf("lookup_color: index out of bounds\n");
     exit(1);
   }
-  return &palette.colors[i];
+  return &pal->colors[i];
+}
+
+//same as lookup_color, 8 bits per channel
+extern color8 * lookup_color8(colorpalette * pal, float index){
+  int i = (int)(index*pal->ncolors);
+  if(i == pal->ncolors)
+    i--;
+  if(i < 0 || i >= pal->ncolors){
+    printf("lookup_color8: index out of bounds\n");
+    exit(1);
+  }
+  return &pal->colors8[i];
 }
@@ -3,16 +3,35 @@
 
 #include "global.h"
 
+//a palette entry as the 8-bit channels it was made from
+typedef struct {
+  unsigned char r;
+  unsigned char g;
+  unsigned char b;
+} color8;
+
+//colors8 is an 8-bit copy of colors, filled in by finish_palette().
+//histograms accumulate these as integers, which (unlike floats) add up the
+//same no matter what order samples arrive in.
 typedef struct {
   color * colors;
+  color8 * colors8;
   int ncolors;
 } colorpalette;
 
 //public
 
+//the compiled-in palette, shared by every flame that doesn't bring its own
 extern int init_color_palette();
 extern int cleanup_color_palette();
+extern colorpalette * get_default_palette();
+
+//palettes from elsewhere (genome files)
+extern colorpalette * new_palette(int ncolors);
+extern int finish_palette(colorpalette * pal);
+extern int free_palette(colorpalette * pal);
 
-extern color * lookup_color(float index);
+extern color * lookup_color(colorpalette * pal, float index);
+extern color8 * lookup_color8(colorpalette * pal, float index);
 
 #endif
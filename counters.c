@@ -0,0 +1,149 @@
+/* Author: Ted Cooper
+ * Last revised: 7-2-2009
+ * FRACTAL FLAME RENDERER
+ * See top of engine.c for program description.
+ *
+ * counters.c: instrumentation of renders.  every frame can get a
+ * frame_counters of how many iterations it got, how many of their plots
+ * missed the canvas or weren't numbers at all, how often each of its
+ * functions was picked, and how long each stage took.  a flame that's
+ * badly framed (most plots outside), degenerate (points gone to inf or nan)
+ * or lopsided (one function picked almost every time) shows up in them.
+ *
+ * it costs next to nothing: the walkers keep what they count in locals or
+ * a worker's own counters, which are added to the frame's only where its
+ * lock is already held, and with no counters asked for, none of it runs.
+ */
+
+//INCLUDES
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "counters.h"
+
+//GLOBALS
+
+static const char * stage_names[NSTAGES] = {
+  "walk", "merge", "filter", "tone_map", "output", "checkpoint"
+};
+
+//FUNCTIONS
+
+//public
+
+//function: init_counters
+//purpose: set up zeroed counters for a flame with nxforms functions
+//returns TRUE on success, FALSE on failure
+extern int init_counters(frame_counters * fc, int nxforms){
+  memset(fc, 0, sizeof(frame_counters));
+  fc->selected = calloc(nxforms > 0 ? nxforms : 1, sizeof(long long));
+  if(fc->selected == NULL){
+    fprintf(stderr,"init_counters: out of memory. returning...\n");
+    return 0;
+  }
+  fc->nxforms = nxforms;
+  return 1;
+}
+
+//function: free_counters
+//purpose: free what init_counters() allocated
+extern int free_counters(frame_counters * fc){
+  free(fc->selected);
+  fc->selected = NULL;
+  fc->nxforms = 0;
+  return 1;
+}
+
+//function: clear_counters
+//purpose: zero fc, keeping its functions
+extern int clear_counters(frame_counters * fc){
+  long long * selected = fc->selected;
+  int nxforms = fc->nxforms;
+
+  memset(fc, 0, sizeof(frame_counters));
+  memset(selected, 0, sizeof(long long) * nxforms);
+  fc->selected = selected;
+  fc->nxforms = nxforms;
+  return 1;
+}
+
+//function: add_counters
+//purpose: add src's counts to dst's.  they should be of the same flame.
+extern int add_counters(frame_counters * dst, frame_counters * src){
+  int i;
+
+  dst->iterations += src->iterations;
+  dst->outside += src->outside;
+  dst->nonfinite += src->nonfinite;
+  for(i=0; i<dst->nxforms && i<src->nxforms; i++){
+    dst->selected[i] += src->selected[i];
+  }
+  for(i=0; i<NSTAGES; i++){
+    dst->seconds[i] += src->seconds[i];
+  }
+  return 1;
+}
+
+//function: write_counters_header
+//purpose: start a file of write_counters() records: Prometheus' HELP and
+//         TYPE lines, nothing for JSON
+//returns TRUE on success, FALSE on failure
+extern int write_counters_header(FILE * f, int format){
+  if(format != COUNTERS_PROMETHEUS)
+    return 1;
+  return fprintf(f,
+    "# HELP flame_iterations_total Iterations walked.\n"
+    "# TYPE flame_iterations_total counter\n"
+    "# HELP flame_outside_total Plots that fell outside the image.\n"
+    "# TYPE flame_outside_total counter\n"
+    "# HELP flame_nonfinite_total Plots that were NaN or infinite.\n"
+    "# TYPE flame_nonfinite_total counter\n"
+    "# HELP flame_xform_selected_total Times each function was picked.\n"
+    "# TYPE flame_xform_selected_total counter\n"
+    "# HELP flame_stage_seconds_total Seconds in each stage, over threads.\n"
+    "# TYPE flame_stage_seconds_total counter\n") > 0;
+}
+
+//function: write_counters
+//purpose: write one frame's counters to f, as one JSON object on a line or
+//         as Prometheus samples labeled label="id"
+//params: label - what id is: "frame", or "genome"
+//returns TRUE on success, FALSE on failure
+extern int write_counters(FILE * f, int format, const char * label, int id,
+                          frame_counters * fc){
+  int i;
+
+  if(format == COUNTERS_PROMETHEUS){
+    fprintf(f, "flame_iterations_total{%s=\"%d\"} %lld\n", label, id,
+            fc->iterations);
+    fprintf(f, "flame_outside_total{%s=\"%d\"} %lld\n", label, id,
+            fc->outside);
+    fprintf(f, "flame_nonfinite_total{%s=\"%d\"} %lld\n", label, id,
+            fc->nonfinite);
+    for(i=0; i<fc->nxforms; i++){
+      fprintf(f, "flame_xform_selected_total{%s=\"%d\",xform=\"%d\"} %lld\n",
+              label, id, i, fc->selected[i]);
+    }
+    for(i=0; i<NSTAGES; i++){
+      fprintf(f, "flame_stage_seconds_total{%s=\"%d\",stage=\"%s\"} %.6f\n",
+              label, id, stage_names[i], fc->seconds[i]);
+    }
+  }else{
+    fprintf(f, "{\"%s\": %d, \"iterations\": %lld, \"outside\": %lld, "
+            "\"nonfinite\": %lld, \"outside_fraction\": %.6f, "
+            "\"selected\": [", label, id, fc->iterations, fc->outside,
+            fc->nonfinite, fc->iterations > 0 ?
+            (double)fc->outside/fc->iterations : 0.0);
+    for(i=0; i<fc->nxforms; i++){
+      fprintf(f, "%s%lld", i > 0 ? ", " : "", fc->selected[i]);
+    }
+    fprintf(f, "], \"seconds\": {");
+    for(i=0; i<NSTAGES; i++){
+      fprintf(f, "%s\"%s\": %.6f", i > 0 ? ", " : "", stage_names[i],
+              fc->seconds[i]);
+    }
+    fprintf(f, "}}\n");
+  }
+  return !ferror(f);
+}
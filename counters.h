@@ -0,0 +1,51 @@
+/* Author: Ted Cooper
+ * Last revised: 7-2-2009
+ * FRACTAL FLAME RENDERER
+ * See top of engine.c for program description.
+ *
+ * counters.h: see counters.c for description.
+ */
+
+#ifndef COUNTERS_H
+#define COUNTERS_H
+
+#include <stdio.h>
+
+//stages of a frame's render, for frame_counters.seconds
+#define STAGE_WALK 0       //walking chunks (on workers, with -R)
+#define STAGE_MERGE 1      //merging them into the frame
+#define STAGE_FILTER 2     //supersampling and density estimation
+#define STAGE_TONE_MAP 3
+#define STAGE_OUTPUT 4     //the frame sink
+#define STAGE_CHECKPOINT 5
+#define NSTAGES 6
+
+//write_counters() formats
+#define COUNTERS_JSON 0       //a JSON object a line
+#define COUNTERS_PROMETHEUS 1 //Prometheus' text exposition format
+
+//TYPES
+
+//what went into a frame.  a walk_fn (render.h) adds what it walks to one if
+//it's given one; render_frames() (animate.c) fills in the rest.
+typedef struct {
+  long long iterations;  //walked, miniterations and all
+  long long outside;     //plots that fell off the canvas
+  long long nonfinite;   //of those, the ones that weren't even numbers
+  long long * selected;  //how many times each of nxforms functions was
+                         //picked
+  int nxforms;
+  double seconds[NSTAGES]; //in each stage, summed over threads
+} frame_counters;
+
+//public
+
+extern int init_counters(frame_counters * fc, int nxforms);
+extern int free_counters(frame_counters * fc);
+extern int clear_counters(frame_counters * fc);
+extern int add_counters(frame_counters * dst, frame_counters * src);
+extern int write_counters_header(FILE * f, int format);
+extern int write_counters(FILE * f, int format, const char * label, int id,
+                          frame_counters * fc);
+
+#endif
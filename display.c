@@ -1,25 +1,25 @@
-#include <math.h>
+/* Author: Ted Cooper
+ * Last revised: 7-2-2009
+ * FRACTAL FLAME RENDERER
+ * See top of engine.c for program description.
+ *
+ * display.c: GLUT viewer.  collects frames from the renderer and plays them
+ * back in a loop.  it can start playing right away: frames are copied in
+ * under the viewer's lock as the render threads make them, rough ones first
+ * and then better ones over them, and each redraw shows whatever the frame
+ * is by then.  the only part of the program that needs GL; headless builds
+ * leave it out.
+ */
+
 #include <stdlib.h>
 #include <stdio.h>
 #include "display.h"
-#include "functions.h"
-#include "variations.h"
-#include "colorpalette.h"
 
 //private globals
 
-static GLint winW, winH;
-static coord_t minX, minY, rangeX, rangeY;
-
-typedef unsigned int plotcount_t;
-
-plotcount_t ** framecounts = NULL;
-
-static int frame_period;
-static int nframes;
-static int dt;
-static color_t ** frames = NULL;
-static color_t * pixels = NULL;
+//the viewer on screen.  GLUT callbacks don't take an argument, and there's
+//only ever one window.
+static viewer * shown = NULL;
 
 //FUNCTIONS
 
@@ -30,6 +30,12 @@ static color_t * pixels = NULL;
 void keyboard(unsigned char key, int mouseX, int mouseY) {
 	//printf("received char %c, value %d\n", key, key);
 	if(EITHERCASE(key, 'q')){
+	  //render threads may still be using everything master_cleanup() would
+	  //free.  exit() gets it all back anyway.
+	  pthread_mutex_lock(&shown->lock);
+	  if(shown->rendering)
+	    exit(0);
+	  pthread_mutex_unlock(&shown->lock);
 	  master_cleanup();
 		exit(0);
 	}
@@ -41,216 +47,129 @@ void keyboard(unsigned char key, int mouseX, int mouseY) {
 
 //switch to next frame
 void update(int t){
+  viewer * v = shown;
+  
   //if we are at an end, switch direction
-  if(t >= nframes - 1 || t <= 0)
-    dt*=-1;
+  if(t >= v->nframes - 1 || t <= 0)
+    v->dt*=-1;
   
-  t+=dt;
+  t+=v->dt;
   
-  pixels = frames[t];
+  v->pixels = v->images[t];
   //reset timer
-  glutTimerFunc(frame_period, update, t);
+  glutTimerFunc(v->frame_period, update, t);
   //time to redraw
   glutPostRedisplay();
 }
 
 //initialization and cleanup
 
-extern int init_display(int _winW, int _winH, 
-                        coord_t _minX, coord_t _minY, 
-                        coord_t _rangeX, coord_t _rangeY,
-                        int _nframes, int _frame_period){
+//function: init_display
+//purpose: make a viewer for an animation of nframes winW x winH frames, 
+//         shown for frame_period ms each.
+//returns the viewer on success, NULL on failure
+extern viewer * init_display(int winW, int winH, 
+                             int nframes, int frame_period){
   int t;
+  viewer * v = calloc(1, sizeof(viewer));
   
-  winW = _winW;
-  winH = _winH;
-  minX = _minX;
-  minY = _minY;
-  rangeX = _rangeX;
-  rangeY = _rangeY;
-  nframes = _nframes;
-  frame_period = _frame_period;
-  dt = 1; //start going forward
-  
-  //set up color palette
-  init_color_palette();
-  
-  //allocate space for frames
-  frames = malloc(sizeof(color_t *) * nframes);
-  framecounts = malloc(sizeof(plotcount_t *) * nframes);
+  if(v == NULL){
+    fprintf(stderr,"init_display: out of memory. returning...\n");
+    return NULL;
+  }
+  v->winW = winW;
+  v->winH = winH;
+  v->nframes = nframes;
+  v->frame_period = frame_period;
+  v->dt = 1; //start going forward
+  v->rendering = 1;
+  pthread_mutex_init(&v->lock, NULL);
+  
+  //allocate space for finished frames.  store_frame() fills these in as the
+  //renderer finishes them, so they start out black.
+  v->images = calloc(nframes, sizeof(GLubyte *));
+  if(v->images == NULL){
+    fprintf(stderr,"init_display: out of memory. returning...\n");
+    cleanup_display(v);
+    return NULL;
+  }
   
   for(t=0; t<nframes; t++){
-    //we'll store counts and colors accumulated in plot() in these arrays
-    frames[t] = malloc(sizeof(color_t) * winW * winH * 3);
-    framecounts[t] = malloc(sizeof(plotcount_t) * winW * winH);
+    v->images[t] = calloc(winW * winH * 3, sizeof(GLubyte));
+    if(v->images[t] == NULL){
+      fprintf(stderr,"init_display: out of memory at frame %d. returning...\n",
+              t);
+      cleanup_display(v);
+      return NULL;
+    }
   }
   
-  return 1;
+  return v;
 }
 
-extern int cleanup_display(){
+extern int cleanup_display(viewer * v){
   printf("cleanup_display: about to free\n");
   int i;
   
-  for(i=0; i<nframes; i++){
-    free(frames[i]);
-    free(framecounts[i]);
-  }
-  free(frames);
-  free(framecounts);
+  //never initialized (frames went to files instead)
+  if(v == NULL)
+    return 1;
   
-  //done with color palette
-  cleanup_color_palette();
+  if(v->images != NULL){
+    for(i=0; i<v->nframes; i++){
+      free(v->images[i]);
+    }
+  }
+  free(v->images);
+  if(shown == v)
+    shown = NULL;
+  pthread_mutex_destroy(&v->lock);
+  free(v);
   
   return 1;
 }
 
-//plot points
-//params coordinate pair, index into color palette
-extern int plot(coords * p, float * c, int t){
-  int x;
-  int y;
-  int i;
-  color * ccolor;
-  
-#if defined(DEBUG)
-  printf("plot: received p:(%LG,%LG)\n", p->x, p->y);
-  printf("      minX: %LG, rangeX: %LG\n", minX, rangeX);
-  printf("      minY: %LG, rangeY: %LG\n", minY, rangeY);
-#endif
-
-  x = (int)((p->x - minX)/rangeX * winW + 0.5);
-  y = (int)((p->y - minY)/rangeY * winH + 0.5);
-  
-  //don't try to plot if out of range
-  if(x < 0 || x >= winW || y < 0 || y >= winH){
-    //printf("plot: coordinates (%d,%d) out of range.  not plotting.\n",x,y);
-    return 0;
-  }
-
-#if defined(DEBUG)
-  printf("plot: about to increment framecounts[t][%d]. (x,y):(%d,%d)\n",
-         i, x, y);
-#endif
-
-  i = y*winW + x;
-
-  //increment count where point is in grid
-  framecounts[t][i]++;
-  
-  //look up color in palette using index
-  ccolor = lookup_color(*c);
-
-  //accumulate color values
-  frames[t][3*i] += ccolor->r;
-  frames[t][3*i+1] += ccolor->g;
-  frames[t][3*i+2] += ccolor->b;
-  
+//function: done_rendering
+//purpose: tell the viewer no more frames are coming
+//returns TRUE
+extern int done_rendering(viewer * v){
+  pthread_mutex_lock(&v->lock);
+  v->rendering = 0;
+  pthread_mutex_unlock(&v->lock);
   return 1;
 }
 
-//display functions
-//vibrancy [0.0,1.0], gamma somewhere ~[2.0,4.0]
-static int compute_pixels(float gamma, float vibrancy, int t){
+//function: store_frame
+//purpose: frame_sink for the animation.  keeps an 8-bit copy of tone-mapped
+//         frame t for the display loop, replacing whatever it had.
+//params: t - frame number.
+//        rgb - width*height tone-mapped RGB pixels.  only valid during the
+//        call.
+//        arg - the viewer.
+//returns TRUE on success, FALSE on failure
+extern int store_frame(int t, color_t * rgb, int width, int height, 
+                       void * arg){
   int i;
-  color_t r,g,b;
-  float invgamma, compvib, alpha_gamma;
-  GLfloat brightness, brightness_scale;
-  GLfloat alpha, alpha_scale, max_alpha_scale, first_scale;
-  
-  printf("compute_pixels:  starting actual frame image computation\n");
+  color_t v;
+  viewer * view = (viewer *)arg;
   
-  invgamma = 1.0/gamma;
-  compvib = 1.0 - vibrancy;
-  
-  plotcount_t max = framecounts[t][0];
-  
-  //find largest count
-  for(i=1; i<winW*winH; i++){
-    if(framecounts[t][i] > max)
-      max = framecounts[t][i];
+  if(t < 0 || t >= view->nframes || width != view->winW || 
+     height != view->winH){
+    fprintf(stderr,"store_frame: frame %d doesn't fit the display\n", t);
+    return 0;
   }
-  /*
-  //grayscale
-  //solve for brightness_scale to fix max's log at 1.0
-  brightness_scale = (GLfloat)1.0/(logf((float)max));
   
-  //store scaled color for each pixel
-  for(i=0; i<winW*winH; i++){
-    brightness = brightness_scale*logf((float)framecounts[t][i]);
-    
-    //don't worry about color for the moment, just do grayscale
-    frames[t][3*i] = brightness;
-    frames[t][3*i+1] = brightness;
-    frames[t][3*i+2] = brightness; 
+  pthread_mutex_lock(&view->lock);
+  for(i=0; i<width*height*3; i++){
+    v = rgb[i];
+    //gamma can push channels a little past 1.0
+    if(v > 1.0)
+      v = 1.0;
+    if(!(v > 0.0))
+      v = 0.0;
+    view->images[t][i] = (GLubyte)(v*255.0 + 0.5);
   }
-  */
-  
-  
-  //color
-  //try doing count-based log scale per channel like on p.10 of paper, then 
-  //divide by log of largest count to ensure all values <= 1.0
-  
-  //solve for brightness_scale to fix max's log at 1.0
-  max_alpha_scale = (GLfloat)1.0/(logf((float)max));
-  
-  for(i=0; i<winW*winH; i++){
-  
-    //this would create weird behavior
-    if(M_E > framecounts[t][i]){
-      frames[t][3*i] = 0.0;
-      frames[t][3*i+1] = 0.0;
-      frames[t][3*i+2] = 0.0;
-      continue;
-    }
-  
-    //basic color scaling
-    alpha = (GLfloat)framecounts[t][i];    
-    alpha_scale = (GLfloat)logf((float)alpha);
-    brightness = alpha_scale*max_alpha_scale;
-        
-    //first scaling factor
-    first_scale = brightness/alpha;
-    
-    
-    //scale colors (already accumulated in pixels array) based on this pixel's
-    //alpha and the entire image's max alpha
-    if((frames[t][3*i] *= first_scale) > 1.0 ||
-       (frames[t][3*i+1] *= first_scale) > 1.0 ||
-       (frames[t][3*i+2] *= first_scale) > 1.0
-      ){
-      printf("compute_pixels: scaling isn't working right\n");
-      exit(1);  
-    }
-    
-    
-    //gamma correction and vibrancy
-    //vibrancy determines how much of gamma correction is determined by
-    //alpha channel's brightness (as opposed to each individual channel's)
-    alpha_gamma = vibrancy*powf(brightness, invgamma);
-    
-    frames[t][3*i] *= compvib*powf(frames[t][3*i], invgamma) + alpha_gamma;
-    frames[t][3*i+1] *= compvib*powf(frames[t][3*i+1], invgamma) + alpha_gamma;
-    frames[t][3*i+2] *= compvib*powf(frames[t][3*i+2], invgamma) + alpha_gamma;
-    
-    /*
-    frames[t][3*i] = ( frames[t][3*i] > 1.0 ? 1.0 : frames[t][3*i]);
-    frames[t][3*i+1] = ( g > 1.0 ? 1.0 : g);
-    frames[t][3*i+2] = ( b > 1.0 ? 1.0 : b);
-    */
-    
-    if(frames[t][3*i]   > 1.0 ||
-       frames[t][3*i+1] > 1.0 ||
-       frames[t][3*i+2] > 1.0
-      ){
-      printf("compute_pixels: gamma put channels out of range\n");
-      //exit(1);  
-    }
-    
-  }
-  
-  printf("compute_pixels:  finished frame %d image computation\n", t);
-  
+  pthread_mutex_unlock(&view->lock);
   
   return 1;
 }
@@ -258,8 +177,11 @@ static int compute_pixels(float gamma, float vibrancy, int t){
 //display
 void display(void) {
 
-  //fill the framebuffer
-  glDrawPixels(winW, winH, GL_RGB, GL_FLOAT, pixels);
+  //fill the framebuffer, with a frame that isn't being replaced
+  pthread_mutex_lock(&shown->lock);
+  glDrawPixels(shown->winW, shown->winH, GL_RGB, GL_UNSIGNED_BYTE, 
+               shown->pixels);
+  pthread_mutex_unlock(&shown->lock);
 
   //frame buffer is complete, so move it to "front" for screen display
   glutSwapBuffers();
@@ -272,33 +194,30 @@ void display(void) {
 }
 
 
-extern int start_display(float gamma, float vibrancy){
+//function: start_display
+//purpose: open the window and play v's frames in a loop.  doesn't return.
+extern int start_display(viewer * v){
   int i=0;
   
+  shown = v;
+  
   //initialize window
   glutInit(&i, NULL);
   glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGBA);
-  glutInitWindowSize(winW, winH);
+  glutInitWindowSize(v->winW, v->winH);
   glutInitWindowPosition(100,150);
   glutCreateWindow("Fractal Flame");
-  glViewport(0, 0, winW, winH); //set size of viewport (in pixels)
+  glViewport(0, 0, v->winW, v->winH); //set size of viewport (in pixels)
+  //rows of 8-bit RGB aren't necessarily 4-byte aligned
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 
-  printf("start_display: before compute_pixels loop\n");
-  
-  //generate the images
-  for(i=0; i<nframes; i++){
-    compute_pixels(gamma, vibrancy, i);
-  }
-  
-  printf("start_display: past compute_pixels loop\n");
-  
-  pixels = frames[1];
+  v->pixels = v->images[v->nframes > 1 ? 1 : 0];
   
   //register callback functions for glut (other events exist too, if needed...)
   glutDisplayFunc(display);
   //glutMouseFunc(mouseclick);
   glutKeyboardFunc(keyboard);
-  glutTimerFunc(frame_period, update, 1);
+  glutTimerFunc(v->frame_period, update, 1);
 
   glutMainLoop(); //infinite event-driven loop (managed by glut)
   return 0;
@@ -1,17 +1,36 @@
 #ifndef DISPLAY_H
 #define DISPLAY_H
 
+#include <pthread.h>
 #include <GL/glut.h>
 #include "global.h"
 
+//DATA TYPES
+
+//an animation to play: its tone-mapped frames, 8 bits per channel.  frames
+//can keep arriving from render threads while it plays.
+typedef struct {
+  GLint winW, winH;
+  int frame_period;
+  int nframes;
+  int dt;
+  GLubyte ** images;
+  GLubyte * pixels; //frame being shown
+  pthread_mutex_t lock; //protects images' contents and rendering
+  int rendering;    //frames are still arriving, see done_rendering()
+} viewer;
+
 //public
-extern int init_display(int _winW, int _winH, 
-                        coord_t _minX, coord_t _minY, 
-                        coord_t _rangeX, coord_t _rangeY,
-                        int _nframes, int _frame_period);
-extern int cleanup_display();
-extern int start_display(float gamma, float vibrancy);
+extern viewer * init_display(int winW, int winH, 
+                             int nframes, int frame_period);
+extern int cleanup_display(viewer * v);
+extern int start_display(viewer * v);
+extern int done_rendering(viewer * v);
 
-extern int plot(coords * p, float * c, int t); 
+//receives finished frames from the renderer (a frame_sink, see animate.h),
+//or unfinished ones (render_params.progress) to show until they're done.
+//arg is the viewer.
+extern int store_frame(int t, color_t * rgb, int width, int height, 
+                       void * arg);
 
 #endif
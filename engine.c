@@ -9,25 +9,55 @@
  * input (http://electricsheep.wikispaces.com/flam3-render), but currently
  * only a subset of the rendering steps and variation functions are 
  * implemented, flame specifications are hardcoded in various  
- * unintuitive places, and no image or video file output is supported - it just
- * renders and displays an animation.  I also need to pull the animation
+ * unintuitive places, and the only file output is a numbered image per frame
+ * (see output.c).  I also need to pull the animation
  * stuff out of this file too and write a separate animator analogous to
  * flam3-animate. 
  *
  * engine.c: initialization and main rendering/display loop.  Currently 
- * renders a simple animation with NFRAMES frames and plays it on loop. 
+ * renders a simple animation with NFRAMES frames and plays it on loop while
+ * it renders (a quick rough pass over every frame first, then each frame 
+ * refined in place), or with -o (and always in the headless build, see 
+ * makefile) writes the frames to image files instead.  with -g it renders
+ * every genome in a flam3 file (see genome.c) to its own image instead, a few
+ * at a time on one thread pool.  with -C a directory, frames are checkpointed
+ * (see checkpoint.c) as they render, -r resumes from the checkpoints there,
+ * and -M merges checkpoints of the same frame from separate renders.  with
+ * -W it's a worker that walks chunks for other processes, and with -R it
+ * hands its chunks to workers like that (see remote.c).  -I writes every
+ * frame's counters (see counters.c) to a file, as Prometheus text if it ends
+ * in .prom and JSON lines otherwise.  -A 1 renders with the variations' fast
+ * approximate math (see fastmath.h), -A 0 with libm's, whichever the build
+ * defaults to.  everything but this file, display.c and global.c is
+ * libflame (see libflame.h), which other programs can link too.
  */
  
 //INCLUDES (INCLUSIONS?)
 
-#include <GL/glut.h>
 #include <sys/time.h>
 #include <time.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "counters.h"
 #include "functions.h"
 #include "global.h"
+#include "histogram.h"
+#if !defined(HEADLESS)
 #include "display.h"
+#endif
+#include "output.h"
+#include "render.h"
+#include "kernel.h"
+#include "batch.h"
+#include "rng.h"
+#include "animate.h"
+#include "pool.h"
+#include "genome.h"
+#include "checkpoint.h"
+#include "remote.h"
 
 //GLOBALS
 
@@ -40,174 +70,685 @@
 #define WINH 600
 #define GAMMA 4.0
 #define VIBRANCY 0.6
+#define SUPERSAMPLE 1 //histogram pixels per image pixel each way
+#define ESTIMATOR_RADIUS 0.0 //density estimation is off unless this is > 0
+#define ESTIMATOR_MINIMUM 0.0
+#define ESTIMATOR_CURVE 0.4
 #define NFRAMES 100
 #define FRAME_PERIOD 30
+#define NTHREADS 0 //render threads. 0 means one per online CPU
+#define MAXFRAMES 0 //frames in flight at once. 0 means one per thread
+#define CHUNK_ITERATIONS 1000000 //iterations per unit of work
+#define TOLERANCE 0.0 //frames stop early once they change less than this 
+                      //per batch of chunks.  0 means they never do.
+#define DEADLINE 0.0 //seconds per frame. 0 means no limit.
+#define CHECKPOINT_INTERVAL 60.0 //seconds between checkpoints of a frame
+                                 //while it renders, with -C
+#define PREVIEW_DIVISOR 64 //the display's first pass gets this much less
+                           //than NITERATIONS per frame
+#define OUTPUT_FORMATS "png"
+#define OUTPUT_QUEUE 4 //frames waiting for the writer thread before renderers
+                       //have to wait for it
+#define GENOMES_IN_FLIGHT 2 //genomes rendering at once with -g, so the pool
+                            //has another one's chunks to run while one is
+                            //tone mapped and written
+
+//TYPES
+
+//a genome file being rendered by render_genomes()' threads
+typedef struct {
+  genome_file * gf;
+  render_params base; //everything but the flame itself
+  const char * outdir;
+  const char * checkpoint_dir; //or NULL
+  int formats;
+
+  pthread_mutex_t lock; //protects gf and everything below
+  int ok;
+  int nrendered;
+  double parse_time, render_time; //seconds, summed over genomes
+} genome_batch;
 
-//MACROS
+//where one genome's only frame goes
+typedef struct {
+  image_writer * writer;
+  int index;
+} genome_sink;
 
-//random floating-point value in range [0.0,1.0)
-#define RANDD (rand()/(RAND_MAX + 1.0))
+//the one flame this program renders, and where it goes
+static flame fl;
+static int fl_ready = 0;
+static canvas cv;
+#if !defined(HEADLESS)
+static viewer * view = NULL;
+#endif
+
+//where -I sends frames' counters, or NULL, and in which format
+static FILE * counters_out = NULL;
+static int counters_format = COUNTERS_JSON;
 
-//random floating-point value in range [MINV, (RANGE + MINV))
-#define RANDU (RANDD * RANGE + MINV)
+//-A: TRUE or FALSE for the variations' fast math, or -1 for the build's
+//default (see fastmath.h)
+static int fast_math = -1;
 
-//FORWARD DECLARATIONS
+//FUNCTIONS
 
-int render(int niterations, int miniterations, float vector_len, int t);
+//private
+
+static double seconds_since(struct timeval * start){
+  struct timeval now;
+  
+  gettimeofday(&now, NULL);
+  return (now.tv_sec - start->tv_sec) + (now.tv_usec - start->tv_usec)/1e6;
+}
+
+//function: report_stats
+//purpose: print how many iterations each frame of an adaptive render got,
+//         and how converged it was
+static void report_stats(frame_stats * stats, int nframes){
+  long long total = 0;
+  int t;
+  
+  for(t=0; t<nframes; t++){
+    printf("frame %d: %lld iterations in %.2f s, residual %.5f\n", t,
+           stats[t].niterations, stats[t].seconds, stats[t].residual);
+    total += stats[t].niterations;
+  }
+  printf("main: %lld iterations, %.0f per frame\n", total, 
+         (double)total/nframes);
+}
+
+//function: new_frame_counters
+//purpose: counters for nframes frames of fl, if they're being written
+//returns them, or NULL if they aren't
+static frame_counters * new_frame_counters(flame * fl, int nframes){
+  frame_counters * fc;
+  int t;
+  
+  if(counters_out == NULL)
+    return NULL;
+  fc = malloc(sizeof(frame_counters) * nframes);
+  if(fc == NULL){
+    fprintf(stderr,"new_frame_counters: out of memory. exiting...\n");
+    exit(1);
+  }
+  for(t=0; t<nframes; t++){
+    if(!init_counters(&fc[t], fl->nfunctions))
+      exit(1);
+  }
+  return fc;
+}
+
+//function: report_counters
+//purpose: write the counters from new_frame_counters() out, as frames
+//         first, first+1, ... (or genomes), and free them
+static void report_counters(frame_counters * fc, int nframes, 
+                            const char * label, int first){
+  int t;
+  
+  if(fc == NULL)
+    return;
+  for(t=0; t<nframes; t++){
+    write_counters(counters_out, counters_format, label, first + t, &fc[t]);
+    free_counters(&fc[t]);
+  }
+  fflush(counters_out);
+  free(fc);
+}
+
+#if !defined(HEADLESS)
+//function: render_for_display
+//purpose: thread that renders the animation in rp for the viewer while it
+//         plays.  every frame gets a quick pass first, so there's something
+//         to look at within seconds, and then the real render replaces them
+//         a frame at a time, showing each one's progress a batch of chunks at
+//         a time (render_params.progress).
+static void * render_for_display(void * arg){
+  render_params * rp = (render_params *)arg;
+  render_params preview = *rp;
+  
+  preview.niterations = rp->niterations / PREVIEW_DIVISOR;
+  preview.tolerance = 0.0;
+  preview.deadline = 0.0;
+  preview.stats = NULL;
+  preview.counters = NULL;
+  preview.progress = NULL;
+  preview.checkpoint_prefix = NULL; //it'd be overwritten anyway
+  if(preview.niterations > preview.miniterations && 
+     !render_frames(&preview))
+    fprintf(stderr,"render_for_display: preview failed\n");
+  
+  if(!render_frames(rp))
+    fprintf(stderr,"render_for_display: render_frames failed\n");
+  else if(rp->stats != NULL)
+    report_stats(rp->stats, rp->nframes);
+  report_counters(rp->counters, rp->nframes, "frame", 0);
+  printf("render_for_display: done\n");
+  done_rendering(view);
+  return NULL;
+}
+#endif
+
+//frame_sink for a genome: its frame 0 is written as frame <genome index>
+static int write_genome(int t, color_t * rgb, int width, int height,
+                        void * arg){
+  genome_sink * gs = (genome_sink *)arg;
+  
+  return write_frame(gs->index, rgb, width, height, gs->writer);
+}
+
+//function: genome_driver
+//purpose: thread that takes the next genome from the batch, renders it on
+//         the shared pool and writes it, until there are none left.  parsing
+//         happens under the batch's lock, rendering doesn't.
+static void * genome_driver(void * arg){
+  genome_batch * gb = (genome_batch *)arg;
+  genome g;
+  genome_sink gs;
+  render_params rp;
+  char prefix[MAXPATH];
+  frame_stats stats;
+  struct timeval start;
+  double parse, rendered;
+  int r, ok;
+  
+  for(;;){
+    pthread_mutex_lock(&gb->lock);
+    gettimeofday(&start, NULL);
+    r = next_genome(gb->gf, &g);
+    parse = seconds_since(&start);
+    gb->parse_time += parse;
+    if(r < 0)
+      gb->ok = 0; //next_genome() said why
+    pthread_mutex_unlock(&gb->lock);
+    if(r == 0)
+      break;
+    if(r < 0)
+      continue;
+    
+    gettimeofday(&start, NULL);
+    gs.index = g.index;
+    gs.writer = open_output(gb->outdir, gb->formats, g.cv.width, g.cv.height,
+                            1);
+    ok = (gs.writer != NULL);
+    if(ok){
+      rp = gb->base;
+      rp.fl = &g.fl;
+      rp.cv = &g.cv;
+      if(fast_math >= 0)
+        set_fast_math(&g.fl.vs, fast_math);
+      rp.gamma = g.gamma;
+      rp.vibrancy = g.vibrancy;
+      if(g.niterations > 0)
+        rp.niterations = g.niterations;
+      if(g.supersample > 0)
+        rp.supersample = g.supersample;
+      if(g.estimator_radius >= 0.0)
+        rp.estimator_radius = g.estimator_radius;
+      if(g.estimator_minimum >= 0.0)
+        rp.estimator_minimum = g.estimator_minimum;
+      if(g.estimator_curve >= 0.0)
+        rp.estimator_curve = g.estimator_curve;
+      //a different stream for every genome
+      rp.seed = gb->base.seed + g.index;
+      if(gb->checkpoint_dir != NULL){
+        snprintf(prefix, MAXPATH, "%s/genome_%05d_", gb->checkpoint_dir,
+                 g.index);
+        rp.checkpoint_prefix = prefix;
+      }
+      rp.sink = &write_genome;
+      rp.sink_arg = &gs;
+      rp.stats = &stats;
+      stats.residual = -1.0;
+      rp.counters = new_frame_counters(&g.fl, 1);
+      ok = render_frames(&rp);
+      ok &= close_output(gs.writer);
+    }
+    rendered = seconds_since(&start);
+    cleanup_functions(&g.fl);
+    
+    pthread_mutex_lock(&gb->lock);
+    if(gs.writer != NULL)
+      report_counters(rp.counters, 1, "genome", g.index);
+    printf("genome %d: %dx%d, parsed in %.3f ms, rendered in %.2f s",
+           g.index, g.cv.width, g.cv.height, parse*1e3, rendered);
+    if(ok && (rp.tolerance > 0.0 || rp.deadline > 0.0))
+      printf(", %lld iterations, residual %.5f", stats.niterations,
+             stats.residual);
+    printf("%s\n", ok ? "" : " (FAILED)");
+    gb->ok &= ok;
+    gb->nrendered += ok;
+    gb->render_time += rendered;
+    pthread_mutex_unlock(&gb->lock);
+  }
+  
+  return NULL;
+}
+
+//function: render_genomes
+//purpose: render every genome in the file at path to outdir, ingenomes of
+//         them at once, with base's settings where a genome doesn't have its
+//         own.  each one's checkpoints go in checkpoint_dir, if it isn't
+//         NULL.
+//returns TRUE if every genome was rendered and written, FALSE otherwise
+static int render_genomes(const char * path, render_params * base,
+                          const char * outdir, const char * checkpoint_dir,
+                          int formats, int ingenomes){
+  genome_batch gb;
+  pthread_t * drivers;
+  int i, nstarted;
+  
+  gb.gf = open_genomes(path);
+  if(gb.gf == NULL || formats == 0){
+    fprintf(stderr,"render_genomes: nothing to render. returning...\n");
+    close_genomes(gb.gf);
+    return 0;
+  }
+  gb.base = *base;
+  gb.base.nframes = 1;
+  gb.base.maxframes = 1;
+  gb.outdir = outdir;
+  gb.checkpoint_dir = checkpoint_dir;
+  gb.formats = formats;
+  gb.ok = 1;
+  gb.nrendered = 0;
+  gb.parse_time = 0.0;
+  gb.render_time = 0.0;
+  pthread_mutex_init(&gb.lock, NULL);
+  
+  //one pool for all of them
+  gb.base.pool = pool_create(base->nthreads);
+  drivers = malloc(sizeof(pthread_t) * ingenomes);
+  if(gb.base.pool == NULL || drivers == NULL){
+    fprintf(stderr,"render_genomes: out of memory. returning...\n");
+    pool_destroy(gb.base.pool);
+    free(drivers);
+    close_genomes(gb.gf);
+    return 0;
+  }
+  
+  nstarted = 0;
+  for(i=0; i<ingenomes; i++){
+    if(pthread_create(&drivers[i], NULL, genome_driver, &gb) != 0)
+      break;
+    nstarted++;
+  }
+  if(nstarted == 0){
+    fprintf(stderr,"render_genomes: pthread_create failed\n");
+    gb.ok = 0;
+  }
+  for(i=0; i<nstarted; i++){
+    pthread_join(drivers[i], NULL);
+  }
+  
+  printf("render_genomes: %d genome(s) rendered, %.3f ms parsing, "
+         "%.2f s rendering\n", gb.nrendered, gb.parse_time*1e3,
+         gb.render_time);
+  
+  free(drivers);
+  pool_destroy(gb.base.pool);
+  pthread_mutex_destroy(&gb.lock);
+  return close_genomes(gb.gf) && gb.ok;
+}
 
 //MAIN
 
 //function: main
 //purpose: runs initializations and outermost loops for rendering and display.
 //         exit status 1 on failure, 0 on success.
-int main(){
+int main(int argc, char ** argv){
 
-  int t;
+  int opt, ok;
+  struct timeval now;
+#if !defined(HEADLESS)
+  pthread_t renderer;
+#endif
+  render_params rp;
+  image_writer * writer = NULL;
+  char * outdir = NULL;
+  char * formats = OUTPUT_FORMATS;
+  char * genomes = NULL;
+  int ingenomes = GENOMES_IN_FLIGHT;
+  char * checkpoint_dir = NULL;
+  char * merged = NULL;
+  char prefix[MAXPATH];
+  const char ** remote_addrs;
+  int nremotes = 0;
+  int port = 0;
+  int compression = 0;
+  char * counters_path = NULL;
+  size_t len;
+  
+  rp.fl = &fl;
+  rp.cv = &cv;
+  rp.pool = NULL;
+  rp.nframes = NFRAMES;
+  rp.niterations = NITERATIONS;
+  rp.miniterations = MINITERATIONS;
+  rp.supersample = SUPERSAMPLE;
+  rp.estimator_radius = ESTIMATOR_RADIUS;
+  rp.estimator_minimum = ESTIMATOR_MINIMUM;
+  rp.estimator_curve = ESTIMATOR_CURVE;
+  rp.gamma = GAMMA;
+  rp.vibrancy = VIBRANCY;
+  rp.nthreads = NTHREADS;
+  rp.maxframes = MAXFRAMES;
+  rp.chunk_iterations = CHUNK_ITERATIONS;
+  rp.walk = &walk_batch;
+  rp.defer_points = DEFER_AUTO;
+  rp.tolerance = TOLERANCE;
+  rp.deadline = DEADLINE;
+  rp.stats = NULL;
+  rp.counters = NULL;
+  rp.sink = NULL;
+  rp.sink_arg = NULL;
+  rp.progress = NULL;
+  rp.progress_arg = NULL;
+  rp.checkpoint_prefix = NULL;
+  rp.checkpoint_interval = CHECKPOINT_INTERVAL;
+  rp.resume = 0;
+  
+  //unless we're told otherwise, seed with the time
+  gettimeofday(&now, NULL);
+  rp.seed = (uint64_t)now.tv_sec * 1000000 + now.tv_usec;
+
+  //every -R could be one
+  remote_addrs = malloc(sizeof(char *) * argc);
+  if(remote_addrs == NULL){
+    fprintf(stderr,"main: out of memory.  exiting...\n");
+    return 1;
+  }
+
+  //options
+  while((opt = getopt(argc, argv,
+                      "j:F:c:o:f:s:w:g:G:b:S:e:t:d:C:i:rM:W:R:z:I:A:")) != -1){
+    switch(opt){
+      case 'j':
+        rp.nthreads = atoi(optarg);
+        break;
+      case 'F':
+        rp.maxframes = atoi(optarg);
+        break;
+      case 'c':
+        rp.chunk_iterations = atoi(optarg);
+        break;
+      case 'o':
+        outdir = optarg;
+        break;
+      case 'f':
+        formats = optarg;
+        break;
+      case 's':
+        rp.seed = strtoull(optarg, NULL, 0);
+        break;
+      case 'b':
+        rp.defer_points = atoi(optarg);
+        break;
+      case 'S':
+        rp.supersample = atoi(optarg);
+        break;
+      case 'e':
+        rp.estimator_radius = atof(optarg);
+        break;
+      case 't':
+        rp.tolerance = atof(optarg);
+        break;
+      case 'd':
+        rp.deadline = atof(optarg);
+        break;
+      case 'C':
+        checkpoint_dir = optarg;
+        break;
+      case 'i':
+        rp.checkpoint_interval = atof(optarg);
+        break;
+      case 'r':
+        rp.resume = 1;
+        break;
+      case 'M':
+        merged = optarg;
+        break;
+      case 'W':
+        port = atoi(optarg);
+        break;
+      case 'R':
+        remote_addrs[nremotes++] = optarg;
+        break;
+      case 'z':
+        compression = atoi(optarg);
+        break;
+      case 'I':
+        counters_path = optarg;
+        break;
+      case 'A':
+        fast_math = (atoi(optarg) != 0);
+        break;
+      case 'g':
+        genomes = optarg;
+        break;
+      case 'G':
+        ingenomes = atoi(optarg);
+        break;
+      case 'w':
+        if(strcmp(optarg, "batch") == 0)
+          rp.walk = &walk_batch;
+        else if(strcmp(optarg, "fused") == 0)
+          rp.walk = &walk_fused;
+        else if(strcmp(optarg, "generic") == 0)
+          rp.walk = &walk; //the reference for the other two
+        else{
+          fprintf(stderr,"main: unknown walker \"%s\"\n", optarg);
+          return 1;
+        }
+        break;
+      default:
+        fprintf(stderr,"usage: %s [-j render threads] [-F frames in flight] "
+                "[-c iterations per chunk] [-b plots deferred per thread] "
+                "[-S supersample] [-e density estimation radius] "
+                "[-t convergence tolerance] [-d seconds per frame] "
+                "[-o output directory] "
+                "[-f formats, any of ppm,png,pfm] [-s random seed] "
+                "[-w walker, one of batch,fused,generic] "
+                "[-g flam3 genome file] [-G genomes in flight] "
+                "[-C checkpoint directory] [-i seconds between checkpoints] "
+                "[-r resume from checkpoints] [-R worker host:port]... "
+                "[-z worker reply compression, 0-9] "
+                "[-I counters file, .prom for Prometheus] "
+                "[-A fast approximate math, 0 or 1]\n"
+                "       %s -M merged checkpoint checkpoints...\n"
+                "       %s -W port [-w walker] [-A 0|1]\n", 
+                argv[0], argv[0], argv[0]);
+        return 1;
+    }
+  }
+  //merging checkpoints doesn't render anything
+  if(merged != NULL){
+    ok = merge_checkpoints(merged, (const char **)&argv[optind],
+                           argc - optind);
+    return ok ? 0 : 1;
+  }
+  if(checkpoint_dir != NULL){
+    snprintf(prefix, MAXPATH, "%s/frame_", checkpoint_dir);
+    rp.checkpoint_prefix = prefix;
+  }
+  if(counters_path != NULL){
+    len = strlen(counters_path);
+    if(len >= 5 && strcmp(counters_path + len - 5, ".prom") == 0)
+      counters_format = COUNTERS_PROMETHEUS;
+    counters_out = fopen(counters_path, "w");
+    if(counters_out == NULL){
+      perror(counters_path);
+      return 1;
+    }
+    write_counters_header(counters_out, counters_format);
+  }
+#if defined(HEADLESS)
+  //nowhere else for frames to go
+  if(outdir == NULL)
+    outdir = ".";
+#endif
+  //genomes are only ever written out
+  if(genomes != NULL && outdir == NULL)
+    outdir = ".";
+  if(ingenomes < 1)
+    ingenomes = 1;
+  //a connection per worker unless we're told otherwise: threads here just
+  //wait for them
+  if(rp.nthreads <= 0 && nremotes > 0)
+    rp.nthreads = nremotes;
+  if(rp.nthreads <= 0)
+    rp.nthreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  if(rp.nthreads <= 0)
+    rp.nthreads = 1;
+  
+  printf("main: rendering with %d thread(s), %s walker, %s seed %llu\n",
+         rp.nthreads, rp.walk == &walk_batch ? "batch" :
+         rp.walk == &walk_fused ? "fused" : "generic", rng_name(),
+         (unsigned long long)rp.seed);
 
   //initializations
 
+  if(genomes != NULL){
+    //each genome brings its own flame, canvas and palette
+    if(!init_histograms()){
+      fprintf(stderr,"main: init_histograms failed.  exiting...\n");
+      return 1;
+    }
+    rp.fl = NULL;
+    rp.cv = NULL;
+    ok = render_genomes(genomes, &rp, outdir, checkpoint_dir,
+                        parse_formats(formats), ingenomes);
+    if(counters_out != NULL)
+      ok &= (fclose(counters_out) == 0);
+    master_cleanup();  //from global.c
+    return ok ? 0 : 1;
+  }
+
   printf("main: before function initialization\n"); 
 
-  if(!init_functions(NFRAMES)){
+  if(!init_functions(&fl, NFRAMES)){
     fprintf(stderr,"main: init_functions failed.  exiting...\n");
     return 1;
   }
+  fl_ready = 1;
+  if(fast_math >= 0)
+    set_fast_math(&fl.vs, fast_math);
   
   printf("main: past function initialization\n");
   
-  if(!init_display(WINW, WINH, MINV, MINV, RANGE, RANGE, NFRAMES, FRAME_PERIOD)){
-    fprintf(stderr,"main: init_display failed.  exiting...\n");
+  if(!init_histograms() || 
+     !init_canvas(&cv, WINW, WINH, MINV, MINV, RANGE, RANGE)){
+    fprintf(stderr,"main: init_histograms failed.  exiting...\n");
     return 1;
   }
   
+  if(port > 0){
+    //walk chunks for coordinators until we're killed
+    serve_remote(port, &fl, rp.walk);
+    master_cleanup();  //from global.c
+    return 1;
+  }
+  if(nremotes > 0){
+    if(!open_remotes(remote_addrs, nremotes, rp.nthreads,
+                     compression)){
+      fprintf(stderr,"main: couldn't reach any workers.  exiting...\n");
+      return 1;
+    }
+    rp.walk = &walk_remote;
+  }
+  
+  if(outdir != NULL){
+    //frames go to files via the writer thread
+    writer = open_output(outdir, parse_formats(formats), WINW, WINH, 
+                         OUTPUT_QUEUE);
+    if(writer == NULL){
+      fprintf(stderr,"main: open_output failed.  exiting...\n");
+      return 1;
+    }
+    rp.sink = &write_frame; //from output.c
+    rp.sink_arg = writer;
+  }
+#if !defined(HEADLESS)
+  else{
+    view = init_display(WINW, WINH, NFRAMES, FRAME_PERIOD);
+    if(view == NULL){
+      fprintf(stderr,"main: init_display failed.  exiting...\n");
+      return 1;
+    }
+    rp.sink = &store_frame; //from display.c
+    rp.sink_arg = view;
+    rp.progress = &store_frame;
+    rp.progress_arg = view;
+  }
+#endif
+  
   printf("main: past display initialization\n");
   
   //rendering
   
-  //render frames
-  for(t=0; t<NFRAMES; t++){    
-    //start rendering loop for the tth frame
-    render(NITERATIONS, MINITERATIONS, get_weight_vector_len(), t);
+  if(rp.tolerance > 0.0 || rp.deadline > 0.0){
+    rp.stats = calloc(NFRAMES, sizeof(frame_stats));
+    if(rp.stats == NULL){
+      fprintf(stderr,"main: out of memory.  exiting...\n");
+      return 1;
+    }
   }
+  rp.counters = new_frame_counters(&fl, NFRAMES);
   
-  printf("main: past rendering loops\n");
-  
-  //display
+#if !defined(HEADLESS)
+  if(outdir == NULL){
+    //the display plays frames as they come in, while they're rendered
+    if(pthread_create(&renderer, NULL, render_for_display, &rp) != 0){
+      fprintf(stderr,"main: pthread_create failed.  exiting...\n");
+      return 1;
+    }
+    
+    //start display loop
+    start_display(view);
+    
+    //cleanup (these will never actually get called here unless the 
+    //glutMainLoop call somehow fails)
+    pthread_join(renderer, NULL);
+    master_cleanup();  //from global.c
+    return 1;
+  }
+#endif
   
-  //start display loop
-  start_display(GAMMA, VIBRANCY);
+  //render frames, as many at once as the pool can handle.  they're tone
+  //mapped and handed to the writer as they finish.
+  ok = render_frames(&rp);
+  if(ok && rp.stats != NULL){
+    report_stats(rp.stats, NFRAMES);
+    free(rp.stats);
+  }
+  report_counters(rp.counters, NFRAMES, "frame", 0);
+  if(counters_out != NULL)
+    ok &= (fclose(counters_out) == 0);
   
-  //cleanup (these will never actually get called here unless the glutMainLoop 
-  //call somehow fails)
+  //wait for the writer to catch up
+  ok &= close_output(writer);
+  close_remotes();
+  free(remote_addrs);
   master_cleanup();  //from global.c
-  
-  return 1;
+  return ok ? 0 : 1;
 }
 
 //DESTRUCTOR
 
 //function: cleanup_engine
-//purpose: doesn't do much at the moment.  will make more sense when this file
-//         no longer has main().
+//purpose: free the flame and the display.  will make more sense when this
+//         file no longer has main().
 extern int cleanup_engine(){
-  return 1;
-}
-
-//RENDERING FUNCTIONS
-
-//function: render
-//purpose: render a single fractal flame image using Draves' random walk loop.
-//         functions and display need to be initialized before this is called.
-//params: niterations - number of times to run the random walk.  the more the 
-//        better, generally, if you have time to kill.
-//        miniterations - minimum number of times the random walk must be run 
-//        before its results can be considered meaningful and plotted.  systems
-//        are supposed to be "contractive on average," so I guess this makes 
-//        sense as a mechanism for getting within a reasonable range.
-//        vector_len - floating-point length of the vector used to randomly
-//        select a function to run.
-//        t - frame number in animation.  just need this to tell display's 
-//        plot() where to put image data in array of frames.
-int render(int niterations, int miniterations, float vector_len, int t){
-
-  int i,outside;
-  float vector_pos;
-
-  coords p;
-  float c, ci, cfinal, cf;
-  struct timeval now; 
-  
-  if(niterations <= miniterations){
-    fprintf(stderr,"render: Rendering won't work unless n > %d. returning...\n", 
-            miniterations);
-    return 0; //return FALSE  
-  }
-  
-  //seed the random number generator with the time
-  gettimeofday(&now, NULL);
-  srand(now.tv_usec * now.tv_sec);
-  
-  //fill vars with random values
-  p.x = (coord_t)RANDU;
-  p.y = (coord_t)RANDU;
-  c = (float)RANDD;
-  
-  //initialize count of points outside the range the algorithm attempts to plot
-  outside = 0;
-  
-  //set current frame in animation
-  set_frame(t);
-  //MAIN LOOP
-  for(i=0; i<niterations; i++){
-#if defined(DEBUG)
-    fprintf(stderr,"render: top of main loop.  p:(%LG,%LG)\n",p.x,p.y);
-#endif
-    //get random function index
-    vector_pos = RANDD; //between 0.0 and 1.0
-    vector_pos = vector_len*vector_pos; //between 0.0 and vector_len 
-    
-    //comments follow steps in loop outline on p.9 in Draves' paper
-    
-    //p = Fi(p) (run initial linear transformation)
-#if defined(DEBUG)
-    fprintf(stderr,"render: about to call run_function\n");
-#endif
-    run_function(vector_pos, &p, &ci);
-    
-    //c = (c + ci)/2 (average color index with current function's color index)
-    c = (c + ci)/2.0;
-    
-    //pf=Ffinal(p) (run final linear transformation)
-#if defined(DEBUG)
-    fprintf(stderr,"render: about to call run_function\n");
-#endif
-    run_final(&p, &cfinal);
-    
-    //cf = (c + cfinal)/2; (average color index with final function's color
-    //                      index)
-    cf = (c + cfinal)/2.0;
- 
-    //plot (pf,cf) to image except during the first MINITERATIONS iterations
-    if(i >= miniterations){
-#if defined(DEBUG)
-      fprintf(stderr,"render: calling plot on (%LG, %LG, %G)\n", p.x, p.y, cf);
-#endif
-      //attempt to plot the current point with the current color.
-      //increment out-of-range plot attempt count if point is out of range for
-      //display.  again, since systems are "contractive on average" this happens
-      //sometimes and shouldn't be considered a problem, but if this number 
-      //grows significant relative to the total number of plot attempts, image
-      //quality and detail will suffer.
-      //TODO: figure out a way to quantify that and check it...
-      if(!plot(&p, &cf, t))
-        outside++;
-    }
-  }
+  int ret = 1;
   
-  //printf("render: rendering complete.  %d/%d points were outside the range\n",
-  //       outside, niterations-miniterations);
+  if(fl_ready)
+    ret &= cleanup_functions(&fl);  //calls cleanup_variations()
+  fl_ready = 0;
+#if !defined(HEADLESS)
+  ret &= cleanup_display(view);
+  view = NULL;
+#endif
   
-
-  return 0;
-
+  return ret;
 }
+
@@ -0,0 +1,304 @@
+/* Author: Ted Cooper
+ * Last revised: 7-2-2009
+ * FRACTAL FLAME RENDERER
+ * See top of engine.c for program description.
+ *
+ * fastmath.h: approximate sin, cos, 1/sqrt, log2 and exp2 for the
+ * variations' fast math mode (set_fast_math(), engine -A).  the chaos game
+ * only needs the density of the points it plots, so the variations can trade
+ * libm's last few bits for a polynomial with no calls or branches in it,
+ * which the batched variations' loops can also vectorize.  tone mapping
+ * (tonemap.c) always uses fast_powf(), for the same reason.
+ *
+ * everything is done in float in float builds, and in double otherwise (long
+ * double is converted).  worst errors, measured against libm over the ranges
+ * given (bench -a compares whole variations):
+ *
+ *   fast_sin, fast_cos  3e-9 absolute for |x| <= 2^20, 6e-8 to 2^30.  float:
+ *                       8e-8 for |x| <= 2^12, 1e-6 to 2^16.  past that the
+ *                       range reduction runs out of bits, and the results
+ *                       are still in [-1, 1] but mean nothing.  past
+ *                       2^(mant-1), and at infinity, they're 0 and 1.  nan
+ *                       gives nan.
+ *   fast_rsqrt          x > 0 and normal: 4.7e-6 relative.  0 gives a large
+ *                       finite number, so fast_sqrt(0) is 0.
+ *   fast_sqrt           the same, 4.7e-6 relative.
+ *   fast_log2           x > 0 and normal: 1.1e-9 absolute (float: 4e-6,
+ *                       half an ulp of log2 x near 100).  0 comes out
+ *                       -BIAS.
+ *   fast_exp2           y in [-(BIAS-1), BIAS]: 7e-9 relative (float: 1e-7).
+ *                       clamped to that range, so there's no infinity.
+ *   fast_pow            exp2(y log2 x), so its relative error grows with
+ *                       |y log2 x|: log2's error times |y| ln 2, plus exp2's.
+ *   fast_log2f, etc.    log2, exp2 and pow in float whatever the build,
+ *                       with the float errors above.
+ *
+ * no omp pragmas in here: it's included by files built without -fopenmp-simd,
+ * and static inline functions get inlined into the loops anyway.
+ */
+
+#ifndef FASTMATH_H
+#define FASTMATH_H
+
+#include <stdint.h>
+#include <math.h>
+#include "global.h"
+
+//TYPES
+
+//the bits of the float and double formats: mantissa width, exponent bias,
+//1.5 * 2^mant (adding it rounds to an integer, which lands in the low
+//bits), and sqrt(2)'s mantissa
+#define FAST_F_MANT 23
+#define FAST_F_BIAS 127
+#define FAST_F_ROUND 12582912.0f
+#define FAST_F_ROUND_BITS 0x4b400000
+#define FAST_F_SQRT2_MANT 0x003504f3
+#define FAST_D_MANT 52
+#define FAST_D_BIAS 1023
+#define FAST_D_ROUND 6755399441055744.0
+#define FAST_D_ROUND_BITS 0x4338000000000000LL
+#define FAST_D_SQRT2_MANT 0x6a09e667f3bcdLL
+
+//the precision the approximations work in, integers the same size, that
+//format's bits as above, and the magic constant for 1/sqrt's first guess
+#if defined(PRECISION_FLOAT)
+typedef float fast_t;
+typedef int32_t fast_int;
+typedef uint32_t fast_uint;
+#define FAST_MANT FAST_F_MANT
+#define FAST_BIAS FAST_F_BIAS
+#define FAST_ROUND FAST_F_ROUND
+#define FAST_ROUND_BITS FAST_F_ROUND_BITS
+#define FAST_SQRT2_MANT FAST_F_SQRT2_MANT
+#define FAST_RSQRT_MAGIC 0x5f3759df
+//pi/2 in three parts, each short enough that k times it is exact
+#define FAST_HUGE 4194304.0f
+#define FAST_PIO2_1 1.5703125f
+#define FAST_PIO2_2 4.837512969970703125e-4f
+#define FAST_PIO2_3 7.54978995489188216e-8f
+#else
+typedef double fast_t;
+typedef int64_t fast_int;
+typedef uint64_t fast_uint;
+#define FAST_MANT FAST_D_MANT
+#define FAST_BIAS FAST_D_BIAS
+#define FAST_ROUND FAST_D_ROUND
+#define FAST_ROUND_BITS FAST_D_ROUND_BITS
+#define FAST_SQRT2_MANT FAST_D_SQRT2_MANT
+#define FAST_RSQRT_MAGIC 0x5fe6eb50c7b537a9LL
+#define FAST_HUGE 2251799813685248.0
+#define FAST_PIO2_1 1.57079632673412561417e+00
+#define FAST_PIO2_2 6.07710050630396597660e-11
+#define FAST_PIO2_3 2.02226624879595063154e-21
+#endif
+
+typedef union {
+  fast_t f;
+  fast_int i;
+} fast_bits;
+
+//FUNCTIONS
+
+//fast_select, fast_log2, fast_exp2 and fast_pow in type T, with the
+//integers I and U the same size and format F's bits (FAST_F or FAST_D), named
+//with suffix S.  written once for both, since tone mapping (tonemap.c) wants
+//them in float whatever the variations' precision.  the functions are:
+//
+//function: fast_select
+//purpose: a if b < c, else d (also d if b - c is a positive nan, as x86
+//         makes it when c is nan), from the sign of b - c with bit masks.
+//         gcc turns a ?: into a branch when it can fold what follows for one
+//         side, and then won't vectorize the loop.
+//
+//function: fast_log2
+//purpose: log2(x): the exponent, plus the mantissa's log from a series in
+//         atanh.  x = m * 2^e with m in [sqrt(1/2), sqrt(2)), k being
+//         whether the mantissa is past sqrt(2).  e goes to floating point
+//         through ROUND's low bits rather than a conversion, which SSE2 has
+//         no vector instruction for in double.  log(m) = 2 atanh(t) with
+//         |t| <= 0.172.
+//
+//function: fast_exp2
+//purpose: 2^y, y clamped to [-(BIAS-1), BIAS]: 2^i * 2^f with i the nearest
+//         integer and f in [-1/2, 1/2], and 2^f from the taylor series of
+//         e^(f ln 2).
+//
+//function: fast_pow
+//purpose: x^y for x >= 0
+#define FAST_LOG_EXP(S, T, I, U, F)                                          \
+  static inline T fast_select##S(T a, T b, T c, T d){                        \
+    union { T f; I i; } ub, va, wd;                                          \
+    I mask;                                                                  \
+                                                                             \
+    ub.f = b - c;                                                            \
+    mask = -(I)((U)ub.i >> (8*sizeof(T) - 1));                               \
+    va.f = a;                                                                \
+    wd.f = d;                                                                \
+    va.i = (va.i & mask) | (wd.i & ~mask);                                   \
+    return va.f;                                                             \
+  }                                                                          \
+                                                                             \
+  static inline T fast_log2##S(T x){                                         \
+    const I mant = ((I)1 << F##_MANT) - 1;                                   \
+    union { T f; I i; } ux, ve;                                              \
+    T e, m, tt, t2, p;                                                       \
+    I k;                                                                     \
+                                                                             \
+    ux.f = x;                                                                \
+    k = ((ux.i & mant) + (mant - F##_SQRT2_MANT)) >> F##_MANT;               \
+    ve.i = F##_ROUND_BITS + ((ux.i >> F##_MANT) & (2*F##_BIAS + 1)) + k;     \
+    e = (ve.f - F##_ROUND) - (T)F##_BIAS;                                    \
+    ux.i = (ux.i & mant) | (((I)F##_BIAS - k) << F##_MANT);                  \
+    m = ux.f;                                                                \
+                                                                             \
+    tt = (m - (T)1.0)/(m + (T)1.0);                                          \
+    t2 = tt*tt;                                                              \
+    p = (T)(1.0/9.0);                                                        \
+    p = p*t2 + (T)(1.0/7.0);                                                 \
+    p = p*t2 + (T)(1.0/5.0);                                                 \
+    p = p*t2 + (T)(1.0/3.0);                                                 \
+    p = p*t2 + (T)1.0;                                                       \
+    return e + (T)2.8853900817779268*tt*p; /* 2/ln(2) */                     \
+  }                                                                          \
+                                                                             \
+  static inline T fast_exp2##S(T y){                                         \
+    union { T f; I i; } uy;                                                  \
+    T fr, p;                                                                 \
+                                                                             \
+    y = fast_select##S((T)F##_BIAS, (T)F##_BIAS, y, y);                      \
+    y = fast_select##S((T)(1 - F##_BIAS), y, (T)(1 - F##_BIAS), y);          \
+                                                                             \
+    uy.f = y + F##_ROUND;                                                    \
+    fr = y - (uy.f - F##_ROUND);                                             \
+                                                                             \
+    p = (T)1.5252733804059841e-5;                                            \
+    p = p*fr + (T)1.5403530393381610e-4;                                     \
+    p = p*fr + (T)1.3333558146428443e-3;                                     \
+    p = p*fr + (T)9.6181291076284772e-3;                                     \
+    p = p*fr + (T)5.5504108664821580e-2;                                     \
+    p = p*fr + (T)2.4022650695910071e-1;                                     \
+    p = p*fr + (T)6.9314718055994531e-1;                                     \
+    p = p*fr + (T)1.0;                                                       \
+                                                                             \
+    uy.i = (uy.i - F##_ROUND_BITS + F##_BIAS) << F##_MANT;                   \
+    return p*uy.f;                                                           \
+  }                                                                          \
+                                                                             \
+  static inline T fast_pow##S(T x, T y){                                     \
+    return fast_exp2##S(y*fast_log2##S(x));                                  \
+  }
+
+//in coordinates' precision, and in float as fast_selectf() etc.
+#if defined(PRECISION_FLOAT)
+FAST_LOG_EXP(, float, int32_t, uint32_t, FAST_F)
+#else
+FAST_LOG_EXP(, double, int64_t, uint64_t, FAST_D)
+#endif
+FAST_LOG_EXP(f, float, int32_t, uint32_t, FAST_F)
+
+//function: fast_sincos
+//purpose: sin(x) into s and cos(x) into c, from one range reduction.  see
+//         the top of the file for the error.
+static inline void fast_sincos(fast_t x, fast_t * s, fast_t * c){
+  fast_t k, h, odd, neg, r, z, ps, pc;
+
+  //x = k pi/2 + r with r in [-pi/4, pi/4], or a little past where rounding
+  //x 2/pi goes the other way, which the polynomials still cover
+  k = (x*(fast_t)M_2_PI + FAST_ROUND) - FAST_ROUND;
+  r = ((x - k*FAST_PIO2_1) - k*FAST_PIO2_2) - k*FAST_PIO2_3;
+
+  //k's two low bits, the quadrant, as 0 or 1 each: floor(k/2) is the
+  //nearest integer to k/2 - 1/4.  this is all floating point because gcc
+  //won't vectorize a loop with integer selects in it.
+  h = (k*(fast_t)0.5 - (fast_t)0.25 + FAST_ROUND) - FAST_ROUND;
+  odd = k - (fast_t)2.0*h;
+  k = (h*(fast_t)0.5 - (fast_t)0.25 + FAST_ROUND) - FAST_ROUND;
+  neg = h - (fast_t)2.0*k;
+
+  //cephes' minimax polynomials for [-pi/4, pi/4]
+  z = r*r;
+  ps = (fast_t)-1.9515295891e-4;
+  ps = ps*z + (fast_t)8.3321608736e-3;
+  ps = ps*z - (fast_t)1.6666654611e-1;
+  ps = ps*z*r + r;
+  pc = (fast_t)2.443315711809948e-5;
+  pc = pc*z - (fast_t)1.388731625493765e-3;
+  pc = pc*z + (fast_t)4.166664568298827e-2;
+  pc = pc*z*z - (fast_t)0.5*z + (fast_t)1.0;
+
+  //sin(r + k pi/2) is sin r, cos r, -sin r, -cos r by quadrant, and cos
+  //is a quadrant behind.  multiplying by exactly 0 and 1 picks one.
+  *s = ((fast_t)1.0 - (fast_t)2.0*neg)*(ps*((fast_t)1.0 - odd) + pc*odd);
+  neg = neg + odd - (fast_t)2.0*neg*odd;
+  *c = ((fast_t)1.0 - (fast_t)2.0*neg)*(pc*((fast_t)1.0 - odd) + ps*odd);
+
+  //past 2^(mant-1), k has no bits below the point to give the quadrant
+  *s = fast_select((fast_t)0.0, FAST_HUGE, fabs(x), *s);
+  *c = fast_select((fast_t)1.0, FAST_HUGE, fabs(x), *c);
+}
+
+//function: fast_sin
+static inline fast_t fast_sin(fast_t x){
+  fast_t s, c;
+  fast_sincos(x, &s, &c);
+  return s;
+}
+
+//function: fast_cos
+static inline fast_t fast_cos(fast_t x){
+  fast_t s, c;
+  fast_sincos(x, &s, &c);
+  return c;
+}
+
+//function: fast_rsqrt
+//purpose: 1/sqrt(x): a first guess from the bits, then two newton steps
+static inline fast_t fast_rsqrt(fast_t x){
+  fast_bits u;
+  fast_t y;
+
+  u.f = x;
+  u.i = FAST_RSQRT_MAGIC - (u.i >> 1);
+  y = u.f;
+  y = y*((fast_t)1.5 - (fast_t)0.5*x*y*y);
+  y = y*((fast_t)1.5 - (fast_t)0.5*x*y*y);
+  return y;
+}
+
+//function: fast_sqrt
+static inline fast_t fast_sqrt(fast_t x){
+  return x*fast_rsqrt(x);
+}
+
+//libm's function, or the approximation if fast is TRUE, in coord_t.  fast
+//is usually a constant or hoisted out of a loop, so there's only the one.
+#define FAST_SIN(fast,x) \
+  ((fast) ? (coord_t)fast_sin((fast_t)(x)) : COORD_SIN(x))
+#define FAST_COS(fast,x) \
+  ((fast) ? (coord_t)fast_cos((fast_t)(x)) : COORD_COS(x))
+#define FAST_SQRT(fast,x) \
+  ((fast) ? (coord_t)fast_sqrt((fast_t)(x)) : COORD_SQRT(x))
+#define FAST_RSQRT(fast,x) \
+  ((fast) ? (coord_t)fast_rsqrt((fast_t)(x)) : (coord_t)1.0/COORD_SQRT(x))
+#define FAST_EXP(fast,x) \
+  ((fast) ? (coord_t)fast_exp2((fast_t)(x)*(fast_t)M_LOG2E) : COORD_EXP(x))
+#define FAST_POW(fast,x,y) \
+  ((fast) ? (coord_t)fast_pow((fast_t)(x), (fast_t)(y)) : COORD_POW(x, y))
+
+//sin(x) into s and cos(x) into c (coord_t lvalues)
+#define FAST_SINCOS(fast,x,s,c)                                            \
+  do{                                                                      \
+    fast_t fast_s_, fast_c_;                                               \
+    if(fast){                                                              \
+      fast_sincos((fast_t)(x), &fast_s_, &fast_c_);                        \
+      (s) = (coord_t)fast_s_;                                              \
+      (c) = (coord_t)fast_c_;                                              \
+    }                                                                      \
+    else{                                                                  \
+      (s) = COORD_SIN(x);                                                  \
+      (c) = COORD_COS(x);                                                  \
+    }                                                                      \
+  }while(0)
+
+#endif
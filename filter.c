@@ -0,0 +1,377 @@
+/* Author: Ted Cooper
+ * Last revised: 7-2-2009
+ * FRACTAL FLAME RENDERER
+ * See top of engine.c for program description.
+ *
+ * filter.c: turns a finished frame's histogram into the image-sized buffer
+ * tonemap.c maps, filtering and downsampling it on the way.
+ *
+ * histograms can be supersampled: ss*ss histogram pixels per output pixel,
+ * which get summed.  that's the anti-aliasing, and it gives the density
+ * estimation filter (see de_filter in filter.h) finer pixels to spread.  a
+ * frame needs far fewer iterations for the same noise with the filter on,
+ * because sparse pixels that would be speckles are spread into smooth
+ * gradients.
+ *
+ * the filter works one tile of output pixels at a time, and every pixel is
+ * written by exactly one tile, so tiles can be filtered on any number of
+ * threads at once with the same result.  the histogram pixels around a tile
+ * that can reach it are sorted by kernel, and then each kernel's pixels are
+ * spread in two 1D passes: along their rows into the tile's scratch rows,
+ * then down its columns, which costs 2*(2r+1) multiply-adds per pixel
+ * instead of (2r+1)^2.  dense pixels have the 1-tap kernel and skip both.
+ */
+
+//INCLUDES
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "global.h"
+#include "histogram.h"
+#include "filter.h"
+
+//FUNCTIONS
+
+//private
+
+//function: kernel_for
+//purpose: which of f's kernels a histogram pixel plotted count times gets
+static int kernel_for(double count, double max_radius, double min_radius,
+                      double curve, int nkernels){
+  double r = max_radius / pow(count, curve);
+  int k;
+
+  if(r < min_radius)
+    r = min_radius;
+  k = (int)(r/DE_STEP + 0.5);
+  return (k >= nkernels ? nkernels-1 : k);
+}
+
+//function: kernel_at
+//purpose: the kernel for a pixel plotted count times
+static inline int kernel_at(de_filter * f, plotcount_t count){
+  return f->kernel_of[count < f->ndensities ? count : f->ndensities-1];
+}
+
+//function: filter_tile
+//purpose: filter and downsample output pixels [x0,x1) x [y0,y1) from h into
+//         out.  they're overwritten; nothing else in out is touched.
+//returns the largest of max and the tile's counts
+static float filter_tile(de_filter * f, histogram * h, de_pixel * out,
+                         int width, int x0, int y0, int x1, int y1,
+                         de_scratch * s, float max){
+  int ss = f->ss, R = f->maxhalfwidth;
+  int W = get_width(h), H = get_height(h);
+  int X0 = x0*ss, X1 = x1*ss, Y0 = y0*ss, Y1 = y1*ss;
+  int tw = X1 - X0;
+  int sx0, sy0, sx1, sy1, rw;
+  int x, y, X, Y, i, j, k, hw, row, lo, hi, dy;
+  float * w, * t, * a;
+  pixel_sum b;
+  de_pixel * o;
+
+  for(y=y0; y<y1; y++){
+    memset(&out[y*width + x0], 0, sizeof(de_pixel) * (x1-x0));
+  }
+
+  //the histogram pixels that the widest kernel could reach the tile from
+  sx0 = (X0 - R < 0 ? 0 : X0 - R);
+  sy0 = (Y0 - R < 0 ? 0 : Y0 - R);
+  sx1 = (X1 + R > W ? W : X1 + R);
+  sy1 = (Y1 + R > H ? H : Y1 + R);
+  rw = sx1 - sx0;
+
+  //counting sort them by kernel, leaving out the empty ones and the ones
+  //whose own kernel doesn't reach
+  memset(s->starts, 0, sizeof(int) * (f->nkernels+1));
+  for(Y=sy0; Y<sy1; Y++){
+    for(X=sx0; X<sx1; X++){
+      i = (Y-sy0)*rw + X-sx0;
+      s->kernel[i] = 255;
+      b = read_bucket(h, X, Y);
+      if(b.count == 0)
+        continue;
+      k = kernel_at(f, b.count);
+      hw = f->halfwidth[k];
+      if(X < X0-hw || X >= X1+hw || Y < Y0-hw || Y >= Y1+hw)
+        continue;
+      s->kernel[i] = k;
+      s->starts[k+1]++;
+    }
+  }
+  for(k=0; k<f->nkernels; k++){
+    s->starts[k+1] += s->starts[k];
+  }
+  for(i=0; i<(sy1-sy0)*rw; i++){
+    if(s->kernel[i] != 255)
+      s->pixels[s->starts[s->kernel[i]]++] = i;
+  }
+  //the placing moved every start up to the next one's
+  for(k=f->nkernels; k>0; k--){
+    s->starts[k] = s->starts[k-1];
+  }
+  s->starts[0] = 0;
+
+  //1 tap: straight into the output pixel
+  for(j=s->starts[0]; j<s->starts[1]; j++){
+    X = sx0 + s->pixels[j] % rw;
+    Y = sy0 + s->pixels[j] / rw;
+    b = read_bucket(h, X, Y);
+    o = &out[(Y/ss)*width + X/ss];
+    o->count += b.count;
+    o->r += b.r;
+    o->g += b.g;
+    o->b += b.b;
+  }
+
+  for(k=1; k<f->nkernels; k++){
+    if(s->starts[k] == s->starts[k+1])
+      continue;
+    hw = f->halfwidth[k];
+    w = f->weights[k];
+
+    //along the rows.  scratch row 0 is histogram row Y0-R.
+    for(j=s->starts[k]; j<s->starts[k+1]; j++){
+      X = sx0 + s->pixels[j] % rw;
+      Y = sy0 + s->pixels[j] / rw;
+      b = read_bucket(h, X, Y);
+      row = Y - (Y0 - R);
+      lo = (X - hw < X0 ? X0 : X - hw);
+      hi = (X + hw >= X1 ? X1 - 1 : X + hw);
+      t = &s->tmp[4*row*tw];
+      for(x=lo; x<=hi; x++){
+        t[4*(x-X0)]   += w[x-X] * b.count;
+        t[4*(x-X0)+1] += w[x-X] * b.r;
+        t[4*(x-X0)+2] += w[x-X] * b.g;
+        t[4*(x-X0)+3] += w[x-X] * b.b;
+      }
+      if(lo-X0 < s->lo[row])
+        s->lo[row] = lo-X0;
+      if(hi-X0 > s->hi[row])
+        s->hi[row] = hi-X0;
+    }
+
+    //down the columns, one histogram row of the tile at a time, and into
+    //the output pixels it's part of
+    a = s->acc;
+    for(Y=Y0; Y<Y1; Y++){
+      lo = tw;
+      hi = -1;
+      for(dy=-hw; dy<=hw; dy++){
+        row = Y + dy - (Y0 - R);
+        if(s->hi[row] < s->lo[row])
+          continue;
+        t = &s->tmp[4*row*tw];
+        for(i=4*s->lo[row]; i<4*(s->hi[row]+1); i++){
+          a[i] += w[dy] * t[i];
+        }
+        if(s->lo[row] < lo)
+          lo = s->lo[row];
+        if(s->hi[row] > hi)
+          hi = s->hi[row];
+      }
+      o = &out[(Y/ss)*width];
+      for(x=lo; x<=hi; x++){
+        o[(X0+x)/ss].count += a[4*x];
+        o[(X0+x)/ss].r += a[4*x+1];
+        o[(X0+x)/ss].g += a[4*x+2];
+        o[(X0+x)/ss].b += a[4*x+3];
+      }
+      if(hi >= lo)
+        memset(&a[4*lo], 0, sizeof(float) * 4 * (hi-lo+1));
+    }
+
+    //leave the scratch rows zeroed for the next kernel
+    for(row=0; row<Y1-Y0+2*R; row++){
+      if(s->hi[row] >= s->lo[row])
+        memset(&s->tmp[4*(row*tw + s->lo[row])], 0,
+               sizeof(float) * 4 * (s->hi[row] - s->lo[row] + 1));
+      s->lo[row] = tw;
+      s->hi[row] = -1;
+    }
+  }
+
+  //while the tile is still in cache
+  for(y=y0; y<y1; y++){
+    for(x=x0; x<x1; x++){
+      max = (out[y*width + x].count > max ? out[y*width + x].count : max);
+    }
+  }
+  return max;
+}
+
+//public
+
+//function: new_de_filter
+//purpose: precompute the kernels for density estimation of histograms
+//         supersampled ss times.  a max_radius of 0 leaves the filter with
+//         only the 1-tap kernel, so it just downsamples, and a curve of 0
+//         blurs everything the same.
+//params: max_radius - radius of a pixel plotted once, in output pixels.
+//                     flam3's estimator_radius, usually ~9.
+//        min_radius - smallest radius, in output pixels (estimator_minimum)
+//        curve - how fast the radius shrinks with count (estimator_curve,
+//                usually ~0.4)
+//returns the filter on success, NULL on failure
+extern de_filter * new_de_filter(float max_radius, float min_radius,
+                                 float curve, int ss){
+  de_filter * f;
+  double maxr, minr, r, sigma, sum;
+  int k, c, d, hw;
+
+  if(ss < 1 || max_radius < 0.0 || min_radius < 0.0 || curve < 0.0){
+    fprintf(stderr,"new_de_filter: bad parameters. returning...\n");
+    return NULL;
+  }
+  maxr = max_radius * ss;
+  minr = min_radius * ss;
+  if(maxr > DE_MAX_RADIUS)
+    maxr = DE_MAX_RADIUS;
+  if(minr > maxr)
+    minr = maxr;
+
+  f = calloc(1, sizeof(de_filter));
+  if(f == NULL)
+    return NULL;
+  f->ss = ss;
+  f->nkernels = (int)(maxr/DE_STEP + 0.5) + 1;
+  f->halfwidth = calloc(f->nkernels, sizeof(int));
+  f->weights = calloc(f->nkernels, sizeof(float *));
+  f->kernel_of = calloc(DE_MAX_DENSITY, 1);
+  if(f->halfwidth == NULL || f->weights == NULL || f->kernel_of == NULL){
+    free_de_filter(f);
+    return NULL;
+  }
+
+  //a truncated gaussian per radius, with the radius at two sigmas
+  for(k=0; k<f->nkernels; k++){
+    r = k*DE_STEP;
+    hw = (int)ceil(r);
+    f->halfwidth[k] = hw;
+    if(hw > f->maxhalfwidth)
+      f->maxhalfwidth = hw;
+    f->weights[k] = malloc(sizeof(float) * (2*hw+1));
+    if(f->weights[k] == NULL){
+      free_de_filter(f);
+      return NULL;
+    }
+    f->weights[k] += hw;
+    if(hw == 0){
+      f->weights[k][0] = 1.0;
+      continue;
+    }
+    sigma = r/2.0;
+    sum = 0.0;
+    for(d=-hw; d<=hw; d++){
+      sum += exp(-d*d/(2.0*sigma*sigma));
+    }
+    for(d=-hw; d<=hw; d++){
+      f->weights[k][d] = exp(-d*d/(2.0*sigma*sigma))/sum;
+    }
+  }
+
+  //the kernel bank, by count, up to where the radius bottoms out
+  f->kernel_of[0] = 0;
+  f->ndensities = DE_MAX_DENSITY;
+  for(c=1; c<DE_MAX_DENSITY; c++){
+    f->kernel_of[c] = kernel_for(c, maxr, minr, curve, f->nkernels);
+    if(f->kernel_of[c] == kernel_for(1e30, maxr, minr, curve, f->nkernels)){
+      f->ndensities = c+1;
+      break;
+    }
+  }
+
+  return f;
+}
+
+//function: free_de_filter
+//purpose: free a filter from new_de_filter()
+extern int free_de_filter(de_filter * f){
+  int k;
+
+  if(f == NULL)
+    return 1;
+  if(f->weights != NULL){
+    for(k=0; k<f->nkernels; k++){
+      if(f->weights[k] != NULL)
+        free(f->weights[k] - f->halfwidth[k]);
+    }
+  }
+  free(f->weights);
+  free(f->halfwidth);
+  free(f->kernel_of);
+  free(f);
+  return 1;
+}
+
+//function: new_de_scratch
+//purpose: working space for one thread to run filter_band() with f
+//returns the scratch on success, NULL on failure
+extern de_scratch * new_de_scratch(de_filter * f){
+  int R = f->maxhalfwidth;
+  int tw = DE_TILE_WIDTH * f->ss, th = DE_TILE_HEIGHT * f->ss;
+  int rows = th + 2*R, region = (tw + 2*R) * (th + 2*R);
+  de_scratch * s = calloc(1, sizeof(de_scratch));
+  int i;
+
+  if(s == NULL)
+    return NULL;
+  s->tmp = calloc((size_t)4 * rows * tw, sizeof(float));
+  s->acc = calloc((size_t)4 * tw, sizeof(float));
+  s->lo = malloc(sizeof(int) * rows);
+  s->hi = malloc(sizeof(int) * rows);
+  s->kernel = malloc(region);
+  s->pixels = malloc(sizeof(int) * region);
+  s->starts = malloc(sizeof(int) * (f->nkernels+1));
+  if(s->tmp == NULL || s->acc == NULL || s->lo == NULL || s->hi == NULL ||
+     s->kernel == NULL || s->pixels == NULL || s->starts == NULL){
+    free_de_scratch(s);
+    return NULL;
+  }
+  for(i=0; i<rows; i++){
+    s->lo[i] = tw;
+    s->hi[i] = -1;
+  }
+  return s;
+}
+
+//function: free_de_scratch
+//purpose: free scratch from new_de_scratch()
+extern int free_de_scratch(de_scratch * s){
+  if(s == NULL)
+    return 1;
+  free(s->tmp);
+  free(s->acc);
+  free(s->lo);
+  free(s->hi);
+  free(s->kernel);
+  free(s->pixels);
+  free(s->starts);
+  free(s);
+  return 1;
+}
+
+//function: filter_band
+//purpose: filter output rows [y0,y1) of a frame from its histogram h, a tile
+//         at a time.  h is ss times the size of the output, which is width
+//         pixels wide, in each direction.  only those rows of out are
+//         written, so bands can be filtered concurrently.
+//params: max - raised to the largest count among the rows, for tone mapping
+//returns TRUE
+extern int filter_band(de_filter * f, histogram * h, de_pixel * out,
+                       int width, int y0, int y1, de_scratch * s, float * max){
+  int x, y;
+  float m = *max;
+
+  for(y=y0; y<y1; y+=DE_TILE_HEIGHT){
+    for(x=0; x<width; x+=DE_TILE_WIDTH){
+      m = filter_tile(f, h, out, width, x, y,
+                  (x + DE_TILE_WIDTH > width ? width : x + DE_TILE_WIDTH),
+                  (y + DE_TILE_HEIGHT > y1 ? y1 : y + DE_TILE_HEIGHT), s, m);
+    }
+  }
+  *max = m;
+  return 1;
+}
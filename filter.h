@@ -0,0 +1,76 @@
+/* Author: Ted Cooper
+ * Last revised: 7-2-2009
+ * FRACTAL FLAME RENDERER
+ * See top of engine.c for program description.
+ *
+ * filter.h: see filter.c for description.
+ */
+
+#ifndef FILTER_H
+#define FILTER_H
+
+#include "global.h"
+#include "histogram.h"
+
+//output pixels per side of the tiles filter_band() works through.  a tile's
+//rows of scratch at supersample 1 are 1KB, so the rows a kernel spans stay
+//in cache while they're summed.
+#define DE_TILE_WIDTH 64
+#define DE_TILE_HEIGHT 32
+//kernel radii are multiples of this many histogram pixels
+#define DE_STEP 0.5
+//largest kernel radius, in histogram pixels
+#define DE_MAX_RADIUS 63.0
+//counts past this all get the smallest kernel
+#define DE_MAX_DENSITY 65536
+
+//TYPES
+
+//one output pixel of a filtered frame: the plot count and summed palette
+//colors of the histogram pixels under it, spread out by their kernels.  the
+//same units as a bucket, but fractional.
+typedef struct {
+  float count, r, g, b;
+} de_pixel;
+
+//the adaptive density estimation filter from Draves' paper and flam3:
+//every histogram pixel is spread out by a gaussian whose radius shrinks with
+//its count, radius = max_radius / count^curve (but at least min_radius), so
+//sparse, noisy parts of the image are smoothed and dense, well-sampled ones
+//are left sharp.  the kernels are precomputed for each count, and being
+//gaussians they're separable.
+typedef struct {
+  int ss;                    //histogram pixels per output pixel, per side
+  int nkernels;              //kernel k has radius k*DE_STEP
+  int * halfwidth;           //kernel k is 2*halfwidth[k]+1 taps per side
+  float ** weights;          //weights[k][-halfwidth[k] .. halfwidth[k]],
+                             //summing to 1
+  unsigned char * kernel_of; //kernel for each count below ndensities
+  int ndensities;
+  int maxhalfwidth;          //how far past a tile its pixels reach into
+} de_filter;
+
+//one thread's working space for filter_band()
+typedef struct {
+  float * tmp;        //a tile's rows after the horizontal pass, 4 floats
+                      //(count, r, g, b) per histogram pixel
+  float * acc;        //one of them after the vertical pass
+  int * lo, * hi;     //the part of each tmp row that isn't zero
+  unsigned char * kernel; //the kernel of each pixel around the tile
+  int * pixels;       //those pixels, sorted by kernel
+  int * starts;       //nkernels+1 offsets into pixels
+} de_scratch;
+
+//FUNCTIONS
+
+//public
+
+extern de_filter * new_de_filter(float max_radius, float min_radius,
+                                 float curve, int ss);
+extern int free_de_filter(de_filter * f);
+extern de_scratch * new_de_scratch(de_filter * f);
+extern int free_de_scratch(de_scratch * s);
+extern int filter_band(de_filter * f, histogram * h, de_pixel * out,
+                       int width, int y0, int y1, de_scratch * s, float * max);
+
+#endif
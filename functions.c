@@ -17,27 +17,6 @@
 #include "functions.h"
 #include "variations.h"
 
-//GLOBALS
-
-//variations
-static V_func * variations;
-static coord_t * v_coeff;
-static int nv;
-
-//functions
-static F * functions;
-static int nfunctions;
-float weight_vector_len;
-
-//final transformation
-static V_func * final;
-static F_params * finalfp;
-static float cfinal;
-
-//animation
-static int nframes;
-static coord_t dv_coeff;  //rate of variation coefficient change
-
 //FUNCTIONS
 
 //private
@@ -53,6 +32,21 @@ extern int linear_transformation(coords * c,
   return 1;                                
 }
 
+//function: affine_transformation
+//purpose: the affine map x' = ax + by + c, y' = dx + ey + f, both from the
+//         original point (unlike linear_transformation, which the built-in
+//         flame was designed with).  genome.c uses this.
+//returns TRUE
+extern int affine_transformation(coords * c,
+                                 F_params * fp){
+  coord_t x = c->x;
+  
+  c->x = x*fp->a + c->y*fp->b + fp->c;
+  c->y = x*fp->d + c->y*fp->e + fp->f;
+  
+  return 1;
+}
+
 //function: identity_transformation
 //purpose: don't change c
 //returns TRUE
@@ -65,6 +59,8 @@ extern int identity_transformation(coords *c,
 //purpose: run the specified linear function on the specified coordinate pair.
 //         roughly corresponds to Fi definition on p.5 of Draves' paper.
 //params: func - pointer to the function we want to apply.
+//        v_coeff - the current frame's variational coefficients.  used unless 
+//        func has its own.
 //        coords - pointer to coordinate pair to which we want to apply the
 //        function.
 //return TRUE on success, FALSE on failure
@@ -72,10 +68,11 @@ extern int identity_transformation(coords *c,
 //quick linear function
 #define LINEAR(f_struct, c) ((*(f_struct).f)(c, &(f_struct).fp))
 
-static int run_f(F * func, coords * c){
-  static int j;
-  static coords ccopy;
-  static coords ctemp;
+static int run_f(F * func, coord_t * v_coeff, coords * c){
+  //scratch has to live on the stack, render threads run this concurrently
+  int j;
+  coords ccopy;
+  coords ctemp;
   
   //first linear transformation associated with this function
   if(!LINEAR(func->f, c)){
@@ -84,12 +81,17 @@ static int run_f(F * func, coords * c){
     return 0;
   }
 #if defined(DEBUG)  
-  fprintf(stderr,"run_f: past first linear transformation. c:(%LG,%LG)\n",
+  fprintf(stderr,"run_f: past first linear transformation. c:("
+                 "%" PRIcoord ",%" PRIcoord ")\n",
           c->x,c->y);
 #endif  
   //keep a copy of original coordinate pair values around
   ccopy = *c;
   
+  //animated coefficients unless this function has its own
+  if(func->v_coeff != NULL)
+    v_coeff = func->v_coeff;
+  
   //compute sum of this function's associated variations
   //TODO: at some point may want to consider threads here???? probably not worth
   //it
@@ -104,27 +106,33 @@ static int run_f(F * func, coords * c){
       //variations modify coordinates, so make a copy of the copy :)
       ctemp = ccopy;
       //run the variation!
-      if(!run_v(&func->v[j], &ctemp, &func->f.fp)){
+      if(!run_v(&func->v[j], &ctemp, &func->f.fp,
+                (func->v_param != NULL ? func->v_param + j*MAXVPARAMS :
+                 NULL), v_coeff[j])){
         fprintf(stderr,"run_f: run_v failed.  returning...\n");
         return 0;
       }
 #if defined(DEBUG)
-      fprintf(stderr,"run_f: inside variation loop. j: %d, ctemp:(%LG,%LG)\n",
+      fprintf(stderr,"run_f: inside variation loop. j: %d, ctemp:("
+                     "%" PRIcoord ",%" PRIcoord ")\n",
              j,ctemp.x,ctemp.y);
-      fprintf(stderr,"run_f: c before additions: (%LG,%LG)\n",c->x,c->y);
+      fprintf(stderr,"run_f: c before additions: ("
+                     "%" PRIcoord ",%" PRIcoord ")\n",c->x,c->y);
 #endif
       //scale result by this function's coefficient for this variation and add
       //to sum
-      c->x += func->v_coeff[j] * ctemp.x;
-      c->y += func->v_coeff[j] * ctemp.y;
+      c->x += v_coeff[j] * ctemp.x;
+      c->y += v_coeff[j] * ctemp.y;
 #if defined(DEBUG)
-      fprintf(stderr,"run_f: inside variation loop. j: %d, c:(%LG,%LG)\n",
+      fprintf(stderr,"run_f: inside variation loop. j: %d, c:("
+                     "%" PRIcoord ",%" PRIcoord ")\n",
              j,c->x,c->y);
 #endif
     }
   }
 #if defined(DEBUG)
-  fprintf(stderr,"run_f: past variations. c:(%LG,%LG)\n",c->x,c->y);
+  fprintf(stderr,"run_f: past variations. c:("
+                 "%" PRIcoord ",%" PRIcoord ")\n",c->x,c->y);
 #endif
   //linear post transformation associated with this function
   if(!LINEAR(func->p, c)){
@@ -132,7 +140,8 @@ static int run_f(F * func, coords * c){
     return 0;
   }
 #if defined(DEBUG)
-  fprintf(stderr,"run_f: past second linear transformation. c:(%LG,%LG)\n",
+  fprintf(stderr,"run_f: past second linear transformation. c:("
+                 "%" PRIcoord ",%" PRIcoord ")\n",
           c->x,c->y);
 #endif
 
@@ -143,13 +152,13 @@ static int run_f(F * func, coords * c){
 //public
 
 //function: init_functions
-//purpose: initialize function lists, variations, etc.  ready to run after this!
+//purpose: initialize fl's function lists, variations, etc.  ready to run 
+//         after this!
 //         TODO: find all the constants somewhere reasonable, rather
 //         than writing them into this function.
 //returns number of functions loaded on success, 0 on failure
-extern int init_functions(int _nframes){
-  int i,j;
-  F bigf;
+extern int init_functions(flame * fl, int nframes){
+  int i,t;
   F_func first;
   F_func post;
   float ci_scale;
@@ -172,106 +181,210 @@ extern int init_functions(int _nframes){
                     {  0.5,  0.0,  0.0,  0.0, -0.5, -0.5 }
                   }; 
   
-  //set up variations  
-  nv = init_variations();
-  
-  if(!nv){
-    printf("init_functions: init_variations failed... cannot continue\n");
+  //set up variations and space for 9 functions
+  if(!init_flame(fl, 9, nframes)){
+    printf("init_functions: init_flame failed... cannot continue\n");
     return 0;
   }
-  //get list of variation functions
-  variations = get_variations();
   
   //initialize animation parameters
-  nframes = _nframes;
-  dv_coeff = 0.3;
-  
-  //specify list of complete functions
-  nfunctions = 9;
-  functions = malloc(sizeof(bigf) * nfunctions);
-  
-  //can use the same v_coeff for all cases right now, since we're just 
-  //zeroing it
-  v_coeff = malloc(sizeof(coord_t) * nv);
-  for(j=0; j<nv; j++){
-    v_coeff[j] = 0.0;
+  fl->dv_coeff = 0.3;
+  
+  //every function uses the animated coefficients, so there's one vector per
+  //frame instead of one per function.  they're all computed up front so 
+  //frames can render concurrently without touching shared state.
+  for(t=0; t<nframes; t++){
+    set_frame(fl, t);
   }
   
   //set up scaling factor so color indices are evenly distributed among
   //functions
-  ci_scale = 1.0/(nfunctions-1);
+  ci_scale = 1.0/(fl->nfunctions-1);
   
   //fill F structs in functions array
   post.f = &identity_transformation;
-  weight_vector_len = 0.0;
   //don't need to fill post.fp since we aren't using it
-  for(i=0; i<nfunctions; i++){
+  for(i=0; i<fl->nfunctions; i++){
     //initial linear transformation
     first.f = &linear_transformation;
     first.fp = fp[i];
-    functions[i].f = first;
+    fl->functions[i].f = first;
     
-    //variations and weights
-    functions[i].v = variations;
-    functions[i].v_coeff = v_coeff;
-    functions[i].nv = nv;
+    //variations and weights.  NULL v_coeff means use the frame's.
+    fl->functions[i].v = fl->vs.variations;
+    fl->functions[i].v_coeff = NULL;
+    fl->functions[i].v_param = NULL;
+    fl->functions[i].nv = fl->vs.nv;
     
     //linear post transformation
-    functions[i].p = post;
+    fl->functions[i].p = post;
     
     //these aren't used yet
     //color
-    functions[i].c = ci_scale*i;
+    fl->functions[i].c = ci_scale*i;
     
     //probabilistic function weight
-    functions[i].w = 1.0;
-    functions[i].startw = weight_vector_len;
-    weight_vector_len += functions[i].w; 
+    fl->functions[i].w = 1.0;
   }
   
-  //set up final nonlinear transformation (set up in init_variations since it's
-  //nonlinear)
-  final = get_final();
-  cfinal = 0.5; //make final transform the middle color for no particular reason
+  //final nonlinear transformation is set up in init_variations since it's
+  //nonlinear.  make it the middle color for no particular reason.
+  fl->cfinal = 0.5;
   
-  return nfunctions;
+  if(!finish_flame(fl)){
+    printf("init_functions: finish_flame failed... cannot continue\n");
+    return 0;
+  }
+  
+  return fl->nfunctions;
+}
+
+//function: init_flame
+//purpose: set up fl's variations and room for nfunctions functions and 
+//         nframes frames, for whoever fills them in (init_functions(), 
+//         genome.c).  functions start out as identity transformations with 
+//         no weight, no color and the frame's coefficients (all zero); the 
+//         final transformation is the linear no-op with no color of its own
+//         (cfinal -1), and the palette is the compiled-in one.  call 
+//         finish_flame() when done.
+//returns TRUE on success, FALSE on failure
+extern int init_flame(flame * fl, int nfunctions, int nframes){
+  int i,t;
+  F_func identity;
+  
+  fl->functions = NULL;
+  fl->v_coeffs = NULL;
+  fl->nfunctions = 0;
+  fl->nframes = 0;
+  fl->selector.cutoff = NULL;
+  fl->selector.alias = NULL;
+  fl->selector.n = 0;
+  fl->finalxform = NULL;
+  fl->cfinal = -1.0;
+  fl->dv_coeff = 0.0;
+  fl->palette = get_default_palette();
+  fl->vs.variations = NULL;
+  fl->vs.nv = 0;
+  fl->vs.final = NULL;
+  fl->vs.finalfp = NULL;
+  
+  if(nfunctions <= 0 || nframes <= 0){
+    fprintf(stderr,"init_flame: nothing to set up. returning...\n");
+    return 0;
+  }
+  
+  if(!init_variations(&fl->vs)){
+    fprintf(stderr,"init_flame: init_variations failed. returning...\n");
+    return 0;
+  }
+  
+  fl->functions = calloc(nfunctions, sizeof(F));
+  fl->v_coeffs = calloc(nframes, sizeof(coord_t *));
+  if(fl->functions == NULL || fl->v_coeffs == NULL){
+    fprintf(stderr,"init_flame: out of memory. returning...\n");
+    cleanup_functions(fl);
+    return 0;
+  }
+  fl->nfunctions = nfunctions;
+  fl->nframes = nframes;
+  for(t=0; t<nframes; t++){
+    fl->v_coeffs[t] = calloc(fl->vs.nv, sizeof(coord_t));
+    if(fl->v_coeffs[t] == NULL){
+      fprintf(stderr,"init_flame: out of memory. returning...\n");
+      cleanup_functions(fl);
+      return 0;
+    }
+  }
+  
+  identity.f = &identity_transformation;
+  identity.fp.a = 1.0;
+  identity.fp.b = 0.0;
+  identity.fp.c = 0.0;
+  identity.fp.d = 0.0;
+  identity.fp.e = 1.0;
+  identity.fp.f = 0.0;
+  for(i=0; i<nfunctions; i++){
+    fl->functions[i].f = identity;
+    fl->functions[i].v = fl->vs.variations;
+    fl->functions[i].v_coeff = NULL;
+    fl->functions[i].v_param = NULL;
+    fl->functions[i].nv = fl->vs.nv;
+    fl->functions[i].p = identity;
+    fl->functions[i].c = 0.0;
+    fl->functions[i].w = 0.0;
+  }
+  
+  return 1;
+}
+
+//function: finish_flame
+//purpose: get fl ready to run once its functions are filled in.
+//returns TRUE on success, FALSE on failure (e.g. no function has any weight)
+extern int finish_flame(flame * fl){
+  //constant-time selection by weight
+  return build_alias_table(fl->functions, fl->nfunctions, &fl->selector);
 }
 
 //function: cleanup_functions
-//purpose: free whatever needs freeing, etc. don't try to run after calling 
-//         this!
+//purpose: free whatever fl needs freeing, etc. don't try to run it after 
+//         calling this!
 //returns TRUE on success, FALSE on failure
-extern int cleanup_functions(){
-  //int i;
+extern int cleanup_functions(flame * fl){
+  int i,t;
   
   //let this take care of memory init_variations allocated
-  cleanup_variations();
+  cleanup_variations(&fl->vs);
+  
+  //free anything that's specific to each function (loaded genomes have
+  //their own coefficients and parameters)
+  if(fl->functions != NULL){
+    for(i=0; i<fl->nfunctions; i++){
+      free(fl->functions[i].v_coeff);
+      free(fl->functions[i].v_param);
+    }
+  }
+  if(fl->finalxform != NULL){
+    free(fl->finalxform->v_coeff);
+    free(fl->finalxform->v_param);
+  }
+  free(fl->finalxform);
+  fl->finalxform = NULL;
   
-  printf("cleanup_functions: about to free\n");
+  //the compiled-in palette is shared, free_palette leaves it alone
+  free_palette(fl->palette);
+  fl->palette = NULL;
   
-  /*
-  //free anything allocated in init_functions that's specific to each function
-  for(i=0; i<nfunctions; i++){
-    free(functions[i].v_coeff);
+  if(fl->v_coeffs != NULL){
+    for(t=0; t<fl->nframes; t++){
+      free(fl->v_coeffs[t]);
+    }
   }
-  */
-  //only using 1 variational coefficient vector at the moment
-  free(v_coeff);
+  free(fl->v_coeffs);
   
-  free(functions);
+  free(fl->functions);
+  free(fl->selector.cutoff);
+  free(fl->selector.alias);
+  fl->v_coeffs = NULL;
+  fl->functions = NULL;
+  fl->selector.cutoff = NULL;
+  fl->selector.alias = NULL;
   
   return 1;
 } 
 
 //function: set_frame
-//purpose: create animation by messing around with variation weights
+//purpose: create animation by messing around with variation weights.  fills
+//         in fl's frame t coefficient vector; init_functions() already does
+//         this for every frame, so calling it again is harmless.
 //TODO: figure out how animations are actually done and write something less
 //      ad hoc.
-extern int set_frame(int t){
-  static float y;
+extern int set_frame(flame * fl, int t){
+  float y;
   float x, s,ss,ssd, c,cc,ccd;
-  x = ((float)t)/nframes*M_PI;
-  y = ((float)t)/(3*nframes)*M_PI + 1;
+  coord_t dv_coeff = fl->dv_coeff;
+  coord_t * v_coeff = fl->v_coeffs[t];
+  x = ((float)t)/fl->nframes*M_PI;
+  y = ((float)t)/(3*fl->nframes)*M_PI + 1;
   //take advantage of sin^2 + cos^2 = 1
   s = sinf(x);
   c = cosf(x);
@@ -289,51 +402,152 @@ extern int set_frame(int t){
   return 1; 
 }
 
-//function: run_function
-//purpose: invoke linear function, grab associated color index
-//params: vector_pos - random floating-point value used to select the function.
-//                     this allows functions to have different probabilistic
-//                     weights.
-//        c - input coordinates for function
-//        ci - current color index
-extern int run_function(float vector_pos, coords * c, float * ci){
-  //TODO
-  //figure out some clever constant-time way to index from vector_pos to some
-  //Fi.  maybe build an array in init that divides the range up into distinct
-  //chunks of size=(gcd weights) populated with pointers to appropriate Fis?
+//function: build_alias_table
+//purpose: (re)build at for the weights of funcs, e.g. after they change for a
+//         new frame.  Vose's version of the alias method: columns with less
+//         than their share of probability get topped up by ones with more.
+//         reuses at's arrays if they're already the right size.
+//params: funcs - functions to choose between, n of them.  weights can't be
+//        negative and have to add up to something positive.
+//returns TRUE on success, FALSE on failure
+extern int build_alias_table(F * funcs, int n, alias_table * at){
+  int i, s, l, nsmall, nlarge;
+  int * small, * large;
+  float * p;
+  double total;
   
-  //for now, linear search
-  int i;
-  for(i=0; i<=nfunctions-1; i++){
-    if(functions[i].startw <= vector_pos && vector_pos < functions[i+1].startw){
-      *ci = functions[i].c;
-      return run_f(&functions[i], c);
+  total = 0.0;
+  for(i=0; i<n; i++){
+    if(funcs[i].w < 0.0){
+      fprintf(stderr,"build_alias_table: negative weight. returning...\n");
+      return 0;
     }
+    total += funcs[i].w;
+  }
+  if(n <= 0 || !(total > 0.0)){
+    fprintf(stderr,"build_alias_table: nothing to choose. returning...\n");
+    return 0;
   }
-  //check last one
-  if(functions[i].startw <= vector_pos && 
-     vector_pos <= (functions[i].startw + functions[i].w)){ 
-    *ci = functions[i].c;  
-    return run_f(&functions[i], c);
+  
+  if(at->n != n || at->cutoff == NULL){
+    free(at->cutoff);
+    free(at->alias);
+    at->cutoff = malloc(sizeof(float) * n);
+    at->alias = malloc(sizeof(int) * n);
+    at->n = n;
+  }
+  p = malloc(sizeof(float) * n);
+  small = malloc(sizeof(int) * n);
+  large = malloc(sizeof(int) * n);
+  if(at->cutoff == NULL || at->alias == NULL || p == NULL || small == NULL ||
+     large == NULL){
+    fprintf(stderr,"build_alias_table: out of memory. returning...\n");
+    //leave at empty rather than half allocated
+    free(at->cutoff);
+    free(at->alias);
+    at->cutoff = NULL;
+    at->alias = NULL;
+    at->n = 0;
+    free(p);
+    free(small);
+    free(large);
+    return 0;
+  }
+  
+  //probabilities scaled so the average column holds exactly 1
+  nsmall = nlarge = 0;
+  for(i=0; i<n; i++){
+    p[i] = funcs[i].w * n / total;
+    if(p[i] < 1.0)
+      small[nsmall++] = i;
+    else
+      large[nlarge++] = i;
   }
   
-  //otherwise, vector_pos doesn't correspond to a function
-  return 0;
+  //fill each short column with the rest of a tall one
+  while(nsmall > 0 && nlarge > 0){
+    s = small[--nsmall];
+    l = large[--nlarge];
+    at->cutoff[s] = p[s];
+    at->alias[s] = l;
+    p[l] = (p[l] + p[s]) - 1.0;
+    if(p[l] < 1.0)
+      small[nsmall++] = l;
+    else
+      large[nlarge++] = l;
+  }
+  //whatever's left is full, give or take rounding
+  while(nlarge > 0){
+    l = large[--nlarge];
+    at->cutoff[l] = 1.0;
+    at->alias[l] = l;
+  }
+  while(nsmall > 0){
+    s = small[--nsmall];
+    at->cutoff[s] = 1.0;
+    at->alias[s] = s;
+  }
+  
+  free(p);
+  free(small);
+  free(large);
+  return 1;
 }
 
-//function: run_final
-//purpose: run final transformation
-extern int run_final(coords * c, float * _cfinal){
-  *_cfinal = cfinal;
-  return run_v(final, c, finalfp);
+//function: select_function
+//purpose: pick one of fl's linear functions by its probabilistic weight
+//params: u - uniform random value in [0.0,1.0)
+//returns the function's index
+extern int select_function(flame * fl, float u){
+  float x;
+  int i;
+  alias_table * at = &fl->selector;
+  
+  //one table lookup, however many functions there are
+  x = u*at->n;
+  i = (int)x;
+  //u*n can round up to n when u is just under 1.0
+  if(i >= at->n)
+    i = at->n - 1;
+  if(x - i >= at->cutoff[i])
+    i = at->alias[i];
+  return i;
 }
 
+//function: run_function
+//purpose: invoke one of fl's linear functions, grab associated color index
+//params: u - uniform random value in [0.0,1.0) used to select the function by
+//            its probabilistic weight.
+//        c - input coordinates for function
+//        ci - current color index
+//        t - frame being rendered, for its variational coefficients
+extern int run_function(flame * fl, int t, float u, coords * c, float * ci){
+  return run_xform(fl, t, select_function(fl, u), c, ci);
+}
 
-//accessors
+//function: run_xform
+//purpose: run_function() for a function already picked by select_function()
+//params: i - the function's index.  see run_function() for the rest.
+extern int run_xform(flame * fl, int t, int i, coords * c, float * ci){
+  *ci = fl->functions[i].c;
+  return run_f(&fl->functions[i], fl->v_coeffs[t], c);
+}
 
-//function: get_weight_vector_len
-//purpose: engine needs this to define range for random function selection value
-extern float get_weight_vector_len(){
-  return weight_vector_len;
+//function: run_final
+//purpose: run fl's final transformation: a whole function if the genome has
+//         one, otherwise a single variation
+extern int run_final(flame * fl, coords * c, float * cfinal){
+  if(fl->finalxform != NULL){
+    *cfinal = fl->finalxform->c;
+    return run_f(fl->finalxform, fl->v_coeffs[0], c);
+  }
+  *cfinal = fl->cfinal;
+  return run_v(fl->vs.final, c, fl->vs.finalfp, NULL, 1.0);
 }
 
+//accessors
+
+//frame t's animated variational coefficients, one per variation
+extern coord_t * get_frame_coeffs(flame * fl, int t){
+  return fl->v_coeffs[t];
+}
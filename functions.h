@@ -10,6 +10,7 @@
 #define FUNCTIONS_H
 
 #include "variations.h"
+#include "colorpalette.h"
 
 //DATA TYPES
 
@@ -27,9 +28,14 @@ typedef struct {
   //1. initial linear transformation
   F_func f;
   
-  //2. array of nonlinear variations and variational coefficients
+  //2. array of nonlinear variations and variational coefficients.  v_coeff
+  //can be NULL to use the animated coefficients of the frame being rendered.
+  //v_param holds this function's own parameters for the variations that
+  //take them, MAXVPARAMS apiece (variation j's from v_param[j*MAXVPARAMS]),
+  //or is NULL to use their defaults in v[j].vp.
   V_func * v;
-  long double * v_coeff;
+  coord_t * v_coeff;
+  coord_t * v_param;
   int nv;
   
   //3. linear post transformation
@@ -40,27 +46,76 @@ typedef struct {
   
   //weight associated with this function
   float w;
-  float startw; //where in the weight vector this function's weight range
-                //begins
 
 } F;
 
+//Walker's alias method: pick function i with probability w_i/(sum of w) from
+//one uniform draw u in [0,1).  scale u to [0,n), take the integer part as a
+//column, and keep that column's function if the fractional part is below its
+//cutoff, otherwise take its alias.  O(n) to build, O(1) to sample.
+typedef struct {
+  float * cutoff;
+  int * alias;
+  int n;
+} alias_table;
+
+//everything about one flame (a "genome"): its functions, variations, final
+//transformation and animation.  every function that evaluates a flame takes
+//one of these, so any number of them can be rendered at once, each by any
+//number of threads.  nothing changes it after init_functions() (or
+//finish_flame()) except set_frame(), which only writes that frame's
+//coefficients.
+typedef struct {
+  //variations
+  variation_set vs;
+  coord_t ** v_coeffs; //variational coefficients for each frame
+  
+  //functions
+  F * functions;
+  int nfunctions;
+  alias_table selector; //picks functions by weight
+  
+  //final transformation: a whole function if finalxform isn't NULL,
+  //otherwise vs.final with color cfinal.  a negative cfinal means points are
+  //plotted with their own color instead of one averaged with it.
+  F * finalxform;
+  float cfinal;
+  
+  //colors the color indices map to
+  colorpalette * palette;
+  
+  //animation
+  int nframes;
+  coord_t dv_coeff;  //rate of variation coefficient change
+} flame;
+
 //FUNCTIONS
 
 //public
 
+//F_func.f is one of these
+extern int linear_transformation(coords * c, F_params * fp);
+extern int affine_transformation(coords * c, F_params * fp);
+extern int identity_transformation(coords * c, F_params * fp);
+
 //init/teardown:
 //this init should take care of _everything_
-extern int init_functions(int nframes);
-extern int cleanup_functions();
+extern int init_functions(flame * fl, int nframes);
+extern int cleanup_functions(flame * fl);
+//for building other flames: room for the functions, then finish when filled
+extern int init_flame(flame * fl, int nfunctions, int nframes);
+extern int finish_flame(flame * fl);
 
 //invoke functions:
-extern int run_function(float vector_pos, coords * c, float * ci);
-extern int run_final(coords * c, float * cfinal);
+extern int select_function(flame * fl, float u);
+extern int run_function(flame * fl, int t, float u, coords * c, float * ci);
+extern int run_xform(flame * fl, int t, int i, coords * c, float * ci);
+extern int run_final(flame * fl, coords * c, float * cfinal);
 
-//accessors
-extern float get_weight_vector_len();
+//accessors (for evaluators that don't go through run_function, see kernel.c)
+extern coord_t * get_frame_coeffs(flame * fl, int t);
 
 //mutators
-extern int set_frame(int t);
+extern int set_frame(flame * fl, int t);
+extern int build_alias_table(F * funcs, int n, alias_table * at);
 #endif
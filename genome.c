@@ -0,0 +1,682 @@
+/* Author: Ted Cooper
+ * Last revised: 7-2-2009
+ * FRACTAL FLAME RENDERER
+ * See top of engine.c for program description.
+ *
+ * genome.c: loads flam3 genome files (the XML flam3-render reads, see
+ * http://flam3.com/flame.pdf appendix) so batches of flames can be rendered
+ * without recompiling.  the file is mmap'd and never copied: the tokenizer
+ * below hands out (pointer, length) spans of the mapping for tag names,
+ * attribute names and values, and only numbers get copied, a few bytes at a
+ * time onto the stack for strtod (the mapping isn't NUL-terminated).
+ * genomes are read one at a time as the renderer asks for them, so a file
+ * of thousands of them costs nothing up front and rendering starts as soon
+ * as the first one is parsed.
+ *
+ * this is a subset of flam3, not a general XML parser.  understood:
+ *   <flame size center scale quality gamma vibrancy supersample
+ *          estimator_radius estimator_minimum estimator_curve>
+ *   <xform weight color coefs post (variation names)>
+ *   <finalxform color coefs post (variation names)>
+ *   <color index rgb>
+ *   <palette count format="RGB"> hex </palette>
+ * variations are the ones variations.c has: flam3's first 49, the random
+ * ones drawing from a hash of the point instead of an rng.  a genome that
+ * gives any other variation (or unknown attribute) a nonzero value is
+ * refused, since it would render wrong; zero ones are reported and left
+ * out.  their parameters
+ * (blob_low, ngon_sides, ...) are each xform's own, as in flam3, and
+ * default to flam3's where an xform doesn't set them.  rotate, brightness,
+ * background, symmetry, color_speed and the spatial filter settings are
+ * ignored.  swirl and horseshoe keep this renderer's formulas,
+ * which take y from the new x, so images won't match flam3's exactly.
+ */
+
+//INCLUDES
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "global.h"
+#include "functions.h"
+#include "variations.h"
+#include "histogram.h"
+#include "colorpalette.h"
+#include "genome.h"
+
+//GLOBALS
+
+//defaults for attributes a genome leaves out, flam3's where it has one
+#define DEFAULT_SCALE 50.0 //pixels per unit
+#define DEFAULT_GAMMA 4.0
+#define DEFAULT_VIBRANCY 1.0
+
+//longest number we'll parse
+#define MAXNUMBER 64
+
+//xform attributes that aren't variations
+static const char * xform_attrs[] = {
+  "weight", "color", "coefs", "post", "symmetry", "color_speed", "animate",
+  "opacity", "var_color", "name", "chaos", "plotmode", "motion_frequency",
+  "motion_function"
+};
+#define NXFORM_ATTRS ((int)(sizeof(xform_attrs)/sizeof(xform_attrs[0])))
+
+//TYPES
+
+//a piece of the mapped file
+typedef struct {
+  const char * p;
+  size_t n;
+} span;
+
+//a tag: <name attrs>, </name>, or <name attrs/>
+typedef struct {
+  span name;
+  span attrs;  //everything between the name and the closing > or />
+  int closing; //</name>
+  int empty;   //<name ... />
+} xml_tag;
+
+//FUNCTIONS
+
+//private
+
+static int is_space(char c){
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static int span_is(span s, const char * str){
+  size_t n = strlen(str);
+  return s.n == n && memcmp(s.p, str, n) == 0;
+}
+
+//function: next_tag
+//purpose: find the next tag at or after *pos, skipping comments,
+//         declarations and processing instructions.  *pos ends up just past
+//         its >.
+//returns TRUE if there was one, FALSE at the end of the text
+static int next_tag(const char ** pos, const char * end, xml_tag * tag){
+  const char * p = *pos;
+  const char * q;
+
+  for(;;){
+    p = memchr(p, '<', end - p);
+    if(p == NULL || end - p < 2)
+      return 0;
+    //<!-- ... -->, <!DOCTYPE ...>, <?xml ... ?>
+    if(end - p >= 4 && memcmp(p, "<!--", 4) == 0){
+      for(q = p + 4; end - q >= 3 && memcmp(q, "-->", 3) != 0; q++)
+        ;
+      if(end - q < 3)
+        return 0;
+      p = q + 3;
+      continue;
+    }
+    if(p[1] == '!' || p[1] == '?'){
+      q = memchr(p, '>', end - p);
+      if(q == NULL)
+        return 0;
+      p = q + 1;
+      continue;
+    }
+    break;
+  }
+
+  p++;
+  tag->closing = (*p == '/');
+  if(tag->closing)
+    p++;
+  tag->name.p = p;
+  while(p < end && !is_space(*p) && *p != '>' && *p != '/')
+    p++;
+  tag->name.n = p - tag->name.p;
+
+  //attribute values can't contain > in anything flam3 writes
+  q = memchr(p, '>', end - p);
+  if(q == NULL)
+    return 0;
+  tag->empty = (q > p && q[-1] == '/');
+  tag->attrs.p = p;
+  tag->attrs.n = (q - p) - (tag->empty ? 1 : 0);
+  *pos = q + 1;
+  return 1;
+}
+
+//function: next_attr
+//purpose: take the first name="value" pair off the front of attrs
+//returns TRUE if there was one, FALSE if there are no more
+static int next_attr(span * attrs, span * name, span * value){
+  const char * p = attrs->p;
+  const char * end = attrs->p + attrs->n;
+  const char * q;
+  char quote;
+
+  while(p < end && is_space(*p))
+    p++;
+  if(p == end)
+    return 0;
+  name->p = p;
+  while(p < end && !is_space(*p) && *p != '=')
+    p++;
+  name->n = p - name->p;
+  while(p < end && is_space(*p))
+    p++;
+  if(p == end || *p != '=')
+    return 0;
+  p++;
+  while(p < end && is_space(*p))
+    p++;
+  if(p == end || (*p != '"' && *p != '\''))
+    return 0;
+  quote = *p++;
+  q = memchr(p, quote, end - p);
+  if(q == NULL)
+    return 0;
+  value->p = p;
+  value->n = q - p;
+  attrs->p = q + 1;
+  attrs->n = end - (q + 1);
+  return 1;
+}
+
+//function: get_attr
+//purpose: look up attribute name in tag
+//returns TRUE and its value if it's there, FALSE otherwise
+static int get_attr(xml_tag * tag, const char * name, span * value){
+  span attrs = tag->attrs;
+  span n;
+
+  while(next_attr(&attrs, &n, value)){
+    if(span_is(n, name))
+      return 1;
+  }
+  return 0;
+}
+
+//function: get_numbers
+//purpose: parse up to max whitespace-separated numbers from s into out
+//returns how many there were, or -1 if one of them wasn't a number
+static int get_numbers(span s, double * out, int max){
+  char buf[MAXNUMBER];
+  const char * p = s.p;
+  const char * end = s.p + s.n;
+  const char * start;
+  char * stop;
+  int k = 0;
+
+  while(k < max){
+    while(p < end && is_space(*p))
+      p++;
+    if(p == end)
+      break;
+    start = p;
+    while(p < end && !is_space(*p))
+      p++;
+    if((size_t)(p - start) >= sizeof(buf))
+      return -1;
+    memcpy(buf, start, p - start);
+    buf[p - start] = '\0';
+    out[k] = strtod(buf, &stop);
+    if(*stop != '\0')
+      return -1;
+    k++;
+  }
+  return k;
+}
+
+//function: get_number
+//purpose: attribute name of tag as a single number
+//returns TRUE if it's there and is one, FALSE otherwise (*out untouched)
+static int get_number(xml_tag * tag, const char * name, double * out){
+  span value;
+
+  return get_attr(tag, name, &value) && get_numbers(value, out, 1) == 1;
+}
+
+//function: get_affine
+//purpose: flam3 coefs="a d b e c f" (its column-major c[3][2]) into ff as an
+//         affine_transformation
+//returns TRUE on success, FALSE if the attribute isn't six numbers
+static int get_affine(span value, F_func * ff){
+  double c[6];
+
+  if(get_numbers(value, c, 6) != 6)
+    return 0;
+  ff->f = &affine_transformation;
+  ff->fp.a = c[0];
+  ff->fp.d = c[1];
+  ff->fp.b = c[2];
+  ff->fp.e = c[3];
+  ff->fp.c = c[4];
+  ff->fp.f = c[5];
+  return 1;
+}
+
+static int is_xform_attr(span name){
+  int i;
+
+  for(i=0; i<NXFORM_ATTRS; i++){
+    if(span_is(name, xform_attrs[i]))
+      return 1;
+  }
+  return 0;
+}
+
+//function: own_params
+//purpose: give func its own copy of the variations' parameters, starting out
+//         at their defaults, so a genome's xforms can each set theirs
+//returns TRUE on success, FALSE on failure
+static int own_params(flame * fl, F * func){
+  int j, k;
+
+  func->v_param = calloc(fl->vs.nv*MAXVPARAMS, sizeof(coord_t));
+  if(func->v_param == NULL){
+    fprintf(stderr,"own_params: out of memory. returning...\n");
+    return 0;
+  }
+  for(j=0; j<fl->vs.nv; j++){
+    for(k=0; k<fl->vs.variations[j].vp.np; k++){
+      func->v_param[j*MAXVPARAMS + k] = fl->vs.variations[j].vp.p[k];
+    }
+  }
+  return 1;
+}
+
+//function: load_xform
+//purpose: fill func from an <xform> or <finalxform> tag.  func already has
+//         init_flame()'s identity transformations.
+//returns TRUE on success, FALSE on failure
+static int load_xform(flame * fl, xml_tag * tag, F * func, int index){
+  span attrs = tag->attrs;
+  span name, value;
+  double x;
+  int j, k;
+
+  func->v_coeff = calloc(fl->vs.nv, sizeof(coord_t));
+  if(func->v_coeff == NULL){
+    fprintf(stderr,"load_xform: out of memory. returning...\n");
+    return 0;
+  }
+
+  while(next_attr(&attrs, &name, &value)){
+    if(span_is(name, "coefs")){
+      if(!get_affine(value, &func->f)){
+        fprintf(stderr,"load_xform: bad coefs in genome %d\n", index);
+        return 0;
+      }
+    }
+    else if(span_is(name, "post")){
+      if(!get_affine(value, &func->p)){
+        fprintf(stderr,"load_xform: bad post in genome %d\n", index);
+        return 0;
+      }
+    }
+    else if(span_is(name, "weight")){
+      if(get_numbers(value, &x, 1) != 1 || x < 0.0){
+        fprintf(stderr,"load_xform: bad weight in genome %d\n", index);
+        return 0;
+      }
+      func->w = x;
+    }
+    else if(span_is(name, "color")){
+      //flam3 allows a second number (for color animation); only the first
+      //one matters here.  palette lookups need it in [0,1].
+      if(get_numbers(value, &x, 1) != 1){
+        fprintf(stderr,"load_xform: bad color in genome %d\n", index);
+        return 0;
+      }
+      func->c = (x < 0.0 ? 0.0 : x > 1.0 ? 1.0 : x);
+    }
+    else if(!is_xform_attr(name)){
+      //anything else is a variation, or one of its parameters
+      k = -1;
+      j = find_variation(&fl->vs, name.p, name.n);
+      if(j < 0)
+        j = find_variation_param(&fl->vs, name.p, name.n, &k);
+      if(j < 0){
+        //one flam3 has and this renderer doesn't would come out wrong, so
+        //only a zero one (or something not a number) can be left out
+        if(get_numbers(value, &x, 1) == 1 && x != 0.0){
+          fprintf(stderr,"load_xform: genome %d uses \"%.*s\", which isn't "
+                  "a variation or attribute here\n", index, (int)name.n,
+                  name.p);
+          return 0;
+        }
+        fprintf(stderr,"load_xform: genome %d: no variation or attribute "
+                "\"%.*s\", leaving it out\n", index, (int)name.n, name.p);
+        continue;
+      }
+      if(get_numbers(value, &x, 1) != 1){
+        fprintf(stderr,"load_xform: bad %.*s in genome %d\n",
+                (int)name.n, name.p, index);
+        return 0;
+      }
+      if(k < 0)
+        func->v_coeff[j] = x;
+      else if(func->v_param != NULL || own_params(fl, func))
+        func->v_param[j*MAXVPARAMS + k] = x;
+      else
+        return 0;
+    }
+  }
+
+  //identity post transformations stay identity_transformation, so plans
+  //know to skip them
+  if(func->p.f == &affine_transformation &&
+     func->p.fp.a == 1.0 && func->p.fp.b == 0.0 && func->p.fp.c == 0.0 &&
+     func->p.fp.d == 0.0 && func->p.fp.e == 1.0 && func->p.fp.f == 0.0)
+    func->p.f = &identity_transformation;
+
+  return 1;
+}
+
+//function: load_palette
+//purpose: a palette from the <color> tags or <palette> hex between start and
+//         end, into fl
+//returns TRUE on success (including when there's no palette, which leaves
+//        the default one), FALSE on failure
+static int load_palette(flame * fl, const char * start, const char * end,
+                        int index){
+  const char * pos = start;
+  const char * p;
+  xml_tag tag;
+  span value;
+  double x[3];
+  int i, k, digit, ncolors = 0;
+  unsigned int rgb;
+  colorpalette * pal;
+
+  //how many colors: the highest <color> index, or <palette count>
+  while(next_tag(&pos, end, &tag)){
+    if(tag.closing)
+      continue;
+    if(span_is(tag.name, "color") && get_number(&tag, "index", x) &&
+       x[0] >= 0.0 && x[0] < 65536.0 && (int)x[0] + 1 > ncolors)
+      ncolors = (int)x[0] + 1;
+    else if(span_is(tag.name, "palette") && get_number(&tag, "count", x) &&
+            x[0] >= 1.0 && x[0] < 65536.0)
+      ncolors = (int)x[0];
+  }
+  if(ncolors == 0)
+    return 1;
+
+  pal = new_palette(ncolors);
+  if(pal == NULL){
+    fprintf(stderr,"load_palette: out of memory. returning...\n");
+    return 0;
+  }
+
+  pos = start;
+  while(next_tag(&pos, end, &tag)){
+    if(tag.closing)
+      continue;
+    if(span_is(tag.name, "color")){
+      if(!get_number(&tag, "index", x) || x[0] < 0.0 || x[0] >= ncolors ||
+         !get_attr(&tag, "rgb", &value))
+        continue;
+      i = (int)x[0];
+      if(get_numbers(value, x, 3) != 3){
+        fprintf(stderr,"load_palette: bad rgb in genome %d\n", index);
+        free_palette(pal);
+        return 0;
+      }
+      pal->colors[i].r = x[0]/255.0;
+      pal->colors[i].g = x[1]/255.0;
+      pal->colors[i].b = x[2]/255.0;
+    }
+    else if(span_is(tag.name, "palette") && !tag.empty){
+      if(get_attr(&tag, "format", &value) && !span_is(value, "RGB")){
+        fprintf(stderr,"load_palette: genome %d: palette format \"%.*s\" "
+                "isn't supported\n", index, (int)value.n, value.p);
+        free_palette(pal);
+        return 0;
+      }
+      //six hex digits per color, whitespace anywhere
+      p = pos;
+      for(i=0; i<ncolors; i++){
+        rgb = 0;
+        for(k=0; k<6; k++){
+          while(p < end && is_space(*p))
+            p++;
+          if(p == end || *p == '<')
+            break;
+          digit = (*p >= '0' && *p <= '9') ? *p - '0' :
+                  (*p >= 'a' && *p <= 'f') ? *p - 'a' + 10 :
+                  (*p >= 'A' && *p <= 'F') ? *p - 'A' + 10 : -1;
+          if(digit < 0)
+            break;
+          rgb = (rgb << 4) | digit;
+          p++;
+        }
+        if(k < 6){
+          fprintf(stderr,"load_palette: genome %d: palette has %d of %d "
+                  "colors\n", index, i, ncolors);
+          free_palette(pal);
+          return 0;
+        }
+        pal->colors[i].r = ((rgb >> 16) & 0xff)/255.0;
+        pal->colors[i].g = ((rgb >> 8) & 0xff)/255.0;
+        pal->colors[i].b = (rgb & 0xff)/255.0;
+      }
+    }
+  }
+
+  if(!finish_palette(pal)){
+    free_palette(pal);
+    return 0;
+  }
+  fl->palette = pal;
+  return 1;
+}
+
+//function: load_genome
+//purpose: fill g from the <flame> tag ftag, whose contents run from start
+//         to end (its </flame>)
+//returns TRUE on success, FALSE on failure (g->fl is cleaned up)
+static int load_genome(genome * g, xml_tag * ftag, const char * start,
+                       const char * end){
+  const char * pos;
+  xml_tag tag;
+  span value;
+  double x[2], scale, q;
+  int i, nxforms, width, height;
+  double cx = 0.0, cy = 0.0;
+  flame * fl = &g->fl;
+
+  //image size and the part of the plane it shows
+  if(!get_attr(ftag, "size", &value) || get_numbers(value, x, 2) != 2 ||
+     x[0] < 1.0 || x[1] < 1.0 || x[0] > 65536.0 || x[1] > 65536.0){
+    fprintf(stderr,"load_genome: genome %d has no usable size\n", g->index);
+    return 0;
+  }
+  width = (int)x[0];
+  height = (int)x[1];
+  if(get_attr(ftag, "center", &value) && get_numbers(value, x, 2) == 2){
+    cx = x[0];
+    cy = x[1];
+  }
+  scale = DEFAULT_SCALE;
+  if(get_number(ftag, "scale", x) && x[0] > 0.0)
+    scale = x[0];
+  if(!init_canvas(&g->cv, width, height, cx - width/scale/2.0,
+                  cy - height/scale/2.0, width/scale, height/scale)){
+    fprintf(stderr,"load_genome: init_canvas failed for genome %d\n",
+            g->index);
+    return 0;
+  }
+
+  g->gamma = DEFAULT_GAMMA;
+  g->vibrancy = DEFAULT_VIBRANCY;
+  if(get_number(ftag, "gamma", x) && x[0] > 0.0)
+    g->gamma = x[0];
+  if(get_number(ftag, "vibrancy", x))
+    g->vibrancy = x[0];
+  g->niterations = 0;
+  if(get_number(ftag, "quality", x) && x[0] > 0.0){
+    q = x[0] * width * height;
+    g->niterations = (q > INT_MAX ? INT_MAX : (int)q);
+  }
+  g->supersample = 0;
+  if(get_number(ftag, "supersample", x) && x[0] >= 1.0 && x[0] <= 16.0)
+    g->supersample = (int)x[0];
+  g->estimator_radius = -1.0;
+  g->estimator_minimum = -1.0;
+  g->estimator_curve = -1.0;
+  if(get_number(ftag, "estimator_radius", x) && x[0] >= 0.0)
+    g->estimator_radius = x[0];
+  if(get_number(ftag, "estimator_minimum", x) && x[0] >= 0.0)
+    g->estimator_minimum = x[0];
+  if(get_number(ftag, "estimator_curve", x) && x[0] >= 0.0)
+    g->estimator_curve = x[0];
+
+  //one pass to count the functions, another to fill them in
+  nxforms = 0;
+  pos = start;
+  while(next_tag(&pos, end, &tag)){
+    if(!tag.closing && span_is(tag.name, "xform"))
+      nxforms++;
+  }
+  if(!init_flame(fl, nxforms, 1)){
+    fprintf(stderr,"load_genome: genome %d has no xforms\n", g->index);
+    cleanup_functions(fl);
+    return 0;
+  }
+
+  i = 0;
+  pos = start;
+  while(next_tag(&pos, end, &tag)){
+    if(tag.closing)
+      continue;
+    if(span_is(tag.name, "xform")){
+      if(!load_xform(fl, &tag, &fl->functions[i++], g->index)){
+        cleanup_functions(fl);
+        return 0;
+      }
+    }
+    else if(span_is(tag.name, "finalxform") && fl->finalxform == NULL){
+      fl->finalxform = malloc(sizeof(F));
+      if(fl->finalxform == NULL){
+        fprintf(stderr,"load_genome: out of memory. returning...\n");
+        cleanup_functions(fl);
+        return 0;
+      }
+      //starts out like init_flame()'s functions
+      *fl->finalxform = fl->functions[nxforms-1];
+      fl->finalxform->v_coeff = NULL;
+      fl->finalxform->v_param = NULL;
+      fl->finalxform->f.f = &identity_transformation;
+      fl->finalxform->p.f = &identity_transformation;
+      fl->finalxform->c = 0.0;
+      fl->finalxform->w = 0.0;
+      if(!load_xform(fl, &tag, fl->finalxform, g->index)){
+        cleanup_functions(fl);
+        return 0;
+      }
+    }
+  }
+
+  if(!load_palette(fl, start, end, g->index) || !finish_flame(fl)){
+    fprintf(stderr,"load_genome: genome %d can't be rendered\n", g->index);
+    cleanup_functions(fl);
+    return 0;
+  }
+
+  return 1;
+}
+
+//public
+
+//function: open_genomes
+//purpose: map the genome file at path for next_genome()
+//returns the file on success, NULL on failure
+extern genome_file * open_genomes(const char * path){
+  int fd;
+  struct stat st;
+  void * data;
+  genome_file * gf;
+
+  fd = open(path, O_RDONLY);
+  if(fd < 0){
+    perror(path);
+    return NULL;
+  }
+  if(fstat(fd, &st) != 0 || st.st_size == 0){
+    fprintf(stderr,"open_genomes: %s is empty or unreadable\n", path);
+    close(fd);
+    return NULL;
+  }
+  data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd); //the mapping keeps the file
+  if(data == MAP_FAILED){
+    perror(path);
+    return NULL;
+  }
+  //read front to back, once
+  madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+  gf = malloc(sizeof(genome_file));
+  if(gf == NULL){
+    fprintf(stderr,"open_genomes: out of memory. returning...\n");
+    munmap(data, st.st_size);
+    return NULL;
+  }
+  gf->data = data;
+  gf->size = st.st_size;
+  gf->next = data;
+  gf->nread = 0;
+  return gf;
+}
+
+extern int close_genomes(genome_file * gf){
+  int ok;
+
+  if(gf == NULL)
+    return 1;
+  ok = (munmap((void *)gf->data, gf->size) == 0);
+  free(gf);
+  return ok;
+}
+
+//function: next_genome
+//purpose: find the next <flame> in gf and load it into g
+//returns 1 on success, 0 if there are no more, -1 if this one was no good
+extern int next_genome(genome_file * gf, genome * g){
+  const char * end = gf->data + gf->size;
+  const char * start;
+  const char * pos;
+  xml_tag ftag, tag;
+
+  //the next <flame>
+  do{
+    if(!next_tag(&gf->next, end, &ftag))
+      return 0;
+  }while(ftag.closing || !span_is(ftag.name, "flame"));
+
+  g->index = gf->nread++;
+  if(ftag.empty){
+    fprintf(stderr,"next_genome: genome %d is empty\n", g->index);
+    return -1;
+  }
+
+  //and its </flame>.  genomes don't nest, so the first one is it.
+  start = gf->next;
+  pos = start;
+  for(;;){
+    if(!next_tag(&pos, end, &tag)){
+      fprintf(stderr,"next_genome: genome %d has no </flame>\n", g->index);
+      gf->next = end;
+      return -1;
+    }
+    if(tag.closing && span_is(tag.name, "flame"))
+      break;
+  }
+  gf->next = pos;
+
+  return load_genome(g, &ftag, start, pos) ? 1 : -1;
+}
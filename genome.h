@@ -0,0 +1,50 @@
+/* Author: Ted Cooper
+ * Last revised: 7-2-2009
+ * FRACTAL FLAME RENDERER
+ * See top of engine.c for program description.
+ *
+ * genome.h: see genome.c for description.
+ */
+
+#ifndef GENOME_H
+#define GENOME_H
+
+#include <stddef.h>
+#include "global.h"
+#include "functions.h"
+#include "histogram.h"
+
+//DATA TYPES
+
+//a file of flam3 genomes, mapped into memory and read one <flame> at a time
+typedef struct {
+  const char * data; //the whole file
+  size_t size;
+  const char * next; //where the next <flame> search starts
+  int nread;         //genomes returned so far
+} genome_file;
+
+//one genome, ready to render as a single frame
+typedef struct {
+  int index;        //which <flame> in the file, counting from 0
+  flame fl;         //cleanup_functions() it when done
+  canvas cv;
+  float gamma;
+  float vibrancy;
+  int niterations;  //from quality (samples per pixel), or 0 if not given
+  //filtering, see render_params in animate.h.  0 or negative if not given.
+  int supersample;
+  float estimator_radius, estimator_minimum, estimator_curve;
+} genome;
+
+//public
+
+extern genome_file * open_genomes(const char * path);
+extern int close_genomes(genome_file * gf);
+
+//loads the next genome in gf into g.  returns 1 if it did, 0 at the end of
+//the file, -1 if the genome couldn't be used (gf moves past it anyway).
+//not reentrant for the same gf.
+extern int next_genome(genome_file * gf, genome * g);
+
+#endif
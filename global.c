@@ -1,7 +1,6 @@
 #include <stdlib.h>
 #include "global.h"
-#include "functions.h"
-#include "display.h"
+#include "histogram.h"
 #include "engine.h"
 
 //MASTER DESTRUCTOR!!
@@ -9,9 +8,8 @@
 extern int master_cleanup(){
   int ret = 1;
   
-  ret &= cleanup_functions();  //calls cleanup_variations()
-  ret &= cleanup_display(); //calls cleanup_color_palette()
-  ret &= cleanup_engine();
+  ret &= cleanup_engine();     //frees the flame and the display
+  ret &= cleanup_histograms(); //calls cleanup_color_palette()
   
   return ret;
 }
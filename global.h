@@ -1,12 +1,63 @@
 #ifndef GLOBAL_H
 #define GLOBAL_H
 
-#include <GL/glut.h>
-
 //types
 
+//coordinate precision is picked at compile time (makefile PRECISION=...).
+//long double is the original 80-bit x87 math; double and float are several
+//times faster and can be vectorized.  COORD_* are the matching libm calls and
+//PRIcoord the printf conversion, used like "%" PRIcoord.
+#if defined(PRECISION_FLOAT)
+typedef float coord_t;
+#define COORD_SIN sinf
+#define COORD_COS cosf
+#define COORD_SQRT sqrtf
+#define COORD_ATAN2 atan2f
+#define COORD_EXP expf
+#define COORD_POW powf
+#define COORD_TAN tanf
+#define COORD_SINH sinhf
+#define COORD_COSH coshf
+#define COORD_FMOD fmodf
+#define COORD_FLOOR floorf
+#define COORD_LOG10 log10f
+#define COORD_FABS fabsf
+#define PRIcoord "G"
+#elif defined(PRECISION_DOUBLE)
+typedef double coord_t;
+#define COORD_SIN sin
+#define COORD_COS cos
+#define COORD_SQRT sqrt
+#define COORD_ATAN2 atan2
+#define COORD_EXP exp
+#define COORD_POW pow
+#define COORD_TAN tan
+#define COORD_SINH sinh
+#define COORD_COSH cosh
+#define COORD_FMOD fmod
+#define COORD_FLOOR floor
+#define COORD_LOG10 log10
+#define COORD_FABS fabs
+#define PRIcoord "G"
+#else
 typedef long double coord_t;
-typedef GLfloat color_t;
+#define COORD_SIN sinl
+#define COORD_COS cosl
+#define COORD_SQRT sqrtl
+#define COORD_ATAN2 atan2l
+#define COORD_EXP expl
+#define COORD_POW powl
+#define COORD_TAN tanl
+#define COORD_SINH sinhl
+#define COORD_COSH coshl
+#define COORD_FMOD fmodl
+#define COORD_FLOOR floorl
+#define COORD_LOG10 log10l
+#define COORD_FABS fabsl
+#define PRIcoord "LG"
+#endif
+
+typedef float color_t; //same as GLfloat, without dragging GL in
 
 typedef struct {
   coord_t x;
@@ -21,13 +72,16 @@ typedef struct {
 
 //parameters for linear transformations
 typedef struct {
-  long double a,b,c,d,e,f;
+  coord_t a,b,c,d,e,f;
 } F_params;
 
 //parametric coefficients for variational functions that require them
 typedef struct {
-  long double * p;
+  coord_t * p;
   int np;
+  int fast; //TRUE to use fastmath.h's approximations instead of libm
+  coord_t w; //the caller's coefficient for the variation, which a few of
+             //them use themselves (see run_v())
 } V_params;
 
 //MASTER DESTRUCTOR!!
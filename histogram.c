@@ -0,0 +1,642 @@
+/* Author: Ted Cooper
+ * Last revised: 7-2-2009
+ * FRACTAL FLAME RENDERER
+ * See top of engine.c for program description.
+ *
+ * histogram.c: the image being rendered, as the random walk sees it.  maps
+ * points from flame coordinates to pixels and accumulates plot counts and
+ * palette colors for each pixel, in the bucket layout histogram.h picks.
+ * nothing in here knows about GL or windows.
+ *
+ * a big histogram is mostly cache and TLB misses to plot into: consecutive
+ * points land all over the image.  a histogram can instead defer its plots
+ * (defer_histogram()): each point is appended to a buffer as a bucket and a
+ * color, and when the buffer fills it's sorted by which 32KB of buckets the
+ * points land in and accumulated in one pass from the first bucket to the
+ * last.  the buffer stays in cache and the histogram is swept in order, so
+ * the cost per point stays about the same however big the image is.  sums
+ * are integers, so the result is exactly the same either way.
+ *
+ * with compact buckets (histogram.h), a bucket about to overflow is spilled
+ * into its page of the histogram's side table first, and readers add the
+ * two back together.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include "histogram.h"
+#include "colorpalette.h"
+
+//FUNCTIONS
+
+//initialization and cleanup
+
+//function: init_histograms
+//purpose: set up what every histogram shares (the color palette).  has to be
+//         called before anything is plotted.
+//returns TRUE on success, FALSE on failure
+extern int init_histograms(){
+  //set up color palette
+  return init_color_palette();
+}
+
+extern int cleanup_histograms(){
+  //done with color palette
+  return cleanup_color_palette();
+}
+
+//function: init_canvas
+//purpose: set cv to an image size and the region of the plane it covers.
+//returns TRUE on success, FALSE on failure (a bad size, or more than
+//        MAX_BUCKETS buckets)
+extern int init_canvas(canvas * cv, int width, int height, 
+                       coord_t minX, coord_t minY, 
+                       coord_t rangeX, coord_t rangeY){
+  long long tilesX, tilesY;
+
+  if(width <= 0 || height <= 0 || !(rangeX > 0.0) || !(rangeY > 0.0)){
+    fprintf(stderr,"init_canvas: bad image size %dx%d. returning...\n",
+            width, height);
+    return 0;
+  }
+  //whole tiles, so bucket_index() never has to check for a partial one
+  tilesX = ((long long)width + TILE_MASK) >> TILE_BITS;
+  tilesY = ((long long)height + TILE_MASK) >> TILE_BITS;
+  if((tilesX * tilesY << 2*TILE_BITS) > MAX_BUCKETS){
+    fprintf(stderr,"init_canvas: image size %dx%d is more than %d pixels. "
+            "returning...\n", width, height, MAX_BUCKETS);
+    return 0;
+  }
+  
+  cv->width = width;
+  cv->height = height;
+  cv->minX = minX;
+  cv->minY = minY;
+  cv->rangeX = rangeX;
+  cv->rangeY = rangeY;
+  cv->scaleX = width/rangeX;
+  cv->scaleY = height/rangeY;
+  
+  cv->tilesX = (int)tilesX;
+  cv->nbuckets = (int)(tilesX * tilesY << 2*TILE_BITS);
+  
+  return 1;
+}
+
+//histograms
+
+//function: new_histogram
+//purpose: allocate a zeroed histogram for an image on canvas cv.  buckets
+//         start on a cache line, so no bucket spans two.
+//returns the histogram on success, NULL on failure
+extern histogram * new_histogram(canvas * cv){
+  histogram * h = malloc(sizeof(histogram));
+  void * buckets;
+  
+  if(h == NULL)
+    return NULL;
+  
+  h->cv = *cv;
+  h->defer = NULL;
+  h->wrapped = 0;
+  if(posix_memalign(&buckets, 64, sizeof(bucket) * cv->nbuckets) != 0){
+    free(h);
+    return NULL;
+  }
+  h->buckets = buckets;
+#if defined(HIST_COMPACT)
+  h->npages = (cv->nbuckets + SPILL_MASK) >> SPILL_BITS;
+  h->spill = calloc(h->npages, sizeof(pixel_sum *));
+  if(h->spill == NULL){
+    free(h->buckets);
+    free(h);
+    return NULL;
+  }
+  pthread_mutex_init(&h->spill_lock, NULL);
+#endif
+  clear_histogram(h);
+  
+  return h;
+}
+
+//function: wrap_histogram
+//purpose: a histogram whose buckets are pixels, width*height pixel_sums in
+//         rows that the caller owns and has to keep around (and 16-byte 
+//         aligned) until it's freed.  plots and merges add to what's there.
+//returns the histogram on success, NULL if this build's buckets aren't laid
+//        out like that (see HIST_WRAPS), pixels isn't aligned, or we're out
+//        of memory
+extern histogram * wrap_histogram(canvas * cv, pixel_sum * pixels){
+#if defined(HIST_WRAPS)
+  histogram * h;
+
+  if(((uintptr_t)pixels & (__alignof__(bucket) - 1)) != 0)
+    return NULL;
+  h = malloc(sizeof(histogram));
+  if(h == NULL)
+    return NULL;
+  h->cv = *cv;
+  h->defer = NULL;
+  h->wrapped = 1;
+  h->buckets = (bucket *)pixels;
+  return h;
+#else
+  return NULL;
+#endif
+}
+
+//function: free_histogram
+//purpose: free a histogram from new_histogram() or wrap_histogram().
+extern int free_histogram(histogram * h){
+#if defined(HIST_COMPACT)
+  int p;
+#endif
+
+  if(h == NULL)
+    return 1;
+  defer_histogram(h, 0);
+#if defined(HIST_COMPACT)
+  for(p=0; p<h->npages; p++){
+    free(h->spill[p]);
+  }
+  free(h->spill);
+  pthread_mutex_destroy(&h->spill_lock);
+#endif
+  if(!h->wrapped)
+    free(h->buckets);
+  free(h);
+  return 1;
+}
+
+//function: clear_histogram
+//purpose: zero every pixel of h so it can be plotted into again, including
+//         deferred points that haven't been added yet
+//returns TRUE
+extern int clear_histogram(histogram * h){
+#if defined(HIST_COMPACT)
+  int p;
+#endif
+
+  memset(h->buckets, 0, sizeof(bucket) * get_nbuckets(h));
+#if defined(HIST_COMPACT)
+  //pages are kept for the next frame: the same pixels tend to spill again
+  for(p=0; p<h->npages; p++){
+    if(h->spill[p] != NULL)
+      memset(h->spill[p], 0, sizeof(pixel_sum) << SPILL_BITS);
+  }
+#endif
+  if(h->defer != NULL)
+    h->defer->n = 0;
+  return 1;
+}
+
+#if defined(HIST_COMPACT)
+//function: peek_page
+//purpose: page p of h's side table, or NULL if it hasn't been allocated.
+//         an acquire load, since another thread merging next to this one
+//         can be publishing it in spill_page().
+static inline pixel_sum * peek_page(histogram * h, int p){
+  return __atomic_load_n(&h->spill[p], __ATOMIC_ACQUIRE);
+}
+
+//function: spill_page
+//purpose: page p of h's side table, allocating it if it isn't there yet.
+//         locked, since threads merging next to each other can share a page;
+//         the page is stored with release order so peek_page() outside the
+//         lock sees it zeroed.
+static pixel_sum * spill_page(histogram * h, int p){
+  pixel_sum * page = peek_page(h, p);
+  
+  if(page != NULL)
+    return page;
+  pthread_mutex_lock(&h->spill_lock);
+  page = h->spill[p];
+  if(page == NULL){
+    page = calloc(1 << SPILL_BITS, sizeof(pixel_sum));
+    if(page == NULL){
+      fprintf(stderr,"spill_page: out of memory. exiting...\n");
+      exit(1);
+    }
+    __atomic_store_n(&h->spill[p], page, __ATOMIC_RELEASE);
+  }
+  pthread_mutex_unlock(&h->spill_lock);
+  return page;
+}
+
+//function: spill_bucket
+//purpose: move bucket i of h into the side table, leaving it 0
+static void spill_bucket(histogram * h, int i){
+  pixel_sum * s = &spill_page(h, i >> SPILL_BITS)[i & SPILL_MASK];
+  bucket * b = &h->buckets[i];
+  
+  s->count += b->count;
+  s->r += b->r;
+  s->g += b->g;
+  s->b += b->b;
+  b->count = b->r = b->g = b->b = 0;
+}
+#endif
+
+//function: add_plot
+//purpose: add a plot of color (r,g,b) to bucket i of h
+static inline void add_plot(histogram * h, int i, unsigned char r,
+                            unsigned char g, unsigned char b){
+  bucket * d = &h->buckets[i];
+  
+#if defined(HIST_COMPACT)
+  if(d->count == SPILL_COUNT)
+    spill_bucket(h, i);
+#endif
+  d->count++;
+  d->r += r;
+  d->g += g;
+  d->b += b;
+}
+
+//function: copy_histogram
+//purpose: make dst's pixels the same as src's.  they have to be on the same
+//         canvas, and src's deferred points have to have been flushed.
+//         dst's deferred points are dropped.
+//returns TRUE
+extern int copy_histogram(histogram * dst, histogram * src){
+#if defined(HIST_COMPACT)
+  int p;
+#endif
+
+  memcpy(dst->buckets, src->buckets, sizeof(bucket) * get_nbuckets(src));
+#if defined(HIST_COMPACT)
+  for(p=0; p<src->npages; p++){
+    if(src->spill[p] != NULL)
+      memcpy(spill_page(dst, p), src->spill[p], sizeof(pixel_sum) << 
+             SPILL_BITS);
+    else if(dst->spill[p] != NULL)
+      memset(dst->spill[p], 0, sizeof(pixel_sum) << SPILL_BITS);
+  }
+#endif
+  if(dst->defer != NULL)
+    dst->defer->n = 0;
+  return 1;
+}
+
+//function: add_pixel
+//purpose: add sums that came from somewhere else (a checkpoint, say) to
+//         pixel (x,y) of h
+//returns TRUE
+extern int add_pixel(histogram * h, int x, int y, pixel_sum * p){
+  int i = bucket_index(&h->cv, x, y);
+  bucket * b = &h->buckets[i];
+#if defined(HIST_COMPACT)
+  pixel_sum * s;
+
+  //whatever doesn't fit goes in the side table, along with the bucket
+  if(b->count + p->count > SPILL_COUNT){
+    spill_bucket(h, i);
+    s = &spill_page(h, i >> SPILL_BITS)[i & SPILL_MASK];
+    s->count += p->count;
+    s->r += p->r;
+    s->g += p->g;
+    s->b += p->b;
+    return 1;
+  }
+#endif
+  b->count += p->count;
+  b->r += p->r;
+  b->g += p->g;
+  b->b += p->b;
+  return 1;
+}
+
+//function: defer_histogram
+//purpose: buffer up to npoints plots to h before they're added to its
+//         buckets, or plot straight into them again if npoints is 0.  points
+//         already buffered are added first.  only whoever plots into h may
+//         call this.  the buffer, twice over, should fit in cache: a few
+//         hundred thousand points.
+//returns TRUE on success, FALSE on failure (h plots straight into its 
+//        buckets)
+extern int defer_histogram(histogram * h, int npoints){
+  deferral * d;
+  
+  flush_histogram(h);
+  if(h->defer != NULL){
+    free(h->defer->points);
+    free(h->defer->sorted);
+    free(h->defer->bins);
+    free(h->defer);
+    h->defer = NULL;
+  }
+  if(npoints <= 0)
+    return 1;
+  
+  d = malloc(sizeof(deferral));
+  if(d == NULL){
+    fprintf(stderr,"defer_histogram: out of memory. returning...\n");
+    return 0;
+  }
+  d->n = 0;
+  d->cap = npoints;
+  d->nbins = (get_nbuckets(h) + (1 << BIN_BITS) - 1) >> BIN_BITS;
+  d->points = malloc(sizeof(deferred_point) * npoints);
+  d->sorted = malloc(sizeof(deferred_point) * npoints);
+  d->bins = malloc(sizeof(int) * (d->nbins + 1));
+  if(d->points == NULL || d->sorted == NULL || d->bins == NULL){
+    fprintf(stderr,"defer_histogram: out of memory. returning...\n");
+    free(d->points);
+    free(d->sorted);
+    free(d->bins);
+    free(d);
+    return 0;
+  }
+  h->defer = d;
+  return 1;
+}
+
+//function: flush_histogram
+//purpose: add h's deferred points to its buckets.  has to happen before h is
+//         read or merged, by whoever plots into it.
+//returns TRUE
+extern int flush_histogram(histogram * h){
+  int k, n, bin, sum, count;
+  deferral * d = h->defer;
+  deferred_point * p, * sorted;
+  int * bins;
+  
+  if(d == NULL || d->n == 0)
+    return 1;
+  n = d->n;
+  p = d->points;
+  sorted = d->sorted;
+  bins = d->bins;
+  
+  //counting sort by bin: how many land in each, where each bin starts, then
+  //every point into its bin's place
+  memset(bins, 0, sizeof(int) * (d->nbins + 1));
+  for(k=0; k<n; k++){
+    bins[p[k].i >> BIN_BITS]++;
+  }
+  sum = 0;
+  for(bin=0; bin<d->nbins; bin++){
+    count = bins[bin];
+    bins[bin] = sum;
+    sum += count;
+  }
+  for(k=0; k<n; k++){
+    sorted[bins[p[k].i >> BIN_BITS]++] = p[k];
+  }
+  
+  //one pass over the histogram, a bin at a time
+  for(k=0; k<n; k++){
+    add_plot(h, sorted[k].i, sorted[k].r, sorted[k].g, sorted[k].b);
+  }
+  
+  d->n = 0;
+  return 1;
+}
+
+//function: defer_point
+//purpose: buffer a plot of color c into bucket i of h, adding the buffer to
+//         the buckets if it's full
+static inline void defer_point(histogram * h, int i, color8 * c){
+  deferral * d = h->defer;
+  deferred_point * p;
+  
+  if(d->n == d->cap)
+    flush_histogram(h);
+  p = &d->points[d->n++];
+  p->i = i;
+  p->r = c->r;
+  p->g = c->g;
+  p->b = c->b;
+}
+
+//accessors
+
+extern int get_npixels(histogram * h){
+  return h->cv.width * h->cv.height;
+}
+
+//number of buckets, which is more than get_npixels() if the layout pads
+extern int get_nbuckets(histogram * h){
+  return h->cv.nbuckets;
+}
+
+extern int get_width(histogram * h){
+  return h->cv.width;
+}
+
+extern int get_height(histogram * h){
+  return h->cv.height;
+}
+
+//function: plot_histogram
+//purpose: accumulate a point into h, colored from pal.  the histogram is only
+//         touched by the caller, so render threads can each plot into their 
+//         own without locking.
+//returns TRUE if the point was plotted, FALSE if it was out of range
+extern int plot_histogram(histogram * h, colorpalette * pal, coords * p,
+                          float * c){
+  int x;
+  int y;
+  bucket * b;
+  color8 * ccolor;
+  canvas * cv = &h->cv;
+  
+#if defined(DEBUG)
+  printf("plot: received p:(%" PRIcoord ",%" PRIcoord ")\n", p->x, p->y);
+  printf("      minX: %" PRIcoord ", rangeX: %" PRIcoord "\n", 
+         cv->minX, cv->rangeX);
+  printf("      minY: %" PRIcoord ", rangeY: %" PRIcoord "\n", 
+         cv->minY, cv->rangeY);
+#endif
+
+  x = (int)((p->x - cv->minX)*cv->scaleX + (coord_t)0.5);
+  y = (int)((p->y - cv->minY)*cv->scaleY + (coord_t)0.5);
+  
+  //don't try to plot if out of range
+  if(x < 0 || x >= cv->width || y < 0 || y >= cv->height){
+    //printf("plot: coordinates (%d,%d) out of range.  not plotting.\n",x,y);
+    return 0;
+  }
+
+  b = get_bucket(h, x, y);
+
+#if defined(DEBUG)
+  printf("plot: about to increment bucket %d. (x,y):(%d,%d)\n",
+         (int)(b - h->buckets), x, y);
+#endif
+
+  //look up color in palette using index
+  ccolor = lookup_color8(pal, *c);
+  
+  if(h->defer != NULL){
+    defer_point(h, b - h->buckets, ccolor);
+    return 1;
+  }
+
+  //increment count where point is in grid, and accumulate color values
+  add_plot(h, b - h->buckets, ccolor->r, ccolor->g, ccolor->b);
+  
+  return 1;
+}
+
+//function: plot_batch
+//purpose: plot_histogram() for n points given as separate x, y and color
+//         arrays.  pixel indices are worked out for a block of points at a 
+//         time, which the compiler can vectorize, before the scattered 
+//         writes into h.
+//returns the number of points that were out of range
+#define PLOT_BLOCK 64
+extern int plot_batch(histogram * h, colorpalette * pal, coord_t * xs,
+                      coord_t * ys, float * cs, int n){
+  int k, j, m, x, y, i, outside;
+  int idx[PLOT_BLOCK];
+  color8 * ccolor;
+  canvas cv = h->cv; //a local copy, so the compiler knows it won't change
+  
+  outside = 0;
+  for(k=0; k<n; k+=PLOT_BLOCK){
+    m = (n - k < PLOT_BLOCK ? n - k : PLOT_BLOCK);
+    
+    for(j=0; j<m; j++){
+      x = (int)((xs[k+j] - cv.minX)*cv.scaleX + (coord_t)0.5);
+      y = (int)((ys[k+j] - cv.minY)*cv.scaleY + (coord_t)0.5);
+      idx[j] = (x < 0 || x >= cv.width || y < 0 || y >= cv.height ? -1 : 
+                bucket_index(&cv, x, y));
+    }
+    
+    for(j=0; j<m; j++){
+      i = idx[j];
+      if(i < 0){
+        outside++;
+        continue;
+      }
+      ccolor = lookup_color8(pal, cs[k+j]);
+      if(h->defer != NULL){
+        defer_point(h, i, ccolor);
+        continue;
+      }
+      add_plot(h, i, ccolor->r, ccolor->g, ccolor->b);
+    }
+  }
+  
+  return outside;
+}
+
+//buckets merge_histograms() checks for spills at a time
+#define MERGE_GROUP 64
+
+//function: merge_histograms
+//purpose: add the buckets in [start, end) of each of the nsrc histograms in
+//         src to dst, in order.  they all have to be on the same canvas, and
+//         deferred points have to have been flushed.
+//         threads can merge disjoint bucket ranges of the same histograms 
+//         concurrently.  with compact buckets, sources' spilled sums are
+//         added to dst's side table and dst's buckets spill as they need to.
+//params: max - if it isn't NULL, raised to the largest count in [start, end)
+//              of dst afterwards, so tone mapping doesn't have to look for
+//              it.  checked on the last source's pass, which is reading 
+//              every bucket anyway.
+//returns TRUE
+extern int merge_histograms(histogram * dst, histogram ** src, int nsrc,
+                            int start, int end, plotcount_t * max){
+  int i,j;
+  bucket * d = dst->buckets;
+  bucket * s;
+  plotcount_t m;
+#if defined(HIST_COMPACT)
+  int p, a, e, g, ge, over;
+  plotcount_t c;
+  pixel_sum * ds, * ss;
+  
+  //a page at a time, so dst's page stays in cache while every source is
+  //added to it
+  m = (max != NULL ? *max : 0);
+  for(p=start >> SPILL_BITS; p<<SPILL_BITS < end; p++){
+    a = (p<<SPILL_BITS > start ? p<<SPILL_BITS : start);
+    e = ((p+1)<<SPILL_BITS < end ? (p+1)<<SPILL_BITS : end);
+    for(j=0; j<nsrc; j++){
+      s = src[j]->buckets;
+      ss = src[j]->spill[p];
+      if(ss != NULL){
+        ds = spill_page(dst, p);
+        for(i=a; i<e; i++){
+          ds[i & SPILL_MASK].count += ss[i & SPILL_MASK].count;
+          ds[i & SPILL_MASK].r += ss[i & SPILL_MASK].r;
+          ds[i & SPILL_MASK].g += ss[i & SPILL_MASK].g;
+          ds[i & SPILL_MASK].b += ss[i & SPILL_MASK].b;
+        }
+      }
+      for(g=a; g<e; g+=MERGE_GROUP){
+        ge = (g + MERGE_GROUP < e ? g + MERGE_GROUP : e);
+        //most groups won't need a spill, and adding them without checking
+        //each bucket vectorizes
+        over = 0;
+#pragma omp simd reduction(|:over)
+        for(i=g; i<ge; i++){
+          over |= (d[i].count + s[i].count > SPILL_COUNT);
+        }
+        if(over){
+          //neither is over SPILL_COUNT, so once dst's is spilled the sum
+          //fits
+          for(i=g; i<ge; i++){
+            if(d[i].count + s[i].count > SPILL_COUNT)
+              spill_bucket(dst, i);
+          }
+        }
+#pragma omp simd
+        for(i=g; i<ge; i++){
+          d[i].count += s[i].count;
+          d[i].r += s[i].r;
+          d[i].g += s[i].g;
+          d[i].b += s[i].b;
+        }
+      }
+    }
+    if(max == NULL)
+      continue;
+    ds = peek_page(dst, p);
+    if(ds == NULL){
+#pragma omp simd reduction(max:m)
+      for(i=a; i<e; i++){
+        m = (d[i].count > m ? d[i].count : m);
+      }
+    }
+    else{
+#pragma omp simd reduction(max:m) private(c)
+      for(i=a; i<e; i++){
+        c = d[i].count + ds[i & SPILL_MASK].count;
+        m = (c > m ? c : m);
+      }
+    }
+  }
+  if(max != NULL)
+    *max = m;
+#else
+  
+  for(j=0; j<nsrc; j++){
+    s = src[j]->buckets;
+    if(j == nsrc-1 && max != NULL){
+      m = *max;
+      for(i=start; i<end; i++){
+        d[i].count += s[i].count;
+        d[i].r += s[i].r;
+        d[i].g += s[i].g;
+        d[i].b += s[i].b;
+        m = (d[i].count > m ? d[i].count : m);
+      }
+      *max = m;
+      continue;
+    }
+    for(i=start; i<end; i++){
+      d[i].count += s[i].count;
+      d[i].r += s[i].r;
+      d[i].g += s[i].g;
+      d[i].b += s[i].b;
+    }
+  }
+#endif
+  
+  return 1;
+}
@@ -0,0 +1,223 @@
+/* Author: Ted Cooper
+ * Last revised: 7-2-2009
+ * FRACTAL FLAME RENDERER
+ * See top of engine.c for program description.
+ *
+ * histogram.h: see histogram.c for description.
+ */
+
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <limits.h>
+#include "global.h"
+#include "colorpalette.h"
+
+//TYPES
+
+//64 bits, so sums don't wrap however long a frame renders, or however many
+//renders' checkpoints are merged: a pixel would have to be plotted 2^64/255
+//(about 7*10^16) times.  with 32 bits a hot pixel's colors wrapped after
+//about 16.8 million plots.
+typedef uint64_t plotcount_t;
+typedef uint64_t colorsum_t; //sum of 8-bit palette channels
+
+//a pixel's plot count and summed palette color
+typedef struct {
+  plotcount_t count;
+  colorsum_t r, g, b;
+} pixel_sum;
+
+//how buckets store those (makefile BUCKETS=...).  count and colors are
+//together so a plot touches one cache line instead of one in each of four
+//arrays.
+//  default        a pixel_sum, 64 bits each, 32 bytes.  two fit a 64-byte
+//                 line exactly, and none straddles two in a histogram's
+//                 own buckets.
+//  -DHIST_COMPACT 16 bits each, 8 bytes: a quarter of the memory, and of
+//                 the bandwidth plotting and merging.  palette channels are
+//                 8 bits, so 257 plots can't overflow a 16-bit sum; a bucket
+//                 that's taken that many is added to a pixel_sum in a side
+//                 table (spilled) and starts over from 0.  only pixels
+//                 plotted that often have side table entries, in pages of
+//                 2^SPILL_BITS.  sums are exact either way, up to
+//                 pixel_sum's limit.
+#if defined(HIST_COMPACT)
+typedef struct {
+  unsigned short count, r, g, b;
+} __attribute__((aligned(8))) bucket;
+#define SPILL_COUNT 257 //257*255 = 65535
+#define SPILL_BITS 11
+#define SPILL_MASK ((1 << SPILL_BITS) - 1)
+#else
+typedef struct {
+  plotcount_t count;
+  colorsum_t r, g, b;
+} __attribute__((aligned(16))) bucket;
+#endif
+
+//the order pixels' buckets are stored in (makefile LAYOUT=...).  flames plot
+//in clusters, so keeping pixels that are close in the image close in memory
+//(square tiles, row-major tile by tile) means fewer cache lines and TLB 
+//pages per cluster than whole rows do.
+//  default       rows, like the image
+//  -DHIST_TILED  8x8 tiles (1KB), rows within a tile
+//  -DHIST_MORTON 32x32 tiles (16KB), Morton (Z) order within a tile, so any
+//                2^k x 2^k aligned square of pixels is contiguous
+#if defined(HIST_MORTON)
+#define TILE_BITS 5
+#elif defined(HIST_TILED)
+#define TILE_BITS 3
+#else
+#define TILE_BITS 0
+#endif
+#define TILE_SIZE (1 << TILE_BITS)
+#define TILE_MASK (TILE_SIZE - 1)
+
+//with full-width sums in rows, buckets are just an image of pixel_sums, so a 
+//histogram can plot straight into one someone else owns (wrap_histogram())
+#if !defined(HIST_COMPACT) && TILE_BITS == 0
+#define HIST_WRAPS 1
+#endif
+
+//the image size and the region of the plane it covers
+typedef struct {
+  int width, height;
+  coord_t minX, minY, rangeX, rangeY;
+  coord_t scaleX, scaleY; //pixels per unit, so plotting doesn't divide
+  int tilesX;             //tiles per row of them, see bucket_index()
+  int nbuckets;           //width*height, plus padding out to whole tiles
+} canvas;
+
+//most buckets a canvas can have, so bucket indices, and indices into its
+//3-channel RGB image, fit in an int
+#define MAX_BUCKETS (INT_MAX/3)
+
+//deferred plots are binned by which 2^BIN_BITS buckets (32KB) they land in
+#define BIN_BITS 11
+
+//a plot that hasn't been added to its bucket yet
+typedef struct {
+  unsigned int i; //bucket
+  unsigned char r, g, b;
+} deferred_point;
+
+//points waiting to be accumulated, see defer_histogram()
+typedef struct {
+  deferred_point * points;
+  deferred_point * sorted; //scratch for binning points
+  int n, cap;
+  int * bins;              //nbins+1 offsets into sorted
+  int nbins;
+} deferral;
+
+//accumulation buffers for one image: a bucket for every pixel.  each frame
+//in progress has one, and render threads keep private ones that get merged
+//into the frame's when they're done.  all integers, so merging in any order
+//gives bit-identical results.  each one carries its own copy of its canvas,
+//so histograms for different images can be plotted at the same time.
+typedef struct {
+  bucket * buckets; //nbuckets of them, in bucket_index() order
+  int wrapped;      //TRUE if they're someone else's, see wrap_histogram()
+  canvas cv;
+  deferral * defer; //NULL to plot straight into the buckets
+#if defined(HIST_COMPACT)
+  pixel_sum ** spill; //spilled sums, pages of 2^SPILL_BITS buckets' worth.
+                      //NULL until one of a page's buckets spills.
+  int npages;
+  pthread_mutex_t spill_lock; //protects allocating pages
+#endif
+} histogram;
+
+//FUNCTIONS
+
+//private (inlined wherever pixels are looked up)
+
+#if defined(HIST_MORTON)
+//spread the low 8 bits of v out to the even bits
+static inline unsigned int spread_bits(unsigned int v){
+  v = (v | (v << 4)) & 0x0F0F;
+  v = (v | (v << 2)) & 0x3333;
+  v = (v | (v << 1)) & 0x5555;
+  return v;
+}
+#endif
+
+//function: bucket_index
+//purpose: where pixel (x,y) of an image on cv is in its histogram's buckets
+static inline int bucket_index(const canvas * cv, int x, int y){
+#if defined(HIST_MORTON)
+  return (((y >> TILE_BITS)*cv->tilesX + (x >> TILE_BITS)) << 2*TILE_BITS) |
+         (spread_bits(y & TILE_MASK) << 1) | spread_bits(x & TILE_MASK);
+#elif defined(HIST_TILED)
+  return (((y >> TILE_BITS)*cv->tilesX + (x >> TILE_BITS)) << 2*TILE_BITS) |
+         ((y & TILE_MASK) << TILE_BITS) | (x & TILE_MASK);
+#else
+  return y*cv->width + x;
+#endif
+}
+
+static inline bucket * get_bucket(histogram * h, int x, int y){
+  return &h->buckets[bucket_index(&h->cv, x, y)];
+}
+
+//function: read_bucket
+//purpose: pixel (x,y)'s totals, however its bucket stores them.  what 
+//         anything but histogram.c should read pixels with.
+static inline pixel_sum read_bucket(histogram * h, int x, int y){
+  int i = bucket_index(&h->cv, x, y);
+  bucket * b = &h->buckets[i];
+  pixel_sum p;
+#if defined(HIST_COMPACT)
+  pixel_sum * page = h->spill[i >> SPILL_BITS];
+#endif
+
+  p.count = b->count;
+  p.r = b->r;
+  p.g = b->g;
+  p.b = b->b;
+#if defined(HIST_COMPACT)
+  if(page != NULL){
+    p.count += page[i & SPILL_MASK].count;
+    p.r += page[i & SPILL_MASK].r;
+    p.g += page[i & SPILL_MASK].g;
+    p.b += page[i & SPILL_MASK].b;
+  }
+#endif
+  return p;
+}
+
+//public
+
+//initialization/teardown
+extern int init_histograms();
+extern int cleanup_histograms();
+extern int init_canvas(canvas * cv, int width, int height, 
+                       coord_t minX, coord_t minY, 
+                       coord_t rangeX, coord_t rangeY);
+
+//histograms
+extern histogram * new_histogram(canvas * cv);
+extern histogram * wrap_histogram(canvas * cv, pixel_sum * pixels);
+extern int free_histogram(histogram * h);
+extern int clear_histogram(histogram * h);
+extern int copy_histogram(histogram * dst, histogram * src);
+extern int add_pixel(histogram * h, int x, int y, pixel_sum * p);
+extern int defer_histogram(histogram * h, int npoints);
+extern int flush_histogram(histogram * h);
+extern int plot_histogram(histogram * h, colorpalette * pal, coords * p,
+                          float * c);
+extern int plot_batch(histogram * h, colorpalette * pal, coord_t * xs,
+                      coord_t * ys, float * cs, int n);
+extern int merge_histograms(histogram * dst, histogram ** src, int nsrc,
+                            int start, int end, plotcount_t * max);
+
+//accessors
+extern int get_npixels(histogram * h);
+extern int get_nbuckets(histogram * h);
+extern int get_width(histogram * h);
+extern int get_height(histogram * h);
+
+#endif
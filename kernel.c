@@ -0,0 +1,478 @@
+/* Author: Ted Cooper
+ * Last revised: 7-2-2009
+ * FRACTAL FLAME RENDERER
+ * See top of engine.c for program description.
+ *
+ * kernel.c: flame specialization.  run_function() goes through a function
+ * pointer for each linear transformation, another for every variation (after
+ * testing its coefficient), and another for the final transformation, which
+ * is usually the no-op linear variation, on every iteration.
+ *
+ * make_flame_plan() flattens a frame's flame into plain arrays, leaving out
+ * zero-weight variations, identity post transformations and an identity final
+ * transformation.  both kinds of linear transformation (y from the new or the
+ * old x) fit one formula with an extra coefficient.  walk_fused() then runs
+ * walk()'s loop through a kernel written out for exactly the variations that
+ * are left: FUSED() below instantiates fused_walk() once for each combination
+ * of the NFUSED variations it knows, with and without a post transformation,
+ * so the compiler sees the combination as constants and drops everything
+ * else.  anything else (unknown variations or transformations) goes to the
+ * generic walk().
+ *
+ * a fused kernel does the same arithmetic in the same order and draws the
+ * same random numbers as walk(), so the same seed renders the same image.
+ * batch.c walks from the same plans.
+ */
+
+//INCLUDES
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "functions.h"
+#include "variations.h"
+#include "fastmath.h"
+#include "global.h"
+#include "histogram.h"
+#include "render.h"
+#include "rng.h"
+#include "kernel.h"
+
+//GLOBALS
+
+//range initial points are drawn from, same as render.c
+#define MINV -1.0
+#define RANGE 2.0
+
+//TYPES
+
+//a walk with the flame's structure compiled in
+typedef int (*fused_fn)(flame_plan * fp, int niterations, int miniterations,
+                        histogram * h, rng_state * rng, frame_counters * fc);
+
+//FUNCTIONS
+
+//private
+
+#define KNOWN_AFFINE(f) ((f) == &linear_transformation ||                     \
+                         (f) == &affine_transformation ||                     \
+                         (f) == &identity_transformation)
+
+//function: fill_affine
+//purpose: copy the linear transformation in ff to entry i of a..g (see 
+//         flame_plan).
+//returns TRUE if it's one we know, FALSE otherwise
+static int fill_affine(F_func * ff, int i, coord_t * a, coord_t * b,
+                       coord_t * c, coord_t * d, coord_t * g, coord_t * e,
+                       coord_t * f){
+  if(ff->f == &linear_transformation || ff->f == &affine_transformation){
+    a[i] = ff->fp.a;
+    b[i] = ff->fp.b;
+    c[i] = ff->fp.c;
+    e[i] = ff->fp.e;
+    f[i] = ff->fp.f;
+    if(ff->f == &linear_transformation){
+      d[i] = ff->fp.d;
+      g[i] = 0.0;
+    }
+    else{
+      d[i] = 0.0;
+      g[i] = ff->fp.d;
+    }
+    return 1;
+  }
+  if(ff->f == &identity_transformation){
+    //leaves both coordinates alone
+    a[i] = 1.0;
+    b[i] = 0.0;
+    c[i] = 0.0;
+    d[i] = 0.0;
+    g[i] = 0.0;
+    e[i] = 1.0;
+    f[i] = 0.0;
+    return 1;
+  }
+  return 0;
+}
+
+//function: fused_walk
+//purpose: walk() for a flame whose active variations are mask (bits are
+//         1 << V_ number) and which has a post transformation if post is
+//         TRUE.  only ever called with constant mask and post, and always
+//         inlined, so each FUSED() instance gets just its own variations.
+//params: fp - the frame's plan.  see walk() for the rest.
+//returns the number of points that fell outside the plotted range
+static inline __attribute__((always_inline))
+int fused_walk(flame_plan * fp, int niterations, int miniterations,
+               histogram * h, rng_state * rng, frame_counters * fc,
+               const int mask, const int post){
+  int i, fi, n, nf, outside, nonfinite;
+  long long * selected = (fc != NULL ? fc->selected : NULL);
+  float u, x;
+  float draws[RNG_BATCH];
+  coords p, pf;
+  coord_t X, Y, tx, ty, r2, s, c, wt;
+  coord_t * w = fp->fused_weights;
+  const int fast = fp->fast;
+  float col, cfinal, cf;
+  alias_table * at = fp->selector;
+
+  //same starting point as walk()
+  p.x = (coord_t)(rng_uniform(rng) * RANGE + MINV);
+  p.y = (coord_t)(rng_uniform(rng) * RANGE + MINV);
+  col = (float)rng_uniform(rng);
+
+  n = at->n;
+  nf = fp->nfunctions;
+  outside = 0;
+  nonfinite = 0;
+  for(i=0; i<niterations; i++){
+    if(i % RNG_BATCH == 0)
+      rng_fill_uniform(rng, draws, RNG_BATCH);
+    u = draws[i % RNG_BATCH];
+
+    //pick a function, as in run_function()
+    x = u*n;
+    fi = (int)x;
+    if(fi >= n)
+      fi = n - 1;
+    if(x - fi >= at->cutoff[fi])
+      fi = at->alias[fi];
+    if(selected != NULL)
+      selected[fi]++;
+
+    //first linear transformation (see flame_plan for d and g)
+    X = p.x*fp->a[fi] + p.y*fp->b[fi] + fp->c[fi];
+    Y = X*fp->d[fi] + p.x*fp->g[fi] + p.y*fp->e[fi] + fp->f[fi];
+
+    //the variations, same formulas as v0-v4 and summed in the same order as
+    //run_f(), which skips a function's zero coefficients
+    p.x = 0.0;
+    p.y = 0.0;
+    if(mask & (1 << V_LINEAR)){
+      wt = w[V_LINEAR*nf + fi];
+      if(wt != 0.0){
+        p.x += wt * X;
+        p.y += wt * Y;
+      }
+    }
+    if(mask & (1 << V_SINUSOIDAL)){
+      wt = w[V_SINUSOIDAL*nf + fi];
+      if(wt != 0.0){
+        p.x += wt * FAST_SIN(fast, X);
+        p.y += wt * FAST_SIN(fast, Y);
+      }
+    }
+    if(mask & (1 << V_SPHERICAL)){
+      wt = w[V_SPHERICAL*nf + fi];
+      if(wt != 0.0){
+        r2 = (coord_t)1.0/(X*X + Y*Y);
+        p.x += wt * (X*r2);
+        p.y += wt * (Y*r2);
+      }
+    }
+    if(mask & (1 << V_SWIRL)){
+      wt = w[V_SWIRL*nf + fi];
+      if(wt != 0.0){
+        r2 = X*X + Y*Y;
+        FAST_SINCOS(fast, r2, s, c);
+        tx = X*s - Y*c;
+        ty = tx*c + Y*s;
+        p.x += wt * tx;
+        p.y += wt * ty;
+      }
+    }
+    if(mask & (1 << V_HORSESHOE)){
+      wt = w[V_HORSESHOE*nf + fi];
+      if(wt != 0.0){
+        r2 = FAST_RSQRT(fast, X*X + Y*Y);
+        tx = r2*(X - Y)*(X + Y);
+        ty = r2*(coord_t)2.0*tx*Y;
+        p.x += wt * tx;
+        p.y += wt * ty;
+      }
+    }
+
+    if(post){
+      X = p.x*fp->pa[fi] + p.y*fp->pb[fi] + fp->pc[fi];
+      p.y = X*fp->pd[fi] + p.x*fp->pg[fi] + p.y*fp->pe[fi] + fp->pf[fi];
+      p.x = X;
+    }
+
+    col = (col + fp->color[fi])/2.0;
+
+    //a final transformation that isn't the no-op still goes through 
+    //run_final.  only its result is plotted.
+    pf = p;
+    if(fp->final)
+      run_final(fp->fl, &pf, &cfinal);
+    cf = (fp->cfinal < 0.0 ? col : (col + fp->cfinal)/2.0);
+
+    if(i >= miniterations){
+      if(!plot_histogram(h, fp->fl->palette, &pf, &cf)){
+        outside++;
+        if(!isfinite(pf.x) || !isfinite(pf.y))
+          nonfinite++;
+      }
+    }
+  }
+
+  if(fc != NULL){
+    fc->iterations += niterations;
+    fc->outside += outside;
+    fc->nonfinite += nonfinite;
+  }
+  return outside;
+}
+
+//one kernel per combination of variations, with and without post
+#define FUSED(mask)                                                          \
+  static int fused_##mask(flame_plan * fp, int niterations,                  \
+                          int miniterations, histogram * h,                  \
+                          rng_state * rng, frame_counters * fc){             \
+    return fused_walk(fp, niterations, miniterations, h, rng, fc, mask, 0);  \
+  }                                                                          \
+  static int fused_##mask##_post(flame_plan * fp, int niterations,           \
+                                 int miniterations, histogram * h,           \
+                                 rng_state * rng, frame_counters * fc){      \
+    return fused_walk(fp, niterations, miniterations, h, rng, fc, mask, 1);  \
+  }
+
+FUSED(0)
+FUSED(1)
+FUSED(2)
+FUSED(3)
+FUSED(4)
+FUSED(5)
+FUSED(6)
+FUSED(7)
+FUSED(8)
+FUSED(9)
+FUSED(10)
+FUSED(11)
+FUSED(12)
+FUSED(13)
+FUSED(14)
+FUSED(15)
+FUSED(16)
+FUSED(17)
+FUSED(18)
+FUSED(19)
+FUSED(20)
+FUSED(21)
+FUSED(22)
+FUSED(23)
+FUSED(24)
+FUSED(25)
+FUSED(26)
+FUSED(27)
+FUSED(28)
+FUSED(29)
+FUSED(30)
+FUSED(31)
+
+#define FUSED_ROW(mask) { &fused_##mask, &fused_##mask##_post }
+
+//kernels[mask][post]
+static const fused_fn kernels[1 << NFUSED][2] = {
+  FUSED_ROW(0),
+  FUSED_ROW(1),
+  FUSED_ROW(2),
+  FUSED_ROW(3),
+  FUSED_ROW(4),
+  FUSED_ROW(5),
+  FUSED_ROW(6),
+  FUSED_ROW(7),
+  FUSED_ROW(8),
+  FUSED_ROW(9),
+  FUSED_ROW(10),
+  FUSED_ROW(11),
+  FUSED_ROW(12),
+  FUSED_ROW(13),
+  FUSED_ROW(14),
+  FUSED_ROW(15),
+  FUSED_ROW(16),
+  FUSED_ROW(17),
+  FUSED_ROW(18),
+  FUSED_ROW(19),
+  FUSED_ROW(20),
+  FUSED_ROW(21),
+  FUSED_ROW(22),
+  FUSED_ROW(23),
+  FUSED_ROW(24),
+  FUSED_ROW(25),
+  FUSED_ROW(26),
+  FUSED_ROW(27),
+  FUSED_ROW(28),
+  FUSED_ROW(29),
+  FUSED_ROW(30),
+  FUSED_ROW(31)
+};
+
+//public
+
+//function: make_flame_plan
+//purpose: flatten frame t of fl into bp.  free_flame_plan() it when
+//         done.
+//returns TRUE on success, FALSE if the functions use something that can't be
+//        flattened (callers fall back to walk()) or we're out of memory
+extern int make_flame_plan(flame_plan * bp, flame * fl, int t){
+  int i, j, k, n, nv, id, last, own;
+  F * funcs;
+  coord_t * frame, * coeff, * p;
+  V_func * final;
+
+  funcs = fl->functions;
+  n = fl->nfunctions;
+  frame = get_frame_coeffs(fl, t);
+  nv = funcs[0].nv;
+
+  //one shared variation list, linear transformations only
+  for(i=0; i<n; i++){
+    if(funcs[i].v != funcs[0].v || funcs[i].nv != nv)
+      return 0;
+    if(!KNOWN_AFFINE(funcs[i].f.f) || !KNOWN_AFFINE(funcs[i].p.f))
+      return 0;
+  }
+
+  bp->nfunctions = n;
+  bp->fl = fl;
+  bp->selector = &fl->selector;
+  bp->v = funcs[0].v;
+  bp->nv = nv;
+  bp->fast = fl->vs.fast;
+  bp->uniform = 1;
+  own = 0;
+  for(i=0; i<n; i++){
+    if(funcs[i].v_coeff != NULL)
+      bp->uniform = 0;
+    if(funcs[i].v_param != NULL)
+      own = 1;
+  }
+
+  bp->block = malloc(sizeof(coord_t) * (14*n + NFUSED*n +
+                                         nv*n +
+                                         (own ? nv*n*MAXVPARAMS : 0)));
+  bp->color = malloc(sizeof(float) * n);
+  bp->fp = malloc(sizeof(F_params) * n);
+  bp->active = malloc(sizeof(int) * (nv > 0 ? nv : 1));
+  if(bp->block == NULL || bp->color == NULL || bp->fp == NULL ||
+     bp->active == NULL){
+    fprintf(stderr,"make_plan: out of memory. returning...\n");
+    free(bp->block);
+    free(bp->color);
+    free(bp->fp);
+    free(bp->active);
+    return 0;
+  }
+  p = bp->block;
+  bp->a = p; p += n;
+  bp->b = p; p += n;
+  bp->c = p; p += n;
+  bp->d = p; p += n;
+  bp->g = p; p += n;
+  bp->e = p; p += n;
+  bp->f = p; p += n;
+  bp->pa = p; p += n;
+  bp->pb = p; p += n;
+  bp->pc = p; p += n;
+  bp->pd = p; p += n;
+  bp->pg = p; p += n;
+  bp->pe = p; p += n;
+  bp->pf = p; p += n;
+  bp->fused_weights = p; p += NFUSED*n;
+  bp->weights = p; p += nv*n;
+  bp->params = (own ? p : NULL);
+
+  bp->post = 0;
+  for(i=0; i<n; i++){
+    fill_affine(&funcs[i].f, i, bp->a, bp->b, bp->c, bp->d, bp->g, bp->e,
+                bp->f);
+    fill_affine(&funcs[i].p, i, bp->pa, bp->pb, bp->pc, bp->pd, bp->pg,
+                bp->pe, bp->pf);
+    if(funcs[i].p.f != &identity_transformation)
+      bp->post = 1;
+    bp->color[i] = funcs[i].c;
+    bp->fp[i] = funcs[i].f.fp;
+  }
+
+  //coefficients, and which variations are worth running at all
+  bp->nactive = 0;
+  for(j=0; j<nv; j++){
+    for(i=0; i<n; i++){
+      coeff = (funcs[i].v_coeff != NULL ? funcs[i].v_coeff : frame);
+      bp->weights[j*n + i] = coeff[j];
+    }
+    for(i=0; i<n; i++){
+      if(bp->weights[j*n + i] != 0.0){
+        bp->active[bp->nactive++] = j;
+        break;
+      }
+    }
+  }
+
+  //parameters, each function's own or the defaults
+  for(j=0; own && j<nv; j++){
+    for(i=0; i<n; i++){
+      for(k=0; k<bp->v[j].vp.np; k++){
+        bp->params[(j*n + i)*MAXVPARAMS + k] =
+          (funcs[i].v_param != NULL ? funcs[i].v_param[j*MAXVPARAMS + k] :
+           bp->v[j].vp.p[k]);
+      }
+    }
+  }
+
+  //walk_fused() needs every active variation to be one it knows, in V_
+  //order so the sum adds up the same way as in run_f()
+  bp->fused_mask = 0;
+  last = -1;
+  for(j=0; j<bp->nactive; j++){
+    id = bp->v[bp->active[j]].id;
+    if(id < 0 || id >= NFUSED || id <= last){
+      bp->fused_mask = -1;
+      break;
+    }
+    bp->fused_mask |= 1 << id;
+    for(i=0; i<n; i++){
+      bp->fused_weights[id*n + i] = bp->weights[bp->active[j]*n + i];
+    }
+    last = id;
+  }
+
+  final = fl->vs.final;
+  bp->final = (fl->finalxform != NULL || final->id != V_LINEAR);
+  bp->cfinal = (fl->finalxform != NULL ? fl->finalxform->c : fl->cfinal);
+
+  return 1;
+}
+
+extern void free_flame_plan(flame_plan * bp){
+  free(bp->block);
+  free(bp->color);
+  free(bp->fp);
+  free(bp->active);
+}
+
+//function: walk_fused
+//purpose: walk() through the kernel for frame t's flame, or walk() itself if
+//         there isn't one.
+//params: see walk().
+//returns the number of points that fell outside the plotted range
+extern int walk_fused(flame * fl, int t, int niterations, int miniterations,
+                      histogram * h, rng_state * rng, frame_counters * fc){
+  int outside;
+  flame_plan fp;
+
+  if(!make_flame_plan(&fp, fl, t))
+    return walk(fl, t, niterations, miniterations, h, rng, fc);
+  if(fp.fused_mask < 0){
+    free_flame_plan(&fp);
+    return walk(fl, t, niterations, miniterations, h, rng, fc);
+  }
+
+  outside = kernels[fp.fused_mask][fp.post](&fp, niterations, miniterations,
+                                           h, rng, fc);
+
+  free_flame_plan(&fp);
+  return outside;
+}
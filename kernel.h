@@ -0,0 +1,84 @@
+/* Author: Ted Cooper
+ * Last revised: 7-2-2009
+ * FRACTAL FLAME RENDERER
+ * See top of engine.c for program description.
+ *
+ * kernel.h: see kernel.c for description.
+ */
+
+#ifndef KERNEL_H
+#define KERNEL_H
+
+#include "global.h"
+#include "counters.h"
+#include "functions.h"
+#include "variations.h"
+#include "histogram.h"
+#include "rng.h"
+
+//variations walk_fused() has kernels for: V_LINEAR through V_HORSESHOE
+#define NFUSED 5
+
+//DATA TYPES
+
+//one frame's flame with the function pointers taken out: everything an
+//iteration needs from functions.c, flattened into arrays indexed by function
+//number
+typedef struct {
+  flame * fl; //the flame this came from
+  int nfunctions;
+  alias_table * selector;
+
+  //first linear transformation x' = ax + by + c, y' = dx' + gx + ey + f.
+  //linear_transformation() takes y from the new x (g = 0),
+  //affine_transformation() from the old one (d = 0), identity is
+  //1 0 0 0 0 1 0.
+  coord_t * a, * b, * c, * d, * g, * e, * f;
+  //post transformation, the same way.  only used if post is TRUE.
+  coord_t * pa, * pb, * pc, * pd, * pg, * pe, * pf;
+  int post;
+  float * color;
+  F_params * fp; //the first linear transformations' own, for variations
+                 //that use them
+
+  //variations, shared by every function.  function i's coefficient for
+  //variation j is weights[j*nfunctions + i] (every function's is the same
+  //if uniform is TRUE, but run_v_batch() takes them per function) and its
+  //parameters for it start at params[(j*nfunctions + i)*MAXVPARAMS], or
+  //params is NULL if every function uses the variations' defaults.
+  V_func * v;
+  int nv;
+  int fast; //their vp.fast, so fastmath.h's approximations in the kernels
+  coord_t * weights;
+  int uniform;
+  coord_t * params;
+  int * active; //variations with a nonzero coefficient somewhere
+  int nactive;
+
+  //the active variations as a mask of (1 << V_ number), with function i's
+  //coefficient for V_ number id at fused_weights[id*nfunctions + i], or
+  //fused_mask -1 if walk_fused() has no kernel for them
+  int fused_mask;
+  coord_t * fused_weights;
+
+  //final transformation, unless it's the linear variation (a no-op).  its
+  //result is only plotted; the walk carries on from the point before it.
+  int final;
+  float cfinal; //negative to plot the walk's own color
+
+  coord_t * block; //all the coord_t arrays above, in one allocation
+} flame_plan;
+
+//public
+
+//flatten frame t's flame.  FALSE if it uses something other than linear,
+//affine and identity transformations or a variation list shared by every
+//function.
+extern int make_flame_plan(flame_plan * fp, flame * fl, int t);
+extern void free_flame_plan(flame_plan * fp);
+
+//walk() with the frame's flame compiled in (a walk_fn, see render.h)
+extern int walk_fused(flame * fl, int t, int niterations, int miniterations,
+                      histogram * h, rng_state * rng, frame_counters * fc);
+
+#endif
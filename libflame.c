@@ -0,0 +1,474 @@
+/* Author: Ted Cooper
+ * Last revised: 7-2-2009
+ * FRACTAL FLAME RENDERER
+ * See top of engine.c for program description.
+ *
+ * libflame.c: the library's C API (libflame.h).  an lf_flame is a flame
+ * (functions.c) and the canvas it's shown on, built a setter at a time the
+ * way genome.c builds one from a <flame>.  lf_render() walks it with
+ * walk_batch() in the same chunks, from the same streams, as render_frames()
+ * (animate.c), so it plots exactly what the engine would.  histograms and
+ * images are the caller's: in the default build (see HIST_WRAPS in
+ * histogram.h) the walk plots straight into the caller's pixels and tone
+ * mapping reads them in place.  other builds lay their buckets out
+ * differently and go through one of their own histograms.
+ *
+ * none of the engine's main loop, animation scheduling or GL is in here;
+ * engine.c and display.c are one client of the library, bench.c another.
+ */
+
+//INCLUDES
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "global.h"
+#include "functions.h"
+#include "variations.h"
+#include "colorpalette.h"
+#include "histogram.h"
+#include "batch.h"
+#include "rng.h"
+#include "tonemap.h"
+#include "animate.h"
+#include "libflame.h"
+
+//GLOBALS
+
+//what lf_new_flame() flames show, the engine's default
+#define DEFAULT_WIDTH 800
+#define DEFAULT_HEIGHT 600
+#define DEFAULT_MIN -1.0
+#define DEFAULT_RANGE 2.0
+//the engine's MINITERATIONS and CHUNK_ITERATIONS, so lf_render() walks what
+//it does
+#define LF_MINITERATIONS 20
+#define LF_CHUNK_ITERATIONS 1000000
+
+//TYPES
+
+struct lf_flame {
+  flame fl;
+  canvas cv;
+  int finished; //since the last change
+};
+
+//FUNCTIONS
+
+//private
+
+//function: get_xform
+//purpose: xform i of f, or its final transformation for LF_FINAL, which is
+//         made the first time it's asked for.  either way the flame has to
+//         be finished again.
+//returns it, or NULL if there isn't one
+static F * get_xform(lf_flame * f, int i){
+  F * func;
+
+  if(f == NULL){
+    fprintf(stderr,"get_xform: no flame. returning...\n");
+    return NULL;
+  }
+  if(i != LF_FINAL && (i < 0 || i >= f->fl.nfunctions)){
+    fprintf(stderr,"get_xform: no xform %d. returning...\n", i);
+    return NULL;
+  }
+  f->finished = 0;
+  if(i != LF_FINAL)
+    return &f->fl.functions[i];
+  if(f->fl.finalxform != NULL)
+    return f->fl.finalxform;
+
+  func = malloc(sizeof(F));
+  if(func == NULL){
+    fprintf(stderr,"get_xform: out of memory. returning...\n");
+    return NULL;
+  }
+  //starts out like an lf_new_flame() xform
+  *func = f->fl.functions[0];
+  func->f.f = &identity_transformation;
+  func->p.f = &identity_transformation;
+  func->c = 0.0;
+  func->w = 0.0;
+  func->v_param = NULL;
+  func->v_coeff = calloc(f->fl.vs.nv, sizeof(coord_t));
+  if(func->v_coeff == NULL){
+    fprintf(stderr,"get_xform: out of memory. returning...\n");
+    free(func);
+    return NULL;
+  }
+  func->v_coeff[find_variation(&f->fl.vs, "linear", 6)] = 1.0;
+  f->fl.finalxform = func;
+  return func;
+}
+
+//function: set_affine
+//purpose: ff from lf_set_affine()'s coefs.  an identity stays
+//         identity_transformation, so plans know to skip it.
+static void set_affine(F_func * ff, const double coefs[6]){
+  ff->fp.a = coefs[0];
+  ff->fp.b = coefs[1];
+  ff->fp.c = coefs[2];
+  ff->fp.d = coefs[3];
+  ff->fp.e = coefs[4];
+  ff->fp.f = coefs[5];
+  ff->f = (coefs[0] == 1.0 && coefs[1] == 0.0 && coefs[2] == 0.0 &&
+           coefs[3] == 0.0 && coefs[4] == 1.0 && coefs[5] == 0.0 ?
+           &identity_transformation : &affine_transformation);
+}
+
+//function: wrap_pixels
+//purpose: a histogram for w x h pixels of hist on cv: hist itself if this
+//         build's buckets can be, otherwise one of our own with hist's sums
+//         in it if copy is TRUE
+//returns the histogram, or NULL if we're out of memory
+static histogram * wrap_pixels(canvas * cv, const lf_pixel * hist, int copy){
+  histogram * h;
+  pixel_sum p;
+  int x, y;
+
+  h = wrap_histogram(cv, (pixel_sum *)hist);
+  if(h != NULL)
+    return h;
+  h = new_histogram(cv);
+  if(h == NULL || !copy)
+    return h;
+  for(y=0; y<cv->height; y++){
+    for(x=0; x<cv->width; x++){
+      p.count = hist->count;
+      p.r = hist->r;
+      p.g = hist->g;
+      p.b = hist->b;
+      add_pixel(h, x, y, &p);
+      hist++;
+    }
+  }
+  return h;
+}
+
+//function: unwrap_pixels
+//purpose: free a histogram from wrap_pixels(), adding what's in it to hist
+//         first if it isn't hist
+static void unwrap_pixels(histogram * h, lf_pixel * hist){
+  pixel_sum p;
+  int x, y;
+
+  if(hist != NULL && !h->wrapped){
+    for(y=0; y<get_height(h); y++){
+      for(x=0; x<get_width(h); x++){
+        p = read_bucket(h, x, y);
+        hist->count += p.count;
+        hist->r += p.r;
+        hist->g += p.g;
+        hist->b += p.b;
+        hist++;
+      }
+    }
+  }
+  free_histogram(h);
+}
+
+//public
+
+extern int lf_api_version(void){
+  return LF_API_VERSION;
+}
+
+//function: lf_init
+//purpose: set up what every flame shares (the compiled-in palette)
+extern int lf_init(void){
+  return init_histograms();
+}
+
+extern int lf_cleanup(void){
+  return cleanup_histograms();
+}
+
+//function: lf_new_flame
+//purpose: a flame of nxforms xforms, see libflame.h for what they start as
+//returns it, or NULL on failure
+extern lf_flame * lf_new_flame(int nxforms){
+  lf_flame * f;
+  int i, linear;
+
+  f = calloc(1, sizeof(lf_flame));
+  if(f == NULL){
+    fprintf(stderr,"lf_new_flame: out of memory. returning...\n");
+    return NULL;
+  }
+  if(!init_flame(&f->fl, nxforms, 1)){
+    cleanup_functions(&f->fl);
+    free(f);
+    return NULL;
+  }
+  linear = find_variation(&f->fl.vs, "linear", 6);
+  for(i=0; i<nxforms; i++){
+    f->fl.functions[i].w = 1.0;
+    f->fl.functions[i].v_coeff = calloc(f->fl.vs.nv, sizeof(coord_t));
+    if(f->fl.functions[i].v_coeff == NULL){
+      fprintf(stderr,"lf_new_flame: out of memory. returning...\n");
+      lf_free_flame(f);
+      return NULL;
+    }
+    f->fl.functions[i].v_coeff[linear] = 1.0;
+  }
+  init_canvas(&f->cv, DEFAULT_WIDTH, DEFAULT_HEIGHT, DEFAULT_MIN, DEFAULT_MIN,
+              DEFAULT_RANGE, DEFAULT_RANGE);
+  return f;
+}
+
+//function: lf_builtin_flame
+//purpose: the engine's animation (init_functions()), already finished
+//returns it, or NULL on failure
+extern lf_flame * lf_builtin_flame(int nframes){
+  lf_flame * f;
+
+  f = calloc(1, sizeof(lf_flame));
+  if(f == NULL){
+    fprintf(stderr,"lf_builtin_flame: out of memory. returning...\n");
+    return NULL;
+  }
+  if(!init_functions(&f->fl, nframes)){
+    cleanup_functions(&f->fl);
+    free(f);
+    return NULL;
+  }
+  init_canvas(&f->cv, DEFAULT_WIDTH, DEFAULT_HEIGHT, DEFAULT_MIN, DEFAULT_MIN,
+              DEFAULT_RANGE, DEFAULT_RANGE);
+  f->finished = 1;
+  return f;
+}
+
+extern void lf_free_flame(lf_flame * f){
+  if(f == NULL)
+    return;
+  cleanup_functions(&f->fl);
+  free(f);
+}
+
+extern int lf_set_affine(lf_flame * f, int i, const double coefs[6]){
+  F * func = get_xform(f, i);
+
+  if(func == NULL)
+    return 0;
+  set_affine(&func->f, coefs);
+  return 1;
+}
+
+extern int lf_set_post(lf_flame * f, int i, const double coefs[6]){
+  F * func = get_xform(f, i);
+
+  if(func == NULL)
+    return 0;
+  set_affine(&func->p, coefs);
+  return 1;
+}
+
+//function: lf_set_weight
+//purpose: how likely xform i is to be picked, relative to the others.  the
+//         final transformation doesn't have one.
+extern int lf_set_weight(lf_flame * f, int i, double weight){
+  F * func;
+
+  if(i == LF_FINAL || !(weight >= 0.0)){
+    fprintf(stderr,"lf_set_weight: bad weight for xform %d. returning...\n",
+            i);
+    return 0;
+  }
+  func = get_xform(f, i);
+  if(func == NULL)
+    return 0;
+  func->w = weight;
+  return 1;
+}
+
+//function: lf_set_color
+//purpose: xform i's color index, clamped to [0,1] like genome.c's
+extern int lf_set_color(lf_flame * f, int i, double color){
+  F * func = get_xform(f, i);
+
+  if(func == NULL)
+    return 0;
+  func->c = (color < 0.0 ? 0.0 : color > 1.0 ? 1.0 : color);
+  return 1;
+}
+
+extern int lf_set_variation(lf_flame * f, int i, const char * name,
+                            double weight){
+  F * func;
+  int j;
+
+  if(f == NULL || name == NULL)
+    return 0;
+  j = find_variation(&f->fl.vs, name, strlen(name));
+  if(j < 0){
+    fprintf(stderr,"lf_set_variation: no variation \"%s\". returning...\n",
+            name);
+    return 0;
+  }
+  func = get_xform(f, i);
+  if(func == NULL)
+    return 0;
+  //the built-in flame's xforms use the frame's coefficients until now
+  if(func->v_coeff == NULL){
+    func->v_coeff = calloc(f->fl.vs.nv, sizeof(coord_t));
+    if(func->v_coeff == NULL){
+      fprintf(stderr,"lf_set_variation: out of memory. returning...\n");
+      return 0;
+    }
+  }
+  func->v_coeff[j] = weight;
+  return 1;
+}
+
+extern int lf_set_palette(lf_flame * f, const float * rgb, int ncolors){
+  colorpalette * pal;
+  int i;
+
+  if(f == NULL || rgb == NULL)
+    return 0;
+  pal = new_palette(ncolors);
+  if(pal == NULL){
+    fprintf(stderr,"lf_set_palette: bad palette. returning...\n");
+    return 0;
+  }
+  for(i=0; i<ncolors; i++){
+    pal->colors[i].r = rgb[3*i];
+    pal->colors[i].g = rgb[3*i+1];
+    pal->colors[i].b = rgb[3*i+2];
+  }
+  if(!finish_palette(pal)){
+    free_palette(pal);
+    return 0;
+  }
+  free_palette(f->fl.palette);
+  f->fl.palette = pal;
+  f->finished = 0;
+  return 1;
+}
+
+extern int lf_set_view(lf_flame * f, int width, int height, double cx,
+                       double cy, double scale){
+  canvas cv;
+
+  if(f == NULL || !(scale > 0.0) ||
+     !init_canvas(&cv, width, height, cx - width/scale/2.0,
+                  cy - height/scale/2.0, width/scale, height/scale)){
+    fprintf(stderr,"lf_set_view: bad view. returning...\n");
+    return 0;
+  }
+  f->cv = cv;
+  return 1;
+}
+
+extern int lf_set_fast_math(lf_flame * f, int on){
+  if(f == NULL)
+    return 0;
+  set_fast_math(&f->fl.vs, on);
+  f->finished = 0;
+  return 1;
+}
+
+//function: lf_finish_flame
+//purpose: get f ready to render once it's set up
+extern int lf_finish_flame(lf_flame * f){
+  if(f == NULL)
+    return 0;
+  f->finished = finish_flame(&f->fl);
+  if(!f->finished)
+    fprintf(stderr,"lf_finish_flame: flame can't be rendered\n");
+  return f->finished;
+}
+
+extern int lf_get_width(lf_flame * f){
+  return f->cv.width;
+}
+
+extern int lf_get_height(lf_flame * f){
+  return f->cv.height;
+}
+
+extern int lf_get_nframes(lf_flame * f){
+  return f->fl.nframes;
+}
+
+//function: lf_render
+//purpose: walk frame t of f into hist, a chunk of LF_CHUNK_ITERATIONS at a
+//         time like render_frames(), each from its own stream of seed
+extern int lf_render(lf_flame * f, int t, long long niterations,
+                     uint64_t seed, lf_pixel * hist){
+  histogram * h;
+  rng_state rng;
+  long long nchunks, c;
+  int n;
+
+  if(f == NULL || hist == NULL || !f->finished){
+    fprintf(stderr,"lf_render: no finished flame or no histogram. "
+            "returning...\n");
+    return 0;
+  }
+  if(t < 0 || t >= f->fl.nframes || niterations <= LF_MINITERATIONS){
+    fprintf(stderr,"lf_render: no frame %d, or not more than %d iterations."
+            " returning...\n", t, LF_MINITERATIONS);
+    return 0;
+  }
+  h = wrap_pixels(&f->cv, hist, 0);
+  if(h == NULL){
+    fprintf(stderr,"lf_render: out of memory. returning...\n");
+    return 0;
+  }
+  //binning plots pays once the image is well past the size of the cache
+  if((long long)f->cv.width * f->cv.height > 1920*1080)
+    defer_histogram(h, DEFER_POINTS);
+
+  //render_frames()' chunks: the last one takes the remainder, and a runt
+  //too short to get past miniterations goes to the one before
+  nchunks = (niterations + LF_CHUNK_ITERATIONS - 1)/LF_CHUNK_ITERATIONS;
+  if(nchunks > 1 &&
+     niterations - (nchunks-1)*LF_CHUNK_ITERATIONS <= LF_MINITERATIONS)
+    nchunks--;
+  for(c=0; c<nchunks; c++){
+    n = (c == nchunks-1 ? niterations - (nchunks-1)*LF_CHUNK_ITERATIONS :
+         LF_CHUNK_ITERATIONS);
+    rng_seed(&rng, seed, ((uint64_t)t << 32) | (uint64_t)c);
+    walk_batch(&f->fl, t, n, LF_MINITERATIONS, h, &rng, NULL);
+  }
+  flush_histogram(h);
+
+  unwrap_pixels(h, hist);
+  return 1;
+}
+
+//function: lf_tone_map
+//purpose: tone_map_rows() for a caller's histogram, straight into its image
+extern int lf_tone_map(const lf_pixel * hist, int width, int height,
+                       double gamma, double vibrancy, float * rgb){
+  canvas cv;
+  histogram * h;
+  tone_map * tm;
+  plotcount_t max = 0;
+  long long i, n = (long long)width * height;
+
+  if(hist == NULL || rgb == NULL ||
+     !init_canvas(&cv, width, height, 0.0, 0.0, 1.0, 1.0)){
+    fprintf(stderr,"lf_tone_map: bad histogram or image. returning...\n");
+    return 0;
+  }
+  tm = new_tone_map(gamma, vibrancy);
+  h = wrap_pixels(&cv, hist, 1);
+  if(tm == NULL || h == NULL){
+    fprintf(stderr,"lf_tone_map: out of memory. returning...\n");
+    free_tone_map(tm);
+    if(h != NULL)
+      unwrap_pixels(h, NULL);
+    return 0;
+  }
+  for(i=0; i<n; i++){
+    if(hist[i].count > max)
+      max = hist[i].count;
+  }
+  tone_map_rows(tm, h, max, rgb, 0, height);
+  unwrap_pixels(h, NULL);
+  free_tone_map(tm);
+  return 1;
+}
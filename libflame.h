@@ -0,0 +1,112 @@
+/* Author: Ted Cooper
+ * Last revised: 7-2-2009
+ * FRACTAL FLAME RENDERER
+ * See top of engine.c for program description.
+ *
+ * libflame.h: the renderer as a library (libflame.a or libflame.so, see
+ * makefile), for programs that want flames without the engine around them.
+ * this is the only header they need, and it doesn't change from build to
+ * build: nothing in it depends on the precision, layout or bucket options
+ * the library was compiled with.  see libflame.c for description.
+ *
+ *   lf_init();
+ *   f = lf_new_flame(2);
+ *   lf_set_affine(f, 0, coefs0); lf_set_variation(f, 0, "swirl", 1.0); ...
+ *   lf_set_view(f, 640, 480, 0.0, 0.0, 200.0);
+ *   lf_finish_flame(f);
+ *   hist = calloc(640*480, sizeof(lf_pixel));
+ *   lf_render(f, 0, 10000000, seed, hist);
+ *   lf_tone_map(hist, 640, 480, 4.0, 1.0, rgb);
+ *   lf_free_flame(f);
+ *   lf_cleanup();
+ */
+
+#ifndef LIBFLAME_H
+#define LIBFLAME_H
+
+#include <stdint.h>
+
+//bumped whenever something here changes incompatibly
+#define LF_API_VERSION 1
+
+//what the shared library exports
+#define LF_API __attribute__((visibility("default")))
+
+//the xform index of a flame's final transformation
+#define LF_FINAL -1
+
+//TYPES
+
+//a flame: its xforms, palette and the part of the plane its images show
+typedef struct lf_flame lf_flame;
+
+//a histogram pixel: how many points were plotted there, and their palette
+//colors (0-255 a channel) summed, 64 bits so nothing a render or a sum of
+//renders does can wrap them.  a histogram is width*height of these, in rows
+//from the bottom (smallest y) up.  16-byte aligned ones (calloc's are) are
+//plotted into in place.
+typedef struct {
+  uint64_t count, r, g, b;
+} lf_pixel;
+
+//FUNCTIONS
+
+//every function that can fail returns nonzero on success and 0 on failure,
+//saying why on stderr.
+
+//the library.  lf_init() before anything else, lf_cleanup() after the last
+//flame is freed.
+LF_API extern int lf_api_version(void);
+LF_API extern int lf_init(void);
+LF_API extern int lf_cleanup(void);
+
+//flames.  a new flame's xforms are identities with weight 1, color 0 and
+//linear variation 1, and it has no final transformation until one of the
+//setters makes one.  it shows 800x600 pixels of [-1,1] x [-1,1] until
+//lf_set_view().  a flame can't be rendered after being changed until
+//lf_finish_flame() is called again.
+LF_API extern lf_flame * lf_new_flame(int nxforms);
+//the engine's own animation of nframes frames
+LF_API extern lf_flame * lf_builtin_flame(int nframes);
+LF_API extern void lf_free_flame(lf_flame * f);
+
+//xform i's, or the final transformation's with LF_FINAL.  coefs are
+//{a, b, c, d, e, f} for x' = ax + by + c, y' = dx + ey + f.
+LF_API extern int lf_set_affine(lf_flame * f, int i, const double coefs[6]);
+LF_API extern int lf_set_post(lf_flame * f, int i, const double coefs[6]);
+LF_API extern int lf_set_weight(lf_flame * f, int i, double weight);
+LF_API extern int lf_set_color(lf_flame * f, int i, double color);
+//name as in flam3 ("linear", "swirl", ...).  0 takes it out.
+LF_API extern int lf_set_variation(lf_flame * f, int i, const char * name,
+                                   double weight);
+//ncolors RGB triples in [0,1] that color indices 0 to 1 map to
+LF_API extern int lf_set_palette(lf_flame * f, const float * rgb,
+                                 int ncolors);
+//width x height pixels centered on (cx, cy), scale pixels to a unit
+LF_API extern int lf_set_view(lf_flame * f, int width, int height, double cx,
+                              double cy, double scale);
+//TRUE to walk with the variations' fast approximate math (fastmath.h in
+//the source), which plots a slightly different image faster.  off unless
+//the library was built with FASTMATH=1.
+LF_API extern int lf_set_fast_math(lf_flame * f, int on);
+LF_API extern int lf_finish_flame(lf_flame * f);
+
+LF_API extern int lf_get_width(lf_flame * f);
+LF_API extern int lf_get_height(lf_flame * f);
+LF_API extern int lf_get_nframes(lf_flame * f);
+
+//rendering.  a finished flame is only read, so any number of threads can
+//render it at once into different histograms.
+
+//walk niterations iterations of frame t (0 for anything but the built-in
+//animation) and add their plots to hist, lf_get_width() x lf_get_height()
+//pixels.  the same seed always plots the same points, the same ones
+//engine -s renders into that frame.
+LF_API extern int lf_render(lf_flame * f, int t, long long niterations,
+                            uint64_t seed, lf_pixel * hist);
+//tone map width x height pixels of hist into rgb, width*height RGB triples
+//in [0,1]
+LF_API extern int lf_tone_map(const lf_pixel * hist, int width, int height,
+                              double gamma, double vibrancy, float * rgb);
+
+#endif
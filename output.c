@@ -0,0 +1,347 @@
+/* Author: Ted Cooper
+ * Last revised: 7-2-2009
+ * FRACTAL FLAME RENDERER
+ * See top of engine.c for program description.
+ *
+ * output.c: headless output.  write_frame() copies each tone-mapped frame into
+ * an image_writer's bounded queue and returns; the writer's own thread does
+ * the encoding (8-bit conversion, PNG compression) and the file I/O, so render
+ * threads never wait on either unless the writer falls a whole queue behind.
+ * every animation being rendered can have its own.
+ *
+ * files are named <dir>/frame_NNNNN.<ext>.  PPM and PNG are 8-bit, clamped,
+ * top row first.  PFM keeps the tone-mapped floats as they are, including
+ * anything gamma pushed past 1.0, bottom row first like the histogram.
+ */
+
+//INCLUDES
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <png.h>
+#include "global.h"
+#include "output.h"
+
+//FUNCTIONS
+
+//private
+
+//clamp a tone-mapped channel to [0,1] and scale to 8 bits
+static unsigned char to_byte(color_t v){
+  if(v > 1.0)
+    v = 1.0;
+  if(!(v > 0.0))
+    v = 0.0;
+  return (unsigned char)(v*255.0 + 0.5);
+}
+
+//fill ow's row with 8-bit pixels from image row y (counting from the bottom)
+static void byte_row(image_writer * ow, color_t * rgb, int y){
+  int i;
+  color_t * src = rgb + 3*ow->width*y;
+
+  for(i=0; i<3*ow->width; i++){
+    ow->row[i] = to_byte(src[i]);
+  }
+}
+
+static int write_ppm(image_writer * ow, const char * path, color_t * rgb){
+  int y;
+  int width = ow->width, height = ow->height;
+  FILE * f = fopen(path, "wb");
+
+  if(f == NULL){
+    perror(path);
+    return 0;
+  }
+  fprintf(f, "P6\n%d %d\n255\n", width, height);
+  //ppm goes top to bottom, the histogram bottom to top
+  for(y=height-1; y>=0; y--){
+    byte_row(ow, rgb, y);
+    if(fwrite(ow->row, 1, 3*width, f) != (size_t)(3*width)){
+      perror(path);
+      fclose(f);
+      return 0;
+    }
+  }
+  return fclose(f) == 0;
+}
+
+static int write_pfm(image_writer * ow, const char * path, color_t * rgb){
+  union { unsigned int i; unsigned char c[4]; } endian;
+  FILE * f = fopen(path, "wb");
+  size_t n = (size_t)3*ow->width*ow->height;
+
+  if(f == NULL){
+    perror(path);
+    return 0;
+  }
+  //negative scale means little-endian
+  endian.i = 1;
+  fprintf(f, "PF\n%d %d\n%s\n", ow->width, ow->height,
+          endian.c[0] ? "-1.0" : "1.0");
+  //pfm rows go bottom to top already
+  if(sizeof(color_t) != 4 || fwrite(rgb, sizeof(color_t), n, f) != n){
+    perror(path);
+    fclose(f);
+    return 0;
+  }
+  return fclose(f) == 0;
+}
+
+static int write_png(image_writer * ow, const char * path, color_t * rgb){
+  int y;
+  int width = ow->width, height = ow->height;
+  png_structp png;
+  png_infop info;
+  FILE * f = fopen(path, "wb");
+
+  if(f == NULL){
+    perror(path);
+    return 0;
+  }
+  png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+  info = (png == NULL ? NULL : png_create_info_struct(png));
+  if(info == NULL){
+    fprintf(stderr,"write_png: couldn't set up libpng for %s\n", path);
+    png_destroy_write_struct(&png, NULL);
+    fclose(f);
+    return 0;
+  }
+  //libpng reports errors by longjmp'ing back here
+  if(setjmp(png_jmpbuf(png))){
+    fprintf(stderr,"write_png: libpng failed writing %s\n", path);
+    png_destroy_write_struct(&png, &info);
+    fclose(f);
+    return 0;
+  }
+  png_init_io(png, f);
+  png_set_IHDR(png, info, width, height, 8, PNG_COLOR_TYPE_RGB,
+               PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT,
+               PNG_FILTER_TYPE_DEFAULT);
+  png_write_info(png, info);
+  for(y=height-1; y>=0; y--){
+    byte_row(ow, rgb, y);
+    png_write_row(png, ow->row);
+  }
+  png_write_end(png, NULL);
+  png_destroy_write_struct(&png, &info);
+  return fclose(f) == 0;
+}
+
+//function: write_files
+//purpose: write frame t in every format ow wants
+//returns TRUE on success, FALSE if any of them failed
+static int write_files(image_writer * ow, int t, color_t * rgb){
+  char path[MAXPATH + 32];
+  int ok = 1;
+
+  if(ow->formats & FORMAT_PPM){
+    snprintf(path, sizeof(path), "%s/frame_%05d.ppm", ow->dir, t);
+    ok &= write_ppm(ow, path, rgb);
+  }
+  if(ow->formats & FORMAT_PNG){
+    snprintf(path, sizeof(path), "%s/frame_%05d.png", ow->dir, t);
+    ok &= write_png(ow, path, rgb);
+  }
+  if(ow->formats & FORMAT_PFM){
+    snprintf(path, sizeof(path), "%s/frame_%05d.pfm", ow->dir, t);
+    ok &= write_pfm(ow, path, rgb);
+  }
+  return ok;
+}
+
+//writer thread: drain ow's queue until close_output() says we're done
+static void * writer_main(void * arg){
+  image_writer * ow = (image_writer *)arg;
+  queued_frame qf;
+  int ok;
+
+  for(;;){
+    pthread_mutex_lock(&ow->queue_lock);
+    while(ow->nqueued == 0 && !ow->done){
+      pthread_cond_wait(&ow->not_empty, &ow->queue_lock);
+    }
+    if(ow->nqueued == 0 && ow->done){
+      pthread_mutex_unlock(&ow->queue_lock);
+      break;
+    }
+    qf = ow->queue[ow->head];
+    pthread_mutex_unlock(&ow->queue_lock);
+
+    //the entry stays queued (so its buffer isn't reused) until it's written
+    ok = write_files(ow, qf.t, qf.rgb);
+
+    pthread_mutex_lock(&ow->queue_lock);
+    if(!ok)
+      ow->failed = 1;
+    ow->head = (ow->head + 1) % ow->queue_len;
+    ow->nqueued--;
+    pthread_cond_signal(&ow->not_full);
+    pthread_mutex_unlock(&ow->queue_lock);
+  }
+
+  return NULL;
+}
+
+//public
+
+//function: open_output
+//purpose: start a writer thread for frames going in dir, which has to exist.
+//params: formats - FORMAT_ flags.
+//        width, height - image size every frame will have.
+//        queue_len - frames that can be waiting to be written before
+//        write_frame() blocks.  each costs a float image's worth of memory.
+//returns the writer on success, NULL on failure
+extern image_writer * open_output(const char * dir, int formats, int width,
+                                  int height, int queue_len){
+  int i;
+  image_writer * ow;
+
+  if(strlen(dir) >= MAXPATH || formats == 0 || width <= 0 ||
+     height <= 0 || queue_len <= 0){
+    fprintf(stderr,"open_output: bad arguments. returning...\n");
+    return NULL;
+  }
+
+  ow = calloc(1, sizeof(image_writer));
+  if(ow == NULL){
+    fprintf(stderr,"open_output: out of memory. returning...\n");
+    return NULL;
+  }
+  strcpy(ow->dir, dir);
+  ow->formats = formats;
+  ow->width = width;
+  ow->height = height;
+  ow->queue_len = queue_len;
+  pthread_mutex_init(&ow->queue_lock, NULL);
+  pthread_cond_init(&ow->not_empty, NULL);
+  pthread_cond_init(&ow->not_full, NULL);
+
+  ow->row = malloc(3*width);
+  ow->queue = calloc(queue_len, sizeof(queued_frame));
+  if(ow->row == NULL || ow->queue == NULL){
+    fprintf(stderr,"open_output: out of memory. returning...\n");
+    close_output(ow);
+    return NULL;
+  }
+  for(i=0; i<queue_len; i++){
+    ow->queue[i].rgb = malloc(sizeof(color_t) * 3 * width * height);
+    if(ow->queue[i].rgb == NULL){
+      fprintf(stderr,"open_output: out of memory. returning...\n");
+      close_output(ow);
+      return NULL;
+    }
+  }
+
+  if(pthread_create(&ow->writer, NULL, writer_main, ow) != 0){
+    fprintf(stderr,"open_output: pthread_create failed. returning...\n");
+    close_output(ow);
+    return NULL;
+  }
+  ow->writer_running = 1;
+
+  return ow;
+}
+
+//function: close_output
+//purpose: wait for every frame queued on ow to be written, then stop its
+//         writer and free it.
+//returns TRUE if every frame was written, FALSE otherwise
+extern int close_output(image_writer * ow){
+  int i, ok;
+
+  if(ow == NULL)
+    return 1;
+
+  if(ow->writer_running){
+    pthread_mutex_lock(&ow->queue_lock);
+    ow->done = 1;
+    pthread_cond_signal(&ow->not_empty);
+    pthread_mutex_unlock(&ow->queue_lock);
+    pthread_join(ow->writer, NULL);
+  }
+
+  if(ow->queue != NULL){
+    for(i=0; i<ow->queue_len; i++){
+      free(ow->queue[i].rgb);
+    }
+  }
+  free(ow->queue);
+  free(ow->row);
+  pthread_cond_destroy(&ow->not_full);
+  pthread_cond_destroy(&ow->not_empty);
+  pthread_mutex_destroy(&ow->queue_lock);
+  ok = !ow->failed;
+  free(ow);
+
+  return ok;
+}
+
+//function: parse_formats
+//purpose: parse a comma-separated list of format names (ppm, png, pfm)
+//returns the FORMAT_ flags on success, 0 on failure
+extern int parse_formats(const char * list){
+  int f = 0;
+  const char * p = list;
+  size_t n;
+
+  while(*p){
+    n = strcspn(p, ",");
+    if(n == 3 && strncmp(p, "ppm", 3) == 0)
+      f |= FORMAT_PPM;
+    else if(n == 3 && strncmp(p, "png", 3) == 0)
+      f |= FORMAT_PNG;
+    else if(n == 3 && strncmp(p, "pfm", 3) == 0)
+      f |= FORMAT_PFM;
+    else{
+      fprintf(stderr,"parse_formats: unknown format in \"%s\"\n", list);
+      return 0;
+    }
+    p += n;
+    if(*p == ',')
+      p++;
+  }
+
+  return f;
+}
+
+//function: write_frame
+//purpose: frame_sink for the animation.  copies frame t into the queue of
+//         arg, an image_writer, waiting only if the queue is full.
+//returns TRUE on success, FALSE on failure (including an earlier frame that
+//        the writer couldn't write)
+extern int write_frame(int t, color_t * rgb, int width, int height,
+                       void * arg){
+  image_writer * ow = (image_writer *)arg;
+  int tail, ok;
+
+  if(width != ow->width || height != ow->height){
+    fprintf(stderr,"write_frame: frame %d is %dx%d, expected %dx%d\n",
+            t, width, height, ow->width, ow->height);
+    return 0;
+  }
+
+  pthread_mutex_lock(&ow->queue_lock);
+  while(ow->nqueued == ow->queue_len){
+    pthread_cond_wait(&ow->not_full, &ow->queue_lock);
+  }
+  tail = (ow->head + ow->nqueued) % ow->queue_len;
+  pthread_mutex_unlock(&ow->queue_lock);
+
+  //nobody else touches the tail entry until it's counted.  write_frame is a
+  //frame_sink, so it's never called concurrently with itself for the same
+  //writer.
+  ow->queue[tail].t = t;
+  memcpy(ow->queue[tail].rgb, rgb, sizeof(color_t) * 3 * width * height);
+
+  pthread_mutex_lock(&ow->queue_lock);
+  ow->nqueued++;
+  ok = !ow->failed;
+  pthread_cond_signal(&ow->not_empty);
+  pthread_mutex_unlock(&ow->queue_lock);
+
+  return ok;
+}
@@ -0,0 +1,69 @@
+/* Author: Ted Cooper
+ * Last revised: 7-2-2009
+ * FRACTAL FLAME RENDERER
+ * See top of engine.c for program description.
+ *
+ * output.h: see output.c for description.
+ */
+
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <pthread.h>
+#include "global.h"
+
+//image formats, or'd together to write more than one per frame
+#define FORMAT_PPM 1 //8-bit binary portable pixmap
+#define FORMAT_PNG 2 //8-bit RGB PNG
+#define FORMAT_PFM 4 //32-bit float portable float map, not clamped
+
+#define MAXPATH 4096
+
+//DATA TYPES
+
+//writer queue entry
+typedef struct {
+  int t;
+  color_t * rgb;
+} queued_frame;
+
+//one output directory and the thread that writes frames into it
+typedef struct {
+  char dir[MAXPATH];
+  int formats;
+  int width, height;
+
+  pthread_t writer;
+  int writer_running;
+
+  //ring buffer of frames waiting to be written.  the pixel buffers are
+  //allocated once and passed around with their entries.
+  pthread_mutex_t queue_lock;
+  pthread_cond_t not_empty;
+  pthread_cond_t not_full;
+  queued_frame * queue;
+  int queue_len;
+  int head;      //next entry to write out
+  int nqueued;
+  int done;      //no more frames are coming
+  int failed;    //some write went wrong
+
+  unsigned char * row; //writer's 8-bit row scratch
+} image_writer;
+
+//public
+
+//initialization/teardown
+extern image_writer * open_output(const char * dir, int formats, int width,
+                                  int height, int queue_len);
+extern int close_output(image_writer * ow);
+
+//turns a list like "png,pfm" into FORMAT_ flags. returns 0 if it's no good
+extern int parse_formats(const char * list);
+
+//queues a finished frame for the writer thread (a frame_sink, see animate.h).
+//arg is the image_writer.
+extern int write_frame(int t, color_t * rgb, int width, int height,
+                       void * arg);
+
+#endif
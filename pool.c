@@ -0,0 +1,304 @@
+/* Author: Ted Cooper
+ * Last revised: 7-2-2009
+ * FRACTAL FLAME RENDERER
+ * See top of engine.c for program description.
+ *
+ * pool.c: a small work-stealing thread pool.  every worker has its own task
+ * deque; it runs its own newest work first and, when it runs dry, steals the
+ * oldest work from somebody else.  the deques are locked rather than
+ * lock-free, which is plenty when tasks are as coarse as ours (millions of
+ * iterations each).
+ */
+
+//INCLUDES
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sched.h>
+#include "pool.h"
+
+//GLOBALS
+
+#define INITIAL_DEQUE_CAP 64
+
+//FUNCTIONS
+
+//private
+
+static int deque_init(task_deque * d){
+  d->tasks = malloc(sizeof(task) * INITIAL_DEQUE_CAP);
+  if(d->tasks == NULL)
+    return 0;
+  d->cap = INITIAL_DEQUE_CAP;
+  d->top = 0;
+  d->bottom = 0;
+  pthread_mutex_init(&d->lock, NULL);
+  return 1;
+}
+
+static void deque_cleanup(task_deque * d){
+  pthread_mutex_destroy(&d->lock);
+  free(d->tasks);
+}
+
+//function: deque_push
+//purpose: push a task onto the bottom of d, growing it if it's full.
+//returns TRUE on success, FALSE on failure
+static int deque_push(task_deque * d, task tk){
+  int i, n;
+  task * grown;
+
+  pthread_mutex_lock(&d->lock);
+  n = d->bottom - d->top;
+  if(n == d->cap){
+    grown = malloc(sizeof(task) * d->cap * 2);
+    if(grown == NULL){
+      pthread_mutex_unlock(&d->lock);
+      return 0;
+    }
+    for(i=0; i<n; i++){
+      grown[i] = d->tasks[(d->top + i) % d->cap];
+    }
+    free(d->tasks);
+    d->tasks = grown;
+    d->cap *= 2;
+    d->top = 0;
+    d->bottom = n;
+  }
+  d->tasks[d->bottom % d->cap] = tk;
+  d->bottom++;
+  pthread_mutex_unlock(&d->lock);
+  return 1;
+}
+
+//function: deque_pop
+//purpose: owner's end.  take the newest task from the bottom of d.
+//returns TRUE if a task was taken, FALSE if d was empty
+static int deque_pop(task_deque * d, task * tk){
+  int ret = 0;
+
+  pthread_mutex_lock(&d->lock);
+  if(d->bottom > d->top){
+    d->bottom--;
+    *tk = d->tasks[d->bottom % d->cap];
+    ret = 1;
+  }
+  pthread_mutex_unlock(&d->lock);
+  return ret;
+}
+
+//function: deque_steal
+//purpose: thief's end.  take the oldest task from the top of d.
+//returns TRUE if a task was taken, FALSE if d was empty
+static int deque_steal(task_deque * d, task * tk){
+  int ret = 0;
+
+  pthread_mutex_lock(&d->lock);
+  if(d->bottom > d->top){
+    *tk = d->tasks[d->top % d->cap];
+    d->top++;
+    //keep the indices small
+    if(d->top == d->bottom){
+      d->top = 0;
+      d->bottom = 0;
+    }
+    ret = 1;
+  }
+  pthread_mutex_unlock(&d->lock);
+  return ret;
+}
+
+//function: find_task
+//purpose: worker's own deque first, then every other worker's, starting with
+//         its neighbor so thieves don't all pile onto worker 0.
+//returns TRUE if a task was found
+static int find_task(thread_pool * pool, int worker, task * tk){
+  int i;
+
+  if(deque_pop(&pool->deques[worker], tk))
+    return 1;
+  for(i=1; i<pool->nworkers; i++){
+    if(deque_steal(&pool->deques[(worker + i) % pool->nworkers], tk))
+      return 1;
+  }
+  return 0;
+}
+
+typedef struct {
+  thread_pool * pool;
+  int worker;
+} worker_arg;
+
+static void * worker_main(void * arg){
+  thread_pool * pool = ((worker_arg *)arg)->pool;
+  int worker = ((worker_arg *)arg)->worker;
+  task tk;
+
+  free(arg);
+
+  for(;;){
+    pthread_mutex_lock(&pool->lock);
+    while(pool->nqueued == 0 && !pool->shutdown){
+      pthread_cond_wait(&pool->work, &pool->lock);
+    }
+    if(pool->nqueued == 0 && pool->shutdown){
+      pthread_mutex_unlock(&pool->lock);
+      break;
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    //nqueued is bumped before the push lands in a deque, so this can come up
+    //empty for a moment
+    if(!find_task(pool, worker, &tk)){
+      sched_yield();
+      continue;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->nqueued--;
+    pthread_mutex_unlock(&pool->lock);
+
+    tk.fn(tk.arg, worker);
+
+    pthread_mutex_lock(&pool->lock);
+    pool->noutstanding--;
+    if(pool->noutstanding == 0)
+      pthread_cond_broadcast(&pool->idle);
+    pthread_mutex_unlock(&pool->lock);
+  }
+
+  return NULL;
+}
+
+//public
+
+//function: pool_create
+//purpose: start a pool of nworkers threads, all idle until work is submitted
+//returns the pool on success, NULL on failure
+extern thread_pool * pool_create(int nworkers){
+  int i;
+  thread_pool * pool;
+  worker_arg * arg;
+
+  if(nworkers < 1){
+    fprintf(stderr,"pool_create: need at least one worker. returning...\n");
+    return NULL;
+  }
+
+  pool = calloc(1, sizeof(thread_pool));
+  if(pool == NULL)
+    return NULL;
+  pool->nworkers = nworkers;
+  pool->threads = calloc(nworkers, sizeof(pthread_t));
+  pool->deques = calloc(nworkers, sizeof(task_deque));
+  if(pool->threads == NULL || pool->deques == NULL){
+    free(pool->threads);
+    free(pool->deques);
+    free(pool);
+    return NULL;
+  }
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->work, NULL);
+  pthread_cond_init(&pool->idle, NULL);
+
+  for(i=0; i<nworkers; i++){
+    if(!deque_init(&pool->deques[i])){
+      fprintf(stderr,"pool_create: out of memory. exiting...\n");
+      exit(1);
+    }
+  }
+  for(i=0; i<nworkers; i++){
+    arg = malloc(sizeof(worker_arg));
+    if(arg == NULL){
+      fprintf(stderr,"pool_create: out of memory. exiting...\n");
+      exit(1);
+    }
+    arg->pool = pool;
+    arg->worker = i;
+    if(pthread_create(&pool->threads[i], NULL, worker_main, arg) != 0){
+      fprintf(stderr,"pool_create: pthread_create failed. exiting...\n");
+      exit(1);
+    }
+  }
+
+  return pool;
+}
+
+//function: pool_destroy
+//purpose: finish whatever is queued, stop the workers and free the pool
+//returns TRUE
+extern int pool_destroy(thread_pool * pool){
+  int i;
+
+  if(pool == NULL)
+    return 1;
+
+  pthread_mutex_lock(&pool->lock);
+  pool->shutdown = 1;
+  pthread_cond_broadcast(&pool->work);
+  pthread_mutex_unlock(&pool->lock);
+
+  for(i=0; i<pool->nworkers; i++){
+    pthread_join(pool->threads[i], NULL);
+  }
+  for(i=0; i<pool->nworkers; i++){
+    deque_cleanup(&pool->deques[i]);
+  }
+  pthread_cond_destroy(&pool->idle);
+  pthread_cond_destroy(&pool->work);
+  pthread_mutex_destroy(&pool->lock);
+  free(pool->deques);
+  free(pool->threads);
+  free(pool);
+
+  return 1;
+}
+
+//function: pool_submit
+//purpose: queue fn(arg).  tasks submitted by a pool thread go on that
+//         thread's own deque (where it will run them next unless someone
+//         steals them first); tasks from outside are dealt out round-robin.
+//params: worker - index of the calling pool thread, or -1 if the caller
+//        isn't one.
+//returns TRUE on success, FALSE on failure
+extern int pool_submit(thread_pool * pool, int worker, task_fn fn, void * arg){
+  task tk;
+
+  tk.fn = fn;
+  tk.arg = arg;
+
+  //count the task before it's visible, so it can't finish (and drop
+  //noutstanding) before it's been counted
+  pthread_mutex_lock(&pool->lock);
+  if(worker < 0 || worker >= pool->nworkers){
+    worker = pool->next;
+    pool->next = (pool->next + 1) % pool->nworkers;
+  }
+  pool->nqueued++;
+  pool->noutstanding++;
+  pthread_mutex_unlock(&pool->lock);
+
+  if(!deque_push(&pool->deques[worker], tk)){
+    fprintf(stderr,"pool_submit: out of memory. exiting...\n");
+    exit(1);
+  }
+
+  pthread_mutex_lock(&pool->lock);
+  pthread_cond_signal(&pool->work);
+  pthread_mutex_unlock(&pool->lock);
+
+  return 1;
+}
+
+//function: pool_wait
+//purpose: block until every submitted task (including ones submitted by
+//         other tasks in the meantime) has finished
+//returns TRUE
+extern int pool_wait(thread_pool * pool){
+  pthread_mutex_lock(&pool->lock);
+  while(pool->noutstanding > 0){
+    pthread_cond_wait(&pool->idle, &pool->lock);
+  }
+  pthread_mutex_unlock(&pool->lock);
+  return 1;
+}
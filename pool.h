@@ -0,0 +1,61 @@
+/* Author: Ted Cooper
+ * Last revised: 7-2-2009
+ * FRACTAL FLAME RENDERER
+ * See top of engine.c for program description.
+ *
+ * pool.h: see pool.c for description.
+ */
+
+#ifndef POOL_H
+#define POOL_H
+
+#include <pthread.h>
+
+//DATA TYPES
+
+//a unit of work.  worker is the index of the pool thread running it, so tasks
+//can keep per-worker scratch space and submit follow-up work to themselves.
+typedef void (*task_fn)(void * arg, int worker);
+
+typedef struct {
+  task_fn fn;
+  void * arg;
+} task;
+
+//one worker's double-ended task queue.  the owner pushes and pops at the
+//bottom, thieves take from the top.
+typedef struct {
+  task * tasks;
+  int cap;
+  int top;
+  int bottom;
+  pthread_mutex_t lock;
+} task_deque;
+
+typedef struct {
+  int nworkers;
+  pthread_t * threads;
+  task_deque * deques;
+
+  //protects everything below
+  pthread_mutex_t lock;
+  pthread_cond_t work;  //signaled when tasks are queued or on shutdown
+  pthread_cond_t idle;  //signaled when the last outstanding task finishes
+  int nqueued;          //tasks sitting in deques
+  int noutstanding;     //tasks queued or running
+  int next;             //round-robin deque for tasks submitted from outside
+  int shutdown;
+} thread_pool;
+
+//FUNCTIONS
+
+//public
+
+extern thread_pool * pool_create(int nworkers);
+extern int pool_destroy(thread_pool * pool);
+
+//worker - index of the submitting pool thread, or -1 from outside the pool
+extern int pool_submit(thread_pool * pool, int worker, task_fn fn, void * arg);
+extern int pool_wait(thread_pool * pool);
+
+#endif
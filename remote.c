@@ -0,0 +1,680 @@
+/* Author: Ted Cooper
+ * Last revised: 7-2-2009
+ * FRACTAL FLAME RENDERER
+ * See top of engine.c for program description.
+ *
+ * remote.c: renders split over several processes, on this machine or
+ * others.  a worker process (engine -W port) serves walks: a coordinator
+ * sends it a frame, an iteration count and the rng state to walk them from,
+ * and it walks them into a histogram of its own and sends back just the
+ * pixels that got plotted, packed small, and deflated with zlib too if the
+ * coordinator asks.
+ *
+ * on the coordinator, walk_remote() is a walk_fn (see render.h) that has a
+ * worker do the walking, so render_frames() (animate.c) hands out chunks,
+ * merges them, tone maps, checkpoints and writes frames exactly as it does
+ * when it walks them itself.  chunks carry the same rng states they would
+ * locally, so a split render makes the same images as one on one machine
+ * with the same walker.
+ *
+ * workers build their flames the way the coordinator does, and every
+ * request has the frame's flame parameters (see checkpoint.c) in it, so a
+ * worker with a different flame refuses chunks instead of plotting the wrong
+ * one.  a worker that refuses, can't be reached or drops its connection
+ * loses it, and its chunk, and any after the last connection is gone, are
+ * walked locally.
+ */
+
+//INCLUDES
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <zlib.h>
+#include "global.h"
+#include "functions.h"
+#include "histogram.h"
+#include "render.h"
+#include "batch.h"
+#include "rng.h"
+#include "checkpoint.h"
+#include "remote.h"
+
+//GLOBALS
+
+#define REMOTE_REQUEST_MAGIC "FLAMEWLK"
+#define REMOTE_REPLY_MAGIC "FLAMEPIX"
+#define REMOTE_VERSION 3
+#define REMOTE_BYTE_ORDER 0x01020304 //see CHECKPOINT_BYTE_ORDER
+#define REMOTE_BACKLOG 16
+//most a packed pixel can take, see pack_pixels(): a 5-byte index and four
+//10-byte sums
+#define REMOTE_PIXEL_BYTES 45
+
+//TYPES
+
+//coordinator to worker: walk these.  followed by nparams doubles of flame
+//parameters, see flame_params().
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  int32_t t, niterations, miniterations;
+  uint32_t width, height; //of the histogram to walk into
+  uint32_t nparams;
+  int32_t compression;    //zlib level for the reply, or 0 for none
+  int32_t counted;        //TRUE to have the walk's counters sent back
+  rng_state rng;
+} remote_request;
+
+//worker to coordinator.  if ok, followed by nselected counts of times each
+//function was picked (none unless the request was counted), then nbytes of
+//pixels from pack_pixels(), nraw bytes of them before they were deflated.
+typedef struct {
+  char magic[8];
+  int32_t ok;
+  int32_t compressed;
+  uint64_t nraw, nbytes;
+  int64_t iterations, outside, nonfinite; //see frame_counters
+  uint32_t nselected;
+} remote_reply;
+
+
+//a worker connection's state
+typedef struct {
+  int fd;
+  flame * fl;
+  walk_fn walk;
+} remote_client;
+
+//the coordinator's connections to workers
+typedef struct {
+  pthread_mutex_t lock;  //protects everything below
+  pthread_cond_t idle;   //signaled when a connection is put back or dropped
+  int * fds;             //idle connections
+  int nidle;
+  int nlive;             //connections that haven't been dropped
+  int compression;       //zlib level replies are deflated with, or 0
+} remote_set;
+
+static remote_set remotes;
+static int remotes_open = 0;
+
+//FUNCTIONS
+
+//private
+
+//function: read_full
+//purpose: read exactly n bytes from fd
+//returns TRUE on success, FALSE on error or end of file
+static int read_full(int fd, void * buf, size_t n){
+  char * p = buf;
+  ssize_t r;
+
+  while(n > 0){
+    r = recv(fd, p, n, 0);
+    if(r < 0 && errno == EINTR)
+      continue;
+    if(r <= 0)
+      return 0;
+    p += r;
+    n -= r;
+  }
+  return 1;
+}
+
+//function: write_full
+//purpose: write exactly n bytes to fd.  a closed connection is an error,
+//         not a SIGPIPE.
+//returns TRUE on success, FALSE on failure
+static int write_full(int fd, const void * buf, size_t n){
+  const char * p = buf;
+  ssize_t r;
+
+  while(n > 0){
+    r = send(fd, p, n, MSG_NOSIGNAL);
+    if(r < 0 && errno == EINTR)
+      continue;
+    if(r <= 0)
+      return 0;
+    p += r;
+    n -= r;
+  }
+  return 1;
+}
+
+//function: refuse
+//purpose: tell the coordinator on fd that its request won't be walked
+static void refuse(int fd, const char * why){
+  remote_reply rep;
+
+  fprintf(stderr,"serve_remote: refusing a request: %s\n", why);
+  memset(&rep, 0, sizeof(rep));
+  memcpy(rep.magic, REMOTE_REPLY_MAGIC, sizeof(rep.magic));
+  rep.ok = 0;
+  write_full(fd, &rep, sizeof(rep));
+}
+
+//function: put_varint
+//purpose: write v 7 bits a byte, low bits first, with the top bit of every
+//         byte but the last set
+//returns the byte after it
+static inline unsigned char * put_varint(unsigned char * p, uint64_t v){
+  while(v >= 0x80){
+    *p++ = (v & 0x7f) | 0x80;
+    v >>= 7;
+  }
+  *p++ = v;
+  return p;
+}
+
+//function: get_varint
+//purpose: read a number put_varint() wrote, if it's all before end
+//returns the byte after it, or NULL if it runs past end
+static inline const unsigned char * get_varint(const unsigned char * p,
+                                               const unsigned char * end,
+                                               uint64_t * v){
+  int shift;
+
+  *v = 0;
+  for(shift=0; p < end && shift < 70; shift+=7){
+    *v |= (uint64_t)(*p & 0x7f) << shift;
+    if(!(*p++ & 0x80))
+      return p;
+  }
+  return NULL;
+}
+
+//function: pack_pixels
+//purpose: h's plotted pixels, in row order, and clear h for the next
+//         request.  each is how many pixels after the one before it it is
+//         (the first, after pixel 0), then its sums, all varints: a chunk's
+//         sums are small and most plotted pixels are next to another one,
+//         so it's mostly a byte a number.
+//params: raw - REMOTE_PIXEL_BYTES for every pixel of h
+//returns how many bytes of raw it took
+static size_t pack_pixels(histogram * h, unsigned char * raw){
+  int x, y, last = 0;
+  int width = get_width(h), height = get_height(h);
+  unsigned char * p = raw;
+  pixel_sum s;
+
+  for(y=0; y<height; y++){
+    for(x=0; x<width; x++){
+      s = read_bucket(h, x, y);
+      if(s.count == 0)
+        continue;
+      p = put_varint(p, y*width + x - last);
+      p = put_varint(p, s.count);
+      p = put_varint(p, s.r);
+      p = put_varint(p, s.g);
+      p = put_varint(p, s.b);
+      last = y*width + x;
+    }
+  }
+  clear_histogram(h);
+  return p - raw;
+}
+
+//function: serve_client
+//purpose: thread that walks a coordinator's requests, one at a time, until
+//         it hangs up or sends one this worker won't walk
+static void * serve_client(void * arg){
+  remote_client * rc = (remote_client *)arg;
+  remote_request req;
+  remote_reply rep;
+  histogram * h = NULL;
+  frame_counters fc;
+  canvas cv;
+  double * params, * mine;
+  unsigned char * raw = NULL, * out = NULL;
+  size_t nraw;
+  uLongf nbytes;
+  int n;
+
+  params = malloc(sizeof(double) * CHECKPOINT_MAX_PARAMS);
+  mine = malloc(sizeof(double) * CHECKPOINT_MAX_PARAMS);
+  if(params == NULL || mine == NULL ||
+     !init_counters(&fc, rc->fl->nfunctions)){
+    fprintf(stderr,"serve_client: out of memory. exiting...\n");
+    exit(1);
+  }
+
+  while(read_full(rc->fd, &req, sizeof(req))){
+    if(memcmp(req.magic, REMOTE_REQUEST_MAGIC, sizeof(req.magic)) != 0 ||
+       req.version != REMOTE_VERSION ||
+       req.byte_order != REMOTE_BYTE_ORDER ||
+       req.nparams > CHECKPOINT_MAX_PARAMS){
+      refuse(rc->fd, "not a version 2 request from a machine like this one");
+      break;
+    }
+    if(!read_full(rc->fd, params, sizeof(double) * req.nparams))
+      break;
+    if(req.t < 0 || req.t >= rc->fl->nframes ||
+       req.niterations <= req.miniterations ||
+       req.nparams < 4 ||
+       !init_canvas(&cv, req.width, req.height, params[0], params[1],
+                    params[2], params[3])){
+      refuse(rc->fd, "bad frame, iterations or canvas");
+      break;
+    }
+    n = flame_params(rc->fl, req.t, &cv, mine, CHECKPOINT_MAX_PARAMS);
+    if(n != (int)req.nparams ||
+       memcmp(mine, params, sizeof(double) * n) != 0){
+      refuse(rc->fd, "it's for a different flame");
+      break;
+    }
+
+    //the histogram only has to be made again if the canvas changes
+    if(h == NULL || get_width(h) != cv.width ||
+       get_height(h) != cv.height || h->cv.minX != cv.minX ||
+       h->cv.minY != cv.minY || h->cv.rangeX != cv.rangeX ||
+       h->cv.rangeY != cv.rangeY){
+      free_histogram(h);
+      free(raw);
+      free(out);
+      h = new_histogram(&cv);
+      raw = malloc((size_t)REMOTE_PIXEL_BYTES * get_npixels(h));
+      out = malloc(compressBound((size_t)REMOTE_PIXEL_BYTES *
+                                 get_npixels(h)));
+      if(h == NULL || raw == NULL || out == NULL){
+        fprintf(stderr,"serve_client: out of memory. exiting...\n");
+        exit(1);
+      }
+    }
+
+    clear_counters(&fc);
+    rc->walk(rc->fl, req.t, req.niterations, req.miniterations, h,
+             &req.rng, req.counted ? &fc : NULL);
+    flush_histogram(h);
+    nraw = pack_pixels(h, raw);
+    nbytes = compressBound(nraw);
+    if(req.compression > 0 &&
+       compress2(out, &nbytes, raw, nraw, req.compression) != Z_OK){
+      refuse(rc->fd, "compress2 failed");
+      break;
+    }
+
+    memset(&rep, 0, sizeof(rep));
+    memcpy(rep.magic, REMOTE_REPLY_MAGIC, sizeof(rep.magic));
+    rep.ok = 1;
+    rep.compressed = (req.compression > 0);
+    rep.nraw = nraw;
+    rep.nbytes = (rep.compressed ? nbytes : nraw);
+    if(req.counted){
+      rep.iterations = fc.iterations;
+      rep.outside = fc.outside;
+      rep.nonfinite = fc.nonfinite;
+      rep.nselected = fc.nxforms;
+    }
+    if(!write_full(rc->fd, &rep, sizeof(rep)) ||
+       !write_full(rc->fd, fc.selected, sizeof(int64_t) * rep.nselected) ||
+       !write_full(rc->fd, rep.compressed ? out : raw, rep.nbytes))
+      break;
+  }
+
+  close(rc->fd);
+  free_counters(&fc);
+  free_histogram(h);
+  free(raw);
+  free(out);
+  free(params);
+  free(mine);
+  free(rc);
+  return NULL;
+}
+
+//function: connect_to
+//purpose: open a connection to the worker at addr, "host:port"
+//returns the connection on success, -1 on failure
+static int connect_to(const char * addr){
+  struct addrinfo hints, * res, * ai;
+  char host[256];
+  const char * colon = strrchr(addr, ':');
+  int fd = -1, one = 1;
+
+  if(colon == NULL || colon == addr || colon - addr >= (int)sizeof(host)){
+    fprintf(stderr,"connect_to: \"%s\" isn't host:port. returning...\n",
+            addr);
+    return -1;
+  }
+  memcpy(host, addr, colon - addr);
+  host[colon - addr] = '\0';
+
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  if(getaddrinfo(host, colon + 1, &hints, &res) != 0){
+    fprintf(stderr,"connect_to: can't resolve %s. returning...\n", addr);
+    return -1;
+  }
+  for(ai=res; ai!=NULL; ai=ai->ai_next){
+    fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if(fd < 0)
+      continue;
+    if(connect(fd, ai->ai_addr, ai->ai_addrlen) == 0)
+      break;
+    close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(res);
+  if(fd < 0){
+    perror(addr);
+    return -1;
+  }
+  //requests are small and answered one at a time
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  return fd;
+}
+
+//function: take_connection
+//purpose: wait for an idle connection to a worker
+//returns it, or -1 if they've all been dropped
+static int take_connection(){
+  int fd = -1;
+
+  pthread_mutex_lock(&remotes.lock);
+  while(remotes.nidle == 0 && remotes.nlive > 0){
+    pthread_cond_wait(&remotes.idle, &remotes.lock);
+  }
+  if(remotes.nidle > 0)
+    fd = remotes.fds[--remotes.nidle];
+  pthread_mutex_unlock(&remotes.lock);
+  return fd;
+}
+
+//function: give_back
+//purpose: put a connection from take_connection() back, or drop it if it
+//         failed
+static void give_back(int fd, int ok){
+  pthread_mutex_lock(&remotes.lock);
+  if(ok){
+    remotes.fds[remotes.nidle++] = fd;
+  }else{
+    close(fd);
+    if(--remotes.nlive == 0)
+      fprintf(stderr,"walk_remote: no workers left. walking locally...\n");
+  }
+  pthread_cond_broadcast(&remotes.idle);
+  pthread_mutex_unlock(&remotes.lock);
+}
+
+//function: unpack_pixels
+//purpose: add pixels from pack_pixels() to h, if they're all on it
+//returns TRUE on success, FALSE if they aren't pixels of h
+static int unpack_pixels(histogram * h, const unsigned char * raw,
+                         size_t nraw){
+  const unsigned char * p, * end = raw + nraw;
+  long long i, npixels = get_npixels(h);
+  uint64_t v[5];
+  pixel_sum s;
+  int k, pass;
+
+  //every pixel has to be good before any is added
+  for(pass=0; pass<2; pass++){
+    p = raw;
+    i = 0;
+    while(p < end){
+      for(k=0; k<5 && p != NULL; k++){
+        p = get_varint(p, end, &v[k]);
+      }
+      if(p == NULL)
+        return 0;
+      if(v[0] >= (uint64_t)(npixels - i))
+        return 0;
+      i += v[0];
+      if(pass == 1){
+        s.count = v[1];
+        s.r = v[2];
+        s.g = v[3];
+        s.b = v[4];
+        add_pixel(h, i % get_width(h), i / get_width(h), &s);
+      }
+    }
+  }
+  return 1;
+}
+
+//function: remote_walk
+//purpose: have the worker on fd walk into h, and add its counters to fc if
+//         it isn't NULL.  neither is touched unless the whole reply arrives
+//         and makes sense.
+//returns TRUE on success, FALSE if the connection's no good any more
+static int remote_walk(int fd, remote_request * req, double * params,
+                       histogram * h, frame_counters * fc){
+  remote_reply rep;
+  unsigned char * raw, * in;
+  int64_t * selected = NULL;
+  uLongf n;
+  int i, ok;
+
+  if(!write_full(fd, req, sizeof(remote_request)) ||
+     !write_full(fd, params, sizeof(double) * req->nparams) ||
+     !read_full(fd, &rep, sizeof(rep))){
+    fprintf(stderr,"walk_remote: lost a worker\n");
+    return 0;
+  }
+  if(memcmp(rep.magic, REMOTE_REPLY_MAGIC, sizeof(rep.magic)) != 0 ||
+     !rep.ok){
+    fprintf(stderr,"walk_remote: a worker refused frame %d\n", req->t);
+    return 0;
+  }
+  if(rep.nraw > (uint64_t)REMOTE_PIXEL_BYTES * get_npixels(h) ||
+     rep.nbytes > compressBound(rep.nraw) ||
+     rep.nselected != (fc != NULL ? (uint32_t)fc->nxforms : 0)){
+    fprintf(stderr,"walk_remote: bad reply\n");
+    return 0;
+  }
+  if(rep.nselected > 0){
+    selected = malloc(sizeof(int64_t) * rep.nselected);
+    if(selected == NULL){
+      fprintf(stderr,"walk_remote: out of memory. exiting...\n");
+      exit(1);
+    }
+    if(!read_full(fd, selected, sizeof(int64_t) * rep.nselected)){
+      fprintf(stderr,"walk_remote: lost a worker\n");
+      free(selected);
+      return 0;
+    }
+  }
+
+  raw = malloc(rep.nraw + 1);
+  in = (rep.compressed ? malloc(rep.nbytes + 1) : raw);
+  if(raw == NULL || in == NULL){
+    fprintf(stderr,"walk_remote: out of memory. exiting...\n");
+    exit(1);
+  }
+  n = rep.nraw;
+  ok = read_full(fd, in, rep.nbytes);
+  if(ok && rep.compressed)
+    ok = (uncompress(raw, &n, in, rep.nbytes) == Z_OK && n == rep.nraw);
+  else if(ok)
+    ok = (rep.nbytes == rep.nraw);
+  if(ok && !unpack_pixels(h, raw, rep.nraw)){
+    fprintf(stderr,"walk_remote: bad reply\n");
+    ok = 0;
+  }
+  if(ok && fc != NULL){
+    fc->iterations += rep.iterations;
+    fc->outside += rep.outside;
+    fc->nonfinite += rep.nonfinite;
+    for(i=0; i<fc->nxforms; i++){
+      fc->selected[i] += selected[i];
+    }
+  }
+  if(in != raw)
+    free(in);
+  free(raw);
+  free(selected);
+  return ok;
+}
+
+//public
+
+//function: serve_remote
+//purpose: be a worker: walk fl, with walk, for any coordinator that
+//         connects on port, each connection in a thread of its own
+//returns FALSE if it couldn't listen; otherwise it doesn't return
+extern int serve_remote(int port, flame * fl, walk_fn walk){
+  struct sockaddr_in addr;
+  remote_client * rc;
+  pthread_t thread;
+  int fd, client, one = 1;
+
+  fd = socket(AF_INET, SOCK_STREAM, 0);
+  if(fd < 0){
+    perror("serve_remote");
+    return 0;
+  }
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(port);
+  if(bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+     listen(fd, REMOTE_BACKLOG) != 0){
+    perror("serve_remote");
+    close(fd);
+    return 0;
+  }
+  printf("serve_remote: listening on port %d\n", port);
+  fflush(stdout);
+
+  for(;;){
+    client = accept(fd, NULL, NULL);
+    if(client < 0){
+      if(errno != EINTR)
+        perror("serve_remote");
+      continue;
+    }
+    setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    rc = malloc(sizeof(remote_client));
+    if(rc == NULL){
+      fprintf(stderr,"serve_remote: out of memory. exiting...\n");
+      exit(1);
+    }
+    rc->fd = client;
+    rc->fl = fl;
+    rc->walk = walk;
+    if(pthread_create(&thread, NULL, serve_client, rc) != 0){
+      fprintf(stderr,"serve_remote: pthread_create failed\n");
+      close(client);
+      free(rc);
+      continue;
+    }
+    pthread_detach(thread);
+  }
+  return 1;
+}
+
+//function: open_remotes
+//purpose: connect to the workers at addrs ("host:port" each) for
+//         walk_remote(), nconnections in all, spread over them in turn.
+//         each connection walks one chunk at a time, so a worker gets as
+//         many as it has threads to walk them with.
+//params: compression - zlib level (1-9) workers deflate their pixels with,
+//        or 0 to send them as they are.  deflating takes about as long as
+//        walking, so it only pays on a slow network.
+//returns TRUE if any connected, FALSE otherwise
+extern int open_remotes(const char ** addrs, int naddrs, int nconnections,
+                        int compression){
+  int i, fd;
+
+  if(remotes_open || naddrs < 1 || nconnections < 1){
+    fprintf(stderr,"open_remotes: nothing to connect to. returning...\n");
+    return 0;
+  }
+  remotes.fds = malloc(sizeof(int) * nconnections);
+  if(remotes.fds == NULL){
+    fprintf(stderr,"open_remotes: out of memory. returning...\n");
+    return 0;
+  }
+  remotes.nidle = 0;
+  for(i=0; i<nconnections; i++){
+    fd = connect_to(addrs[i % naddrs]);
+    if(fd >= 0)
+      remotes.fds[remotes.nidle++] = fd;
+  }
+  if(remotes.nidle == 0){
+    free(remotes.fds);
+    return 0;
+  }
+  remotes.nlive = remotes.nidle;
+  remotes.compression = (compression < 0 ? 0 :
+                         compression > 9 ? 9 : compression);
+  pthread_mutex_init(&remotes.lock, NULL);
+  pthread_cond_init(&remotes.idle, NULL);
+  remotes_open = 1;
+  return 1;
+}
+
+//function: walk_remote
+//purpose: a walk_fn.  the same walk as the workers' walker, by a worker from
+//         open_remotes(), or by walk_batch() here if there aren't any left.
+//         safe to call from several threads at once.
+//returns TRUE
+extern int walk_remote(flame * fl, int t, int niterations, int miniterations,
+                       histogram * h, rng_state * rng, frame_counters * fc){
+  remote_request req;
+  double * params;
+  int fd, ok;
+
+  params = malloc(sizeof(double) * CHECKPOINT_MAX_PARAMS);
+  if(params == NULL){
+    fprintf(stderr,"walk_remote: out of memory. exiting...\n");
+    exit(1);
+  }
+  memset(&req, 0, sizeof(req));
+  memcpy(req.magic, REMOTE_REQUEST_MAGIC, sizeof(req.magic));
+  req.version = REMOTE_VERSION;
+  req.byte_order = REMOTE_BYTE_ORDER;
+  req.t = t;
+  req.niterations = niterations;
+  req.miniterations = miniterations;
+  req.width = get_width(h);
+  req.height = get_height(h);
+  req.compression = remotes.compression;
+  req.counted = (fc != NULL);
+  req.rng = *rng;
+  ok = flame_params(fl, t, &h->cv, params, CHECKPOINT_MAX_PARAMS);
+  req.nparams = ok;
+
+  //a flame too big to describe can still be walked here
+  while(remotes_open && ok >= 0 && (fd = take_connection()) >= 0){
+    ok = remote_walk(fd, &req, params, h, fc);
+    give_back(fd, ok);
+    if(ok){
+      free(params);
+      return 1;
+    }
+  }
+  free(params);
+  return walk_batch(fl, t, niterations, miniterations, h, rng, fc);
+}
+
+//function: close_remotes
+//purpose: hang up on the workers from open_remotes().  nothing can be
+//         walking when this is called.
+//returns TRUE
+extern int close_remotes(){
+  int i;
+
+  if(!remotes_open)
+    return 1;
+  for(i=0; i<remotes.nidle; i++){
+    close(remotes.fds[i]);
+  }
+  free(remotes.fds);
+  pthread_cond_destroy(&remotes.idle);
+  pthread_mutex_destroy(&remotes.lock);
+  remotes_open = 0;
+  return 1;
+}
@@ -0,0 +1,27 @@
+/* Author: Ted Cooper
+ * Last revised: 7-2-2009
+ * FRACTAL FLAME RENDERER
+ * See top of engine.c for program description.
+ *
+ * remote.h: see remote.c for description.
+ */
+
+#ifndef REMOTE_H
+#define REMOTE_H
+
+#include "counters.h"
+#include "functions.h"
+#include "histogram.h"
+#include "render.h"
+#include "rng.h"
+
+//public
+
+extern int serve_remote(int port, flame * fl, walk_fn walk);
+extern int open_remotes(const char ** addrs, int naddrs, int nconnections,
+                        int compression);
+extern int walk_remote(flame * fl, int t, int niterations, int miniterations,
+                       histogram * h, rng_state * rng, frame_counters * fc);
+extern int close_remotes();
+
+#endif
@@ -0,0 +1,322 @@
+/* Author: Ted Cooper
+ * Last revised: 7-2-2009
+ * FRACTAL FLAME RENDERER
+ * See top of engine.c for program description.
+ *
+ * render.c: the random walk ("chaos game") that plots a flame into a 
+ * histogram, plus single- and multithreaded drivers that render one frame
+ * of the animation at a time.
+ */
+
+//INCLUDES
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <pthread.h>
+#include "counters.h"
+#include "functions.h"
+#include "global.h"
+#include "histogram.h"
+#include "rng.h"
+#include "render.h"
+
+//GLOBALS
+
+//range initial points are drawn from
+#define MINV -1.0
+#define RANGE 2.0
+
+//MACROS
+
+//random floating-point value in range [0.0,1.0) from the walker's own stream
+#define RANDD(rng) (rng_uniform(rng))
+
+//random floating-point value in range [MINV, (RANGE + MINV))
+#define RANDU(rng) (RANDD(rng) * RANGE + MINV)
+
+//TYPES
+
+//one render thread's share of a frame
+typedef struct {
+  pthread_t thread;
+  flame * fl;
+  int id;
+  int nthreads;
+  int t;
+  int niterations;
+  int miniterations;
+  rng_state rng;
+  histogram * h; //private histogram this thread plots into
+  histogram * frame; //frame histogram the private ones get merged into
+  histogram ** all; //every thread's private histogram, for the merge
+  pthread_barrier_t * merge_barrier;
+  frame_counters counters; //this thread's, if the frame's are counted
+  frame_counters * fc;     //&counters or NULL
+} render_worker;
+
+//FUNCTIONS
+
+//function: walk
+//purpose: Draves' random walk loop.  plots niterations-miniterations points of
+//         frame t of fl into h.  fl's functions need to be initialized before
+//         this is called.
+//params: fl - the flame.  only read, so any number of walks can share it.
+//        t - frame number in animation, for its function parameters.
+//        niterations, miniterations - see render().
+//        h - histogram to plot into.  only this call writes to it.
+//        rng - this walker's random number stream.
+//        fc - counters to add the walk's to, or NULL.
+//returns the number of points that fell outside the plotted range
+extern int walk(flame * fl, int t, int niterations, int miniterations,
+                histogram * h, rng_state * rng, frame_counters * fc){
+
+  int i,fi,outside,nonfinite;
+  long long * selected = (fc != NULL ? fc->selected : NULL);
+  float u;
+  float draws[RNG_BATCH];
+
+  coords p, pf;
+  float c, ci, cfinal, cf;
+  
+  //fill vars with random values
+  p.x = (coord_t)RANDU(rng);
+  p.y = (coord_t)RANDU(rng);
+  c = (float)RANDD(rng);
+  
+  //initialize count of points outside the range the algorithm attempts to plot
+  outside = 0;
+  nonfinite = 0;
+  
+  //MAIN LOOP
+  for(i=0; i<niterations; i++){
+#if defined(DEBUG)
+    fprintf(stderr,"render: top of main loop.  p:("
+                   "%" PRIcoord ",%" PRIcoord ")\n",p.x,p.y);
+#endif
+    //get random function selector
+    if(i % RNG_BATCH == 0)
+      rng_fill_uniform(rng, draws, RNG_BATCH);
+    u = draws[i % RNG_BATCH]; //between 0.0 and 1.0
+    
+    //comments follow steps in loop outline on p.9 in Draves' paper
+    
+    //p = Fi(p) (run initial linear transformation).  run_function() in two
+    //steps, so the pick can be counted.
+#if defined(DEBUG)
+    fprintf(stderr,"render: about to call run_function\n");
+#endif
+    fi = select_function(fl, u);
+    if(selected != NULL)
+      selected[fi]++;
+    run_xform(fl, t, fi, &p, &ci);
+    
+    //c = (c + ci)/2 (average color index with current function's color index)
+    c = (c + ci)/2.0;
+    
+    //pf=Ffinal(p) (run final linear transformation)
+#if defined(DEBUG)
+    fprintf(stderr,"render: about to call run_function\n");
+#endif
+    //the walk carries on from p, only pf is plotted
+    pf = p;
+    run_final(fl, &pf, &cfinal);
+    
+    //cf = (c + cfinal)/2; (average color index with final function's color
+    //                      index).  a flame without a final color plots c.
+    cf = (cfinal < 0.0 ? c : (c + cfinal)/2.0);
+ 
+    //plot (pf,cf) to image except during the first MINITERATIONS iterations
+    if(i >= miniterations){
+#if defined(DEBUG)
+      fprintf(stderr,"render: calling plot on ("
+                     "%" PRIcoord ", %" PRIcoord ", %G)\n", pf.x, pf.y, cf);
+#endif
+      //attempt to plot the current point with the current color.
+      //increment out-of-range plot attempt count if point is out of range for
+      //display.  again, since systems are "contractive on average" this happens
+      //sometimes and shouldn't be considered a problem, but if this number 
+      //grows significant relative to the total number of plot attempts, image
+      //quality and detail will suffer.  the counters (counters.c) keep track
+      //of it, and of points that have stopped being numbers at all.
+      if(!plot_histogram(h, fl->palette, &pf, &cf)){
+        outside++;
+        if(!isfinite(pf.x) || !isfinite(pf.y))
+          nonfinite++;
+      }
+    }
+  }
+  
+  if(fc != NULL){
+    fc->iterations += niterations;
+    fc->outside += outside;
+    fc->nonfinite += nonfinite;
+  }
+  return outside;
+}
+
+//function: render
+//purpose: render a single fractal flame image using Draves' random walk loop.
+//         functions and display need to be initialized before this is called.
+//params: fl - the flame to render.
+//        niterations - number of times to run the random walk.  the more the 
+//        better, generally, if you have time to kill.
+//        miniterations - minimum number of times the random walk must be run 
+//        before its results can be considered meaningful and plotted.  systems
+//        are supposed to be "contractive on average," so I guess this makes 
+//        sense as a mechanism for getting within a reasonable range.
+//        t - frame number in animation, for its function parameters.
+//        h - histogram to plot the frame into.
+//        seed - the same seed always renders the same image.
+//        fc - counters to add the frame's to, or NULL.
+extern int render(flame * fl, int niterations, int miniterations, int t,
+                  histogram * h, uint64_t seed, frame_counters * fc){
+
+  rng_state rng;
+  
+  if(niterations <= miniterations){
+    fprintf(stderr,"render: Rendering won't work unless n > %d. returning...\n", 
+            miniterations);
+    return 0; //return FALSE  
+  }
+  
+  rng_seed(&rng, seed, 0);
+  
+  //set current frame in animation
+  set_frame(fl, t);
+  
+  walk(fl, t, niterations, miniterations, h, &rng, fc);
+
+  return 0;
+
+}
+
+//function: render_worker_main
+//purpose: thread body for render_threaded().  walks into a private histogram,
+//         waits for every other worker to finish, then merges its slice of 
+//         the image from all of the private histograms into the frame's.
+static void * render_worker_main(void * arg){
+  render_worker * w = (render_worker *)arg;
+  int nbuckets, start, end;
+  
+  walk(w->fl, w->t, w->niterations, w->miniterations, w->h, &w->rng, w->fc);
+  
+  //nobody can merge until everybody's done plotting
+  pthread_barrier_wait(w->merge_barrier);
+  
+  //parallel reduction: each thread owns a disjoint range of buckets, and 
+  //sums them across the private histograms in thread order
+  nbuckets = get_nbuckets(w->frame);
+  start = (int)((long long)nbuckets * w->id / w->nthreads);
+  end = (int)((long long)nbuckets * (w->id + 1) / w->nthreads);
+  merge_histograms(w->frame, w->all, w->nthreads, start, end, NULL);
+  
+  return NULL;
+}
+
+//function: render_threaded
+//purpose: render a single frame like render(), but split the iterations 
+//         between nthreads threads, each running its own walker into its own
+//         histogram.  the walkers are independent samples of the same 
+//         attractor, so the merged image is statistically the same as one 
+//         long walk.
+//params: see render().  nthreads - number of render threads.  each one pays 
+//        for its own miniterations and a private histogram the size of the 
+//        display.  thread i walks stream i of seed, so a given seed and 
+//        thread count always render the same image.  fc gets every 
+//        thread's counters.
+//returns TRUE on success, FALSE on failure
+extern int render_threaded(flame * fl, int niterations, int miniterations,
+                           int t, histogram * h, int nthreads, uint64_t seed,
+                           frame_counters * fc){
+
+  int i, ok;
+  render_worker * workers;
+  histogram ** hists;
+  pthread_barrier_t merge_barrier;
+  
+  if(nthreads <= 1){
+    render(fl, niterations, miniterations, t, h, seed, fc);
+    return 1;
+  }
+  
+  if(niterations/nthreads <= miniterations){
+    fprintf(stderr,"render_threaded: Rendering won't work unless n/%d > %d. "
+            "returning...\n", nthreads, miniterations);
+    return 0;
+  }
+  
+  workers = calloc(nthreads, sizeof(render_worker));
+  hists = calloc(nthreads, sizeof(histogram *));
+  if(workers == NULL || hists == NULL){
+    fprintf(stderr,"render_threaded: out of memory. returning...\n");
+    free(workers);
+    free(hists);
+    return 0;
+  }
+  
+  //set current frame in animation.  workers only read the function state, so
+  //this has to happen before any of them start.
+  set_frame(fl, t);
+  
+  pthread_barrier_init(&merge_barrier, NULL, nthreads);
+  
+  ok = 1;
+  for(i=0; i<nthreads; i++){
+    hists[i] = new_histogram(&h->cv);
+    if(hists[i] == NULL){
+      fprintf(stderr,"render_threaded: new_histogram failed. returning...\n");
+      ok = 0;
+      break;
+    }
+    if(fc != NULL){
+      if(!init_counters(&workers[i].counters, fc->nxforms)){
+        ok = 0;
+        break;
+      }
+      workers[i].fc = &workers[i].counters;
+    }
+  }
+  
+  if(ok){
+    for(i=0; i<nthreads; i++){
+      workers[i].fl = fl;
+      workers[i].id = i;
+      workers[i].t = t;
+      workers[i].nthreads = nthreads;
+      //spread the remainder over the first few threads
+      workers[i].niterations = niterations/nthreads + 
+                               (i < niterations%nthreads ? 1 : 0);
+      workers[i].miniterations = miniterations;
+      //different stream per thread, or they'd all walk the same path
+      rng_seed(&workers[i].rng, seed, i);
+      workers[i].h = hists[i];
+      workers[i].frame = h;
+      workers[i].all = hists;
+      workers[i].merge_barrier = &merge_barrier;
+      if(pthread_create(&workers[i].thread, NULL, render_worker_main, 
+                        &workers[i]) != 0){
+        //the barrier counts on every thread showing up, so we can't recover
+        fprintf(stderr,"render_threaded: pthread_create failed. exiting...\n");
+        exit(1);
+      }
+    }
+    
+    for(i=0; i<nthreads; i++){
+      pthread_join(workers[i].thread, NULL);
+      if(fc != NULL)
+        add_counters(fc, &workers[i].counters);
+    }
+  }
+  
+  pthread_barrier_destroy(&merge_barrier);
+  for(i=0; i<nthreads; i++){
+    free_histogram(hists[i]);
+    if(workers[i].fc != NULL)
+      free_counters(&workers[i].counters);
+  }
+  free(hists);
+  free(workers);
+  
+  return ok;
+}
@@ -0,0 +1,39 @@
+/* Author: Ted Cooper
+ * Last revised: 7-2-2009
+ * FRACTAL FLAME RENDERER
+ * See top of engine.c for program description.
+ *
+ * render.h: see render.c for description.
+ */
+
+#ifndef RENDER_H
+#define RENDER_H
+
+#include <stdint.h>
+#include "counters.h"
+#include "functions.h"
+#include "histogram.h"
+#include "rng.h"
+
+//function selection draws are generated this many at a time.  walkers that
+//have to draw the same numbers as walk() (kernel.c) use it too.
+#define RNG_BATCH 256
+
+//TYPES
+
+//a random walk into a histogram: walk() here, walk_fused() in kernel.c or
+//walk_batch() in batch.c.  one given counters adds what it walks to them.
+typedef int (*walk_fn)(flame * fl, int t, int niterations, int miniterations,
+                       histogram * h, rng_state * rng, frame_counters * fc);
+
+//public
+
+extern int walk(flame * fl, int t, int niterations, int miniterations,
+                histogram * h, rng_state * rng, frame_counters * fc);
+extern int render(flame * fl, int niterations, int miniterations, int t,
+                  histogram * h, uint64_t seed, frame_counters * fc);
+extern int render_threaded(flame * fl, int niterations, int miniterations,
+                           int t, histogram * h, int nthreads, uint64_t seed,
+                           frame_counters * fc);
+
+#endif
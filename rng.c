@@ -0,0 +1,73 @@
+/* Author: Ted Cooper
+ * Last revised: 7-2-2009
+ * FRACTAL FLAME RENDERER
+ * See top of engine.c for program description.
+ *
+ * rng.c: seeding and batch generation for rng.h.
+ */
+
+//INCLUDES
+
+#include "rng.h"
+
+//FUNCTIONS
+
+//private
+
+//splitmix64 (Steele, Lea & Flood).  recommended by both generators' authors
+//for turning a single 64-bit seed into full state.
+static uint64_t splitmix64(uint64_t * x){
+  uint64_t z = (*x += 0x9E3779B97F4A7C15ULL);
+
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+//public
+
+//function: rng_seed
+//purpose: seed r for stream number stream of seed.
+extern void rng_seed(rng_state * r, uint64_t seed, uint64_t stream){
+  uint64_t x;
+
+  //mix the stream number in before expanding, so stream n of seed s and
+  //stream m of seed s' only collide if the whole 64-bit mix does
+  x = seed;
+  x = splitmix64(&x) ^ (stream * 0xD1B54A32D192ED03ULL);
+
+#if defined(RNG_PCG32)
+  r->state = 0;
+  r->inc = (splitmix64(&x) << 1) | 1; //has to be odd
+  rng_next32(r);
+  r->state += splitmix64(&x);
+  rng_next32(r);
+#else
+  r->s[0] = splitmix64(&x);
+  r->s[1] = splitmix64(&x);
+  r->s[2] = splitmix64(&x);
+  r->s[3] = splitmix64(&x);
+  //all-zero state is the one thing xoshiro can't recover from
+  if(!(r->s[0] | r->s[1] | r->s[2] | r->s[3]))
+    r->s[0] = 1;
+#endif
+}
+
+//function: rng_fill_uniform
+//purpose: fill out with n uniform floats in [0.0,1.0).  same numbers, in the
+//         same order, as n calls to rng_uniformf().
+extern void rng_fill_uniform(rng_state * r, float * out, int n){
+  int i;
+
+  for(i=0; i<n; i++){
+    out[i] = rng_uniformf(r);
+  }
+}
+
+extern const char * rng_name(){
+#if defined(RNG_PCG32)
+  return "pcg32";
+#else
+  return "xoshiro256+";
+#endif
+}
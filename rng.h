@@ -0,0 +1,105 @@
+/* Author: Ted Cooper
+ * Last revised: 7-2-2009
+ * FRACTAL FLAME RENDERER
+ * See top of engine.c for program description.
+ *
+ * rng.h: random number streams for the random walk.  every walker gets its
+ * own small generator state, seeded from one user seed plus a stream number,
+ * so walkers never share (or lock) anything and a render can be reproduced
+ * exactly from its seed.
+ *
+ * the generator is picked at compile time (makefile RNG=...):
+ *   default      - xoshiro256+ (Blackman & Vigna).  256 bits of state, very
+ *                  fast, top bits are excellent, which is all we use.
+ *   -DRNG_PCG32  - PCG32 (O'Neill).  128 bits of state, 32-bit output,
+ *                  streams come from the increment.
+ * both are seeded through splitmix64, so nearby seeds and stream numbers
+ * still give unrelated sequences.
+ */
+
+#ifndef RNG_H
+#define RNG_H
+
+#include <stdint.h>
+
+//TYPES
+
+typedef struct {
+#if defined(RNG_PCG32)
+  uint64_t state;
+  uint64_t inc;
+#else
+  uint64_t s[4];
+#endif
+} rng_state;
+
+//public
+
+//seed r for stream number stream of seed.  distinct (seed, stream) pairs give
+//independent sequences.
+extern void rng_seed(rng_state * r, uint64_t seed, uint64_t stream);
+
+//fill out with n uniform floats in [0.0,1.0)
+extern void rng_fill_uniform(rng_state * r, float * out, int n);
+
+//name of the compiled-in generator, for messages
+extern const char * rng_name();
+
+//inline, since the random walk calls these every iteration
+
+#if defined(RNG_PCG32)
+
+static inline uint32_t rng_next32(rng_state * r){
+  uint64_t old = r->state;
+  uint32_t xorshifted, rot;
+
+  r->state = old * 6364136223846793005ULL + r->inc;
+  xorshifted = (uint32_t)(((old >> 18) ^ old) >> 27);
+  rot = (uint32_t)(old >> 59);
+  return (xorshifted >> rot) | (xorshifted << ((32 - rot) & 31));
+}
+
+//uniform double in [0.0,1.0), 53 bits from two outputs
+static inline double rng_uniform(rng_state * r){
+  uint64_t hi = rng_next32(r) >> 5;
+  uint64_t lo = rng_next32(r) >> 6;
+  return (double)((hi << 26) | lo) * (1.0/9007199254740992.0);
+}
+
+//uniform float in [0.0,1.0), 24 bits
+static inline float rng_uniformf(rng_state * r){
+  return (float)(rng_next32(r) >> 8) * (1.0f/16777216.0f);
+}
+
+#else
+
+static inline uint64_t rng_rotl(uint64_t x, int k){
+  return (x << k) | (x >> (64 - k));
+}
+
+static inline uint64_t rng_next64(rng_state * r){
+  uint64_t result = r->s[0] + r->s[3];
+  uint64_t t = r->s[1] << 17;
+
+  r->s[2] ^= r->s[0];
+  r->s[3] ^= r->s[1];
+  r->s[1] ^= r->s[2];
+  r->s[0] ^= r->s[3];
+  r->s[2] ^= t;
+  r->s[3] = rng_rotl(r->s[3], 45);
+  return result;
+}
+
+//uniform double in [0.0,1.0), top 53 bits
+static inline double rng_uniform(rng_state * r){
+  return (double)(rng_next64(r) >> 11) * (1.0/9007199254740992.0);
+}
+
+//uniform float in [0.0,1.0), top 24 bits
+static inline float rng_uniformf(rng_state * r){
+  return (float)(rng_next64(r) >> 40) * (1.0f/16777216.0f);
+}
+
+#endif
+
+#endif
@@ -0,0 +1,226 @@
+/* Author: Ted Cooper
+ * Last revised: 7-2-2009
+ * FRACTAL FLAME RENDERER
+ * See top of engine.c for program description.
+ *
+ * tonemap.c: turns a finished frame's histogram (plot counts and summed
+ * palette colors) into a displayable image: log-density scaling, then gamma
+ * correction and vibrancy as described on p.10 of Draves' paper.
+ *
+ * frames are mapped a band of rows at a time, so animate.c can spread one
+ * frame over every worker.  the frame's largest count has to be known first,
+ * but nothing here scans for it: merging (histogram.c) and filtering
+ * (filter.c) already touch every pixel, and keep track of it as they go.
+ *
+ * every pixel needs a log and four pows.  the logs of integer counts come
+ * from a table, and the rest is done a row of pixels at a time in loops the
+ * compiler can vectorize (makefile SIMD=...), with fastmath.h's branch-free
+ * pow in place of the C library's (see there for its error), whether or not
+ * the variations use fast math.
+ */
+
+//INCLUDES
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "global.h"
+#include "histogram.h"
+#include "filter.h"
+#include "tonemap.h"
+#include "fastmath.h"
+
+//GLOBALS
+
+//pixels mapped per pass through the vector loops
+#define TONE_MAP_RUN 256
+
+//TYPES
+
+//pixels waiting to be mapped.  only ones with counts of at least e are
+//mapped at all (the rest are black), and usually most of a flame's pixels
+//aren't, so they're gathered here first and the vector loops only see the
+//ones that matter.
+typedef struct {
+  int n;
+  int pixel[TONE_MAP_RUN];  //where each goes in the image
+  float count[TONE_MAP_RUN], logc[TONE_MAP_RUN]; //logc is log(count)
+  float r[TONE_MAP_RUN], g[TONE_MAP_RUN], b[TONE_MAP_RUN];
+} lit_run;
+
+//FUNCTIONS
+
+//private
+
+//function: map_run
+//purpose: the vector part of tone mapping: map lr's pixels into rgb, and
+//         empty lr.
+static void map_run(tone_map * tm, float max_alpha_scale, lit_run * lr,
+                    color_t * rgb){
+  float br[TONE_MAP_RUN];
+  float rs[TONE_MAP_RUN], gs[TONE_MAP_RUN], bs[TONE_MAP_RUN];
+  float invgamma = tm->invgamma, compvib = tm->compvib;
+  float vibrancy = tm->vibrancy;
+  float color_scale, alpha_gamma;
+  int i, n = lr->n;
+
+  //two loops, because gcc won't vectorize one where a select feeds
+  //fast_powf(): it moves the math into branches to constant fold it
+
+#pragma omp simd private(color_scale)
+  for(i=0; i<n; i++){
+    //basic color scaling, as a fraction of the frame's largest count's log
+    br[i] = lr->logc[i]*max_alpha_scale;
+    //accumulated colors are sums of 8-bit palette channels
+    color_scale = br[i]/lr->count[i]/255.0f;
+    rs[i] = (lr->r[i]*color_scale > 1.0f ? 1.0f : lr->r[i]*color_scale);
+    gs[i] = (lr->g[i]*color_scale > 1.0f ? 1.0f : lr->g[i]*color_scale);
+    bs[i] = (lr->b[i]*color_scale > 1.0f ? 1.0f : lr->b[i]*color_scale);
+  }
+
+  //gamma correction and vibrancy
+  //vibrancy determines how much of gamma correction is determined by
+  //alpha channel's brightness (as opposed to each individual channel's)
+#pragma omp simd private(alpha_gamma)
+  for(i=0; i<n; i++){
+    alpha_gamma = vibrancy*fast_powf(br[i], invgamma);
+    rs[i] *= compvib*fast_powf(rs[i], invgamma) + alpha_gamma;
+    gs[i] *= compvib*fast_powf(gs[i], invgamma) + alpha_gamma;
+    bs[i] *= compvib*fast_powf(bs[i], invgamma) + alpha_gamma;
+  }
+
+  for(i=0; i<n; i++){
+    rgb[3*lr->pixel[i]] = rs[i];
+    rgb[3*lr->pixel[i]+1] = gs[i];
+    rgb[3*lr->pixel[i]+2] = bs[i];
+  }
+  lr->n = 0;
+}
+
+//function: table_log
+//purpose: log(count), from the table if it's in it
+static inline float table_log(tone_map * tm, float count){
+  return (count < TONE_MAP_LOGS ? tm->logs[(int)count] : logf(count));
+}
+
+//public
+
+//function: new_tone_map
+//purpose: set up tone mapping with the given gamma, somewhere ~[2.0,4.0]
+//         (anything under 1.0 is taken as 1.0), and vibrancy, [0.0,1.0].
+//         one can be shared by any number of threads.
+//returns the tone map on success, NULL on failure
+extern tone_map * new_tone_map(float gamma, float vibrancy){
+  tone_map * tm = malloc(sizeof(tone_map));
+  int c;
+
+  if(tm == NULL)
+    return NULL;
+  tm->logs = malloc(sizeof(float) * TONE_MAP_LOGS);
+  if(tm->logs == NULL){
+    free(tm);
+    return NULL;
+  }
+  //an exponent of at most 1 keeps fast_powf()'s error at log2's and exp2's
+  tm->invgamma = (gamma < 1.0 ? 1.0 : 1.0/gamma);
+  tm->vibrancy = vibrancy;
+  tm->compvib = 1.0 - vibrancy;
+  //log(0) is never looked at: those pixels are black
+  tm->logs[0] = 0.0;
+  for(c=1; c<TONE_MAP_LOGS; c++){
+    tm->logs[c] = logf((float)c);
+  }
+  return tm;
+}
+
+//function: free_tone_map
+//purpose: free a tone map from new_tone_map()
+extern int free_tone_map(tone_map * tm){
+  if(tm == NULL)
+    return 1;
+  free(tm->logs);
+  free(tm);
+  return 1;
+}
+
+//function: tone_map_rows
+//purpose: tone map rows [y0,y1) of a frame's histogram into the frame's
+//         image.  h is left alone, and only those rows of rgb are written,
+//         so bands of a frame can be mapped concurrently.
+//params: max - h's largest count, see merge_histograms()
+//        rgb - the whole frame's width*height RGB pixels
+//returns TRUE
+extern int tone_map_rows(tone_map * tm, histogram * h, plotcount_t max,
+                         color_t * rgb, int y0, int y1){
+  lit_run lr;
+  int width = get_width(h);
+  int x, y;
+  float max_alpha_scale;
+  pixel_sum hb;
+
+  //fix max's log at 1.0
+  max_alpha_scale = 1.0f/table_log(tm, (float)max);
+
+  memset(&rgb[3*y0*width], 0, sizeof(color_t) * 3 * (y1-y0) * width);
+  lr.n = 0;
+  for(y=y0; y<y1; y++){
+    for(x=0; x<width; x++){
+      //buckets aren't necessarily in pixel order
+      hb = read_bucket(h, x, y);
+      //counts under e would get negative or tiny logs, which creates weird
+      //behavior
+      if(hb.count < M_E)
+        continue;
+      lr.pixel[lr.n] = y*width + x;
+      lr.count[lr.n] = hb.count;
+      lr.logc[lr.n] = table_log(tm, hb.count);
+      lr.r[lr.n] = hb.r;
+      lr.g[lr.n] = hb.g;
+      lr.b[lr.n] = hb.b;
+      if(++lr.n == TONE_MAP_RUN)
+        map_run(tm, max_alpha_scale, &lr, rgb);
+    }
+  }
+  map_run(tm, max_alpha_scale, &lr, rgb);
+  return 1;
+}
+
+//function: tone_map_filtered_rows
+//purpose: tone_map_rows() for a frame filtered by filter.c, from its
+//         filtered pixels instead of its histogram.  counts can be
+//         fractional, so their logs are only looked up if they're whole.
+//params: px - the frame's width*height filtered pixels
+//        max - the largest count in px, see filter_band()
+//returns TRUE
+extern int tone_map_filtered_rows(tone_map * tm, de_pixel * px, int width,
+                                  float max, color_t * rgb, int y0, int y1){
+  lit_run lr;
+  int i;
+  float max_alpha_scale, c;
+  de_pixel * p;
+
+  max_alpha_scale = 1.0f/logf(max);
+
+  memset(&rgb[3*y0*width], 0, sizeof(color_t) * 3 * (y1-y0) * width);
+  lr.n = 0;
+  for(i=y0*width; i<y1*width; i++){
+    p = &px[i];
+    if(p->count < M_E)
+      continue;
+    lr.pixel[lr.n] = i;
+    lr.count[lr.n] = p->count;
+    lr.logc[lr.n] = (p->count < TONE_MAP_LOGS && p->count == (int)p->count ?
+                     tm->logs[(int)p->count] : logf(p->count));
+    //a filtered channel can come out a rounding error past 255 per plot
+    c = 255.0f*p->count;
+    lr.r[lr.n] = (p->r > c ? c : p->r);
+    lr.g[lr.n] = (p->g > c ? c : p->g);
+    lr.b[lr.n] = (p->b > c ? c : p->b);
+    if(++lr.n == TONE_MAP_RUN)
+      map_run(tm, max_alpha_scale, &lr, rgb);
+  }
+  map_run(tm, max_alpha_scale, &lr, rgb);
+  return 1;
+}
@@ -0,0 +1,37 @@
+/* Author: Ted Cooper
+ * Last revised: 7-2-2009
+ * FRACTAL FLAME RENDERER
+ * See top of engine.c for program description.
+ *
+ * tonemap.h: see tonemap.c for description.
+ */
+
+#ifndef TONEMAP_H
+#define TONEMAP_H
+
+#include "histogram.h"
+#include "filter.h"
+
+//counts whose logs are looked up instead of computed
+#define TONE_MAP_LOGS 65536
+
+//TYPES
+
+//everything about tone mapping that's the same for every frame
+typedef struct {
+  float invgamma;
+  float vibrancy;
+  float compvib;   //1 - vibrancy
+  float * logs;    //logs[c] = log(c) for c < TONE_MAP_LOGS
+} tone_map;
+
+//public
+
+extern tone_map * new_tone_map(float gamma, float vibrancy);
+extern int free_tone_map(tone_map * tm);
+extern int tone_map_rows(tone_map * tm, histogram * h, plotcount_t max,
+                         color_t * rgb, int y0, int y1);
+extern int tone_map_filtered_rows(tone_map * tm, de_pixel * px, int width,
+                                  float max, color_t * rgb, int y0, int y1);
+
+#endif
@@ -1,27 +1,107 @@
 #include <math.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <stdint.h>
 #include "variations.h"
+#include "fastmath.h"
+
+//with -DBATCH_LIBMVEC (makefile MVEC=1), tell the compiler glibc's libmvec
+//has vector versions of sin and cos, so run_v_batch()'s loops that use them
+//vectorize too.  they're accurate to a few ulp instead of one.
+#if defined(BATCH_LIBMVEC)
+#pragma omp declare simd notinbranch
+extern double sin(double);
+#pragma omp declare simd notinbranch
+extern double cos(double);
+#pragma omp declare simd notinbranch
+extern float sinf(float);
+#pragma omp declare simd notinbranch
+extern float cosf(float);
+#endif
 
 //globals
 
-#define NVARIATIONS 5
+//nonlinear functions.  these are externally linked because pointers to them
+//will be used in functio of this file.  no static scratch variables in here:
+//render threads call these concurrently.
+//
+//v0-v48 are the paper's (and flam3's) variations, with flam3's formulas for
+//the ones after v4: its precalculated angle is atan2(x, y), measured from
+//the y axis, and its sina and cosa are x/r and y/r.  the ones flam3 draws
+//random numbers into (noise, julian, juliascope, blur, gaussian_blur,
+//radial_blur, pie, arch, square, rays, blade, secant2, twintrian) get them
+//from point_draw(), and the ones it draws its own weight into (radial_blur,
+//arch, rays, blade, secant2, twintrian) get it in vp->w.  the caller scales
+//every variation by its weight, so each gives flam3's result over it.
+//
+//vp->fast swaps their sin, cos, sqrt, exp and pow for fastmath.h's
+//approximations (set_fast_math()).  atan2, tan, sinh, cosh, log10, fmod and
+//floor are always libm's.
 
-//variations
-V_func * variations;
-int nv=0;
+//fast math is off unless the build turns it on (makefile FASTMATH=1)
+#if defined(FAST_MATH)
+#define FAST_MATH_DEFAULT 1
+#else
+#define FAST_MATH_DEFAULT 0
+#endif
 
-//final transformation
-V_func * final;
-F_params * finalfp;
+//constants are cast so float builds don't get promoted to double
+#define RSQUARED(c) ((c)->x*(c)->x + (c)->y*(c)->y)
+#define INVRSQUARED(c) ((coord_t)1.0/RSQUARED(c))
+#define R(c,fast) (FAST_SQRT(fast, RSQUARED(c)))
+#define INVR(c,fast) (FAST_RSQRT(fast, RSQUARED(c)))
+#define ATAN(c) (COORD_ATAN2((c)->x, (c)->y))
+#define PI ((coord_t)M_PI)
+#define INVPI ((coord_t)M_1_PI)
+//flam3 adds this where a parameter of 0 would divide by 0
+#define EPS ((coord_t)1e-10)
 
-//nonlinear functions.  these are externally linked because pointers to them
-//will be used in functio of this file
+//function: point_bit
+//purpose: a stand-in for the random bit flam3's julia flips.  variations
+//         don't get the walk's rng, so this hashes the point instead; a walk
+//         doesn't come back to the same point, so it's as good as a coin, and
+//         run_v() and run_v_batch() get the same one.
+static inline int point_bit(coord_t x, coord_t y){
+  union { float f; uint32_t u; } a, b;
+  uint32_t h;
 
-#define RSQUARED(c) ((c)->x*(c)->x + (c)->y*(c)->y)
-#define INVRSQUARED(c) (1.0/RSQUARED(c))
-#define R(c) (sqrtl(RSQUARED(c)))
-#define INVR(c) (1.0/R(c))
+  a.f = (float)x;
+  b.f = (float)y;
+  h = a.u*0x9e3779b1u ^ b.u;
+  h ^= h >> 15;
+  h *= 0x85ebca6bu;
+  h ^= h >> 13;
+  return h >> 31;
+}
+
+//function: point_draw
+//purpose: a stand-in for the uniform random numbers in [0, 1) flam3's noise,
+//         blur and the like draw, hashing the point like point_bit() but
+//         with all of a double's bits, so nearby points get unrelated draws.
+//params: id, k - the variation's V_ number, and which of its draws (0-7)
+//                this is, so each draw, and each variation on the same
+//                point, gets its own
+//returns a multiple of 2^-24, which every precision holds exactly
+static inline coord_t point_draw(coord_t x, coord_t y, int id, int k){
+  union { double f; uint64_t u; } a, b;
+  uint64_t h;
+
+  a.f = (double)x;
+  b.f = (double)y;
+  h = a.u*0x9e3779b97f4a7c15ull ^ b.u ^
+      (uint64_t)((id << 3) + k)*0xbf58476d1ce4e5b9ull;
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdull;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ull;
+  h ^= h >> 33;
+  return (coord_t)(h >> 40)*(coord_t)(1.0/16777216.0);
+}
+#define DRAW(id,c,k) point_draw((c)->x, (c)->y, id, k)
+
+//flam3's test for a result it throws away
+#define BAD_VALUE(x) ((x) != (x) || (x) > (coord_t)1e10 || (x) < -(coord_t)1e10)
 
 //linear
 //NO FP, NO VP
@@ -29,7 +109,7 @@ extern int v0(coords * c,
               F_params * fp,
               V_params * vp){
   //v0 doesn't modify anything
-  return 1;              
+  return 1;
 }
 
 //sinusoidal
@@ -37,9 +117,9 @@ extern int v0(coords * c,
 extern int v1(coords * c,
               F_params * fp,
               V_params * vp){
-  c->x=sinl(c->x);
-  c->y=sinl(c->y);            
-  return 1;            
+  c->x=FAST_SIN(vp->fast, c->x);
+  c->y=FAST_SIN(vp->fast, c->y);
+  return 1;
 }
 
 //spherical
@@ -47,11 +127,11 @@ extern int v1(coords * c,
 extern int v2(coords * c,
               F_params * fp,
               V_params * vp){
-  static long double invrsquared;
+  coord_t invrsquared;
   invrsquared = INVRSQUARED(c);
   c->x=c->x*invrsquared;
-  c->y=c->y*invrsquared;            
-  return 1;            
+  c->y=c->y*invrsquared;
+  return 1;
 }
 
 //swirl
@@ -59,13 +139,12 @@ extern int v2(coords * c,
 extern int v3(coords * c,
               F_params * fp,
               V_params * vp){
-  static long double rsquared; 
-  static long double sinrs;
-  static long double cosrs;
-  
+  coord_t rsquared;
+  coord_t sinrs;
+  coord_t cosrs;
+
   rsquared = RSQUARED(c);
-  sinrs = sinl(rsquared);
-  cosrs = cosl(rsquared);
+  FAST_SINCOS(vp->fast, rsquared, sinrs, cosrs);
   c->x = c->x*sinrs - c->y*cosrs;
   c->y = c->x*cosrs + c->y*sinrs;
   return 1;
@@ -76,22 +155,696 @@ extern int v3(coords * c,
 extern int v4(coords * c,
               F_params * fp,
               V_params * vp){
-  static long double invr;
-  invr = INVR(c);
+  coord_t invr;
+  invr = INVR(c, vp->fast);
   c->x = invr*(c->x - c->y)*(c->x + c->y);
-  c->y = invr*2.0*c->x*c->y;
-  return 1;              
+  c->y = invr*(coord_t)2.0*c->x*c->y;
+  return 1;
+}
+
+//polar
+//NO FP, NO VP
+extern int v5(coords * c,
+              F_params * fp,
+              V_params * vp){
+  coord_t a, r;
+  a = ATAN(c);
+  r = R(c, vp->fast);
+  c->x = a*INVPI;
+  c->y = r - (coord_t)1.0;
+  return 1;
+}
+
+//handkerchief
+//NO FP, NO VP
+extern int v6(coords * c,
+              F_params * fp,
+              V_params * vp){
+  coord_t a, r;
+  a = ATAN(c);
+  r = R(c, vp->fast);
+  c->x = r*FAST_SIN(vp->fast, a + r);
+  c->y = r*FAST_COS(vp->fast, a - r);
+  return 1;
+}
+
+//heart
+//NO FP, NO VP
+extern int v7(coords * c,
+              F_params * fp,
+              V_params * vp){
+  coord_t a, r, sn, cs;
+  r = R(c, vp->fast);
+  a = r*ATAN(c);
+  FAST_SINCOS(vp->fast, a, sn, cs);
+  c->x = r*sn;
+  c->y = -r*cs;
+  return 1;
+}
+
+//disc
+//NO FP, NO VP
+extern int v8(coords * c,
+              F_params * fp,
+              V_params * vp){
+  coord_t a, r, sn, cs;
+  a = ATAN(c)*INVPI;
+  r = PI*R(c, vp->fast);
+  FAST_SINCOS(vp->fast, r, sn, cs);
+  c->x = a*sn;
+  c->y = a*cs;
+  return 1;
+}
+
+//spiral
+//NO FP, NO VP
+extern int v9(coords * c,
+              F_params * fp,
+              V_params * vp){
+  coord_t r, invr, x = c->x, sn, cs;
+  r = R(c, vp->fast);
+  invr = (coord_t)1.0/(r + EPS);
+  //flam3's cosa and sina, so x/r and y/r the other way around
+  FAST_SINCOS(vp->fast, r + EPS, sn, cs);
+  c->x = invr*(c->y/r + sn);
+  c->y = invr*(x/r - cs);
+  return 1;
+}
+
+//hyperbolic
+//NO FP, NO VP
+extern int v10(coords * c,
+               F_params * fp,
+               V_params * vp){
+  coord_t r;
+  r = R(c, vp->fast);
+  c->x = (c->x/r)/(r + EPS);
+  c->y = (c->y/r)*(r + EPS);
+  return 1;
+}
+
+//diamond
+//NO FP, NO VP
+extern int v11(coords * c,
+               F_params * fp,
+               V_params * vp){
+  coord_t r, sn, cs;
+  r = R(c, vp->fast);
+  FAST_SINCOS(vp->fast, r, sn, cs);
+  c->x = (c->x/r)*cs;
+  c->y = (c->y/r)*sn;
+  return 1;
+}
+
+//ex
+//NO FP, NO VP
+extern int v12(coords * c,
+               F_params * fp,
+               V_params * vp){
+  coord_t a, r, n0, n1, m0, m1;
+  a = ATAN(c);
+  r = R(c, vp->fast);
+  n0 = FAST_SIN(vp->fast, a + r);
+  n1 = FAST_COS(vp->fast, a - r);
+  m0 = n0*n0*n0*r;
+  m1 = n1*n1*n1*r;
+  c->x = m0 + m1;
+  c->y = m0 - m1;
+  return 1;
+}
+
+//julia
+//NO FP, NO VP
+extern int v13(coords * c,
+               F_params * fp,
+               V_params * vp){
+  coord_t a, r, sn, cs;
+  a = (coord_t)0.5*ATAN(c) + (point_bit(c->x, c->y) ? PI : (coord_t)0.0);
+  r = FAST_SQRT(vp->fast, R(c, vp->fast));
+  FAST_SINCOS(vp->fast, a, sn, cs);
+  c->x = r*cs;
+  c->y = r*sn;
+  return 1;
+}
+
+//bent
+//NO FP, NO VP
+extern int v14(coords * c,
+               F_params * fp,
+               V_params * vp){
+  if(c->x < (coord_t)0.0)
+    c->x = c->x*(coord_t)2.0;
+  if(c->y < (coord_t)0.0)
+    c->y = c->y/(coord_t)2.0;
+  return 1;
+}
+
+//waves
+//FP, NO VP
+extern int v15(coords * c,
+               F_params * fp,
+               V_params * vp){
+  coord_t x = c->x;
+  c->x = x + fp->b*FAST_SIN(vp->fast, c->y/(fp->c*fp->c + EPS));
+  c->y = c->y + fp->e*FAST_SIN(vp->fast, x/(fp->f*fp->f + EPS));
+  return 1;
+}
+
+//fisheye.  flam3 swaps x and y; eyefish (v27) is the fixed one.
+//NO FP, NO VP
+extern int v16(coords * c,
+               F_params * fp,
+               V_params * vp){
+  coord_t r, x = c->x;
+  r = (coord_t)2.0/(R(c, vp->fast) + (coord_t)1.0);
+  c->x = r*c->y;
+  c->y = r*x;
+  return 1;
+}
+
+//popcorn
+//FP, NO VP
+extern int v17(coords * c,
+               F_params * fp,
+               V_params * vp){
+  coord_t x = c->x;
+  c->x = x + fp->c*FAST_SIN(vp->fast, COORD_TAN((coord_t)3.0*c->y));
+  c->y = c->y + fp->f*FAST_SIN(vp->fast, COORD_TAN((coord_t)3.0*x));
+  return 1;
+}
+
+//exponential
+//NO FP, NO VP
+extern int v18(coords * c,
+               F_params * fp,
+               V_params * vp){
+  coord_t e, a, sn, cs;
+  e = FAST_EXP(vp->fast, c->x - (coord_t)1.0);
+  a = PI*c->y;
+  FAST_SINCOS(vp->fast, a, sn, cs);
+  c->x = e*cs;
+  c->y = e*sn;
+  return 1;
+}
+
+//power
+//NO FP, NO VP
+extern int v19(coords * c,
+               F_params * fp,
+               V_params * vp){
+  coord_t r, sina, cosa;
+  r = R(c, vp->fast);
+  sina = c->x/r;
+  cosa = c->y/r;
+  r = FAST_POW(vp->fast, r, sina);
+  c->x = r*cosa;
+  c->y = r*sina;
+  return 1;
+}
+
+//cosine
+//NO FP, NO VP
+extern int v20(coords * c,
+               F_params * fp,
+               V_params * vp){
+  coord_t a, sn, cs;
+  a = PI*c->x;
+  FAST_SINCOS(vp->fast, a, sn, cs);
+  c->x = cs*COORD_COSH(c->y);
+  c->y = -sn*COORD_SINH(c->y);
+  return 1;
+}
+
+//rings
+//FP, NO VP
+extern int v21(coords * c,
+               F_params * fp,
+               V_params * vp){
+  coord_t r, d, s, x = c->x;
+  d = fp->c*fp->c + EPS;
+  r = R(c, vp->fast);
+  s = COORD_FMOD(r + d, (coord_t)2.0*d) - d + r*((coord_t)1.0 - d);
+  c->x = s*(c->y/r);
+  c->y = s*(x/r);
+  return 1;
+}
+
+//fan
+//FP, NO VP
+extern int v22(coords * c,
+               F_params * fp,
+               V_params * vp){
+  coord_t a, r, d, sn, cs;
+  d = PI*(fp->c*fp->c + EPS);
+  a = ATAN(c);
+  r = R(c, vp->fast);
+  a = a + (COORD_FMOD(a + fp->f, d) > (coord_t)0.5*d ? -(coord_t)0.5*d :
+           (coord_t)0.5*d);
+  FAST_SINCOS(vp->fast, a, sn, cs);
+  c->x = r*cs;
+  c->y = r*sn;
+  return 1;
+}
+
+//blob
+//NO FP, VP: high, low, waves
+extern int v23(coords * c,
+               F_params * fp,
+               V_params * vp){
+  coord_t a, r, s;
+  a = ATAN(c);
+  r = R(c, vp->fast);
+  s = r*(vp->p[1] + (vp->p[0] - vp->p[1])*
+         ((coord_t)0.5 + (coord_t)0.5*FAST_SIN(vp->fast, vp->p[2]*a)));
+  c->x = s*(c->x/r);
+  c->y = s*(c->y/r);
+  return 1;
+}
+
+//pdj
+//NO FP, VP: a, b, c, d
+extern int v24(coords * c,
+               F_params * fp,
+               V_params * vp){
+  coord_t x = c->x;
+  c->x = FAST_SIN(vp->fast, vp->p[0]*c->y) - FAST_COS(vp->fast, vp->p[1]*x);
+  c->y = FAST_SIN(vp->fast, vp->p[2]*x) - FAST_COS(vp->fast, vp->p[3]*c->y);
+  return 1;
+}
+
+//fan2
+//NO FP, VP: x, y
+extern int v25(coords * c,
+               F_params * fp,
+               V_params * vp){
+  coord_t a, r, d, t, sn, cs;
+  d = PI*(vp->p[0]*vp->p[0] + EPS);
+  a = ATAN(c);
+  r = R(c, vp->fast);
+  t = a + vp->p[1] - d*(coord_t)(long)((a + vp->p[1])/d);
+  a = (t > (coord_t)0.5*d ? a - (coord_t)0.5*d : a + (coord_t)0.5*d);
+  FAST_SINCOS(vp->fast, a, sn, cs);
+  c->x = r*sn;
+  c->y = r*cs;
+  return 1;
+}
+
+//rings2
+//NO FP, VP: val
+extern int v26(coords * c,
+               F_params * fp,
+               V_params * vp){
+  coord_t r, d, s;
+  d = vp->p[0]*vp->p[0] + EPS;
+  r = R(c, vp->fast);
+  s = r - (coord_t)2.0*d*(coord_t)(long)((r + d)/((coord_t)2.0*d)) +
+      r*((coord_t)1.0 - d);
+  c->x = s*(c->x/r);
+  c->y = s*(c->y/r);
+  return 1;
 }
 
+//eyefish
+//NO FP, NO VP
+extern int v27(coords * c,
+               F_params * fp,
+               V_params * vp){
+  coord_t r;
+  r = (coord_t)2.0/(R(c, vp->fast) + (coord_t)1.0);
+  c->x = r*c->x;
+  c->y = r*c->y;
+  return 1;
+}
+
+//bubble
+//NO FP, NO VP
+extern int v28(coords * c,
+               F_params * fp,
+               V_params * vp){
+  coord_t r;
+  r = (coord_t)4.0/(RSQUARED(c) + (coord_t)4.0);
+  c->x = r*c->x;
+  c->y = r*c->y;
+  return 1;
+}
+
+//cylinder
+//NO FP, NO VP
+extern int v29(coords * c,
+               F_params * fp,
+               V_params * vp){
+  c->x = FAST_SIN(vp->fast, c->x);
+  return 1;
+}
+
+//perspective
+//NO FP, VP: angle, dist
+extern int v30(coords * c,
+               F_params * fp,
+               V_params * vp){
+  coord_t a, t, sn, cs;
+  a = vp->p[0]*PI*(coord_t)0.5;
+  FAST_SINCOS(vp->fast, a, sn, cs);
+  t = (coord_t)1.0/(vp->p[1] - c->y*sn);
+  c->x = vp->p[1]*c->x*t;
+  c->y = vp->p[1]*cs*c->y*t;
+  return 1;
+}
+//noise
+//NO FP, NO VP
+extern int v31(coords * c,
+               F_params * fp,
+               V_params * vp){
+  coord_t a, r, sn, cs;
+  a = (coord_t)2.0*PI*DRAW(V_NOISE, c, 0);
+  r = DRAW(V_NOISE, c, 1);
+  FAST_SINCOS(vp->fast, a, sn, cs);
+  c->x = c->x*r*cs;
+  c->y = c->y*r*sn;
+  return 1;
+}
+
+//julian
+//NO FP, VP: power, dist
+extern int v32(coords * c,
+               F_params * fp,
+               V_params * vp){
+  coord_t t, a, r, sn, cs;
+  t = (coord_t)(long)(COORD_FABS(vp->p[0])*DRAW(V_JULIAN, c, 0));
+  a = (COORD_ATAN2(c->y, c->x) + (coord_t)2.0*PI*t)/vp->p[0];
+  r = FAST_POW(vp->fast, RSQUARED(c), vp->p[1]/vp->p[0]*(coord_t)0.5);
+  FAST_SINCOS(vp->fast, a, sn, cs);
+  c->x = r*cs;
+  c->y = r*sn;
+  return 1;
+}
+
+//juliascope
+//NO FP, VP: power, dist
+extern int v33(coords * c,
+               F_params * fp,
+               V_params * vp){
+  coord_t a, r, sn, cs;
+  long t;
+  t = (long)(COORD_FABS(vp->p[0])*DRAW(V_JULIASCOPE, c, 0));
+  a = COORD_ATAN2(c->y, c->x);
+  a = ((coord_t)2.0*PI*t + (t & 1 ? -a : a))/vp->p[0];
+  r = FAST_POW(vp->fast, RSQUARED(c), vp->p[1]/vp->p[0]*(coord_t)0.5);
+  FAST_SINCOS(vp->fast, a, sn, cs);
+  c->x = r*cs;
+  c->y = r*sn;
+  return 1;
+}
+
+//blur
+//NO FP, NO VP
+extern int v34(coords * c,
+               F_params * fp,
+               V_params * vp){
+  coord_t a, r, sn, cs;
+  a = (coord_t)2.0*PI*DRAW(V_BLUR, c, 0);
+  r = DRAW(V_BLUR, c, 1);
+  FAST_SINCOS(vp->fast, a, sn, cs);
+  c->x = r*cs;
+  c->y = r*sn;
+  return 1;
+}
+
+//gaussian_blur
+//NO FP, NO VP
+extern int v35(coords * c,
+               F_params * fp,
+               V_params * vp){
+  coord_t a, r, sn, cs;
+  a = (coord_t)2.0*PI*DRAW(V_GAUSSIAN_BLUR, c, 0);
+  r = DRAW(V_GAUSSIAN_BLUR, c, 1) + DRAW(V_GAUSSIAN_BLUR, c, 2) +
+      DRAW(V_GAUSSIAN_BLUR, c, 3) + DRAW(V_GAUSSIAN_BLUR, c, 4) -
+      (coord_t)2.0;
+  FAST_SINCOS(vp->fast, a, sn, cs);
+  c->x = r*cs;
+  c->y = r*sn;
+  return 1;
+}
+
+//radial_blur
+//NO FP, VP: angle.  flam3 doesn't scale its result by the weight, so this is
+//divided by it; the weight can't be 0, which callers skip anyway.
+extern int v36(coords * c,
+               F_params * fp,
+               V_params * vp){
+  coord_t g, a, r, z, spin, zoom, sn, cs, x = c->x;
+  FAST_SINCOS(vp->fast, vp->p[0]*PI*(coord_t)0.5, spin, zoom);
+  g = vp->w*(DRAW(V_RADIAL_BLUR, c, 0) + DRAW(V_RADIAL_BLUR, c, 1) +
+             DRAW(V_RADIAL_BLUR, c, 2) + DRAW(V_RADIAL_BLUR, c, 3) -
+             (coord_t)2.0);
+  r = R(c, vp->fast);
+  a = COORD_ATAN2(c->y, c->x) + spin*g;
+  z = zoom*g - (coord_t)1.0;
+  FAST_SINCOS(vp->fast, a, sn, cs);
+  c->x = (r*cs + z*x)/vp->w;
+  c->y = (r*sn + z*c->y)/vp->w;
+  return 1;
+}
+
+//pie
+//NO FP, VP: slices, rotation, thickness
+extern int v37(coords * c,
+               F_params * fp,
+               V_params * vp){
+  coord_t s, a, r, sn, cs;
+  s = (coord_t)(long)(DRAW(V_PIE, c, 0)*vp->p[0] + (coord_t)0.5);
+  a = vp->p[1] + (coord_t)2.0*PI*(s + DRAW(V_PIE, c, 1)*vp->p[2])/vp->p[0];
+  r = DRAW(V_PIE, c, 2);
+  FAST_SINCOS(vp->fast, a, sn, cs);
+  c->x = r*cs;
+  c->y = r*sn;
+  return 1;
+}
+
+
+//ngon
+//NO FP, VP: sides, power, circle, corners
+extern int v38(coords * c,
+               F_params * fp,
+               V_params * vp){
+  coord_t s, b, phi, amp;
+  s = FAST_POW(vp->fast, RSQUARED(c), vp->p[1]*(coord_t)0.5);
+  b = (coord_t)2.0*PI/vp->p[0];
+  phi = COORD_ATAN2(c->y, c->x);
+  phi = phi - b*COORD_FLOOR(phi/b);
+  if(phi > (coord_t)0.5*b)
+    phi = phi - b;
+  amp = vp->p[3]*((coord_t)1.0/(FAST_COS(vp->fast, phi) + EPS) - (coord_t)1.0) +
+        vp->p[2];
+  amp = amp/(s + EPS);
+  c->x = c->x*amp;
+  c->y = c->y*amp;
+  return 1;
+}
+
+//curl
+//NO FP, VP: c1, c2
+extern int v39(coords * c,
+               F_params * fp,
+               V_params * vp){
+  coord_t re, im, r, x = c->x;
+  re = (coord_t)1.0 + vp->p[0]*x + vp->p[1]*(x*x - c->y*c->y);
+  im = vp->p[0]*c->y + (coord_t)2.0*vp->p[1]*x*c->y;
+  r = (coord_t)1.0/(re*re + im*im);
+  c->x = (x*re + c->y*im)*r;
+  c->y = (c->y*re - x*im)*r;
+  return 1;
+}
+
+//rectangles
+//NO FP, VP: x, y
+extern int v40(coords * c,
+               F_params * fp,
+               V_params * vp){
+  if(vp->p[0] != (coord_t)0.0)
+    c->x = ((coord_t)2.0*COORD_FLOOR(c->x/vp->p[0]) + (coord_t)1.0)*
+           vp->p[0] - c->x;
+  if(vp->p[1] != (coord_t)0.0)
+    c->y = ((coord_t)2.0*COORD_FLOOR(c->y/vp->p[1]) + (coord_t)1.0)*
+           vp->p[1] - c->y;
+  return 1;
+}
+//arch
+//NO FP, NO VP
+extern int v41(coords * c,
+               F_params * fp,
+               V_params * vp){
+  coord_t a, sn, cs;
+  a = DRAW(V_ARCH, c, 0)*vp->w*PI;
+  FAST_SINCOS(vp->fast, a, sn, cs);
+  //flam3 adds nothing if cos is 0
+  c->x = (cs != (coord_t)0.0 ? sn : (coord_t)0.0);
+  c->y = (cs != (coord_t)0.0 ? sn*sn/cs : (coord_t)0.0);
+  return 1;
+}
+
+
+//tangent
+//NO FP, NO VP
+extern int v42(coords * c,
+               F_params * fp,
+               V_params * vp){
+  c->x = FAST_SIN(vp->fast, c->x)/FAST_COS(vp->fast, c->y);
+  c->y = COORD_TAN(c->y);
+  return 1;
+}
+//square
+//NO FP, NO VP
+extern int v43(coords * c,
+               F_params * fp,
+               V_params * vp){
+  coord_t u = DRAW(V_SQUARE, c, 0);
+  c->y = DRAW(V_SQUARE, c, 1) - (coord_t)0.5;
+  c->x = u - (coord_t)0.5;
+  return 1;
+}
+
+//rays
+//NO FP, NO VP
+extern int v44(coords * c,
+               F_params * fp,
+               V_params * vp){
+  coord_t a, r;
+  a = vp->w*DRAW(V_RAYS, c, 0)*PI;
+  r = COORD_TAN(a)*vp->w/(RSQUARED(c) + EPS);
+  c->x = r*FAST_COS(vp->fast, c->x);
+  c->y = r*FAST_SIN(vp->fast, c->y);
+  return 1;
+}
+
+//blade
+//NO FP, NO VP
+extern int v45(coords * c,
+               F_params * fp,
+               V_params * vp){
+  coord_t r, sn, cs;
+  r = DRAW(V_BLADE, c, 0)*vp->w*R(c, vp->fast);
+  FAST_SINCOS(vp->fast, r, sn, cs);
+  c->y = c->x*(cs - sn);
+  c->x = c->x*(cs + sn);
+  return 1;
+}
+
+//secant2
+//NO FP, NO VP
+extern int v46(coords * c,
+               F_params * fp,
+               V_params * vp){
+  coord_t cs;
+  cs = FAST_COS(vp->fast, vp->w*R(c, vp->fast));
+  c->y = (coord_t)1.0/cs + (cs < (coord_t)0.0 ? (coord_t)1.0 : -(coord_t)1.0);
+  return 1;
+}
+
+//twintrian
+//NO FP, NO VP
+extern int v47(coords * c,
+               F_params * fp,
+               V_params * vp){
+  coord_t r, d, sn, cs;
+  r = DRAW(V_TWINTRIAN, c, 0)*vp->w*R(c, vp->fast);
+  FAST_SINCOS(vp->fast, r, sn, cs);
+  d = COORD_LOG10(sn*sn) + cs;
+  d = (BAD_VALUE(d) ? -(coord_t)30.0 : d);
+  c->y = c->x*(d - sn*PI);
+  c->x = c->x*d;
+  return 1;
+}
+
+
+//cross
+//NO FP, NO VP
+extern int v48(coords * c,
+               F_params * fp,
+               V_params * vp){
+  coord_t s, r;
+  s = c->x*c->x - c->y*c->y;
+  r = FAST_SQRT(vp->fast, (coord_t)1.0/(s*s + EPS));
+  c->x = c->x*r;
+  c->y = c->y*r;
+  return 1;
+}
+
+//every variation there is, in V_ order: the name flam3 gives it, whether it
+//uses its function's linear transformation coefficients, and its parameters
+//(flam3's attribute names, which are the variation's name, '_', and these)
+//with flam3's defaults
+static const struct {
+  const char * name;
+  int id;
+  int (*v)(coords * c, F_params * fp, V_params * vp);
+  int use_fp;
+  int np;
+  const char * params[MAXVPARAMS];
+  double defaults[MAXVPARAMS];
+} variation_table[] = {
+  { "linear", V_LINEAR, &v0, 0, 0, {NULL}, {0.0} },
+  { "sinusoidal", V_SINUSOIDAL, &v1, 0, 0, {NULL}, {0.0} },
+  { "spherical", V_SPHERICAL, &v2, 0, 0, {NULL}, {0.0} },
+  { "swirl", V_SWIRL, &v3, 0, 0, {NULL}, {0.0} },
+  { "horseshoe", V_HORSESHOE, &v4, 0, 0, {NULL}, {0.0} },
+  { "polar", V_POLAR, &v5, 0, 0, {NULL}, {0.0} },
+  { "handkerchief", V_HANDKERCHIEF, &v6, 0, 0, {NULL}, {0.0} },
+  { "heart", V_HEART, &v7, 0, 0, {NULL}, {0.0} },
+  { "disc", V_DISC, &v8, 0, 0, {NULL}, {0.0} },
+  { "spiral", V_SPIRAL, &v9, 0, 0, {NULL}, {0.0} },
+  { "hyperbolic", V_HYPERBOLIC, &v10, 0, 0, {NULL}, {0.0} },
+  { "diamond", V_DIAMOND, &v11, 0, 0, {NULL}, {0.0} },
+  { "ex", V_EX, &v12, 0, 0, {NULL}, {0.0} },
+  { "julia", V_JULIA, &v13, 0, 0, {NULL}, {0.0} },
+  { "bent", V_BENT, &v14, 0, 0, {NULL}, {0.0} },
+  { "waves", V_WAVES, &v15, 1, 0, {NULL}, {0.0} },
+  { "fisheye", V_FISHEYE, &v16, 0, 0, {NULL}, {0.0} },
+  { "popcorn", V_POPCORN, &v17, 1, 0, {NULL}, {0.0} },
+  { "exponential", V_EXPONENTIAL, &v18, 0, 0, {NULL}, {0.0} },
+  { "power", V_POWER, &v19, 0, 0, {NULL}, {0.0} },
+  { "cosine", V_COSINE, &v20, 0, 0, {NULL}, {0.0} },
+  { "rings", V_RINGS, &v21, 1, 0, {NULL}, {0.0} },
+  { "fan", V_FAN, &v22, 1, 0, {NULL}, {0.0} },
+  { "blob", V_BLOB, &v23, 0, 3, {"high", "low", "waves"}, {1.0, 0.0, 1.0} },
+  { "pdj", V_PDJ, &v24, 0, 4, {"a", "b", "c", "d"}, {0.0, 0.0, 0.0, 0.0} },
+  { "fan2", V_FAN2, &v25, 0, 2, {"x", "y"}, {0.0, 0.0} },
+  { "rings2", V_RINGS2, &v26, 0, 1, {"val"}, {0.0} },
+  { "eyefish", V_EYEFISH, &v27, 0, 0, {NULL}, {0.0} },
+  { "bubble", V_BUBBLE, &v28, 0, 0, {NULL}, {0.0} },
+  { "cylinder", V_CYLINDER, &v29, 0, 0, {NULL}, {0.0} },
+  { "perspective", V_PERSPECTIVE, &v30, 0, 2, {"angle", "dist"},
+    {0.0, 0.0} },
+  { "noise", V_NOISE, &v31, 0, 0, {NULL}, {0.0} },
+  { "julian", V_JULIAN, &v32, 0, 2, {"power", "dist"}, {1.0, 1.0} },
+  { "juliascope", V_JULIASCOPE, &v33, 0, 2, {"power", "dist"}, {1.0, 1.0} },
+  { "blur", V_BLUR, &v34, 0, 0, {NULL}, {0.0} },
+  { "gaussian_blur", V_GAUSSIAN_BLUR, &v35, 0, 0, {NULL}, {0.0} },
+  { "radial_blur", V_RADIAL_BLUR, &v36, 0, 1, {"angle"}, {0.0} },
+  { "pie", V_PIE, &v37, 0, 3, {"slices", "rotation", "thickness"},
+    {6.0, 0.0, 0.5} },
+  { "ngon", V_NGON, &v38, 0, 4, {"sides", "power", "circle", "corners"},
+    {5.0, 3.0, 1.0, 2.0} },
+  { "curl", V_CURL, &v39, 0, 2, {"c1", "c2"}, {1.0, 0.0} },
+  { "rectangles", V_RECTANGLES, &v40, 0, 2, {"x", "y"}, {1.0, 1.0} },
+  { "arch", V_ARCH, &v41, 0, 0, {NULL}, {0.0} },
+  { "tangent", V_TANGENT, &v42, 0, 0, {NULL}, {0.0} },
+  { "square", V_SQUARE, &v43, 0, 0, {NULL}, {0.0} },
+  { "rays", V_RAYS, &v44, 0, 0, {NULL}, {0.0} },
+  { "blade", V_BLADE, &v45, 0, 0, {NULL}, {0.0} },
+  { "secant2", V_SECANT2, &v46, 0, 0, {NULL}, {0.0} },
+  { "twintrian", V_TWINTRIAN, &v47, 0, 0, {NULL}, {0.0} },
+  { "cross", V_CROSS, &v48, 0, 0, {NULL}, {0.0} }
+};
+#define NVARIATIONS ((int)(sizeof(variation_table)/sizeof(variation_table[0])))
+
 //public functions (in the header)
 
-//loads variations, allocates memory for variations and assigns them for use
+//loads variations into vs, allocates memory for variations and assigns them
+//for use
 //returns the number of variations initialized on success, 0 on failure
-extern int init_variations(){
-  int j;
-  int (*v[])(coords * c,
-           F_params * fp,
-           V_params * vp) = { &v0, &v1, &v2, &v3, &v4 };
+extern int init_variations(variation_set * vs){
+  int j, k;
   V_params vp;
   //try and load variations
   /*
@@ -101,24 +854,48 @@ extern int init_variations(){
   }
   */
   //fill variations array
-  nv = NVARIATIONS;
+  vs->nv = NVARIATIONS;
   vp.p = NULL;
   vp.np = 0;
-  variations = malloc(sizeof(V_func) * nv);
-  for(j=0; j<nv; j++){
-    variations[j].v=v[j];
-    variations[j].use_fp = 0;
-    variations[j].use_vp = 0;
-    variations[j].vp = vp;
+  vp.fast = FAST_MATH_DEFAULT;
+  vp.w = 1.0;
+  vs->fast = FAST_MATH_DEFAULT;
+  vs->variations = calloc(vs->nv, sizeof(V_func));
+  vs->final = malloc(sizeof(V_func));
+  if(vs->variations == NULL || vs->final == NULL){
+    printf("init_variations: out of memory... returning FALSE\n");
+    free(vs->variations);
+    free(vs->final);
+    return 0;
   }
-  
+  for(j=0; j<vs->nv; j++){
+    vs->variations[j].v = variation_table[j].v;
+    vs->variations[j].id = variation_table[j].id;
+    vs->variations[j].use_fp = variation_table[j].use_fp;
+    vs->variations[j].use_vp = (variation_table[j].np > 0);
+    vs->variations[j].vp = vp;
+    if(variation_table[j].np == 0)
+      continue;
+    //parameters start out at flam3's defaults
+    vs->variations[j].vp.p = malloc(sizeof(coord_t) * variation_table[j].np);
+    if(vs->variations[j].vp.p == NULL){
+      printf("init_variations: out of memory... returning FALSE\n");
+      cleanup_variations(vs);
+      return 0;
+    }
+    vs->variations[j].vp.np = variation_table[j].np;
+    for(k=0; k<variation_table[j].np; k++){
+      vs->variations[j].vp.p[k] = variation_table[j].defaults[k];
+    }
+  }
+
   //final transformation
-  final = malloc(sizeof(V_func));
-  final->v=&v0;
-  final->use_fp = 0;
-  final->use_vp = 0;
-  //final->vp will just contain some random bit pattern
-  finalfp = NULL;
+  vs->final->v=&v0;
+  vs->final->id = V_LINEAR;
+  vs->final->use_fp = 0;
+  vs->final->use_vp = 0;
+  vs->final->vp = vp;
+  vs->finalfp = NULL;
   /*
   for(j=0; j<nv; j++){
     variations[j] = get_variation(j);
@@ -128,39 +905,689 @@ extern int init_variations(){
     }
   }
   */
-  
-  return nv;
+
+  return vs->nv;
 }
 
-//only call this after init_variations has been called, so nv will be set
-extern int cleanup_variations(){
+//only call this after init_variations has been called on vs
+extern int cleanup_variations(variation_set * vs){
   int j;
-  
-  printf("cleanup_variations: about to free\n");
-  
-  for(j=0; j<nv; j++){
-    if(variations[j].vp.np != 0)
-      free(variations[j].vp.p);
+
+  fprintf(stderr,"cleanup_variations: about to free\n");
+
+  for(j=0; j<vs->nv; j++){
+    if(vs->variations[j].vp.np != 0)
+      free(vs->variations[j].vp.p);
   }
-  free(variations);
-  free(final);
+  free(vs->variations);
+  free(vs->final);
+  vs->variations = NULL;
+  vs->final = NULL;
+  vs->nv = 0;
   return 1;
 }
 
-//accessors
+//function: find_variation
+//purpose: find the variation in vs flam3 calls name, the len characters at
+//         name (which needn't be terminated)
+//returns its index in vs->variations, or -1 if there isn't one
+extern int find_variation(variation_set * vs, const char * name, size_t len){
+  int i, j;
+
+  for(i=0; i<NVARIATIONS; i++){
+    if(strlen(variation_table[i].name) != len ||
+       memcmp(variation_table[i].name, name, len) != 0)
+      continue;
+    for(j=0; j<vs->nv; j++){
+      if(vs->variations[j].id == variation_table[i].id)
+        return j;
+    }
+  }
+  return -1;
+}
+
+//function: find_variation_param
+//purpose: find the variation parameter flam3 calls name ("blob_low", say),
+//         the len characters at name
+//params: k - set to the parameter's index among the variation's: in its
+//            vp.p, and from j*MAXVPARAMS in a function's v_param
+//returns the variation's index in vs->variations, or -1 if there isn't one
+extern int find_variation_param(variation_set * vs, const char * name,
+                                size_t len, int * k){
+  size_t n;
+  int i, j, p;
 
-extern V_func * get_variations(){
-  return variations;
+  for(i=0; i<NVARIATIONS; i++){
+    n = strlen(variation_table[i].name);
+    if(n >= len || memcmp(variation_table[i].name, name, n) != 0 ||
+       name[n] != '_')
+      continue;
+    for(p=0; p<variation_table[i].np; p++){
+      if(strlen(variation_table[i].params[p]) == len - n - 1 &&
+         memcmp(variation_table[i].params[p], name + n + 1, len - n - 1) == 0)
+        break;
+    }
+    if(p == variation_table[i].np)
+      continue;
+    for(j=0; j<vs->nv; j++){
+      if(vs->variations[j].id == variation_table[i].id &&
+         vs->variations[j].vp.np > p){
+        *k = p;
+        return j;
+      }
+    }
+  }
+  return -1;
 }
 
-extern V_func * get_final(){
-  return final;
+//function: set_fast_math
+//purpose: make every variation in vs, and its final transformation, use
+//         fastmath.h's approximations if on is TRUE, or libm if it's FALSE
+//returns TRUE
+extern int set_fast_math(variation_set * vs, int on){
+  int j;
+
+  vs->fast = (on != 0);
+  for(j=0; j<vs->nv; j++){
+    vs->variations[j].vp.fast = vs->fast;
+  }
+  vs->final->vp.fast = vs->fast;
+  return 1;
 }
 
-#define NONLINEAR(v,c,fp) ((*(v)->v)(c, fp, &(v)->vp))
+//function: variation_name
+//returns the name flam3 gives V_ number id, or NULL if there's no such
+//        variation
+extern const char * variation_name(int id){
+  int i;
+
+  for(i=0; i<NVARIATIONS; i++){
+    if(variation_table[i].id == id)
+      return variation_table[i].name;
+  }
+  return NULL;
+}
 
 //run nonlinear function
+//params: p - the calling function's parameters for v (see F.v_param), or
+//        NULL for v's defaults in v->vp
+//        w - the calling function's coefficient for v, which it scales the
+//            result by (1 if it doesn't).  v only uses it as flam3 does.
 //returns v->v's return value
-extern int run_v(V_func * v, coords * c, F_params * fp){
-  return NONLINEAR(v,c,fp);
+extern int run_v(V_func * v, coords * c, F_params * fp, coord_t * p,
+                 coord_t w){
+  V_params vp;
+
+  vp = v->vp;
+  if(p != NULL)
+    vp.p = p;
+  vp.w = w;
+  return (*v->v)(c, fp, &vp);
+}
+
+//batched variations: the same formulas as v0-v48 above, in the same order,
+//over arrays of points, each a loop the compiler can turn into SSE/AVX lanes
+//(makefile SIMD=...).  batch.c runs its walkers through these.
+
+#define RSQ(x,y) ((x)*(x) + (y)*(y))
+
+//function: batch_v
+//purpose: run_v_batch() with fastmath.h's approximations if fast is TRUE.
+//         only ever called with a constant fast, and always inlined, so each
+//         loop has just one kind of math in it.
+static inline __attribute__((always_inline))
+int batch_v(V_func * v, const coord_t * x, const coord_t * y, coord_t * tx,
+            coord_t * ty, int n, F_params * fp, coord_t * vp,
+            const coord_t * w, const int * fi, const int fast){
+  int i, k, ret = 1;
+  long j;
+  coord_t r, a, s, t, d, e, u, n0, n1, m0, m1, re, im, sn, cs;
+  //point k's parameters are p[i*ps] on, i its function (as for fp)
+  coord_t * p = (vp != NULL ? vp : v->vp.p), * q;
+  const int ps = (vp != NULL ? MAXVPARAMS : 0);
+  coords c;
+
+  switch(v->id){
+    case V_LINEAR:
+#pragma omp simd
+      for(k=0; k<n; k++){
+        tx[k] = x[k];
+        ty[k] = y[k];
+      }
+      break;
+    case V_SINUSOIDAL:
+#pragma omp simd
+      for(k=0; k<n; k++){
+        tx[k] = FAST_SIN(fast, x[k]);
+        ty[k] = FAST_SIN(fast, y[k]);
+      }
+      break;
+    case V_SPHERICAL:
+#pragma omp simd private(r)
+      for(k=0; k<n; k++){
+        r = (coord_t)1.0/RSQ(x[k], y[k]);
+        tx[k] = x[k]*r;
+        ty[k] = y[k]*r;
+      }
+      break;
+    case V_SWIRL:
+      //y comes from the new x, as in v3
+#pragma omp simd private(r, s, t)
+      for(k=0; k<n; k++){
+        r = RSQ(x[k], y[k]);
+        FAST_SINCOS(fast, r, s, t);
+        tx[k] = x[k]*s - y[k]*t;
+        ty[k] = tx[k]*t + y[k]*s;
+      }
+      break;
+    case V_HORSESHOE:
+      //y comes from the new x, as in v4
+#pragma omp simd private(r)
+      for(k=0; k<n; k++){
+        r = FAST_RSQRT(fast, RSQ(x[k], y[k]));
+        tx[k] = r*(x[k] - y[k])*(x[k] + y[k]);
+        ty[k] = r*(coord_t)2.0*tx[k]*y[k];
+      }
+      break;
+    case V_POLAR:
+#pragma omp simd
+      for(k=0; k<n; k++){
+        tx[k] = COORD_ATAN2(x[k], y[k])*INVPI;
+        ty[k] = FAST_SQRT(fast, RSQ(x[k], y[k])) - (coord_t)1.0;
+      }
+      break;
+    case V_HANDKERCHIEF:
+#pragma omp simd private(a, r)
+      for(k=0; k<n; k++){
+        a = COORD_ATAN2(x[k], y[k]);
+        r = FAST_SQRT(fast, RSQ(x[k], y[k]));
+        tx[k] = r*FAST_SIN(fast, a + r);
+        ty[k] = r*FAST_COS(fast, a - r);
+      }
+      break;
+    case V_HEART:
+#pragma omp simd private(a, r, sn, cs)
+      for(k=0; k<n; k++){
+        r = FAST_SQRT(fast, RSQ(x[k], y[k]));
+        a = r*COORD_ATAN2(x[k], y[k]);
+        FAST_SINCOS(fast, a, sn, cs);
+        tx[k] = r*sn;
+        ty[k] = -r*cs;
+      }
+      break;
+    case V_DISC:
+#pragma omp simd private(a, r, sn, cs)
+      for(k=0; k<n; k++){
+        a = COORD_ATAN2(x[k], y[k])*INVPI;
+        r = PI*FAST_SQRT(fast, RSQ(x[k], y[k]));
+        FAST_SINCOS(fast, r, sn, cs);
+        tx[k] = a*sn;
+        ty[k] = a*cs;
+      }
+      break;
+    case V_SPIRAL:
+#pragma omp simd private(r, s, sn, cs)
+      for(k=0; k<n; k++){
+        r = FAST_SQRT(fast, RSQ(x[k], y[k]));
+        s = (coord_t)1.0/(r + EPS);
+        FAST_SINCOS(fast, r + EPS, sn, cs);
+        tx[k] = s*(y[k]/r + sn);
+        ty[k] = s*(x[k]/r - cs);
+      }
+      break;
+    case V_HYPERBOLIC:
+#pragma omp simd private(r)
+      for(k=0; k<n; k++){
+        r = FAST_SQRT(fast, RSQ(x[k], y[k]));
+        tx[k] = (x[k]/r)/(r + EPS);
+        ty[k] = (y[k]/r)*(r + EPS);
+      }
+      break;
+    case V_DIAMOND:
+#pragma omp simd private(r, sn, cs)
+      for(k=0; k<n; k++){
+        r = FAST_SQRT(fast, RSQ(x[k], y[k]));
+        FAST_SINCOS(fast, r, sn, cs);
+        tx[k] = (x[k]/r)*cs;
+        ty[k] = (y[k]/r)*sn;
+      }
+      break;
+    case V_EX:
+#pragma omp simd private(a, r, n0, n1, m0, m1)
+      for(k=0; k<n; k++){
+        a = COORD_ATAN2(x[k], y[k]);
+        r = FAST_SQRT(fast, RSQ(x[k], y[k]));
+        n0 = FAST_SIN(fast, a + r);
+        n1 = FAST_COS(fast, a - r);
+        m0 = n0*n0*n0*r;
+        m1 = n1*n1*n1*r;
+        tx[k] = m0 + m1;
+        ty[k] = m0 - m1;
+      }
+      break;
+    case V_JULIA:
+#pragma omp simd private(a, r, sn, cs)
+      for(k=0; k<n; k++){
+        a = (coord_t)0.5*COORD_ATAN2(x[k], y[k]) +
+            (point_bit(x[k], y[k]) ? PI : (coord_t)0.0);
+        r = FAST_SQRT(fast, FAST_SQRT(fast, RSQ(x[k], y[k])));
+        FAST_SINCOS(fast, a, sn, cs);
+        tx[k] = r*cs;
+        ty[k] = r*sn;
+      }
+      break;
+    case V_BENT:
+#pragma omp simd
+      for(k=0; k<n; k++){
+        tx[k] = (x[k] < (coord_t)0.0 ? x[k]*(coord_t)2.0 : x[k]);
+        ty[k] = (y[k] < (coord_t)0.0 ? y[k]/(coord_t)2.0 : y[k]);
+      }
+      break;
+    case V_WAVES:
+#pragma omp simd private(i)
+      for(k=0; k<n; k++){
+        i = (fi != NULL ? fi[k] : 0);
+        tx[k] = x[k] + fp[i].b*FAST_SIN(fast, y[k]/(fp[i].c*fp[i].c + EPS));
+        ty[k] = y[k] + fp[i].e*FAST_SIN(fast, x[k]/(fp[i].f*fp[i].f + EPS));
+      }
+      break;
+    case V_FISHEYE:
+#pragma omp simd private(r)
+      for(k=0; k<n; k++){
+        r = (coord_t)2.0/(FAST_SQRT(fast, RSQ(x[k], y[k])) + (coord_t)1.0);
+        tx[k] = r*y[k];
+        ty[k] = r*x[k];
+      }
+      break;
+    case V_POPCORN:
+#pragma omp simd private(i)
+      for(k=0; k<n; k++){
+        i = (fi != NULL ? fi[k] : 0);
+        tx[k] = x[k] + fp[i].c*FAST_SIN(fast, COORD_TAN((coord_t)3.0*y[k]));
+        ty[k] = y[k] + fp[i].f*FAST_SIN(fast, COORD_TAN((coord_t)3.0*x[k]));
+      }
+      break;
+    case V_EXPONENTIAL:
+#pragma omp simd private(e, a, sn, cs)
+      for(k=0; k<n; k++){
+        e = FAST_EXP(fast, x[k] - (coord_t)1.0);
+        a = PI*y[k];
+        FAST_SINCOS(fast, a, sn, cs);
+        tx[k] = e*cs;
+        ty[k] = e*sn;
+      }
+      break;
+    case V_POWER:
+#pragma omp simd private(r, s)
+      for(k=0; k<n; k++){
+        r = FAST_SQRT(fast, RSQ(x[k], y[k]));
+        s = FAST_POW(fast, r, x[k]/r);
+        tx[k] = s*(y[k]/r);
+        ty[k] = s*(x[k]/r);
+      }
+      break;
+    case V_COSINE:
+#pragma omp simd private(a, sn, cs)
+      for(k=0; k<n; k++){
+        a = PI*x[k];
+        FAST_SINCOS(fast, a, sn, cs);
+        tx[k] = cs*COORD_COSH(y[k]);
+        ty[k] = -sn*COORD_SINH(y[k]);
+      }
+      break;
+    case V_RINGS:
+#pragma omp simd private(i, r, d, s)
+      for(k=0; k<n; k++){
+        i = (fi != NULL ? fi[k] : 0);
+        d = fp[i].c*fp[i].c + EPS;
+        r = FAST_SQRT(fast, RSQ(x[k], y[k]));
+        s = COORD_FMOD(r + d, (coord_t)2.0*d) - d + r*((coord_t)1.0 - d);
+        tx[k] = s*(y[k]/r);
+        ty[k] = s*(x[k]/r);
+      }
+      break;
+    case V_FAN:
+#pragma omp simd private(i, a, r, d, sn, cs)
+      for(k=0; k<n; k++){
+        i = (fi != NULL ? fi[k] : 0);
+        d = PI*(fp[i].c*fp[i].c + EPS);
+        a = COORD_ATAN2(x[k], y[k]);
+        r = FAST_SQRT(fast, RSQ(x[k], y[k]));
+        a = a + (COORD_FMOD(a + fp[i].f, d) > (coord_t)0.5*d ?
+                 -(coord_t)0.5*d : (coord_t)0.5*d);
+        FAST_SINCOS(fast, a, sn, cs);
+        tx[k] = r*cs;
+        ty[k] = r*sn;
+      }
+      break;
+    case V_BLOB:
+#pragma omp simd private(i, q, a, r, s)
+      for(k=0; k<n; k++){
+        i = (fi != NULL ? fi[k] : 0);
+        q = &p[i*ps];
+        a = COORD_ATAN2(x[k], y[k]);
+        r = FAST_SQRT(fast, RSQ(x[k], y[k]));
+        s = r*(q[1] + (q[0] - q[1])*
+               ((coord_t)0.5 + (coord_t)0.5*FAST_SIN(fast, q[2]*a)));
+        tx[k] = s*(x[k]/r);
+        ty[k] = s*(y[k]/r);
+      }
+      break;
+    case V_PDJ:
+#pragma omp simd private(i, q)
+      for(k=0; k<n; k++){
+        i = (fi != NULL ? fi[k] : 0);
+        q = &p[i*ps];
+        tx[k] = FAST_SIN(fast, q[0]*y[k]) - FAST_COS(fast, q[1]*x[k]);
+        ty[k] = FAST_SIN(fast, q[2]*x[k]) - FAST_COS(fast, q[3]*y[k]);
+      }
+      break;
+    case V_FAN2:
+#pragma omp simd private(i, q, d, a, r, t, sn, cs)
+      for(k=0; k<n; k++){
+        i = (fi != NULL ? fi[k] : 0);
+        q = &p[i*ps];
+        d = PI*(q[0]*q[0] + EPS);
+        a = COORD_ATAN2(x[k], y[k]);
+        r = FAST_SQRT(fast, RSQ(x[k], y[k]));
+        t = a + q[1] - d*(coord_t)(long)((a + q[1])/d);
+        a = (t > (coord_t)0.5*d ? a - (coord_t)0.5*d : a + (coord_t)0.5*d);
+        FAST_SINCOS(fast, a, sn, cs);
+        tx[k] = r*sn;
+        ty[k] = r*cs;
+      }
+      break;
+    case V_RINGS2:
+#pragma omp simd private(i, d, r, s)
+      for(k=0; k<n; k++){
+        i = (fi != NULL ? fi[k] : 0);
+        d = p[i*ps]*p[i*ps] + EPS;
+        r = FAST_SQRT(fast, RSQ(x[k], y[k]));
+        s = r - (coord_t)2.0*d*(coord_t)(long)((r + d)/((coord_t)2.0*d)) +
+            r*((coord_t)1.0 - d);
+        tx[k] = s*(x[k]/r);
+        ty[k] = s*(y[k]/r);
+      }
+      break;
+    case V_EYEFISH:
+#pragma omp simd private(r)
+      for(k=0; k<n; k++){
+        r = (coord_t)2.0/(FAST_SQRT(fast, RSQ(x[k], y[k])) + (coord_t)1.0);
+        tx[k] = r*x[k];
+        ty[k] = r*y[k];
+      }
+      break;
+    case V_BUBBLE:
+#pragma omp simd private(r)
+      for(k=0; k<n; k++){
+        r = (coord_t)4.0/(RSQ(x[k], y[k]) + (coord_t)4.0);
+        tx[k] = r*x[k];
+        ty[k] = r*y[k];
+      }
+      break;
+    case V_CYLINDER:
+#pragma omp simd
+      for(k=0; k<n; k++){
+        tx[k] = FAST_SIN(fast, x[k]);
+        ty[k] = y[k];
+      }
+      break;
+    case V_PERSPECTIVE:
+#pragma omp simd private(i, q, a, s, e, t)
+      for(k=0; k<n; k++){
+        i = (fi != NULL ? fi[k] : 0);
+        q = &p[i*ps];
+        a = q[0]*PI*(coord_t)0.5;
+        FAST_SINCOS(fast, a, s, e);
+        t = (coord_t)1.0/(q[1] - y[k]*s);
+        tx[k] = q[1]*x[k]*t;
+        ty[k] = q[1]*e*y[k]*t;
+      }
+      break;
+    case V_NOISE:
+#pragma omp simd private(a, r, sn, cs)
+      for(k=0; k<n; k++){
+        a = (coord_t)2.0*PI*point_draw(x[k], y[k], V_NOISE, 0);
+        r = point_draw(x[k], y[k], V_NOISE, 1);
+        FAST_SINCOS(fast, a, sn, cs);
+        tx[k] = x[k]*r*cs;
+        ty[k] = y[k]*r*sn;
+      }
+      break;
+    case V_JULIAN:
+#pragma omp simd private(i, q, t, a, r, sn, cs)
+      for(k=0; k<n; k++){
+        i = (fi != NULL ? fi[k] : 0);
+        q = &p[i*ps];
+        t = (coord_t)(long)(COORD_FABS(q[0])*
+                            point_draw(x[k], y[k], V_JULIAN, 0));
+        a = (COORD_ATAN2(y[k], x[k]) + (coord_t)2.0*PI*t)/q[0];
+        r = FAST_POW(fast, RSQ(x[k], y[k]), q[1]/q[0]*(coord_t)0.5);
+        FAST_SINCOS(fast, a, sn, cs);
+        tx[k] = r*cs;
+        ty[k] = r*sn;
+      }
+      break;
+    case V_JULIASCOPE:
+#pragma omp simd private(i, q, j, a, r, sn, cs)
+      for(k=0; k<n; k++){
+        i = (fi != NULL ? fi[k] : 0);
+        q = &p[i*ps];
+        j = (long)(COORD_FABS(q[0])*point_draw(x[k], y[k], V_JULIASCOPE, 0));
+        a = COORD_ATAN2(y[k], x[k]);
+        a = ((coord_t)2.0*PI*j + (j & 1 ? -a : a))/q[0];
+        r = FAST_POW(fast, RSQ(x[k], y[k]), q[1]/q[0]*(coord_t)0.5);
+        FAST_SINCOS(fast, a, sn, cs);
+        tx[k] = r*cs;
+        ty[k] = r*sn;
+      }
+      break;
+    case V_BLUR:
+#pragma omp simd private(a, r, sn, cs)
+      for(k=0; k<n; k++){
+        a = (coord_t)2.0*PI*point_draw(x[k], y[k], V_BLUR, 0);
+        r = point_draw(x[k], y[k], V_BLUR, 1);
+        FAST_SINCOS(fast, a, sn, cs);
+        tx[k] = r*cs;
+        ty[k] = r*sn;
+      }
+      break;
+    case V_GAUSSIAN_BLUR:
+#pragma omp simd private(a, r, sn, cs)
+      for(k=0; k<n; k++){
+        a = (coord_t)2.0*PI*point_draw(x[k], y[k], V_GAUSSIAN_BLUR, 0);
+        r = point_draw(x[k], y[k], V_GAUSSIAN_BLUR, 1) +
+            point_draw(x[k], y[k], V_GAUSSIAN_BLUR, 2) +
+            point_draw(x[k], y[k], V_GAUSSIAN_BLUR, 3) +
+            point_draw(x[k], y[k], V_GAUSSIAN_BLUR, 4) - (coord_t)2.0;
+        FAST_SINCOS(fast, a, sn, cs);
+        tx[k] = r*cs;
+        ty[k] = r*sn;
+      }
+      break;
+    case V_RADIAL_BLUR:
+      //divided by the weight, as in v36
+#pragma omp simd private(i, q, u, s, e, d, r, a, t, sn, cs)
+      for(k=0; k<n; k++){
+        i = (fi != NULL ? fi[k] : 0);
+        q = &p[i*ps];
+        u = w[i];
+        FAST_SINCOS(fast, q[0]*PI*(coord_t)0.5, s, e);
+        d = u*(point_draw(x[k], y[k], V_RADIAL_BLUR, 0) +
+               point_draw(x[k], y[k], V_RADIAL_BLUR, 1) +
+               point_draw(x[k], y[k], V_RADIAL_BLUR, 2) +
+               point_draw(x[k], y[k], V_RADIAL_BLUR, 3) - (coord_t)2.0);
+        r = FAST_SQRT(fast, RSQ(x[k], y[k]));
+        a = COORD_ATAN2(y[k], x[k]) + s*d;
+        t = e*d - (coord_t)1.0;
+        FAST_SINCOS(fast, a, sn, cs);
+        tx[k] = (r*cs + t*x[k])/u;
+        ty[k] = (r*sn + t*y[k])/u;
+      }
+      break;
+    case V_PIE:
+#pragma omp simd private(i, q, s, a, r, sn, cs)
+      for(k=0; k<n; k++){
+        i = (fi != NULL ? fi[k] : 0);
+        q = &p[i*ps];
+        s = (coord_t)(long)(point_draw(x[k], y[k], V_PIE, 0)*q[0] +
+                            (coord_t)0.5);
+        a = q[1] + (coord_t)2.0*PI*
+                   (s + point_draw(x[k], y[k], V_PIE, 1)*q[2])/q[0];
+        r = point_draw(x[k], y[k], V_PIE, 2);
+        FAST_SINCOS(fast, a, sn, cs);
+        tx[k] = r*cs;
+        ty[k] = r*sn;
+      }
+      break;
+    case V_NGON:
+#pragma omp simd private(i, q, d, s, a, t)
+      for(k=0; k<n; k++){
+        i = (fi != NULL ? fi[k] : 0);
+        q = &p[i*ps];
+        d = (coord_t)2.0*PI/q[0];
+        s = FAST_POW(fast, RSQ(x[k], y[k]), q[1]*(coord_t)0.5);
+        a = COORD_ATAN2(y[k], x[k]);
+        a = a - d*COORD_FLOOR(a/d);
+        a = (a > (coord_t)0.5*d ? a - d : a);
+        t = q[3]*((coord_t)1.0/(FAST_COS(fast, a) + EPS) - (coord_t)1.0) + q[2];
+        t = t/(s + EPS);
+        tx[k] = x[k]*t;
+        ty[k] = y[k]*t;
+      }
+      break;
+    case V_CURL:
+#pragma omp simd private(i, q, re, im, r)
+      for(k=0; k<n; k++){
+        i = (fi != NULL ? fi[k] : 0);
+        q = &p[i*ps];
+        re = (coord_t)1.0 + q[0]*x[k] + q[1]*(x[k]*x[k] - y[k]*y[k]);
+        im = q[0]*y[k] + (coord_t)2.0*q[1]*x[k]*y[k];
+        r = (coord_t)1.0/(re*re + im*im);
+        tx[k] = (x[k]*re + y[k]*im)*r;
+        ty[k] = (y[k]*re - x[k]*im)*r;
+      }
+      break;
+    case V_RECTANGLES:
+#pragma omp simd private(i, q)
+      for(k=0; k<n; k++){
+        i = (fi != NULL ? fi[k] : 0);
+        q = &p[i*ps];
+        tx[k] = (q[0] != (coord_t)0.0 ?
+                 ((coord_t)2.0*COORD_FLOOR(x[k]/q[0]) + (coord_t)1.0)*q[0] -
+                 x[k] : x[k]);
+        ty[k] = (q[1] != (coord_t)0.0 ?
+                 ((coord_t)2.0*COORD_FLOOR(y[k]/q[1]) + (coord_t)1.0)*q[1] -
+                 y[k] : y[k]);
+      }
+      break;
+    case V_ARCH:
+#pragma omp simd private(i, a, sn, cs)
+      for(k=0; k<n; k++){
+        i = (fi != NULL ? fi[k] : 0);
+        a = point_draw(x[k], y[k], V_ARCH, 0)*w[i]*PI;
+        FAST_SINCOS(fast, a, sn, cs);
+        tx[k] = (cs != (coord_t)0.0 ? sn : (coord_t)0.0);
+        ty[k] = (cs != (coord_t)0.0 ? sn*sn/cs : (coord_t)0.0);
+      }
+      break;
+    case V_TANGENT:
+#pragma omp simd
+      for(k=0; k<n; k++){
+        tx[k] = FAST_SIN(fast, x[k])/FAST_COS(fast, y[k]);
+        ty[k] = COORD_TAN(y[k]);
+      }
+      break;
+    case V_SQUARE:
+#pragma omp simd
+      for(k=0; k<n; k++){
+        tx[k] = point_draw(x[k], y[k], V_SQUARE, 0) - (coord_t)0.5;
+        ty[k] = point_draw(x[k], y[k], V_SQUARE, 1) - (coord_t)0.5;
+      }
+      break;
+    case V_RAYS:
+#pragma omp simd private(i, a, r)
+      for(k=0; k<n; k++){
+        i = (fi != NULL ? fi[k] : 0);
+        a = w[i]*point_draw(x[k], y[k], V_RAYS, 0)*PI;
+        r = COORD_TAN(a)*w[i]/(RSQ(x[k], y[k]) + EPS);
+        tx[k] = r*FAST_COS(fast, x[k]);
+        ty[k] = r*FAST_SIN(fast, y[k]);
+      }
+      break;
+    case V_BLADE:
+#pragma omp simd private(i, r, sn, cs)
+      for(k=0; k<n; k++){
+        i = (fi != NULL ? fi[k] : 0);
+        r = point_draw(x[k], y[k], V_BLADE, 0)*w[i]*
+            FAST_SQRT(fast, RSQ(x[k], y[k]));
+        FAST_SINCOS(fast, r, sn, cs);
+        tx[k] = x[k]*(cs + sn);
+        ty[k] = x[k]*(cs - sn);
+      }
+      break;
+    case V_SECANT2:
+#pragma omp simd private(i, cs)
+      for(k=0; k<n; k++){
+        i = (fi != NULL ? fi[k] : 0);
+        cs = FAST_COS(fast, w[i]*FAST_SQRT(fast, RSQ(x[k], y[k])));
+        tx[k] = x[k];
+        ty[k] = (coord_t)1.0/cs +
+                (cs < (coord_t)0.0 ? (coord_t)1.0 : -(coord_t)1.0);
+      }
+      break;
+    case V_TWINTRIAN:
+#pragma omp simd private(i, r, d, sn, cs)
+      for(k=0; k<n; k++){
+        i = (fi != NULL ? fi[k] : 0);
+        r = point_draw(x[k], y[k], V_TWINTRIAN, 0)*w[i]*
+            FAST_SQRT(fast, RSQ(x[k], y[k]));
+        FAST_SINCOS(fast, r, sn, cs);
+        d = COORD_LOG10(sn*sn) + cs;
+        d = (BAD_VALUE(d) ? -(coord_t)30.0 : d);
+        tx[k] = x[k]*d;
+        ty[k] = x[k]*(d - sn*PI);
+      }
+      break;
+    case V_CROSS:
+#pragma omp simd private(s, r)
+      for(k=0; k<n; k++){
+        s = x[k]*x[k] - y[k]*y[k];
+        r = FAST_SQRT(fast, (coord_t)1.0/(s*s + EPS));
+        tx[k] = x[k]*r;
+        ty[k] = y[k]*r;
+      }
+      break;
+    default:
+      //anything else, one point at a time
+      for(k=0; k<n; k++){
+        i = (fi != NULL ? fi[k] : 0);
+        c.x = x[k];
+        c.y = y[k];
+        ret = run_v(v, &c, &fp[i], (vp != NULL ? &vp[i*MAXVPARAMS] : NULL),
+                    w[i]);
+        tx[k] = c.x;
+        ty[k] = c.y;
+      }
+      break;
+  }
+  return ret;
+}
+
+//function: run_v_batch
+//purpose: v on the n points (x[k], y[k]), into (tx[k], ty[k]).  x and y are
+//         left alone; tx and ty can't be either of them.
+//params: fp, p, w, fi - point k's linear transformation coefficients are
+//        fp[fi[k]], its parameters for v (see F.v_param) start at
+//        p[fi[k]*MAXVPARAMS] and its coefficient for v (see run_v()) is
+//        w[fi[k]], or fp[0], p[0] and w[0] for every point if fi is NULL.
+//        p can be NULL for v's defaults in v->vp.  only variations with
+//        use_fp or use_vp look at fp or p.
+//returns v->v's return value for the last point
+extern int run_v_batch(V_func * v, const coord_t * x, const coord_t * y,
+                       coord_t * tx, coord_t * ty, int n, F_params * fp,
+                       coord_t * p, const coord_t * w, const int * fi){
+  if(v->vp.fast)
+    return batch_v(v, x, y, tx, ty, n, fp, p, w, fi, 1);
+  return batch_v(v, x, y, tx, ty, n, fp, p, w, fi, 0);
 }
@@ -1,3 +1,4 @@
+#include <stddef.h>
 #include "global.h"
 
 #ifndef VARIATIONS_H
@@ -7,29 +8,99 @@
 //to make function names instead of function pointers.  can we make function
 //names at runtime... probably not, actually.
 
+//variation numbers, as in the paper and flam3.  kernel.c has its own
+//inlined versions of the first few and needs to know which one a V_func is.
+#define V_LINEAR 0
+#define V_SINUSOIDAL 1
+#define V_SPHERICAL 2
+#define V_SWIRL 3
+#define V_HORSESHOE 4
+#define V_POLAR 5
+#define V_HANDKERCHIEF 6
+#define V_HEART 7
+#define V_DISC 8
+#define V_SPIRAL 9
+#define V_HYPERBOLIC 10
+#define V_DIAMOND 11
+#define V_EX 12
+#define V_JULIA 13
+#define V_BENT 14
+#define V_WAVES 15
+#define V_FISHEYE 16
+#define V_POPCORN 17
+#define V_EXPONENTIAL 18
+#define V_POWER 19
+#define V_COSINE 20
+#define V_RINGS 21
+#define V_FAN 22
+#define V_BLOB 23
+#define V_PDJ 24
+#define V_FAN2 25
+#define V_RINGS2 26
+#define V_EYEFISH 27
+#define V_BUBBLE 28
+#define V_CYLINDER 29
+#define V_PERSPECTIVE 30
+#define V_NOISE 31
+#define V_JULIAN 32
+#define V_JULIASCOPE 33
+#define V_BLUR 34
+#define V_GAUSSIAN_BLUR 35
+#define V_RADIAL_BLUR 36
+#define V_PIE 37
+#define V_NGON 38
+#define V_CURL 39
+#define V_RECTANGLES 40
+#define V_ARCH 41
+#define V_TANGENT 42
+#define V_SQUARE 43
+#define V_RAYS 44
+#define V_BLADE 45
+#define V_SECANT2 46
+#define V_TWINTRIAN 47
+#define V_CROSS 48
+
+//most parameters a variation has
+#define MAXVPARAMS 4
+
 //nonlinear transformation
 typedef struct {
   int (*v)(coords * c,
            F_params * fp,
            V_params * vp);
+  int id; //V_ number, or -1 for anything else
   int use_fp;
   int use_vp;
   V_params vp;
 } V_func;
 
+//the variations a flame's functions can use, and its final transformation
+typedef struct {
+  V_func * variations;
+  int nv;
+  V_func * final;
+  F_params * finalfp;
+  int fast; //every V_func's vp.fast, see set_fast_math()
+} variation_set;
+
 //public
 
 //initialization/teardown
 
-extern int init_variations();
-extern int cleanup_variations();
+extern int init_variations(variation_set * vs);
+extern int cleanup_variations(variation_set * vs);
+extern int find_variation(variation_set * vs, const char * name, size_t len);
 
-//accessors  
-        
-extern V_func * get_variations();
-extern V_func * get_final();
+extern int find_variation_param(variation_set * vs, const char * name,
+                                size_t len, int * k);
+extern const char * variation_name(int id);
+extern int set_fast_math(variation_set * vs, int on);
 
 //run functions
-extern int run_v(V_func * v, coords * c, F_params * fp);
+extern int run_v(V_func * v, coords * c, F_params * fp, coord_t * p,
+                 coord_t w);
+extern int run_v_batch(V_func * v, const coord_t * x, const coord_t * y,
+                       coord_t * tx, coord_t * ty, int n, F_params * fp,
+                       coord_t * p, const coord_t * w, const int * fi);
 
 #endif